@@ -0,0 +1,70 @@
+#ifndef LCC_BENCH_H
+#define LCC_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lcc_lexer.h"
+
+#define LCC_BENCH_RUNS      5
+
+typedef void (*lcc_bench_fn)(void *data);
+
+static inline double lcc_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline double lcc_bench_best(lcc_bench_fn fn, void *data)
+{
+    double best = 0.0;
+
+    /* the fastest run has the least noise */
+    for (int i = 0; i < LCC_BENCH_RUNS; i++)
+    {
+        double start = lcc_bench_now();
+        fn(data);
+
+        /* keep the best time */
+        double time = lcc_bench_now() - start;
+        best = (!i || (time < best)) ? time : best;
+    }
+
+    return best;
+}
+
+static inline void lcc_bench_report(const char *name, double count, const char *unit, double time)
+{
+    /* rate in millions of `unit` per second */
+    printf("%-40s %9.3f s %10.1f M%s/s\n", name, time, count / time / 1e6, unit);
+}
+
+static inline size_t lcc_bench_lex(const char *name, const char *data, size_t size)
+{
+    size_t count = 0;
+    lcc_lexer_t lexer;
+    lcc_token_t *token;
+
+    /* the lexer owns the file from now on */
+    if (!(lcc_lexer_init(&lexer, lcc_file_from_string(name, data, size))))
+    {
+        fprintf(stderr, "*** FATAL: cannot create the lexer for '%s'\n", name);
+        abort();
+    }
+
+    /* lex to the end, counting every token */
+    while ((token = lcc_lexer_next(&lexer)))
+    {
+        count++;
+        lcc_token_free(token);
+    }
+
+    /* release the lexer */
+    lcc_lexer_free(&lexer);
+    return count;
+}
+
+#endif /* LCC_BENCH_H */
@@ -0,0 +1,86 @@
+#include <stdint.h>
+
+#include "bench.h"
+#include "lcc_array.h"
+
+#define BULK_ITEMS      10000
+#define BULK_ROUNDS     200
+#define STACK_ROUNDS    2000000
+
+typedef struct _item_t
+{
+    int64_t a;
+    int64_t b;
+    int64_t c;
+} item_t;
+
+static void bench_bulk(void *data)
+{
+    item_t item = { 0 };
+    lcc_array_t *array = data;
+
+    /* fill the array, then drain it */
+    for (int r = 0; r < BULK_ROUNDS; r++)
+    {
+        for (int64_t i = 0; i < BULK_ITEMS; i++)
+        {
+            item.a = i;
+            lcc_array_append(array, &item);
+        }
+
+        while (lcc_array_pop(array, &item));
+    }
+}
+
+static void bench_stack(void *data)
+{
+    item_t item = { 0 };
+    lcc_array_t *array = data;
+
+    /* stays shallow, like the lexer's state stacks */
+    for (int64_t i = 0; i < STACK_ROUNDS; i++)
+    {
+        item.a = i;
+        lcc_array_append(array, &item);
+        lcc_array_append(array, &item);
+        lcc_array_pop(array, &item);
+        lcc_array_pop(array, &item);
+    }
+}
+
+static void bench_fresh(void *data)
+{
+    item_t item = { 0 };
+    (void)data;
+
+    /* growing from empty every time */
+    for (int r = 0; r < BULK_ROUNDS; r++)
+    {
+        lcc_array_t array;
+        lcc_array_init(&array, sizeof(item_t), NULL, NULL);
+
+        /* append only */
+        for (int64_t i = 0; i < BULK_ITEMS; i++)
+        {
+            item.a = i;
+            lcc_array_append(&array, &item);
+        }
+
+        lcc_array_free(&array);
+    }
+}
+
+int main(void)
+{
+    lcc_array_t array;
+    lcc_array_init(&array, sizeof(item_t), NULL, NULL);
+
+    /* appends and pops are counted separately */
+    lcc_bench_report("append then pop, 10k items", 2.0 * BULK_ITEMS * BULK_ROUNDS, "ops", lcc_bench_best(bench_bulk, &array));
+    lcc_bench_report("push, push, pop, pop", 4.0 * STACK_ROUNDS, "ops", lcc_bench_best(bench_stack, &array));
+    lcc_bench_report("append to a new array, 10k items", 1.0 * BULK_ITEMS * BULK_ROUNDS, "ops", lcc_bench_best(bench_fresh, NULL));
+
+    /* release the array */
+    lcc_array_free(&array);
+    return 0;
+}
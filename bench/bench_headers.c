@@ -0,0 +1,73 @@
+#include "bench.h"
+
+/* lexes already preprocessed headers, with comments kept, which are mostly
+ * identifiers, whitespaces and comments, generate one with, for example:
+ *   printf '#include <stdio.h>\n#include <stdlib.h>\n#include <pthread.h>\n' | cc -E -C -P - > headers.i */
+
+typedef struct _input_t
+{
+    char *buf;
+    size_t len;
+    const char *name;
+} input_t;
+
+static char load(input_t *input, const char *name)
+{
+    long size;
+    FILE *fp = fopen(name, "rb");
+
+    /* check for errors */
+    if (!fp)
+        return 0;
+
+    /* whole file in memory, so only the lexer is measured */
+    if (fseek(fp, 0, SEEK_END) || ((size = ftell(fp)) < 0) || fseek(fp, 0, SEEK_SET))
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    /* read the content */
+    input->buf = malloc(size + 1);
+    input->len = fread(input->buf, 1, size, fp);
+    input->name = name;
+    fclose(fp);
+    return 1;
+}
+
+static void bench_lex(void *data)
+{
+    input_t *input = data;
+    lcc_bench_lex(input->name, input->buf, input->len);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s FILE...\n", argv[0]);
+        return 2;
+    }
+
+    /* every file on its own */
+    for (int i = 1; i < argc; i++)
+    {
+        input_t input;
+
+        /* load into memory */
+        if (!(load(&input, argv[i])))
+        {
+            fprintf(stderr, "* ERROR: Cannot read file '%s'\n", argv[i]);
+            return 1;
+        }
+
+        /* bytes and tokens per second */
+        size_t tokens = lcc_bench_lex(input.name, input.buf, input.len);
+        double time = lcc_bench_best(bench_lex, &input);
+        lcc_bench_report(input.name, (double)input.len, "B", time);
+        lcc_bench_report(input.name, (double)tokens, "tokens", time);
+        free(input.buf);
+    }
+
+    return 0;
+}
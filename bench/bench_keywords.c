@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define WORDS           200000
+#define WORDS_PER_LINE  10
+#define KEYWORD_RATIO   30          /* percentage of keywords among the words */
+#define CLASSIFY_ROUNDS 20
+
+typedef struct _input_t
+{
+    char *buf;
+    size_t len;
+    lcc_string_t *words[WORDS];
+} input_t;
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void)
+{
+    /* same sequence on every run */
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void generate(input_t *input)
+{
+    size_t cap = WORDS * 24;
+    input->buf = malloc(cap);
+    input->len = 0;
+
+    /* lines of keywords and identifiers */
+    for (size_t i = 0; i < WORDS; i++)
+    {
+        uint32_t r = next_random();
+        const char *sep = ((i + 1) % WORDS_PER_LINE) ? " " : ";\n";
+
+        /* keywords, or identifiers with some common prefixes */
+        if (r % 100 < KEYWORD_RATIO)
+            input->words[i] = lcc_string_from(lcc_token_kw_name((lcc_keyword_t)((r / 100) % (LCC_KW_WHILE + 1))));
+        else
+            input->words[i] = lcc_string_from_format("%s_%u", (r & 1) ? "item" : "ctx", (r / 100) % 4096);
+
+        /* append to the source */
+        input->len += snprintf(input->buf + input->len, cap - input->len, "%s%s", input->words[i]->buf, sep);
+    }
+}
+
+static void bench_lex(void *data)
+{
+    input_t *input = data;
+    lcc_bench_lex("<keywords>", input->buf, input->len);
+}
+
+static void bench_linear(void *data)
+{
+    input_t *input = data;
+    volatile long found = 0;
+
+    /* every keyword in turn, as the lexer used to do */
+    for (int r = 0; r < CLASSIFY_ROUNDS; r++)
+    {
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            for (int kw = LCC_KW_AUTO; kw <= LCC_KW_WHILE; kw++)
+            {
+                if (!(strcmp(input->words[i]->buf, lcc_token_kw_name((lcc_keyword_t)kw))))
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void bench_hashed(void *data)
+{
+    lcc_map_t keywords;
+    input_t *input = data;
+    volatile long found = 0;
+
+    /* keyed by name, like the lexer's keyword map */
+    lcc_map_init(&keywords, sizeof(lcc_keyword_t), NULL, NULL);
+    for (lcc_keyword_t kw = LCC_KW_AUTO; kw <= LCC_KW_WHILE; kw++)
+        lcc_map_set_string(&keywords, lcc_token_kw_name(kw), NULL, &kw);
+
+    /* one probe per word, the hash is cached in the word after the first round */
+    for (int r = 0; r < CLASSIFY_ROUNDS; r++)
+        for (size_t i = 0; i < WORDS; i++)
+            found += lcc_map_get(&keywords, input->words[i], NULL);
+
+    /* release the keyword map */
+    lcc_map_free(&keywords);
+}
+
+int main(void)
+{
+    input_t input;
+    generate(&input);
+
+    /* whole lexer, then classification alone */
+    size_t tokens = lcc_bench_lex("<keywords>", input.buf, input.len);
+    lcc_bench_report("lex identifier-heavy input", (double)tokens, "tokens", lcc_bench_best(bench_lex, &input));
+    lcc_bench_report("classify: strcmp every keyword", (double)WORDS * CLASSIFY_ROUNDS, "words", lcc_bench_best(bench_linear, &input));
+    lcc_bench_report("classify: keyword map", (double)WORDS * CLASSIFY_ROUNDS, "words", lcc_bench_best(bench_hashed, &input));
+
+    /* release the input */
+    for (size_t i = 0; i < WORDS; i++)
+        lcc_string_unref(input.words[i]);
+
+    free(input.buf);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "bench.h"
+#include "old_map.h"
+#include "lcc_map.h"
+
+#define KEYS            5000
+#define CHURN_ROUNDS    20
+#define LOOKUP_ROUNDS   200
+#define FRESH_ROUNDS    20
+
+typedef struct _keys_t
+{
+    lcc_string_t *names[KEYS];      /* keys stored in the map */
+    lcc_string_t *probes[KEYS];     /* keys never stored */
+} keys_t;
+
+static keys_t keys;
+
+/* the same workloads against both implementations, `map` is a `type` set up by `prefix ## _init` */
+#define BENCH_MAP(prefix, type)                                                     \
+    static void bench_ ## prefix ## _churn(void *data)                              \
+    {                                                                               \
+        type map;                                                                   \
+        void *value = NULL;                                                         \
+        prefix ## _init(&map, sizeof(void *), NULL, NULL);                          \
+                                                                                    \
+        /* insert every key, then remove half of them */                            \
+        for (int r = 0; r < CHURN_ROUNDS; r++)                                      \
+        {                                                                           \
+            for (int i = 0; i < KEYS; i++)                                          \
+                prefix ## _set(&map, keys.names[i], NULL, &value);                  \
+            for (int i = 0; i < KEYS; i += 2)                                       \
+                prefix ## _pop(&map, keys.names[i], NULL);                          \
+        }                                                                           \
+                                                                                    \
+        prefix ## _free(&map);                                                      \
+        (void)data;                                                                 \
+    }                                                                               \
+                                                                                    \
+    static void bench_ ## prefix ## _lookup(void *data)                             \
+    {                                                                               \
+        type *map = data;                                                           \
+        volatile long hits = 0;                                                     \
+                                                                                    \
+        /* half hits, half misses */                                                \
+        for (int r = 0; r < LOOKUP_ROUNDS; r++)                                     \
+        {                                                                           \
+            for (int i = 0; i < KEYS; i++)                                          \
+            {                                                                       \
+                hits += prefix ## _get(map, keys.names[i], NULL);                   \
+                hits += prefix ## _get(map, keys.probes[i], NULL);                  \
+            }                                                                       \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static void bench_ ## prefix ## _fresh(void *data)                              \
+    {                                                                               \
+        type *map = data;                                                           \
+        volatile long hits = 0;                                                     \
+                                                                                    \
+        /* keys built for each lookup, nothing is cached in them */                 \
+        for (int r = 0; r < FRESH_ROUNDS; r++)                                      \
+        {                                                                           \
+            for (int i = 0; i < KEYS; i++)                                          \
+            {                                                                       \
+                lcc_string_t *key = lcc_string_from(keys.names[i]->buf);            \
+                hits += prefix ## _get(map, key, NULL);                             \
+                lcc_string_unref(key);                                              \
+            }                                                                       \
+        }                                                                           \
+    }
+
+BENCH_MAP(lcc_old_map, lcc_old_map_t)
+BENCH_MAP(lcc_map, lcc_map_t)
+
+#undef BENCH_MAP
+
+int main(void)
+{
+    void *value = NULL;
+    lcc_map_t map;
+    lcc_old_map_t old_map;
+
+    /* macro-like names, and identifiers that are not macros */
+    for (int i = 0; i < KEYS; i++)
+    {
+        keys.names[i] = lcc_string_from_format("__SOME_HEADER_%d_H", i);
+        keys.probes[i] = lcc_string_from_format("local_ident_%d", i);
+    }
+
+    /* both maps hold every name for lookups */
+    lcc_map_init(&map, sizeof(void *), NULL, NULL);
+    lcc_old_map_init(&old_map, sizeof(void *), NULL, NULL);
+
+    /* fill the maps */
+    for (int i = 0; i < KEYS; i++)
+    {
+        lcc_map_set(&map, keys.names[i], NULL, &value);
+        lcc_old_map_set(&old_map, keys.names[i], NULL, &value);
+    }
+
+    /* insertions and removals are counted separately */
+    lcc_bench_report("old map: set, pop half", 1.5 * KEYS * CHURN_ROUNDS, "ops", lcc_bench_best(bench_lcc_old_map_churn, NULL));
+    lcc_bench_report("new map: set, pop half", 1.5 * KEYS * CHURN_ROUNDS, "ops", lcc_bench_best(bench_lcc_map_churn, NULL));
+    lcc_bench_report("old map: get, half misses", 2.0 * KEYS * LOOKUP_ROUNDS, "ops", lcc_bench_best(bench_lcc_old_map_lookup, &old_map));
+    lcc_bench_report("new map: get, half misses", 2.0 * KEYS * LOOKUP_ROUNDS, "ops", lcc_bench_best(bench_lcc_map_lookup, &map));
+    lcc_bench_report("old map: get with a new key", 1.0 * KEYS * FRESH_ROUNDS, "ops", lcc_bench_best(bench_lcc_old_map_fresh, &old_map));
+    lcc_bench_report("new map: get with a new key", 1.0 * KEYS * FRESH_ROUNDS, "ops", lcc_bench_best(bench_lcc_map_fresh, &map));
+
+    /* release the maps */
+    lcc_map_free(&map);
+    lcc_old_map_free(&old_map);
+
+    /* release the keys */
+    for (int i = 0; i < KEYS; i++)
+    {
+        lcc_string_unref(keys.names[i]);
+        lcc_string_unref(keys.probes[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "bench.h"
+
+#define BLOCKS      20000
+
+/* a header-like block, with everything the line skipper has to hand back */
+static const char BLOCK[] =
+    "/* Copyright notice, long enough to span a few\n"
+    " * lines of a block comment, as most headers do. */\n"
+    "extern int some_function(const char *name, unsigned long size, void *data);\n"
+    "struct some_struct { int first; long second; char third[16]; };\n"
+    "typedef unsigned long long some_type_t;   // trailing line comment\n"
+    "#ifdef SOME_FEATURE\n"
+    "#define SOME_MACRO(a, b) \\\n"
+    "    ((a) + (b))\n"
+    "#endif\n"
+    "static inline int some_inline(int x) { return x * 2 + 1; }\n"
+    "\n";
+
+typedef struct _input_t
+{
+    char *buf;
+    size_t len;
+    size_t skipped;
+} input_t;
+
+static void bench_skip(void *data)
+{
+    input_t *input = data;
+    lcc_lexer_t lexer;
+    lcc_token_t *token;
+
+    /* the lexer owns the file from now on */
+    if (!(lcc_lexer_init(&lexer, lcc_file_from_string("<skip>", input->buf, input->len))))
+    {
+        fprintf(stderr, "*** FATAL: cannot create the lexer\n");
+        abort();
+    }
+
+    /* everything but the last line is skipped */
+    while ((token = lcc_lexer_next(&lexer)))
+        lcc_token_free(token);
+
+    /* bytes dropped a whole line at a time */
+    input->skipped = lexer.skip_bytes;
+    lcc_lexer_free(&lexer);
+}
+
+int main(void)
+{
+    input_t input;
+    size_t size = sizeof(BLOCK) - 1;
+
+    /* "#if 0" around every block */
+    input.buf = malloc(size * BLOCKS + 64);
+    input.len = sprintf(input.buf, "#if 0\n");
+
+    /* repeat the block */
+    for (size_t i = 0; i < BLOCKS; i++, input.len += size)
+        memcpy(input.buf + input.len, BLOCK, size);
+
+    /* the only line that is not skipped */
+    input.len += sprintf(input.buf + input.len, "#endif\nint x;\n");
+
+    /* skipped bytes per second */
+    double time = lcc_bench_best(bench_skip, &input);
+    lcc_bench_report("skip \"#if 0\" block", (double)input.len, "B", time);
+    printf("%zu of %zu bytes skipped a whole line at a time\n", input.skipped, input.len);
+
+    /* release the input */
+    free(input.buf);
+    return 0;
+}
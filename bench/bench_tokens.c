@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define STATEMENTS  100000
+
+/* every operator the transition table accepts */
+static const char *OPERATORS[] = {
+    "+", "++", "+=", "-", "--", "-=", "->", "*", "*=", "/", "/=", "%", "%=",
+    "=", "==", ">", ">=", ">>", ">>=", "<", "<=", "<<", "<<=", "!", "!=",
+    "&", "&&", "&=", "|", "||", "|=", "^", "^=", "~", "?", ":", ",",
+};
+
+typedef struct _input_t
+{
+    char *buf;
+    size_t len;
+    const char *name;
+} input_t;
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void)
+{
+    /* same sequence on every run */
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void generate_operators(input_t *input)
+{
+    size_t cap = STATEMENTS * 96;
+    input->buf = malloc(cap);
+    input->len = 0;
+    input->name = "<operators>";
+
+    /* "a0 OP b1 OP c2 ... ;", operands keep operators from merging */
+    for (size_t i = 0; i < STATEMENTS; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            uint32_t r = next_random();
+            const char *op = OPERATORS[r % (sizeof(OPERATORS) / sizeof(OPERATORS[0]))];
+            input->len += snprintf(input->buf + input->len, cap - input->len, "%c%u %s ", 'a' + (r >> 8) % 26, j, op);
+        }
+
+        /* end of statement */
+        input->len += snprintf(input->buf + input->len, cap - input->len, "z;\n");
+    }
+}
+
+static void generate_code(input_t *input)
+{
+    size_t cap = STATEMENTS * 128;
+    input->buf = malloc(cap);
+    input->len = 0;
+    input->name = "<code>";
+
+    /* ordinary statements, with comments, numbers and strings */
+    for (size_t i = 0; i < STATEMENTS; i++)
+    {
+        input->len += snprintf(
+            input->buf + input->len,
+            cap - input->len,
+            "/* step %zu */ if (count_%zu >= 0x%zx && !flags[%zu]) { total += values[%zu] * 3.5f; puts(\"ok\"); }\n",
+            i, i % 64, i, i % 8, i % 16
+        );
+    }
+}
+
+static void bench_lex(void *data)
+{
+    input_t *input = data;
+    lcc_bench_lex(input->name, input->buf, input->len);
+}
+
+int main(void)
+{
+    input_t inputs[2];
+
+    /* operators only, and a mix of everything */
+    generate_operators(&inputs[0]);
+    generate_code(&inputs[1]);
+
+    /* tokens per second on each input */
+    for (int i = 0; i < 2; i++)
+    {
+        size_t tokens = lcc_bench_lex(inputs[i].name, inputs[i].buf, inputs[i].len);
+        double time = lcc_bench_best(bench_lex, &inputs[i]);
+        lcc_bench_report(inputs[i].name, (double)tokens, "tokens", time);
+        free(inputs[i].buf);
+    }
+
+    return 0;
+}
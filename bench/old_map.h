@@ -0,0 +1,41 @@
+#ifndef LCC_OLD_MAP_H
+#define LCC_OLD_MAP_H
+
+#include <stddef.h>
+#include "lcc_string.h"
+
+/* lcc_map_t before the open-addressing rewrite, only for comparison in benchmarks */
+
+struct _lcc_old_map_t;
+typedef void (*lcc_old_map_dtor_fn)(struct _lcc_old_map_t *self, void *value, void *data);
+
+#define LCC_OLD_MAP_FLAGS_DEL   0x00000001      /* node was deleted */
+#define LCC_OLD_MAP_FLAGS_USED  0x00000002      /* node was occupied */
+
+typedef struct _lcc_old_map_node_t
+{
+    long hash;
+    long flags;
+    void *value;
+    lcc_string_t *key;
+} lcc_old_map_node_t;
+
+typedef struct _lcc_old_map_t
+{
+    size_t count;
+    size_t capacity;
+    size_t value_size;
+    lcc_old_map_node_t *bucket;
+
+    void *dtor_data;
+    lcc_old_map_dtor_fn dtor_fn;
+} lcc_old_map_t;
+
+void lcc_old_map_free(lcc_old_map_t *self);
+void lcc_old_map_init(lcc_old_map_t *self, size_t value_size, lcc_old_map_dtor_fn dtor, void *data);
+
+char lcc_old_map_pop(lcc_old_map_t *self, lcc_string_t *key, void *data);
+char lcc_old_map_get(lcc_old_map_t *self, lcc_string_t *key, void **data);
+char lcc_old_map_set(lcc_old_map_t *self, lcc_string_t *key, void *data, const void *new);
+
+#endif /* LCC_OLD_MAP_H */
@@ -10,6 +10,7 @@ typedef struct _lcc_array_t
 {
     void *items;
     size_t count;
+    size_t capacity;
     size_t item_size;
 
     void *dtor_data;
@@ -19,6 +20,7 @@ typedef struct _lcc_array_t
 #define LCC_ARRAY_STATIC_INIT(_item_size, _dtor_fn, _dtor_data)   { \
     .count      = 0,                                                \
     .items      = NULL,                                             \
+    .capacity   = 0,                                                \
     .item_size  = _item_size,                                       \
     .dtor_fn    = _dtor_fn,                                         \
     .dtor_data  = _dtor_data,                                       \
@@ -31,6 +33,9 @@ void *lcc_array_top(lcc_array_t *self);
 void *lcc_array_get(lcc_array_t *self, size_t index);
 void *lcc_array_set(lcc_array_t *self, size_t index, const void *data);
 
+void lcc_array_reserve(lcc_array_t *self, size_t capacity);
+void lcc_array_shrink_to_fit(lcc_array_t *self);
+
 char lcc_array_pop(lcc_array_t *self, void *data);
 char lcc_array_remove(lcc_array_t *self, size_t index);
 void lcc_array_append(lcc_array_t *self, const void *data);
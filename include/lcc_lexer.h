@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
 
 #include "lcc_map.h"
 #include "lcc_set.h"
@@ -135,6 +137,7 @@ typedef struct _lcc_literal_t
 {
     lcc_string_t *raw;
     lcc_literal_type_t type;
+    char pending;           /* numeric value not converted yet, see lcc_literal_eval() */
 
     union
     {
@@ -152,15 +155,20 @@ typedef struct _lcc_literal_t
     };
 } lcc_literal_t;
 
+struct _lcc_token_pool_t;
 typedef struct _lcc_token_t
 {
     struct _lcc_token_t *prev;
     struct _lcc_token_t *next;
 
     char                 ref;
+    uint32_t             loc;       /* source location, 0 if unknown */
     lcc_string_t        *src;
     lcc_token_type_t     type;
 
+    /* owner of this token, NULL if allocated with malloc() */
+    struct _lcc_token_pool_t *pool;
+
     union
     {
         lcc_string_t   *ident;
@@ -176,6 +184,22 @@ typedef struct _lcc_token_t
     };
 } lcc_token_t;
 
+#define LCC_TOKEN_SLAB_SIZE     256
+
+typedef struct _lcc_token_pool_t
+{
+    size_t live;
+    size_t peak;
+    lcc_token_t *free;
+    lcc_array_t slabs;
+} lcc_token_pool_t;
+
+/* tokens are allocated from the active pool of the calling thread,
+ * all pool tokens must be released before the pool itself */
+void lcc_token_pool_free(lcc_token_pool_t *self);
+void lcc_token_pool_init(lcc_token_pool_t *self);
+lcc_token_pool_t *lcc_token_pool_swap(lcc_token_pool_t *self);
+
 void lcc_token_free(lcc_token_t *self);
 void lcc_token_init(lcc_token_t *self);
 void lcc_token_clear(lcc_token_t *self);
@@ -198,6 +222,9 @@ lcc_token_t *lcc_token_from_char(lcc_string_t *src, lcc_string_t *value, char al
 lcc_token_t *lcc_token_from_string(lcc_string_t *src, lcc_string_t *value, char allow_gnuext);
 lcc_token_t *lcc_token_from_number(lcc_string_t *src, lcc_string_t *value, lcc_literal_type_t type);
 
+/* converts a deferred numeric literal in place, returns 0 if out of range */
+char lcc_literal_eval(lcc_literal_t *self);
+
 const char *lcc_token_kw_name(lcc_keyword_t value);
 const char *lcc_token_op_name(lcc_operator_t value);
 
@@ -208,8 +235,18 @@ lcc_string_t *lcc_token_repr(lcc_token_t *self);
 
 #define LCC_FF_LNODIR           0x00000001      /* no compiler directive is allowed on this line */
 #define LCC_FF_SYS              0x00000002      /* built-in pre-included definations */
+#define LCC_FF_MMAP             0x00000004      /* file content is memory-mapped */
+#define LCC_FF_IDENT            0x00000008      /* file identity (device and inode) is known */
 #define LCC_FF_INVALID          0x80000000      /* this file object is invalid */
 
+typedef enum _lcc_file_guard_state_t
+{
+    LCC_FG_INIT,        /* nothing but whitespaces, comments or null directives so far */
+    LCC_FG_OPEN,        /* inside the "#ifndef" of an include guard candidate */
+    LCC_FG_DONE,        /* include guard closed by the matching "#endif" */
+    LCC_FG_NONE,        /* file is not guarded */
+} lcc_file_guard_state_t;
+
 typedef struct _lcc_file_t
 {
     int flags;
@@ -219,12 +256,64 @@ typedef struct _lcc_file_t
     lcc_string_t *name;
     lcc_string_t *display;
     lcc_string_array_t lines;
+
+    /* memory-mapped content, lines are indexed on demand */
+    char *data;
+    size_t size;
+    size_t scan;
+    lcc_array_t index;
+
+    /* file identity */
+    dev_t dev;
+    ino_t ino;
+
+    /* include guard detection */
+    lcc_string_t *guard;
+    size_t guard_level;
+    lcc_file_guard_state_t guard_state;
+
+    /* token cache of this file, if any */
+    struct _lcc_file_cache_t *cache;
+
+    /* shared content from the source cache, if any */
+    struct _lcc_source_t *source;
 } lcc_file_t;
 
+char lcc_file_line(lcc_file_t *self, size_t row, const char **buf, size_t *len);
+
 lcc_file_t lcc_file_open(const char *fname);
 lcc_file_t lcc_file_from_file(const char *fname, FILE *fp);
 lcc_file_t lcc_file_from_string(const char *fname, const char *data, size_t size);
 
+/*** Source Cache ***/
+
+/* memory-mapped files and their line indexes shared between lexers, keyed by device, inode
+ * and mtime, least recently used files are evicted when the total size exceeds `limit`,
+ * may be shared between threads, evicted files stay valid until their last user is done */
+typedef struct _lcc_source_cache_t
+{
+    lcc_map_t files;
+    pthread_mutex_t lock;
+
+    /* recently used list, and the total size of cached files */
+    struct _lcc_source_t *head;
+    struct _lcc_source_t *tail;
+    size_t size;
+    size_t limit;
+
+    /* statistics */
+    size_t hits;            /* files shared from the cache */
+    size_t misses;          /* files loaded into the cache */
+    size_t stale;           /* cached files changed on disk */
+    size_t evictions;       /* files evicted to stay within the limit */
+} lcc_source_cache_t;
+
+void lcc_source_cache_free(lcc_source_cache_t *self);
+void lcc_source_cache_init(lcc_source_cache_t *self, size_t limit);
+
+/* same as lcc_file_open(), but regular files share their content through the cache */
+lcc_file_t lcc_source_cache_open(lcc_source_cache_t *self, const char *fname);
+
 /*** Token Buffer ***/
 
 typedef struct _lcc_token_buffer_t
@@ -238,11 +327,56 @@ void lcc_token_buffer_free(lcc_token_buffer_t *self);
 void lcc_token_buffer_init(lcc_token_buffer_t *self);
 void lcc_token_buffer_reset(lcc_token_buffer_t *self);
 void lcc_token_buffer_append(lcc_token_buffer_t *self, char ch);
+void lcc_token_buffer_append_from_size(lcc_token_buffer_t *self, const char *buf, size_t size);
+
+/*** Predefined Symbols ***/
+
+/* immutable symbol table shared between lexers, possibly on different threads,
+ * tokens from lexers using it must be released before the last reference */
+struct _lcc_psyms_t;
+typedef struct _lcc_psyms_t lcc_psyms_t;
+
+void lcc_psyms_unref(lcc_psyms_t *self);
+lcc_psyms_t *lcc_psyms_ref(lcc_psyms_t *self);
+
+/*** Token Cache ***/
+
+#define LCC_TCF_VERIFY          0x00000001      /* re-lex cached lines and compare instead of replaying */
+
+/* on-disk cache of lexed tokens for included files, keyed by path, size, mtime and
+ * content hash, only lines outside of directives and comments spanning lines are cached */
+typedef struct _lcc_token_cache_t
+{
+    int flags;
+    lcc_string_t *path;
+
+    /* statistics */
+    size_t hits;            /* files with a valid cache */
+    size_t misses;          /* files without a cache, or with a stale one */
+    size_t stale;           /* cache found but outdated */
+    size_t lines;           /* lines replayed from cache */
+    size_t stores;          /* cache files written */
+    size_t mismatches;      /* lines differ from cache in verify mode */
+    size_t leads;           /* lines only differ in source left over from previous lines */
+} lcc_token_cache_t;
+
+void lcc_token_cache_free(lcc_token_cache_t *self);
+char lcc_token_cache_init(lcc_token_cache_t *self, const char *path, int flags);
 
 /*** Lexer Object ***/
 
 #define LCC_LEXER_MAX_LINE_LEN      4096
 
+/* a source location is a 32-bit offset into the lines that has
+ * been read by the lexer, every line records it's first location */
+typedef struct _lcc_lexer_line_t
+{
+    uint32_t loc;           /* location of the first character */
+    uint32_t col;           /* column of the first character */
+    uint32_t row;           /* row number, adjusted by "#line" */
+    uint32_t name;          /* index of the display file name */
+} lcc_lexer_line_t;
+
 typedef enum _lcc_lexer_state_t
 {
     LCC_LX_STATE_INIT,
@@ -304,7 +438,7 @@ typedef enum _lcc_lexer_substate_t
     LCC_LX_SUBSTATE_INCLUDE_FILE,
     LCC_LX_SUBSTATE_COMMENT_LINE,
     LCC_LX_SUBSTATE_COMMENT_BLOCK,
-    LCC_LX_SUBSTATE_COMMENT_BLOCK_END,
+    LCC_LX_SUBSTATE_COMMENT_BLOCK_END,      /* must be the last, it sizes the transition tables */
 } lcc_lexer_substate_t;
 
 typedef enum _lcc_lexer_define_state_t
@@ -390,7 +524,6 @@ typedef char (*lcc_lexer_on_error_fn)(
 #define LCC_LXDF_DEFINE_VAR     0x0000000008000000      /* variadic function-like macro */
 #define LCC_LXDF_DEFINE_NVAR    0x0000000010000000      /* named variadic arguments */
 #define LCC_LXDF_DEFINE_FINE    0x0000000020000000      /* macro is been checked */
-#define LCC_LXDF_DEFINE_USING   0x0000000040000000      /* macro is been expanding */
 #define LCC_LXDF_DEFINE_SYS     0x0000000080000000      /* built-in macro */
 #define LCC_LXDF_DEFINE_MASK    0x00000000ff000000      /* #define directive flags mask */
 
@@ -399,14 +532,40 @@ typedef char (*lcc_lexer_on_error_fn)(
 
 typedef struct _lcc_lexer_t
 {
-    /* lexer tables */
+    /* lexer tables, identifiers are interned in `idents` */
     int gnuext;
+    lcc_set_t idents;
     lcc_map_t psyms;
+    lcc_map_t keywords;
     lcc_array_t files;
     lcc_string_array_t sccs_msgs;
     lcc_string_array_t include_paths;
     lcc_string_array_t library_paths;
 
+    /* shared pre-defined symbols, frozen after the "<define>" pseudo-file,
+     * `psyms` holds symbols changed by this lexer, NULL for undefined ones */
+    char base_ready;
+    lcc_psyms_t *base;
+
+    /* symbols added by lcc_lexer_add_macro() before the "<define>" pseudo-file
+     * is done, applied after the textual definitions, NULL for removed ones */
+    lcc_map_t defines;
+
+    /* symbols loaded by lcc_lexer_load_preamble(), applied after the
+     * pre-defined symbols are frozen, NULL for removed ones */
+    lcc_map_t preamble;
+
+    /* resolved include files, including those not found, keyed
+     * by the search path generation so stale results are never hit */
+    size_t include_gen;
+    lcc_map_t include_cache;
+
+    /* include guards, maps file identity to guard macro name,
+     * files marked with "#pragma once" are kept in a separate set */
+    lcc_set_t once;
+    lcc_map_t guards;
+    size_t guard_skips;
+
     /* built-in features */
     int64_t counter;
     lcc_set_t builtins;
@@ -421,30 +580,48 @@ typedef struct _lcc_lexer_t
     lcc_lexer_condition_state_t condstate;
     lcc_lexer_condition_state_t savestate;
 
+    /* bytes skipped line-by-line in false conditional blocks */
+    size_t skip_bytes;
+
     /* complex state buffers */
     size_t cond_level;
     size_t subst_level;
     lcc_map_t sym_stacks;
+    lcc_array_t expanding;
     lcc_array_t eval_stack;
     lcc_string_t *macro_name;
     lcc_string_t *macro_vaname;
     lcc_string_array_t macro_args;
 
     /* current file info */
-    size_t col;
-    size_t row;
     size_t curr_col;
     size_t curr_row;
-    lcc_string_t *fname;
-    lcc_string_t *source;
+    lcc_token_buffer_t source;
+
+    /* source locations, decoded only when needed */
+    uint32_t loc;
+    uint32_t loc_base;
+    uint32_t loc_token;
+    size_t loc_row;
+    lcc_file_t *loc_file;
+    lcc_array_t loc_lines;
+    lcc_string_array_t loc_names;
 
     /* current file and token */
     char ch;
     lcc_file_t *file;
     lcc_token_t tokens;
+    lcc_token_pool_t token_pool;
     lcc_token_buffer_t token_buffer;
 
-    /* error handling */
+    /* token cache for included files, owned by the caller */
+    lcc_token_cache_t *tcache;
+
+    /* shared source cache for included files, owned by the caller */
+    lcc_source_cache_t *scache;
+
+    /* error handling, `diags` counts every error and warning */
+    size_t diags;
     void *error_data;
     lcc_lexer_on_error_fn error_fn;
 } lcc_lexer_t;
@@ -458,13 +635,51 @@ typedef enum _lcc_lexer_gnu_ext_t
 
 void lcc_lexer_free(lcc_lexer_t *self);
 char lcc_lexer_init(lcc_lexer_t *self, lcc_file_t file);
+char lcc_lexer_init_shared(lcc_lexer_t *self, lcc_file_t file, lcc_psyms_t *psyms);
+
+/* restarts on a new main file, keeping the predefined symbols and caches, symbols
+ * defined after lcc_lexer_reset() only apply to the new file, returns 0 if the file
+ * is invalid or the predefined symbols were never completed */
+char lcc_lexer_reset(lcc_lexer_t *self, lcc_file_t file);
 
+/* returned tokens are allocated from the lexer pool, free them before lcc_lexer_free() */
 lcc_token_t *lcc_lexer_next(lcc_lexer_t *self);
+/* numeric literals in the list returned by lcc_lexer_advance() may still be deferred */
 lcc_token_t *lcc_lexer_advance(lcc_lexer_t *self);
 
+/* fills `tokens` with up to `count` tokens, fewer only after EOF or on error */
+size_t lcc_lexer_next_batch(lcc_lexer_t *self, lcc_token_t **tokens, size_t count);
+
+/* new reference to the pre-defined symbols, NULL until the "<define>" pseudo-file is done */
+lcc_psyms_t *lcc_lexer_psyms(lcc_lexer_t *self);
+
+/* decode a source location, the file name is borrowed from the lexer */
+char lcc_lexer_locate(lcc_lexer_t *self, uint32_t loc, lcc_string_t **file, size_t *row, size_t *col);
+
 void lcc_lexer_undef(lcc_lexer_t *self, const char *name);
 void lcc_lexer_define(lcc_lexer_t *self, const char *name, const char *value);
 
+/* builds the macro directly without lexing, `args` is NULL for object-like macros, the
+ * last argument may be "..." or "name..." for variadic macros, tokens of `body` are moved
+ * into the macro, `body` may be NULL for an empty macro, returns 0 for invalid names, the
+ * `body` list is untouched in that case */
+char lcc_lexer_add_macro(lcc_lexer_t *self, const char *name, const char **args, size_t nargs, lcc_token_t *body);
+void lcc_lexer_remove_macro(lcc_lexer_t *self, const char *name);
+
+/* loads "-DNAME[=VALUE]" and "-UNAME" lines like the command line, "-D" may be omitted,
+ * empty lines and lines starting with "#" are ignored, returns 0 on invalid files or lines */
+char lcc_lexer_load_defines(lcc_lexer_t *self, const char *fname);
+/* loads a single "-DNAME[=VALUE]" or "-UNAME" option, same as a line of lcc_lexer_load_defines() */
+char lcc_lexer_load_option(lcc_lexer_t *self, const char *option);
+
+/* saves symbols, include guards, "#pragma once" files and "__COUNTER__" of the translation unit,
+ * symbols pre-defined before the "<define>" pseudo-file are not saved, returns 0 on errors */
+char lcc_lexer_save_preamble(lcc_lexer_t *self, const char *fname);
+
+/* loads a saved preamble before lexing, as if the saved translation unit was lexed
+ * first, returns 0 on invalid files, or if any of the files it depends on has changed */
+char lcc_lexer_load_preamble(lcc_lexer_t *self, const char *fname);
+
 void lcc_lexer_add_feature(lcc_lexer_t *self, const char *name);
 void lcc_lexer_add_builtin(lcc_lexer_t *self, const char *name);
 void lcc_lexer_add_extension(lcc_lexer_t *self, const char *name);
@@ -475,4 +690,10 @@ void lcc_lexer_add_library_path(lcc_lexer_t *self, const char *path);
 void lcc_lexer_set_gnu_ext(lcc_lexer_t *self, lcc_lexer_gnu_ext_t name, char enabled);
 void lcc_lexer_set_error_handler(lcc_lexer_t *self, lcc_lexer_on_error_fn error_fn, void *data);
 
+/* set before lexing, the cache must outlive the lexer, and may not be shared between threads */
+void lcc_lexer_set_token_cache(lcc_lexer_t *self, lcc_token_cache_t *cache);
+
+/* set before lexing, the cache must outlive the lexer, and may be shared between threads */
+void lcc_lexer_set_source_cache(lcc_lexer_t *self, lcc_source_cache_t *cache);
+
 #endif /* LCC_LEXER_H */
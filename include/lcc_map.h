@@ -12,17 +12,18 @@ typedef void (*lcc_map_dtor_fn)(struct _lcc_map_t *self, void *value, void *data
 
 typedef struct _lcc_map_node_t
 {
-    long hash;
     long flags;
-    void *value;
+    size_t hash;
     lcc_string_t *key;
 } lcc_map_node_t;
 
 typedef struct _lcc_map_t
 {
+    size_t used;            /* occupied nodes, including deleted ones */
     size_t count;
-    size_t capacity;
+    size_t capacity;        /* always a power of 2 */
     size_t value_size;
+    char *values;           /* values are stored parallel to nodes */
     lcc_map_node_t *bucket;
 
     void *dtor_data;
@@ -32,6 +33,8 @@ typedef struct _lcc_map_t
 void lcc_map_free(lcc_map_t *self);
 void lcc_map_init(lcc_map_t *self, size_t value_size, lcc_map_dtor_fn dtor, void *data);
 
+/* keys are retained by reference, and must not be modified afterwards */
+char lcc_map_key(lcc_map_t *self, lcc_string_t *key, lcc_string_t **stored);
 char lcc_map_pop(lcc_map_t *self, lcc_string_t *key, void *data);
 char lcc_map_get(lcc_map_t *self, lcc_string_t *key, void **data);
 char lcc_map_set(lcc_map_t *self, lcc_string_t *key, void *data, const void *new);
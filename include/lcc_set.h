@@ -14,6 +14,7 @@ static inline void lcc_set_init(lcc_set_t *self) { lcc_map_init(&(self->map), 0,
 static inline char lcc_set_add     (lcc_set_t *self, lcc_string_t *key) { return lcc_map_set(&(self->map), key, NULL, NULL); }
 static inline char lcc_set_remove  (lcc_set_t *self, lcc_string_t *key) { return lcc_map_pop(&(self->map), key, NULL); }
 static inline char lcc_set_contains(lcc_set_t *self, lcc_string_t *key) { return lcc_map_get(&(self->map), key, NULL); }
+static inline char lcc_set_find    (lcc_set_t *self, lcc_string_t *key, lcc_string_t **stored) { return lcc_map_key(&(self->map), key, stored); }
 
 static inline char lcc_set_add_string     (lcc_set_t *self, const char *key) { return lcc_map_set_string(&(self->map), key, NULL, NULL); }
 static inline char lcc_set_remove_string  (lcc_set_t *self, const char *key) { return lcc_map_pop_string(&(self->map), key, NULL); }
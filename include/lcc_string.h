@@ -9,12 +9,19 @@ typedef struct _lcc_string_t
     int ref;
     char *buf;
     size_t len;
+    size_t hash;    /* cached hash value, 0 if not calculated yet */
 } lcc_string_t;
 
 void lcc_string_unref(lcc_string_t *self);
 char lcc_string_equals(lcc_string_t *self, lcc_string_t *other);
+size_t lcc_string_hash(lcc_string_t *self);
 
 lcc_string_t *lcc_string_ref(lcc_string_t *self);
+
+/* frozen strings ignore references, and are safe to share between threads */
+void lcc_string_thaw(lcc_string_t *self);
+void lcc_string_freeze(lcc_string_t *self);
+
 lcc_string_t *lcc_string_copy(lcc_string_t *self);
 lcc_string_t *lcc_string_trim(lcc_string_t *self);
 lcc_string_t *lcc_string_repr(lcc_string_t *self, char is_chars);
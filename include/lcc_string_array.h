@@ -12,7 +12,7 @@ typedef struct _lcc_string_array_t
 } lcc_string_array_t;
 
 /* static initializer */
-extern lcc_string_array_t LCC_STRING_ARRAY_STATIC_INIT;
+extern const lcc_string_array_t LCC_STRING_ARRAY_STATIC_INIT;
 
 void lcc_string_array_free(lcc_string_array_t *self);
 void lcc_string_array_init(lcc_string_array_t *self);
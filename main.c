@@ -1,142 +1,549 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
+#include "lcc_set.h"
 #include "lcc_lexer.h"
 #include "lcc_string_array.h"
 
-int main()
+#define LCC_SOURCE_CACHE_LIMIT      (256 * 1024 * 1024)
+
+typedef struct _lcc_driver_t
 {
-    lcc_lexer_t lexer;
-    lcc_token_t *token;
-    lcc_lexer_init(&lexer, lcc_file_open("/Users/Oxygen/Sources/tests/lcc_test.c"));
-    lcc_lexer_set_gnu_ext(&lexer, LCC_LX_GNUX_VA_OPT_MACRO, 1);
-    lcc_lexer_add_include_path(&lexer, "/Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/usr/include");
-    lcc_lexer_add_include_path(&lexer, "/Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/lib/clang/10.0.0/include");
-    lcc_lexer_add_include_path(&lexer, "/usr/local/include");
-    lcc_lexer_add_include_path(&lexer, "/Users/Oxygen/Sources/tests");
-    lcc_lexer_add_include_path(&lexer, "/Users/Oxygen/ClionProjects/LightCC/include");
-
-    int c = 0;
-    int n = 0;
-    int f = 0;
-    while ((token = lcc_lexer_next(&lexer)))
+    /* input files, and where the outputs go */
+    size_t next;
+    size_t count;
+    char **inputs;
+    const char *output;
+    char outdir;
+
+    /* shared by every worker */
+    lcc_psyms_t *psyms;
+    lcc_source_cache_t cache;
+    lcc_string_array_t include_paths;
+
+    /* files failed to preprocess */
+    size_t failed;
+} lcc_driver_t;
+
+typedef struct _lcc_printer_t
+{
+    int c;                  /* tokens on current line */
+    int n;                  /* indentation */
+    int f;                  /* "}" not written yet */
+    FILE *fp;
+} lcc_printer_t;
+
+static void lcc_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-j N] [-o OUTPUT] [-I DIR]... [-D NAME[=VALUE]]... [-U NAME]... FILE...\n", name);
+    fprintf(stderr, "    -j N        preprocess N files in parallel, defaults to the number of CPUs\n");
+    fprintf(stderr, "    -o OUTPUT   output directory if OUTPUT is an existing directory or there are multiple inputs,\n");
+    fprintf(stderr, "                otherwise the output file of the single input\n");
+    fprintf(stderr, "    -I DIR      add DIR to the include search paths\n");
+    fprintf(stderr, "    -D NAME     define NAME as 1, or as VALUE with \"NAME=VALUE\"\n");
+    fprintf(stderr, "    -U NAME     remove the definition of NAME\n");
+    fprintf(stderr, "without -o, a single input goes to stdout, multiple inputs go to \"FILE.i\" next to each input\n");
+}
+
+static lcc_string_t *lcc_output_path(lcc_driver_t *self, const char *input)
+{
+    /* name of the input file */
+    const char *base = strrchr(input, '/');
+    const char *ext = strrchr(input, '.');
+
+    /* base name without the directory */
+    base = base ? base + 1 : input;
+    ext = (ext && (ext > base)) ? ext : input + strlen(input);
+
+    /* "DIR/NAME.i", "OUTPUT", "PATH/NAME.i", or stdout */
+    if (self->outdir)
+        return lcc_string_from_format("%s/%.*s.i", self->output, (int)(ext - base), base);
+    else if (self->output)
+        return lcc_string_from(self->output);
+    else if (self->count > 1)
+        return lcc_string_from_format("%.*s.i", (int)(ext - input), input);
+    else
+        return NULL;
+}
+
+static char lcc_is_directory(const char *path)
+{
+    struct stat st;
+    return !stat(path, &st) && S_ISDIR(st.st_mode);
+}
+
+static char lcc_file_identity(const char *path, char *buf, size_t len)
+{
+    struct stat st;
+
+    /* files that do not exist yet cannot be any of the inputs */
+    if (stat(path, &st))
+        return 0;
+
+    /* device and inode identify the file, whatever the path is */
+    snprintf(buf, len, "%llx:%llx", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+    return 1;
+}
+
+static char lcc_check_outputs(lcc_driver_t *self)
+{
+    char ret = 1;
+    char id[64];
+    lcc_set_t paths;
+    lcc_set_t inputs;
+
+    /* writing to stdout never overwrites anything */
+    if (!(self->output) && (self->count <= 1))
+        return 1;
+
+    /* identities of every input file */
+    lcc_set_init(&inputs);
+    for (size_t i = 0; i < self->count; i++)
+        if (lcc_file_identity(self->inputs[i], id, sizeof(id)))
+            lcc_set_add_string(&inputs, id);
+
+    /* every input must have its own output, otherwise workers may write to the
+     * same file, and no output may be an input, which would be truncated */
+    lcc_set_init(&paths);
+    for (size_t i = 0; i < self->count; i++)
     {
-        if (token->type == LCC_TK_PRAGMA)
+        lcc_string_t *path = lcc_output_path(self, self->inputs[i]);
+
+        /* check for duplications */
+        if (lcc_set_add(&paths, path))
         {
-            if (f)
+            fprintf(stderr, "* ERROR: Output file '%s' is used by more than one input\n", path->buf);
+            ret = 0;
+        }
+
+        /* check for overwriting inputs */
+        if (lcc_file_identity(path->buf, id, sizeof(id)) && lcc_set_contains_string(&inputs, id))
+        {
+            fprintf(stderr, "* ERROR: Output file '%s' would overwrite an input file\n", path->buf);
+            ret = 0;
+        }
+
+        /* the set holds its own reference */
+        lcc_string_unref(path);
+    }
+
+    /* release the sets */
+    lcc_set_free(&paths);
+    lcc_set_free(&inputs);
+    return ret;
+}
+
+static char lcc_on_error(
+    lcc_lexer_t             *self,
+    lcc_string_t            *file,
+    ssize_t                  row,
+    ssize_t                  col,
+    lcc_string_t            *message,
+    lcc_lexer_error_type_t   type,
+    void                    *data
+)
+{
+    /* print the error message */
+    fprintf(
+        stderr,
+        "* %s: (%s:%zd:%zd) %s\n",
+        type == LCC_LXET_ERROR ? "ERROR" : "WARNING",
+        file->buf,
+        row,
+        col,
+        message->buf
+    );
+
+    /* count the errors of current file */
+    if (type == LCC_LXET_ERROR)
+        (*(size_t *)data)++;
+
+    /* cannot continue if it's an error */
+    return type != LCC_LXET_ERROR;
+}
+
+static void lcc_write_token(FILE *fp, lcc_token_t *token)
+{
+    switch (token->type)
+    {
+        /* basic tokens, written directly */
+        case LCC_TK_EOF      : break;
+        case LCC_TK_IDENT    : fputs(token->ident->buf, fp); break;
+        case LCC_TK_LITERAL  : fputs(token->literal.raw->buf, fp); break;
+        case LCC_TK_KEYWORD  : fputs(lcc_token_kw_name(token->keyword), fp); break;
+        case LCC_TK_OPERATOR : fputs(lcc_token_op_name(token->operator), fp); break;
+
+        /* assembled back to "#pragma" directive */
+        case LCC_TK_PRAGMA:
+        {
+            fprintf(fp, "#pragma %s", token->pragma.name->buf);
+
+            /* write every argument */
+            for (lcc_token_t *p = token->pragma.args->next; p != token->pragma.args; p = p->next)
             {
-                f = 0;
-                n -= 4;
-                printf("%*s} ", n, "");
+                fputc(' ', fp);
+                lcc_write_token(fp, p);
             }
 
-            if (c)
-                printf("\n");
+            break;
+        }
+    }
+}
 
-            c = 0;
-            n = 0;
-            lcc_string_t *s = lcc_token_str(token);
-            printf("%s\n", s->buf);
-            lcc_string_unref(s);
+static void lcc_print_token(lcc_printer_t *self, lcc_token_t *token)
+{
+    FILE *fp = self->fp;
+    if (token->type == LCC_TK_EOF)
+    {
+        return;
+    }
+    else if (token->type == LCC_TK_PRAGMA)
+    {
+        if (self->f)
+        {
+            self->f = 0;
+            self->n -= 4;
+            fprintf(fp, "%*s} ", self->n, "");
         }
-        else if (token->type == LCC_TK_OPERATOR &&
-                 token->operator == LCC_OP_LBLOCK)
+
+        if (self->c)
+            fprintf(fp, "\n");
+
+        self->c = 0;
+        self->n = 0;
+        lcc_write_token(fp, token);
+        fprintf(fp, "\n");
+    }
+    else if (token->type == LCC_TK_OPERATOR &&
+             token->operator == LCC_OP_LBLOCK)
+    {
+        if (self->f)
         {
-            if (f)
-            {
-                f = 0;
-                n -= 4;
-                printf("%*s}\n", n, "");
-            }
+            self->f = 0;
+            self->n -= 4;
+            fprintf(fp, "%*s}\n", self->n, "");
+        }
 
-            printf("%*s{\n", !c * n, "");
-            c = 0;
-            n += 4;
+        fprintf(fp, "%*s{\n", !self->c * self->n, "");
+        self->c = 0;
+        self->n += 4;
+    }
+    else if (token->type == LCC_TK_OPERATOR &&
+             token->operator == LCC_OP_RBLOCK)
+    {
+        if (self->f)
+        {
+            self->c = 0;
+            self->n -= 4;
+            fprintf(fp, "%*s}\n", self->n, "");
         }
-        else if (token->type == LCC_TK_OPERATOR &&
-                 token->operator == LCC_OP_RBLOCK)
+
+        self->f = 1;
+    }
+    else if (token->type == LCC_TK_OPERATOR &&
+             token->operator == LCC_OP_SEMICOLON)
+    {
+        if (self->f)
         {
-            if (f)
-            {
-                c = 0;
-                n -= 4;
-                printf("%*s}\n", n, "");
-            }
+            self->f = 0;
+            self->n -= 4;
+            fprintf(fp, "%*s} ", self->n, "");
+        }
 
-            f = 1;
+        self->c = 0;
+        fprintf(fp, ";\n");
+    }
+    else
+    {
+        if (self->f)
+        {
+            self->f = 0;
+            self->c = 0;
+            self->n -= 4;
+            fprintf(fp, "%*s}\n", self->n, "");
         }
-        else if (token->type == LCC_TK_OPERATOR &&
-                 token->operator == LCC_OP_SEMICOLON)
+
+        if (!(self->c++))
+            fprintf(fp, "%*s", self->n, "");
+
+        lcc_write_token(fp, token);
+        fputc(' ', fp);
+    }
+}
+
+static void lcc_preprocess(lcc_lexer_t *lexer, FILE *fp)
+{
+    lcc_token_t *token;
+    lcc_printer_t printer = { .c = 0, .n = 0, .f = 0, .fp = fp };
+
+    /* pretty-print every token, indented by blocks */
+    while ((token = lcc_lexer_next(lexer)))
+    {
+        lcc_print_token(&printer, token);
+        lcc_token_free(token);
+    }
+
+    /* close the last block */
+    if (printer.f)
+        fprintf(fp, "}\n");
+}
+
+static char lcc_close_output(FILE *fp, lcc_string_t *path, char ok)
+{
+    /* stdout is only flushed */
+    if (!path)
+        return !fflush(fp) && ok;
+
+    /* close the output file, and release the path */
+    ok = !fclose(fp) && ok;
+    lcc_string_unref(path);
+    return ok;
+}
+
+static void lcc_discard_output(FILE *fp, lcc_string_t *path)
+{
+    /* nothing was written to stdout */
+    if (!path)
+        return;
+
+    /* the file was never preprocessed, remove the empty output */
+    fclose(fp);
+    unlink(path->buf);
+    lcc_string_unref(path);
+}
+
+static char lcc_run_file(lcc_driver_t *self, lcc_lexer_t *lexer, char *ready, const char *input)
+{
+    size_t errors = 0;
+    FILE *fp = stdout;
+    lcc_string_t *path;
+
+    /* a single input without "-o" goes to stdout, open the output before
+     * touching the lexer, so a failed open leaves the lexer untouched */
+    if ((path = lcc_output_path(self, input)))
+    {
+        /* open the output file */
+        fp = fopen(path->buf, "w");
+
+        /* check for errors */
+        if (!fp)
         {
-            if (f)
-            {
-                f = 0;
-                n -= 4;
-                printf("%*s} ", n, "");
-            }
+            fprintf(stderr, "* ERROR: Cannot open output file '%s': [%d] %s\n", path->buf, errno, strerror_r(errno, (char [128]){ 0 }, 128));
+            lcc_string_unref(path);
+            return 0;
+        }
 
-            c = 0;
-            printf(";\n");
+        /* larger output buffer */
+        setvbuf(fp, NULL, _IOFBF, 65536);
+    }
+
+    /* files are shared between workers */
+    lcc_file_t file = lcc_source_cache_open(&(self->cache), input);
+
+    /* check for errors */
+    if (file.flags & LCC_FF_INVALID)
+    {
+        fprintf(stderr, "* ERROR: Cannot open file '%s': [%d] %s\n", input, errno, strerror_r(errno, (char [128]){ 0 }, 128));
+        lcc_discard_output(fp, path);
+        return 0;
+    }
+
+    /* the first file creates the lexer, later ones reuse it */
+    if (*ready)
+    {
+        /* the file is released on failure, and the lexer can no longer be
+         * reused, so tear it down and let the next file create a new one */
+        if (!(lcc_lexer_reset(lexer, file)))
+        {
+            fprintf(stderr, "* ERROR: Cannot reset the lexer for file '%s'\n", input);
+            lcc_lexer_free(lexer);
+            lcc_discard_output(fp, path);
+            *ready = 0;
+            return 0;
         }
-        else
+    }
+    else
+    {
+        /* create a new lexer with the shared pre-defined symbols */
+        if (!(lcc_lexer_init_shared(lexer, file, self->psyms)))
         {
-            if (f)
-            {
-                f = 0;
-                c = 0;
-                n -= 4;
-                printf("%*s}\n", n, "");
-            }
+            fprintf(stderr, "* ERROR: Cannot create the lexer for file '%s'\n", input);
+            lcc_discard_output(fp, path);
+            return 0;
+        }
+
+        /* lexer options */
+        lcc_lexer_set_gnu_ext(lexer, LCC_LX_GNUX_VA_OPT_MACRO, 1);
+        lcc_lexer_set_source_cache(lexer, &(self->cache));
+
+        /* add every include path */
+        for (size_t i = 0; i < self->include_paths.array.count; i++)
+            lcc_lexer_add_include_path(lexer, lcc_string_array_get(&(self->include_paths), i)->buf);
+
+        /* lexer is ready */
+        *ready = 1;
+    }
+
+    /* preprocess the file, the lexer stops on errors */
+    lcc_lexer_set_error_handler(lexer, lcc_on_error, &errors);
+    lcc_preprocess(lexer, fp);
+
+    /* close the output file, whether it's successful */
+    return lcc_close_output(fp, path, !errors);
+}
+
+static void *lcc_worker(void *data)
+{
+    size_t i;
+    char ready = 0;
+    lcc_lexer_t lexer;
+    lcc_driver_t *self = data;
+
+    /* take the next file from the queue until it's empty */
+    while ((i = __atomic_fetch_add(&(self->next), 1, __ATOMIC_RELAXED)) < self->count)
+        if (!(lcc_run_file(self, &lexer, &ready, self->inputs[i])))
+            __atomic_add_fetch(&(self->failed), 1, __ATOMIC_RELAXED);
+
+    /* release the lexer if any */
+    if (ready)
+        lcc_lexer_free(&lexer);
 
-            lcc_string_t *s = lcc_token_str(token);
-            if (!(c++))
-                printf("%*s", n, "");
-            printf("%s ", s->buf);
-            lcc_string_unref(s);
+    return NULL;
+}
+
+static lcc_psyms_t *lcc_load_psyms(lcc_string_array_t *defines)
+{
+    /* an empty file, only for the pre-defined symbols */
+    lcc_lexer_t lexer;
+    lcc_token_t *token;
+    lcc_lexer_init(&lexer, lcc_file_from_string("<empty>", "", 0));
+
+    /* "-D" and "-U" in command line order, simple ones are built without lexing */
+    for (size_t i = 0; i < defines->array.count; i++)
+    {
+        lcc_string_t *def = lcc_string_array_get(defines, i);
+
+        /* check for invalid options */
+        if (!(lcc_lexer_load_option(&lexer, def->buf)))
+        {
+            fprintf(stderr, "* ERROR: Invalid option '%s'\n", def->buf);
+            lcc_lexer_free(&lexer);
+            return NULL;
         }
+    }
 
+    /* lex to the end, so the pre-defined symbols are complete */
+    while ((token = lcc_lexer_next(&lexer)))
+    {
+        char eof = token->type == LCC_TK_EOF;
         lcc_token_free(token);
+        if (eof) break;
     }
 
-    /* what's wrong with Clion DFA ?? */
-    #pragma clang diagnostic push
-    #pragma ide diagnostic ignored "OCDFAInspection"
-
-    if (f)
-        printf("}\n");
-
-    #pragma clang diagnostic pop
-
-//    printf("\nPSYMS:\n");
-//    typedef struct __sym
-//    {
-//        long flags;
-//        uint64_t *nx;
-//        lcc_token_t *body;
-//        lcc_string_t *name;
-//        lcc_string_t *vaname;
-//        lcc_string_array_t args;
-//    } sym;
-//    for (size_t i = 0; i < lexer.psyms.capacity; i++)
-//    {
-//        if (lexer.psyms.bucket[i].flags == LCC_MAP_FLAGS_USED)
-//        {
-//            printf("#define %s ", lexer.psyms.bucket[i].key->buf);
-//            sym *s = lexer.psyms.bucket[i].value;
-//            if (!(s->body))
-//                printf("<built-in>");
-//            else
-//            {
-//                for (lcc_token_t *p = s->body->next; p != s->body; p = p->next)
-//                {
-//                    lcc_string_t *x = lcc_token_str(p);
-//                    printf("%s ", x->buf);
-//                    lcc_string_unref(x);
-//                }
-//            }
-//            printf("\n");
-//        }
-//    }
-
+    /* share them with every worker */
+    lcc_psyms_t *psyms = lcc_lexer_psyms(&lexer);
     lcc_lexer_free(&lexer);
-    return 0;
+    return psyms;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    lcc_driver_t driver;
+    lcc_string_array_t defines;
+
+    /* initialize the driver */
+    driver.next = 0;
+    driver.failed = 0;
+    driver.output = NULL;
+    lcc_string_array_init(&defines);
+    lcc_string_array_init(&(driver.include_paths));
+
+    /* parse the command line */
+    while ((opt = getopt(argc, argv, "j:o:I:D:U:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j': jobs = strtol(optarg, NULL, 10); break;
+            case 'o': driver.output = optarg; break;
+            case 'I': lcc_string_array_append(&(driver.include_paths), lcc_string_from(optarg)); break;
+            case 'D': lcc_string_array_append(&defines, lcc_string_from_format("-D%s", optarg)); break;
+            case 'U': lcc_string_array_append(&defines, lcc_string_from_format("-U%s", optarg)); break;
+
+            /* invalid options */
+            default:
+            {
+                lcc_usage(argv[0]);
+                lcc_string_array_free(&defines);
+                lcc_string_array_free(&(driver.include_paths));
+                return opt == 'h' ? 0 : 2;
+            }
+        }
+    }
+
+    /* remaining arguments are input files */
+    driver.count = argc - optind;
+    driver.inputs = argv + optind;
+    driver.outdir = driver.output && ((driver.count > 1) || lcc_is_directory(driver.output));
+
+    /* at least one input file, and at least one worker */
+    if (!(driver.count) || (jobs < 1))
+    {
+        lcc_usage(argv[0]);
+        lcc_string_array_free(&defines);
+        lcc_string_array_free(&(driver.include_paths));
+        return 2;
+    }
+
+    /* inputs mapped to the same output */
+    if (!(lcc_check_outputs(&driver)))
+    {
+        lcc_string_array_free(&defines);
+        lcc_string_array_free(&(driver.include_paths));
+        return 2;
+    }
+
+    /* no more workers than files */
+    if ((size_t)jobs > driver.count)
+        jobs = (long)driver.count;
+
+    /* pre-defined symbols and file contents are shared by all workers */
+    driver.psyms = lcc_load_psyms(&defines);
+    lcc_source_cache_init(&(driver.cache), LCC_SOURCE_CACHE_LIMIT);
+    lcc_string_array_free(&defines);
+
+    /* invalid "-D" or "-U" options */
+    if (!(driver.psyms))
+    {
+        fprintf(stderr, "* ERROR: Invalid pre-defined symbols\n");
+        lcc_source_cache_free(&(driver.cache));
+        lcc_string_array_free(&(driver.include_paths));
+        return 1;
+    }
+
+    /* the main thread is one of the workers */
+    pthread_t *threads = malloc((jobs - 1) * sizeof(pthread_t) + 1);
+
+    /* start the other workers, the remaining ones share the work if some failed to start */
+    long started = 0;
+    while ((started < jobs - 1) && !(pthread_create(&(threads[started]), NULL, lcc_worker, &driver)))
+        started++;
+
+    /* work on the main thread as well, then wait for others */
+    lcc_worker(&driver);
+    for (long i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    /* release the shared resources */
+    free(threads);
+    lcc_psyms_unref(driver.psyms);
+    lcc_source_cache_free(&(driver.cache));
+    lcc_string_array_free(&(driver.include_paths));
+    return driver.failed != 0;
 }
\ No newline at end of file
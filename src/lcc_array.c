@@ -1,11 +1,37 @@
+#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "lcc_array.h"
 
+#define LCC_ARRAY_INIT_CAP  8
+
 #define PTR_INDEX(self, index) \
     ((void *)((uintptr_t)self->items + (index) * self->item_size))
 
+static inline void _lcc_array_resize(lcc_array_t *self, size_t capacity)
+{
+    /* release the buffer if empty */
+    if (!capacity)
+    {
+        free(self->items);
+        self->items = NULL;
+        self->capacity = 0;
+        return;
+    }
+
+    /* resize the item buffer */
+    if (!(self->items = realloc(self->items, capacity * self->item_size)))
+    {
+        fprintf(stderr, "*** FATAL: cannot allocate memory for array\n");
+        abort();
+    }
+
+    /* update the capacity */
+    self->capacity = capacity;
+}
+
 void lcc_array_free(lcc_array_t *self)
 {
     /* destruct every item */
@@ -22,6 +48,7 @@ void lcc_array_init(lcc_array_t *self, size_t item_size, lcc_array_dtor_fn dtor,
     /* initialize an empty array */
     self->count = 0;
     self->items = NULL;
+    self->capacity = 0;
     self->item_size = item_size;
 
     /* set item destructor */
@@ -74,9 +101,8 @@ char lcc_array_pop(lcc_array_t *self, void *data)
     else if (self->dtor_fn)
         self->dtor_fn(self, PTR_INDEX(self, self->count - 1), self->dtor_data);
 
-    /* resize the memory and counter */
+    /* update the counter, the memory is kept for later use */
     self->count--;
-    self->items = realloc(self->items, self->count * self->item_size);
     return 1;
 }
 
@@ -100,17 +126,31 @@ char lcc_array_remove(lcc_array_t *self, size_t index)
         );
     }
 
-    /* resize the memory and counter */
+    /* update the counter, the memory is kept for later use */
     self->count--;
-    self->items = realloc(self->items, self->count * self->item_size);
     return 1;
 }
 
+void lcc_array_reserve(lcc_array_t *self, size_t capacity)
+{
+    if (capacity > self->capacity)
+        _lcc_array_resize(self, capacity);
+}
+
+void lcc_array_shrink_to_fit(lcc_array_t *self)
+{
+    if (self->count < self->capacity)
+        _lcc_array_resize(self, self->count);
+}
+
 void lcc_array_append(lcc_array_t *self, const void *data)
 {
-    /* resize the memory and counter */
+    /* grow geometrically when full */
+    if (self->count == self->capacity)
+        _lcc_array_resize(self, self->capacity ? self->capacity * 2 : LCC_ARRAY_INIT_CAP);
+
+    /* update the counter */
     self->count++;
-    self->items = realloc(self->items, self->count * self->item_size);
 
     /* copy new item */
     memcpy(PTR_INDEX(self, self->count - 1), data, self->item_size);
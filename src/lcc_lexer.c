@@ -1,13 +1,22 @@
 #include <time.h>
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <lcc_lexer.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "lcc_lexer.h"
 
 /*** Tokens ***/
@@ -118,6 +127,96 @@ static lcc_string_t *_lcc_string_eval(lcc_string_t *self, char allow_gnuext)
     return self;
 }
 
+/* active token pool of current thread */
+static __thread lcc_token_pool_t *_lcc_token_pool = NULL;
+
+static void _lcc_token_pool_grow(lcc_token_pool_t *self)
+{
+    /* allocate a new slab */
+    lcc_token_t *slab = malloc(LCC_TOKEN_SLAB_SIZE * sizeof(lcc_token_t));
+    lcc_array_append(&(self->slabs), &slab);
+
+    /* link every token into free list */
+    for (size_t i = 0; i < LCC_TOKEN_SLAB_SIZE; i++)
+    {
+        slab[i].next = self->free;
+        self->free = &(slab[i]);
+    }
+}
+
+static lcc_token_t *_lcc_token_alloc(void)
+{
+    lcc_token_t *self;
+    lcc_token_pool_t *pool = _lcc_token_pool;
+
+    /* no active pool, use the heap */
+    if (!pool)
+    {
+        self = malloc(sizeof(lcc_token_t));
+        self->loc = 0;
+        self->pool = NULL;
+        return self;
+    }
+
+    /* refill the free list as needed */
+    if (!(pool->free))
+        _lcc_token_pool_grow(pool);
+
+    /* take one from free list */
+    self = pool->free;
+    pool->free = self->next;
+    self->loc = 0;
+    self->pool = pool;
+
+    /* update counters */
+    if (++pool->live > pool->peak)
+        pool->peak = pool->live;
+
+    return self;
+}
+
+static void _lcc_token_release(lcc_token_t *self)
+{
+    /* allocated from heap */
+    lcc_token_pool_t *pool = self->pool;
+    if (!pool)
+    {
+        free(self);
+        return;
+    }
+
+    /* put back to free list */
+    pool->live--;
+    self->next = pool->free;
+    pool->free = self;
+}
+
+static void _lcc_slab_dtor(lcc_array_t *self, void *item, void *data)
+{
+    lcc_token_t **slab = item;
+    free(*slab);
+}
+
+void lcc_token_pool_free(lcc_token_pool_t *self)
+{
+    lcc_array_free(&(self->slabs));
+}
+
+void lcc_token_pool_init(lcc_token_pool_t *self)
+{
+    self->live = 0;
+    self->peak = 0;
+    self->free = NULL;
+    lcc_array_init(&(self->slabs), sizeof(lcc_token_t *), _lcc_slab_dtor, NULL);
+}
+
+lcc_token_pool_t *lcc_token_pool_swap(lcc_token_pool_t *self)
+{
+    lcc_token_pool_t *old = _lcc_token_pool;
+    _lcc_token_pool = self;
+    return old;
+}
+
 void lcc_token_free(lcc_token_t *self)
 {
     if (self)
@@ -179,14 +278,16 @@ void lcc_token_free(lcc_token_t *self)
 
         lcc_string_unref(self->src);
         lcc_token_detach(self);
-        free(self);
+        _lcc_token_release(self);
     }
 }
 
 void lcc_token_init(lcc_token_t *self)
 {
     self->ref = 0;
+    self->loc = 0;
     self->src = NULL;
+    self->pool = NULL;
     self->prev = self;
     self->next = self;
     self->type = LCC_TK_EOF;
@@ -265,6 +366,10 @@ char lcc_token_equals(lcc_token_t *self, lcc_token_t *other)
             if (self->literal.type != other->literal.type)
                 return 0;
 
+            /* convert deferred values before comparing */
+            lcc_literal_eval(&(self->literal));
+            lcc_literal_eval(&(other->literal));
+
             /* literal value check */
             switch (self->literal.type)
             {
@@ -291,7 +396,7 @@ char lcc_token_equals(lcc_token_t *self, lcc_token_t *other)
 
 lcc_token_t *lcc_token_new(void)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 1;
     self->src = lcc_string_new(0);
     self->prev = self;
@@ -303,7 +408,7 @@ lcc_token_t *lcc_token_new(void)
 lcc_token_t *lcc_token_copy(lcc_token_t *self)
 {
     /* create a new token */
-    lcc_token_t *clone = malloc(sizeof(lcc_token_t));
+    lcc_token_t *clone = _lcc_token_alloc();
 
     /* clone by type */
     switch (self->type)
@@ -315,7 +420,7 @@ lcc_token_t *lcc_token_copy(lcc_token_t *self)
         /* identifiers */
         case LCC_TK_IDENT:
         {
-            clone->ident = lcc_string_copy(self->ident);
+            clone->ident = lcc_string_ref(self->ident);
             break;
         }
 
@@ -363,6 +468,7 @@ lcc_token_t *lcc_token_copy(lcc_token_t *self)
             /* also copy the raw value */
             clone->literal.raw = lcc_string_copy(self->literal.raw);
             clone->literal.type = self->literal.type;
+            clone->literal.pending = self->literal.pending;
             break;
         }
 
@@ -383,6 +489,7 @@ lcc_token_t *lcc_token_copy(lcc_token_t *self)
 
     /* set the new token type */
     clone->ref = self->ref;
+    clone->loc = self->loc;
     clone->src = lcc_string_copy(self->src);
     clone->prev = clone;
     clone->next = clone;
@@ -403,7 +510,7 @@ lcc_token_t *lcc_token_pragma(lcc_string_t *name, lcc_token_t *args)
 {
     /* `repr` header */
     lcc_token_t *p = args->next;
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     lcc_string_t *psrc = lcc_string_from_format("#pragma %s", name->buf);
 
     /* convert every tokens */
@@ -426,7 +533,7 @@ lcc_token_t *lcc_token_pragma(lcc_string_t *name, lcc_token_t *args)
 
 lcc_token_t *lcc_token_from_ident(lcc_string_t *src, lcc_string_t *ident)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = src;
     self->prev = self;
@@ -438,7 +545,7 @@ lcc_token_t *lcc_token_from_ident(lcc_string_t *src, lcc_string_t *ident)
 
 lcc_token_t *lcc_token_from_keyword(lcc_string_t *src, lcc_keyword_t keyword)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = src;
     self->prev = self;
@@ -450,7 +557,7 @@ lcc_token_t *lcc_token_from_keyword(lcc_string_t *src, lcc_keyword_t keyword)
 
 lcc_token_t *lcc_token_from_operator(lcc_string_t *src, lcc_operator_t operator)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = src;
     self->prev = self;
@@ -462,7 +569,7 @@ lcc_token_t *lcc_token_from_operator(lcc_string_t *src, lcc_operator_t operator)
 
 lcc_token_t *lcc_token_from_int(intmax_t value)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = lcc_string_from_format("%li", value);
     self->prev = self;
@@ -470,13 +577,14 @@ lcc_token_t *lcc_token_from_int(intmax_t value)
     self->type = LCC_TK_LITERAL;
     self->literal.raw = lcc_string_from_format("%li", value);
     self->literal.type = LCC_LT_LONGLONG;
+    self->literal.pending = 0;
     self->literal.v_longlong = value;
     return self;
 }
 
 lcc_token_t *lcc_token_from_raw(lcc_string_t *src, lcc_string_t *value)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = src;
     self->prev = self;
@@ -484,13 +592,14 @@ lcc_token_t *lcc_token_from_raw(lcc_string_t *src, lcc_string_t *value)
     self->type = LCC_TK_LITERAL;
     self->literal.raw = lcc_string_from_format("\"%s\"", value->buf);
     self->literal.type = LCC_LT_STRING;
+    self->literal.pending = 0;
     self->literal.v_string = value;
     return self;
 }
 
 lcc_token_t *lcc_token_from_char(lcc_string_t *src, lcc_string_t *value, char allow_gnuext)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = src;
     self->prev = self;
@@ -498,13 +607,14 @@ lcc_token_t *lcc_token_from_char(lcc_string_t *src, lcc_string_t *value, char al
     self->type = LCC_TK_LITERAL;
     self->literal.raw = lcc_string_from_format("'%s'", value->buf);
     self->literal.type = LCC_LT_CHAR;
+    self->literal.pending = 0;
     self->literal.v_char = _lcc_string_eval(value, allow_gnuext);
     return self;
 }
 
 lcc_token_t *lcc_token_from_string(lcc_string_t *src, lcc_string_t *value, char allow_gnuext)
 {
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    lcc_token_t *self = _lcc_token_alloc();
     self->ref = 0;
     self->src = src;
     self->prev = self;
@@ -512,42 +622,257 @@ lcc_token_t *lcc_token_from_string(lcc_string_t *src, lcc_string_t *value, char
     self->type = LCC_TK_LITERAL;
     self->literal.raw = lcc_string_from_format("\"%s\"", value->buf);
     self->literal.type = LCC_LT_STRING;
+    self->literal.pending = 0;
     self->literal.v_string = _lcc_string_eval(value, allow_gnuext);
     return self;
 }
 
-#define _LCC_NUM_BASE(num) \
-    ((num[0] != '0') ? 10 : ((num[1] == 'x') || (num[1] == 'X')) ? 16 : 8)
+static inline char _lcc_parse_int(const char *num, uintmax_t max, uintmax_t *value)
+{
+    /* integer base from prefix */
+    unsigned int base = 10;
+    uintmax_t val = 0;
 
-lcc_token_t *lcc_token_from_number(lcc_string_t *src, lcc_string_t *value, lcc_literal_type_t type)
+    /* octal, hexadecimal or binary */
+    if (num[0] == '0')
+    {
+        if ((num[1] == 'x') || (num[1] == 'X'))
+        {
+            num += 2;
+            base = 16;
+        }
+        else if ((num[1] == 'b') || (num[1] == 'B'))
+        {
+            num += 2;
+            base = 2;
+        }
+        else
+        {
+            num += 1;
+            base = 8;
+        }
+    }
+
+    /* accumulate digits until the suffix */
+    for (;;)
+    {
+        unsigned int digit;
+        char ch = *num++;
+
+        /* convert to digit value */
+        if ((ch >= '0') && (ch <= '9'))
+            digit = ch - '0';
+        else if ((ch >= 'a') && (ch <= 'f'))
+            digit = ch - 'a' + 10;
+        else if ((ch >= 'A') && (ch <= 'F'))
+            digit = ch - 'A' + 10;
+        else
+            break;
+
+        /* not a digit of this base */
+        if (digit >= base)
+            break;
+
+        /* saturate on overflow, like strtoul() does */
+        if (val > (max - digit) / base)
+        {
+            *value = max;
+            return 0;
+        }
+
+        /* append the digit */
+        val = val * base + digit;
+    }
+
+    /* no overflow */
+    *value = val;
+    return 1;
+}
+
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+
+static const double _LCC_POW10[] = {
+    1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 ,
+    1e8 , 1e9 , 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const float _LCC_POW10F[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+static inline char _lcc_parse_decimal(const char *num, uint64_t *mant, long *exp)
 {
-    /* create a new token */
-    const char *num = value->buf;
-    lcc_token_t *self = malloc(sizeof(lcc_token_t));
+    long e = 0;
+    long x = 0;
+    char neg = 0;
+    uint64_t m = 0;
+    unsigned int digits = 0;
+
+    /* integer part, leading zeros are not significant */
+    while ((*num >= '0') && (*num <= '9'))
+    {
+        if ((m || (*num != '0')) && (++digits > 19))
+            return 0;
+
+        /* accumulate the mantissa */
+        m = m * 10 + (*num++ - '0');
+    }
+
+    /* fraction part */
+    if (*num == '.')
+    {
+        for (num++; (*num >= '0') && (*num <= '9'); e--)
+        {
+            if ((m || (*num != '0')) && (++digits > 19))
+                return 0;
+
+            /* accumulate the mantissa */
+            m = m * 10 + (*num++ - '0');
+        }
+    }
+
+    /* exponent part */
+    if ((*num == 'e') || (*num == 'E'))
+    {
+        /* exponent sign */
+        if ((*++num == '+') || (*num == '-'))
+            neg = (*num++ == '-');
+
+        /* exponent digits, anything this large takes the slow path anyway */
+        while ((*num >= '0') && (*num <= '9'))
+            if ((x = x * 10 + (*num++ - '0')) > 9999)
+                return 0;
+    }
+
+    /* the remaining must be the suffix */
+    if (*num && (*num != 'f') && (*num != 'F') && (*num != 'l') && (*num != 'L'))
+        return 0;
+
+    /* decomposed successfully */
+    *mant = m;
+    *exp = neg ? e - x : e + x;
+    return 1;
+}
+
+static inline char _lcc_parse_double(const char *num, double *value)
+{
+    long e;
+    uint64_t m;
+
+    /* exact when both the mantissa and the power of 10 are exact doubles */
+    if (!(_lcc_parse_decimal(num, &m, &e)) || (m > (1ull << 53)) || (e < -22) || (e > 22))
+        return 0;
+
+    /* a single correctly rounded operation */
+    *value = (e < 0) ? (double)m / _LCC_POW10[-e] : (double)m * _LCC_POW10[e];
+    return 1;
+}
+
+static inline char _lcc_parse_float(const char *num, float *value)
+{
+    long e;
+    uint64_t m;
+
+    /* exact when both the mantissa and the power of 10 are exact floats */
+    if (!(_lcc_parse_decimal(num, &m, &e)) || (m > (1ull << 24)) || (e < -10) || (e > 10))
+        return 0;
+
+    /* a single correctly rounded operation */
+    *value = (e < 0) ? (float)m / _LCC_POW10F[-e] : (float)m * _LCC_POW10F[e];
+    return 1;
+}
+
+#else
 
-    /* set as literal */
+/* excess precision in intermediate results breaks the fast path */
+static inline char _lcc_parse_float(const char *num, float *value) { return 0; }
+static inline char _lcc_parse_double(const char *num, double *value) { return 0; }
+
+#endif
+
+char lcc_literal_eval(lcc_literal_t *self)
+{
+    uintmax_t val;
+    const char *num = self->raw->buf;
+
+    /* already converted, or not a number at all */
+    if (!(self->pending))
+        return 1;
+
+    /* convert by type, integer types saturate like strtol() and strtoul() */
     errno = 0;
-    self->ref = 0;
-    self->src = src;
-    self->prev = self;
-    self->next = self;
-    self->type = LCC_TK_LITERAL;
+    self->pending = 0;
 
     /* parse each type of numbers */
-    switch (type)
+    switch (self->type)
     {
-        /* integers */
-        case LCC_LT_INT        :
-        case LCC_LT_LONG       : self->literal.v_long       = strtol  (num, NULL, _LCC_NUM_BASE(num)); break;
-        case LCC_LT_LONGLONG   : self->literal.v_longlong   = strtoll (num, NULL, _LCC_NUM_BASE(num)); break;
-        case LCC_LT_UINT       :
-        case LCC_LT_ULONG      : self->literal.v_ulong      = strtoul (num, NULL, _LCC_NUM_BASE(num)); break;
-        case LCC_LT_ULONGLONG  : self->literal.v_ulonglong  = strtoull(num, NULL, _LCC_NUM_BASE(num)); break;
+        /* signed integers */
+        case LCC_LT_INT:
+        case LCC_LT_LONG:
+        {
+            if (!(_lcc_parse_int(num, LONG_MAX, &val)))
+                errno = ERANGE;
+
+            self->v_long = (long)val;
+            break;
+        }
+
+        /* signed long long integers */
+        case LCC_LT_LONGLONG:
+        {
+            if (!(_lcc_parse_int(num, LLONG_MAX, &val)))
+                errno = ERANGE;
+
+            self->v_longlong = (long long)val;
+            break;
+        }
+
+        /* unsigned integers */
+        case LCC_LT_UINT:
+        case LCC_LT_ULONG:
+        {
+            if (!(_lcc_parse_int(num, ULONG_MAX, &val)))
+                errno = ERANGE;
+
+            self->v_ulong = (unsigned long)val;
+            break;
+        }
+
+        /* unsigned long long integers */
+        case LCC_LT_ULONGLONG:
+        {
+            if (!(_lcc_parse_int(num, ULLONG_MAX, &val)))
+                errno = ERANGE;
+
+            self->v_ulonglong = (unsigned long long)val;
+            break;
+        }
 
-        /* floats */
-        case LCC_LT_FLOAT      : self->literal.v_float      = strtof  (num, NULL); break;
-        case LCC_LT_DOUBLE     : self->literal.v_double     = strtod  (num, NULL); break;
-        case LCC_LT_LONGDOUBLE : self->literal.v_longdouble = strtold (num, NULL); break;
+        /* floats, fall back to the C library for inexact cases */
+        case LCC_LT_FLOAT:
+        {
+            if (!(_lcc_parse_float(num, &(self->v_float))))
+                self->v_float = strtof(num, NULL);
+
+            break;
+        }
+
+        /* doubles */
+        case LCC_LT_DOUBLE:
+        {
+            if (!(_lcc_parse_double(num, &(self->v_double))))
+                self->v_double = strtod(num, NULL);
+
+            break;
+        }
+
+        /* long doubles, always exact */
+        case LCC_LT_LONGDOUBLE:
+        {
+            self->v_longdouble = strtold(num, NULL);
+            break;
+        }
 
         /* cannot happen */
         case LCC_LT_CHAR:
@@ -558,13 +883,35 @@ lcc_token_t *lcc_token_from_number(lcc_string_t *src, lcc_string_t *value, lcc_l
         }
     }
 
-    /* preserve raw value */
+    /* check for overflow */
+    return errno != ERANGE;
+}
+
+static lcc_token_t *_lcc_token_from_number_lazy(lcc_string_t *src, lcc_string_t *value, lcc_literal_type_t type)
+{
+    /* create a new token */
+    lcc_token_t *self = _lcc_token_alloc();
+
+    /* set as literal, the value is converted on first use */
+    self->ref = 0;
+    self->src = src;
+    self->prev = self;
+    self->next = self;
+    self->type = LCC_TK_LITERAL;
     self->literal.raw = value;
     self->literal.type = type;
+    self->literal.pending = 1;
+    self->literal.v_longdouble = 0;
     return self;
 }
 
-#undef _LCC_NUM_BASE
+lcc_token_t *lcc_token_from_number(lcc_string_t *src, lcc_string_t *value, lcc_literal_type_t type)
+{
+    /* create and convert immediately, sets errno to ERANGE on overflow */
+    lcc_token_t *self = _lcc_token_from_number_lazy(src, value, type);
+    lcc_literal_eval(&(self->literal));
+    return self;
+}
 
 const char *lcc_token_kw_name(lcc_keyword_t value)
 {
@@ -761,24 +1108,191 @@ lcc_string_t *lcc_token_repr(lcc_token_t *self)
 static const lcc_file_t INVALID_FILE = {
     .col = 0,
     .row = 0,
+    .dev = 0,
+    .ino = 0,
+    .data = NULL,
     .name = NULL,
+    .scan = 0,
+    .size = 0,
     .flags = LCC_FF_INVALID,
+    .guard = NULL,
+    .cache = NULL,
+    .source = NULL,
+    .index = {},
     .lines = {},
     .offset = 0,
     .display = NULL,
+    .guard_level = 0,
+    .guard_state = LCC_FG_INIT,
 };
 
-lcc_file_t lcc_file_open(const char *fname)
+static char _lcc_file_scan_line(lcc_file_t *self)
+{
+    /* all lines are indexed */
+    if (self->scan >= self->size)
+        return 0;
+
+    /* find the next new line character */
+    uint32_t next;
+    const char *p = self->data + self->scan;
+    const char *q = memchr(p, '\n', self->size - self->scan);
+
+    /* the last line might not have a new line character, pretend it has one */
+    if (q)
+        next = (uint32_t)(q - self->data + 1);
+    else
+        next = (uint32_t)(self->size + 1);
+
+    /* add to line index */
+    self->scan = q ? next : self->size;
+    lcc_array_append(&(self->index), &next);
+    return 1;
+}
+
+static lcc_file_t _lcc_file_from_fd(const char *fname, int fd, size_t size)
+{
+    /* line offsets are 32-bit */
+    if (size >= UINT32_MAX)
+    {
+        errno = EFBIG;
+        return INVALID_FILE;
+    }
+
+    /* result file */
+    lcc_file_t result = {
+        .col = 0,
+        .row = 0,
+        .dev = 0,
+        .ino = 0,
+        .data = NULL,
+        .name = lcc_string_from(fname),
+        .scan = 0,
+        .size = size,
+        .flags = LCC_FF_MMAP,
+        .guard = NULL,
+        .cache = NULL,
+        .source = NULL,
+        .index = LCC_ARRAY_STATIC_INIT(sizeof(uint32_t), NULL, NULL),
+        .lines = LCC_STRING_ARRAY_STATIC_INIT,
+        .offset = 1,
+        .display = lcc_string_from(fname),
+        .guard_level = 0,
+        .guard_state = LCC_FG_INIT,
+    };
+
+    /* empty files cannot be mapped, and have no lines at all */
+    if (!size)
+        return result;
+
+    /* map the entire file */
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* check for errors */
+    if (data == MAP_FAILED)
+    {
+        lcc_string_unref(result.name);
+        lcc_string_unref(result.display);
+        return INVALID_FILE;
+    }
+
+    /* the first line always starts at offset 0 */
+    uint32_t first = 0;
+    lcc_array_append(&(result.index), &first);
+
+    /* set the mapped content */
+    result.data = data;
+    return result;
+}
+
+char lcc_file_line(lcc_file_t *self, size_t row, const char **buf, size_t *len)
+{
+    /* lines are stored as strings */
+    if (!(self->flags & LCC_FF_MMAP))
+    {
+        /* get the line at `row` */
+        lcc_string_t *line = lcc_string_array_get(&(self->lines), row);
+
+        /* line out of range */
+        if (!line)
+            return 0;
+
+        /* store the line buffer */
+        *buf = line->buf;
+        *len = line->len;
+        return 1;
+    }
+
+    /* index more lines as needed, the line index has one
+     * more item than the line count, which marks the end of line */
+    while (row + 1 >= self->index.count)
+        if (!(_lcc_file_scan_line(self)))
+            return 0;
+
+    /* line boundary */
+    uint32_t *index = self->index.items;
+    uint32_t begin = index[row];
+    uint32_t end = index[row + 1] - 1;
+
+    /* windows uses "\r\n" as newline delimiter */
+    if ((end > begin) && (self->data[end - 1] == '\r'))
+        end--;
+
+    /* store the line buffer */
+    *buf = self->data + begin;
+    *len = end - begin;
+    return 1;
+}
+
+static lcc_file_t _lcc_file_from_stat(const char *fname, int fd, struct stat *st)
 {
-    /* open file and load from it */
-    FILE *fp = fopen(fname, "rb");
-    lcc_file_t ret = lcc_file_from_file(fname, fp);
+    /* regular files are memory-mapped */
+    lcc_file_t ret;
+    FILE *fp = NULL;
+
+    /* otherwise load it line by line */
+    if (S_ISREG(st->st_mode))
+        ret = _lcc_file_from_fd(fname, fd, (size_t)st->st_size);
+    else if ((fp = fdopen(fd, "rb")))
+        ret = lcc_file_from_file(fname, fp);
+    else
+        ret = INVALID_FILE;
 
     /* close file */
     if (fp) fclose(fp);
+    else close(fd);
+
+    /* check for errors */
+    if (ret.flags & LCC_FF_INVALID)
+        return ret;
+
+    /* record the file identity */
+    ret.dev = st->st_dev;
+    ret.ino = st->st_ino;
+    ret.flags |= LCC_FF_IDENT;
     return ret;
 }
 
+lcc_file_t lcc_file_open(const char *fname)
+{
+    /* open the file */
+    int fd = open(fname, O_RDONLY);
+    struct stat st;
+
+    /* check for errors */
+    if (fd < 0)
+        return INVALID_FILE;
+
+    /* read the file info */
+    if (fstat(fd, &st))
+    {
+        close(fd);
+        return INVALID_FILE;
+    }
+
+    /* load the file */
+    return _lcc_file_from_stat(fname, fd, &st);
+}
+
 lcc_file_t lcc_file_from_file(const char *fname, FILE *fp)
 {
     /* check for file pointer */
@@ -789,11 +1303,22 @@ lcc_file_t lcc_file_from_file(const char *fname, FILE *fp)
     lcc_file_t result = {
         .col = 0,
         .row = 0,
+        .dev = 0,
+        .ino = 0,
+        .data = NULL,
         .name = lcc_string_from(fname),
+        .scan = 0,
+        .size = 0,
         .flags = 0,
+        .guard = NULL,
+        .cache = NULL,
+        .source = NULL,
+        .index = {},
         .lines = LCC_STRING_ARRAY_STATIC_INIT,
         .offset = 1,
         .display = lcc_string_from(fname),
+        .guard_level = 0,
+        .guard_state = LCC_FG_INIT,
     };
 
     /* line buffer and line size */
@@ -847,11 +1372,22 @@ lcc_file_t lcc_file_from_string(const char *fname, const char *data, size_t size
     lcc_file_t result = {
         .col = 0,
         .row = 0,
+        .dev = 0,
+        .ino = 0,
+        .data = NULL,
         .name = lcc_string_from(fname),
+        .scan = 0,
+        .size = 0,
         .flags = 0,
+        .guard = NULL,
+        .cache = NULL,
+        .source = NULL,
+        .index = {},
         .lines = LCC_STRING_ARRAY_STATIC_INIT,
         .offset = 1,
         .display = lcc_string_from(fname),
+        .guard_level = 0,
+        .guard_state = LCC_FG_INIT,
     };
 
     /* split every line */
@@ -878,22 +1414,296 @@ lcc_file_t lcc_file_from_string(const char *fname, const char *data, size_t size
     return result;
 }
 
-/*** Token Buffer ***/
-
-void lcc_token_buffer_free(lcc_token_buffer_t *self)
+static inline lcc_string_t *_lcc_file_key(dev_t dev, ino_t ino)
 {
-    free(self->buf);
-    self->buf = NULL;
-    self->len = self->cap = 0;
+    return lcc_string_from_format(
+        "%llx:%llx",
+        (unsigned long long)dev,
+        (unsigned long long)ino
+    );
 }
 
-void lcc_token_buffer_init(lcc_token_buffer_t *self)
-{
-    self->len = 0;
-    self->cap = 256;
-    self->buf = malloc(self->cap + 1);
-    self->buf[0] = 0;
-}
+/*** Source Cache ***/
+
+struct _lcc_source_t
+{
+    long ref;
+    size_t cost;            /* bytes counted against the cache limit */
+    lcc_string_t *key;      /* owned by the cache map */
+
+    /* file identity and modification time */
+    dev_t dev;
+    ino_t ino;
+    size_t size;
+    struct timespec mtime;
+
+    /* memory-mapped content, and the complete line index */
+    char *data;
+    lcc_array_t index;
+
+    /* recently used list, most recently used first */
+    struct _lcc_source_t *prev;
+    struct _lcc_source_t *next;
+};
+
+static void _lcc_source_unref(struct _lcc_source_t *self)
+{
+    /* the last user releases the content */
+    if (!(__atomic_sub_fetch(&(self->ref), 1, __ATOMIC_ACQ_REL)))
+    {
+        munmap(self->data, self->size);
+        lcc_array_free(&(self->index));
+        free(self);
+    }
+}
+
+static void _lcc_source_unlink(lcc_source_cache_t *self, struct _lcc_source_t *src)
+{
+    /* remove from the recently used list */
+    if (src->prev) src->prev->next = src->next;
+    else self->head = src->next;
+    if (src->next) src->next->prev = src->prev;
+    else self->tail = src->prev;
+
+    /* clear the links */
+    src->prev = NULL;
+    src->next = NULL;
+}
+
+static void _lcc_source_link(lcc_source_cache_t *self, struct _lcc_source_t *src)
+{
+    /* add to the front of recently used list */
+    src->prev = NULL;
+    src->next = self->head;
+
+    /* update the list ends */
+    if (self->head) self->head->prev = src;
+    else self->tail = src;
+
+    /* the new head */
+    self->head = src;
+}
+
+static void _lcc_source_evict(lcc_source_cache_t *self, struct _lcc_source_t *src)
+{
+    /* remove from cache, the content lives until the last user is done */
+    self->size -= src->cost;
+    _lcc_source_unlink(self, src);
+    lcc_map_pop(&(self->files), src->key, NULL);
+    _lcc_source_unref(src);
+}
+
+static struct _lcc_source_t *_lcc_source_find(lcc_source_cache_t *self, lcc_string_t *key, struct stat *st)
+{
+    /* find the cached file, must be locked */
+    struct _lcc_source_t **src;
+    if (!(lcc_map_get(&(self->files), key, (void **)&src)))
+        return NULL;
+
+    /* the file was changed since cached */
+    if (((*src)->size != (size_t)st->st_size) ||
+        ((*src)->mtime.tv_sec != st->st_mtim.tv_sec) ||
+        ((*src)->mtime.tv_nsec != st->st_mtim.tv_nsec))
+    {
+        self->stale++;
+        _lcc_source_evict(self, *src);
+        return NULL;
+    }
+
+    /* mark as recently used */
+    _lcc_source_unlink(self, *src);
+    _lcc_source_link(self, *src);
+
+    /* add a reference for the caller */
+    __atomic_add_fetch(&((*src)->ref), 1, __ATOMIC_RELAXED);
+    return *src;
+}
+
+static lcc_file_t _lcc_file_from_source(const char *fname, struct _lcc_source_t *src)
+{
+    /* the line index is shared, and already complete */
+    lcc_file_t result = {
+        .col = 0,
+        .row = 0,
+        .dev = src->dev,
+        .ino = src->ino,
+        .data = src->data,
+        .name = lcc_string_from(fname),
+        .scan = src->size,
+        .size = src->size,
+        .flags = LCC_FF_MMAP | LCC_FF_IDENT,
+        .guard = NULL,
+        .cache = NULL,
+        .source = src,
+        .index = src->index,
+        .lines = LCC_STRING_ARRAY_STATIC_INIT,
+        .offset = 1,
+        .display = lcc_string_from(fname),
+        .guard_level = 0,
+        .guard_state = LCC_FG_INIT,
+    };
+
+    /* file with shared content */
+    return result;
+}
+
+void lcc_source_cache_free(lcc_source_cache_t *self)
+{
+    /* files still in use are released by their last user */
+    while (self->head)
+        _lcc_source_evict(self, self->head);
+
+    /* clear the map and lock */
+    lcc_map_free(&(self->files));
+    pthread_mutex_destroy(&(self->lock));
+}
+
+void lcc_source_cache_init(lcc_source_cache_t *self, size_t limit)
+{
+    /* cached files, keyed by file identity */
+    pthread_mutex_init(&(self->lock), NULL);
+    lcc_map_init(&(self->files), sizeof(struct _lcc_source_t *), NULL, NULL);
+
+    /* recently used list */
+    self->head = NULL;
+    self->tail = NULL;
+    self->size = 0;
+    self->limit = limit;
+
+    /* statistics */
+    self->hits = 0;
+    self->misses = 0;
+    self->stale = 0;
+    self->evictions = 0;
+}
+
+lcc_file_t lcc_source_cache_open(lcc_source_cache_t *self, const char *fname)
+{
+    /* open the file */
+    struct stat st;
+    int fd = open(fname, O_RDONLY);
+
+    /* check for errors */
+    if (fd < 0)
+        return INVALID_FILE;
+
+    /* read the file info */
+    if (fstat(fd, &st))
+    {
+        close(fd);
+        return INVALID_FILE;
+    }
+
+    /* only non-empty regular files are shared */
+    if (!(S_ISREG(st.st_mode)) || !(st.st_size))
+        return _lcc_file_from_stat(fname, fd, &st);
+
+    /* find in cache */
+    lcc_string_t *key;
+    struct _lcc_source_t *src;
+
+    /* keys are only touched with the lock held */
+    pthread_mutex_lock(&(self->lock));
+    key = _lcc_file_key(st.st_dev, st.st_ino);
+    src = _lcc_source_find(self, key, &st);
+
+    /* found in cache */
+    if (src)
+    {
+        self->hits++;
+        lcc_string_unref(key);
+        pthread_mutex_unlock(&(self->lock));
+        close(fd);
+        return _lcc_file_from_source(fname, src);
+    }
+
+    /* map the file without the lock */
+    pthread_mutex_unlock(&(self->lock));
+    lcc_file_t file = _lcc_file_from_fd(fname, fd, (size_t)st.st_size);
+    close(fd);
+
+    /* check for errors */
+    if (file.flags & LCC_FF_INVALID)
+    {
+        pthread_mutex_lock(&(self->lock));
+        lcc_string_unref(key);
+        pthread_mutex_unlock(&(self->lock));
+        return file;
+    }
+
+    /* index every line, so the index never changes afterwards */
+    while (_lcc_file_scan_line(&file));
+    lcc_array_shrink_to_fit(&(file.index));
+
+    /* move the content into the shared object, one reference for the cache, one for the caller */
+    src = malloc(sizeof(struct _lcc_source_t));
+    src->ref = 2;
+    src->cost = file.size + file.index.count * sizeof(uint32_t);
+    src->key = key;
+    src->dev = st.st_dev;
+    src->ino = st.st_ino;
+    src->size = file.size;
+    src->mtime = st.st_mtim;
+    src->data = file.data;
+    src->index = file.index;
+    src->prev = NULL;
+    src->next = NULL;
+
+    /* the file object is no longer needed */
+    lcc_string_unref(file.name);
+    lcc_string_unref(file.display);
+
+    /* another thread may have loaded the same file meanwhile */
+    struct _lcc_source_t *old;
+    pthread_mutex_lock(&(self->lock));
+
+    /* use that one instead */
+    if ((old = _lcc_source_find(self, key, &st)))
+    {
+        self->hits++;
+        lcc_string_unref(key);
+        pthread_mutex_unlock(&(self->lock));
+        munmap(src->data, src->size);
+        lcc_array_free(&(src->index));
+        free(src);
+        return _lcc_file_from_source(fname, old);
+    }
+
+    /* add to cache */
+    self->misses++;
+    self->size += src->cost;
+    _lcc_source_link(self, src);
+    lcc_map_set(&(self->files), key, NULL, &src);
+    lcc_string_unref(key);
+
+    /* evict least recently used files until it fits, except the new one */
+    while ((self->size > self->limit) && (self->tail != src))
+    {
+        self->evictions++;
+        _lcc_source_evict(self, self->tail);
+    }
+
+    /* file with shared content */
+    pthread_mutex_unlock(&(self->lock));
+    return _lcc_file_from_source(fname, src);
+}
+
+/*** Token Buffer ***/
+
+void lcc_token_buffer_free(lcc_token_buffer_t *self)
+{
+    free(self->buf);
+    self->buf = NULL;
+    self->len = self->cap = 0;
+}
+
+void lcc_token_buffer_init(lcc_token_buffer_t *self)
+{
+    self->len = 0;
+    self->cap = 256;
+    self->buf = malloc(self->cap + 1);
+    self->buf[0] = 0;
+}
 
 void lcc_token_buffer_reset(lcc_token_buffer_t *self)
 {
@@ -915,6 +1725,21 @@ void lcc_token_buffer_append(lcc_token_buffer_t *self, char ch)
     self->buf[++self->len] = 0;
 }
 
+void lcc_token_buffer_append_from_size(lcc_token_buffer_t *self, const char *buf, size_t size)
+{
+    /* check buffer length */
+    while (self->len + size > self->cap)
+    {
+        self->cap *= 2;
+        self->buf = realloc(self->buf, self->cap + 1);
+    }
+
+    /* append to buffer */
+    memcpy(self->buf + self->len, buf, size);
+    self->len += size;
+    self->buf[self->len] = 0;
+}
+
 /*** Lexer Object ***/
 
 typedef char (_lcc_macro_extension_fn)(
@@ -934,12 +1759,33 @@ typedef struct __lcc_sym_t
     _lcc_macro_extension_fn *ext;
 } _lcc_sym_t;
 
+struct _lcc_psyms_t
+{
+    long ref;
+    lcc_map_t syms;
+    lcc_array_t owned;                  /* symbols frozen by this table */
+    lcc_array_t strings;                /* strings frozen by this table */
+    struct _lcc_psyms_t *parent;        /* inherited symbols are owned by the parent */
+
+    /* source locations of the symbol bodies, copied into every lexer */
+    uint32_t loc;
+    lcc_array_t loc_lines;
+    lcc_string_array_t loc_names;
+};
+
 typedef struct __lcc_val_t
 {
     char discard;
     intmax_t value;
 } _lcc_val_t;
 
+typedef struct __lcc_include_t
+{
+    dev_t dev;
+    ino_t ino;
+    lcc_string_t *path;
+} _lcc_include_t;
+
 typedef struct __lcc_keyword_item_t
 {
     const char *name;
@@ -1013,9 +1859,78 @@ static const _lcc_directive_bits_t DIRECTIVES[] = {
     { 0 },
 };
 
+static void _lcc_loc_line(lcc_lexer_t *self, lcc_file_t *file, size_t row, size_t col)
+{
+    /* locations must fit in 32 bits */
+    if (self->loc >= UINT32_MAX - LCC_LEXER_MAX_LINE_LEN - 1)
+    {
+        fprintf(stderr, "*** FATAL: source location overflow\n");
+        abort();
+    }
+
+    /* display name changed (new file or "#line" directive) */
+    if (lcc_string_array_top(&(self->loc_names)) != file->display)
+        lcc_string_array_append(&(self->loc_names), lcc_string_ref(file->display));
+
+    /* new line starts right after the last character */
+    lcc_lexer_line_t line = {
+        .loc  = self->loc + 1,
+        .col  = (uint32_t)col,
+        .row  = (uint32_t)(row + file->offset),
+        .name = (uint32_t)(self->loc_names.array.count - 1),
+    };
+
+    /* add to line table */
+    lcc_array_append(&(self->loc_lines), &line);
+
+    /* characters are located relative to column 0 */
+    self->loc_row = row;
+    self->loc_file = file;
+    self->loc_base = line.loc - line.col;
+}
+
+char lcc_lexer_locate(lcc_lexer_t *self, uint32_t loc, lcc_string_t **file, size_t *row, size_t *col)
+{
+    /* binary search for the last line that starts before `loc` */
+    size_t lo = 0;
+    size_t hi = self->loc_lines.count;
+    lcc_lexer_line_t *lines = self->loc_lines.items;
+
+    /* lines are sorted by location */
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lines[mid].loc <= loc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    /* unknown location */
+    if (!loc || !lo)
+    {
+        if (row) *row = 0;
+        if (col) *col = 0;
+        if (file) *file = lcc_string_array_get(&(self->loc_names), 0);
+        return 0;
+    }
+
+    /* decode from that line */
+    if (row) *row = lines[lo - 1].row;
+    if (col) *col = loc - lines[lo - 1].loc + lines[lo - 1].col + 1;
+    if (file) *file = lcc_string_array_get(&(self->loc_names), lines[lo - 1].name);
+    return 1;
+}
+
+/* strerror() may share a static buffer between threads, the buffer lives until the end of the block */
+#define _LCC_STRERROR(err)      (strerror_r((err), (char [128]){ 0 }, 128))
+
 static void _lcc_lexer_error(lcc_lexer_t *self, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 static void _lcc_lexer_error(lcc_lexer_t *self, const char *fmt, ...)
 {
+    /* count every diagnostic, even if not reported */
+    self->diags++;
+
     /* invoke the error handler if any */
     if (self->error_fn)
     {
@@ -1024,12 +1939,18 @@ static void _lcc_lexer_error(lcc_lexer_t *self, const char *fmt, ...)
         va_start(args, fmt);
         lcc_string_t *message = lcc_string_from_format_va(fmt, args);
 
+        /* decode the current location */
+        size_t row;
+        size_t col;
+        lcc_string_t *fname;
+        lcc_lexer_locate(self, self->loc, &fname, &row, &col);
+
         /* invoke the error handler */
         self->error_fn(
             self,
-            self->fname,
-            self->row,
-            self->col,
+            fname,
+            row,
+            col,
             message,
             LCC_LXET_ERROR,
             self->error_data
@@ -1047,6 +1968,9 @@ static void _lcc_lexer_error(lcc_lexer_t *self, const char *fmt, ...)
 static void _lcc_lexer_warning(lcc_lexer_t *self, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 static void _lcc_lexer_warning(lcc_lexer_t *self, const char *fmt, ...)
 {
+    /* count every diagnostic, even if not reported */
+    self->diags++;
+
     /* invoke the error handler if any */
     if (self->error_fn)
     {
@@ -1055,12 +1979,18 @@ static void _lcc_lexer_warning(lcc_lexer_t *self, const char *fmt, ...)
         va_start(args, fmt);
         lcc_string_t *message = lcc_string_from_format_va(fmt, args);
 
+        /* decode the current location */
+        size_t row;
+        size_t col;
+        lcc_string_t *fname;
+        lcc_lexer_locate(self, self->loc, &fname, &row, &col);
+
         /* invoke the error handler */
         self->error_fn(
             self,
-            self->fname,
-            self->row,
-            self->col,
+            fname,
+            row,
+            col,
             message,
             LCC_LXET_WARNING,
             self->error_data
@@ -1105,5272 +2035,8381 @@ static char _lcc_error_default(
         _lcc_lexer_error(self, msg " '\\x%02x'", (uint8_t)(self->ch));  \
 }
 
-static inline lcc_string_t *_lcc_dump_token(lcc_lexer_t *self)
+static inline lcc_string_t *_lcc_intern_string(lcc_lexer_t *self, lcc_string_t *str)
 {
-    char *p = self->token_buffer.buf;
-    size_t n = self->token_buffer.len;
-    return lcc_string_from_buffer(p, n);
+    /* already interned, use the existing one */
+    lcc_string_t *old;
+    if (lcc_set_find(&(self->idents), str, &old))
+    {
+        lcc_string_unref(str);
+        return lcc_string_ref(old);
+    }
+
+    /* add to intern pool */
+    lcc_set_add(&(self->idents), str);
+    return str;
 }
 
-static inline lcc_string_t *_lcc_swap_source(lcc_lexer_t *self, char keep_tail)
+static inline lcc_string_t *_lcc_intern_buffer(lcc_lexer_t *self, const char *buf, size_t len)
 {
-    /* old and new strings */
-    lcc_string_t *old = self->source;
-    lcc_string_t *new = lcc_string_new(0);
+    /* a temporary key on stack, no need for allocation */
+    lcc_string_t *old;
+    lcc_string_t key = {
+        .ref = 1,
+        .buf = (char *)buf,
+        .len = len,
+        .hash = 0,
+    };
 
-    /* remove last char as needed */
-    if (old->len && !keep_tail)
-        old->buf[--old->len] = 0;
+    /* already interned, use the existing one */
+    if (lcc_set_find(&(self->idents), &key, &old))
+        return lcc_string_ref(old);
 
-    /* reset the source buffer */
-    self->source = new;
-    return old;
+    /* create a new string, the hash is already calculated */
+    lcc_string_t *str = lcc_string_from_buffer(buf, len);
+    str->hash = key.hash;
+
+    /* add to intern pool */
+    lcc_set_add(&(self->idents), str);
+    return str;
 }
 
-static inline char _lcc_commit_ident(lcc_lexer_t *self, char keep_tail)
+static inline lcc_string_t *_lcc_intern_from(lcc_lexer_t *self, const char *str)
 {
-    /* check for preprocessor reserved identifiers */
-    if ((!(self->flags & LCC_LXDF_DEFINE_VAR) ||                /* must be variadic macro */
-          (self->flags & LCC_LXDF_DEFINE_NVAR) ||               /* but must not be named variadic macro */
-         !(self->flags & LCC_LXDF_DEFINE_FINE)) &&              /* must finish parsing the declaration */
-        (!(strcmp(self->token_buffer.buf, "__VA_ARGS__")) ||    /* must not be "__VA_ARGS__" */
-         ((self->gnuext & LCC_LX_GNUX_VA_OPT_MACRO) &&          /* with "__VA_OPT__" extension enabled, */
-          !(strcmp(self->token_buffer.buf, "__VA_OPT__")))))    /* must not be "__VA_OPT__" */
-    {
-        _lcc_lexer_error(self, "'%s' is not allowed here", self->token_buffer.buf);
-        return 0;
-    }
+    size_t len = strlen(str);
+    return _lcc_intern_buffer(self, str, len);
+}
 
-    /* create a new token */
-    lcc_token_t *token = lcc_token_from_ident(
-        _lcc_swap_source(self, keep_tail),
-        _lcc_dump_token(self)
-    );
+static inline ssize_t _lcc_arg_index(lcc_string_array_t *args, lcc_string_t *name)
+{
+    /* identifiers are interned, compare by pointers */
+    for (size_t i = 0; i < args->array.count; i++)
+        if (lcc_string_array_get(args, i) == name)
+            return i;
 
-    /* attach to token chain */
-    lcc_token_attach(&(self->tokens), token);
-    lcc_token_buffer_reset(&(self->token_buffer));
-    return 1;
+    /* not found */
+    return -1;
 }
 
-static inline void _lcc_commit_chars(lcc_lexer_t *self, char keep_tail)
-{
-    /* create a new token */
-    lcc_token_t *token = lcc_token_from_char(
-        _lcc_swap_source(self, keep_tail),
-        _lcc_dump_token(self),
-        (self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR) != 0
-    );
+/** Token Cache **/
 
-    /* check for multi-character constant */
-    if (token->literal.v_char->len > 1)
-        _lcc_lexer_warning(self, "Multi-character character constant");
+#define LCC_TC_MAGIC            "LCCTC001"
+#define LCC_TCL_VALID           0x00000001      /* line can be replayed */
+#define LCC_TCL_EOL             0x00000002      /* last token is terminated by the line ending */
 
-    /* attach to token chain */
-    lcc_token_attach(&(self->tokens), token);
-    lcc_token_buffer_reset(&(self->token_buffer));
-}
+/* cache files are mapped directly, laid out as the header, the source path
+ * (padded to 8 bytes), one line record per row, the tokens, and the string pool */
+typedef struct __lcc_tc_header_t
+{
+    char magic[8];
+    uint64_t size;
+    uint64_t hash;
+    uint64_t check;         /* hash of everything after the header */
+    int64_t mtime;
+    int64_t mtime_ns;
+    uint32_t gnuext;
+    uint32_t path;
+    uint32_t lines;
+    uint32_t tokens;
+    uint32_t strings;
+    uint32_t reserved;
+} _lcc_tc_header_t;
+
+typedef struct __lcc_tc_line_t
+{
+    uint32_t flags;
+    uint32_t first;         /* index of the first token */
+    uint32_t count;
+    uint32_t lead;          /* source left over from previous lines */
+    uint32_t lead_len;
+    uint32_t tail;          /* source left over after this line */
+    uint32_t tail_len;
+    uint32_t reserved;
+} _lcc_tc_line_t;
+
+typedef struct __lcc_tc_token_t
+{
+    uint8_t type;
+    uint8_t kind;           /* operator or literal type */
+    uint16_t col;           /* column where the token starts */
+    uint16_t acol;          /* column where the token was committed */
+    uint16_t reserved;
+    uint32_t src;
+    uint32_t src_len;
+    uint32_t val;           /* identifier name, or literal contents */
+    uint32_t val_len;
+} _lcc_tc_token_t;
+
+struct _lcc_file_cache_t
+{
+    /* cache file and it's key */
+    lcc_string_t *path;
+    lcc_string_t *fname;
+    _lcc_tc_header_t key;
+
+    /* mapped cache file, either replayed or verified */
+    char *map;
+    size_t map_size;
+    size_t nlines;
+    const char *strings;
+    const _lcc_tc_line_t *lines;
+    const _lcc_tc_token_t *tokens;
+
+    /* replay cursor, only lines starting right after a line ending are cached */
+    char replay;
+    size_t next;
+    size_t clean;
+    const _lcc_tc_line_t *line;
+
+    /* recorder, written out when the file is done */
+    char record;
+    char active;
+    size_t row;
+    size_t diags;
+    size_t ntokens;         /* tokens and strings of complete lines */
+    size_t nstrings;
+    size_t mismatches;
+    _lcc_tc_line_t current;
+    lcc_array_t rec_lines;
+    lcc_array_t rec_tokens;
+    lcc_token_buffer_t rec_strings;
+};
 
-static inline void _lcc_commit_string(lcc_lexer_t *self, char keep_tail)
+char lcc_token_cache_init(lcc_token_cache_t *self, const char *path, int flags)
 {
-    /* create a new token */
-    lcc_token_t *token = lcc_token_from_string(
-        _lcc_swap_source(self, keep_tail),
-        _lcc_dump_token(self),
-        (self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR) != 0
-    );
+    /* create the cache directory as needed */
+    struct stat st;
+    if (mkdir(path, 0777) && (errno != EEXIST))
+        return 0;
 
-    /* attach to token chain */
-    lcc_token_attach(&(self->tokens), token);
-    lcc_token_buffer_reset(&(self->token_buffer));
+    /* must be a directory */
+    if (stat(path, &st) || !(S_ISDIR(st.st_mode)))
+        return 0;
+
+    /* cache options */
+    self->flags = flags;
+    self->path = lcc_string_from(path);
+
+    /* statistics */
+    self->hits = 0;
+    self->misses = 0;
+    self->stale = 0;
+    self->lines = 0;
+    self->stores = 0;
+    self->mismatches = 0;
+    self->leads = 0;
+    return 1;
 }
 
-static inline void _lcc_commit_number(lcc_lexer_t *self, lcc_literal_type_t type, char keep_tail)
+void lcc_token_cache_free(lcc_token_cache_t *self)
 {
-    /* create new tokens */
-    lcc_token_t *token = lcc_token_from_number(
-        _lcc_swap_source(self, keep_tail),
-        _lcc_dump_token(self),
-        type
-    );
-
-    /* check for overflow */
-    if (errno == ERANGE)
-        _lcc_lexer_warning(self, "Literal %s is out of range", self->token_buffer.buf);
-
-    /* attach to token chain */
-    lcc_token_attach(&(self->tokens), token);
-    lcc_token_buffer_reset(&(self->token_buffer));
+    lcc_string_unref(self->path);
 }
 
-static inline void _lcc_commit_operator(lcc_lexer_t *self, lcc_operator_t operator, char keep_tail)
+static void _lcc_tc_free(struct _lcc_file_cache_t *self)
 {
-    lcc_string_t *src = _lcc_swap_source(self, keep_tail);
-    lcc_token_attach(&(self->tokens), lcc_token_from_operator(src, operator));
+    /* release the mapping */
+    if (self->map)
+        munmap(self->map, self->map_size);
+
+    /* release the recorder */
+    lcc_array_free(&(self->rec_lines));
+    lcc_array_free(&(self->rec_tokens));
+    lcc_token_buffer_free(&(self->rec_strings));
+
+    /* release the names */
+    lcc_string_unref(self->path);
+    lcc_string_unref(self->fname);
+    free(self);
 }
 
-static void _lcc_handle_substate(lcc_lexer_t *self)
+static char _lcc_tc_check(struct _lcc_file_cache_t *self)
 {
-    /* check for EOF and EOL flags */
-    if ((self->flags & LCC_LXF_EOF) ||
-        (self->flags & LCC_LXF_EOL))
-    {
-        /* check for sub-state */
-        switch (self->substate)
-        {
-            /* in the middle of nothing, just ignore it */
-            case LCC_LX_SUBSTATE_NULL:
-                break;
+    /* header and path must match the source file exactly */
+    size_t base;
+    const _lcc_tc_header_t *hdr = (const _lcc_tc_header_t *)self->map;
+
+    /* compare the key */
+    if (memcmp(hdr->magic, self->key.magic, sizeof(hdr->magic)) ||
+        (hdr->size != self->key.size) ||
+        (hdr->hash != self->key.hash) ||
+        (hdr->mtime != self->key.mtime) ||
+        (hdr->mtime_ns != self->key.mtime_ns) ||
+        (hdr->gnuext != self->key.gnuext) ||
+        (hdr->path != self->key.path))
+        return 0;
 
-            /* clear source buffer when line comment ends */
-            case LCC_LX_SUBSTATE_COMMENT_LINE:
-            {
-                self->source->len = 0;
-                self->source->buf[0] = 0;
-                break;
-            }
+    /* sections must fit the file exactly */
+    base = (sizeof(_lcc_tc_header_t) + hdr->path + 7) & ~(size_t)7;
+    self->nlines = hdr->lines;
 
-            /* block comment */
-            case LCC_LX_SUBSTATE_COMMENT_BLOCK:
-            case LCC_LX_SUBSTATE_COMMENT_BLOCK_END:
-            {
-                /* fire a warning when meets EOF */
-                if (self->flags & LCC_LXF_EOF)
-                {
-                    _lcc_lexer_warning(self, "EOF when parsing block comment");
-                    break;
-                }
+    /* check for file size */
+    if (base + hdr->lines * sizeof(_lcc_tc_line_t) + hdr->tokens * sizeof(_lcc_tc_token_t) + hdr->strings != self->map_size)
+        return 0;
 
-                /* otherwise shift pass the line ending */
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK;
-                return;
-            }
+    /* check for source path */
+    if (memcmp(self->map + sizeof(_lcc_tc_header_t), self->path->buf, self->path->len))
+        return 0;
 
-            /* in the middle of parsing identifiers, accept or commit it */
-            case LCC_LX_SUBSTATE_NAME:
-            {
-                if (_lcc_commit_ident(self, 1))
-                    break;
-                else
-                    return;
-            }
+    /* check for content corruption */
+    lcc_string_t body = {
+        .ref  = -1,
+        .buf  = self->map + sizeof(_lcc_tc_header_t),
+        .len  = self->map_size - sizeof(_lcc_tc_header_t),
+        .hash = 0,
+    };
 
-            /* in the middle of parsing tokens */
-            case LCC_LX_SUBSTATE_STRING:
-            case LCC_LX_SUBSTATE_STRING_ESCAPE:
-            case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX:
-            case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_D:
-            case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_E:
-            case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_2:
-            case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3:
-            case LCC_LX_SUBSTATE_INCLUDE_FILE:
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN:
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX:
-            case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI:
-            case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP_SIGN:
-            case LCC_LX_SUBSTATE_OPERATOR_ELLIPSIS:
-            {
-                /* not a directive, it's an error */
-                if (!(self->flags & LCC_LXF_DIRECTIVE))
-                {
-                    _lcc_lexer_error(self, "Unexpected %s", (self->flags & LCC_LXF_EOF) ? "EOF" : "EOL");
-                    return;
-                }
+    /* the content hash must match */
+    if (lcc_string_hash(&body) != hdr->check)
+        return 0;
 
-                /* commit as string, but give a warning */
-                _lcc_commit_string(self, 1);
-                _lcc_lexer_warning(self, "Invalid preprocessor token");
-                break;
-            }
+    /* locate each section */
+    self->lines = (const _lcc_tc_line_t *)(self->map + base);
+    self->tokens = (const _lcc_tc_token_t *)(self->lines + hdr->lines);
+    self->strings = (const char *)(self->tokens + hdr->tokens);
 
-            /* in the middle of parsing integers */
-            case LCC_LX_SUBSTATE_NUMBER:
-            case LCC_LX_SUBSTATE_NUMBER_ZERO:
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D:
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D:
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT:
-            {
-                _lcc_commit_number(self, LCC_LT_INT, 1);
-                break;
-            }
+    /* every line must be in range */
+    for (size_t i = 0; i < hdr->lines; i++)
+    {
+        const _lcc_tc_line_t *line = &(self->lines[i]);
 
-            /* in the middle of parsing integers (unsigned) */
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_U:
-            {
-                _lcc_commit_number(self, LCC_LT_UINT, 1);
-                break;
-            }
+        /* invalid lines are never used */
+        if (!(line->flags & LCC_TCL_VALID))
+            continue;
 
-            /* in the middle of parsing integers (long) */
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_L:
-            {
-                _lcc_commit_number(self, LCC_LT_LONG, 1);
-                break;
-            }
+        /* check for tokens and sources */
+        if (((size_t)line->first + line->count > hdr->tokens) ||
+            ((size_t)line->lead + line->lead_len > hdr->strings) ||
+            ((size_t)line->tail + line->tail_len > hdr->strings))
+            return 0;
+    }
 
-            /* in the middle of parsing integers (unsigned long) */
-            case LCC_LX_SUBSTATE_NUMBER_INTEGER_UL:
-            {
-                _lcc_commit_number(self, LCC_LT_ULONG, 1);
-                break;
-            }
+    /* so does every token */
+    for (size_t i = 0; i < hdr->tokens; i++)
+    {
+        const _lcc_tc_token_t *token = &(self->tokens[i]);
 
-            /* in the middle of parsing floats (double) */
-            case LCC_LX_SUBSTATE_NUMBER_DECIMAL:
-            case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP:
-            {
-                _lcc_commit_number(self, LCC_LT_DOUBLE, 1);
-                break;
-            }
+        /* check for sources and values */
+        if ((token->acol >= LCC_LEXER_MAX_LINE_LEN) ||
+            ((size_t)token->src + token->src_len > hdr->strings) ||
+            ((size_t)token->val + token->val_len > hdr->strings))
+            return 0;
 
-            /* in the middle of parsing operators, accept or commit what already got */
-            case LCC_LX_SUBSTATE_NUMBER_OR_OP     : _lcc_commit_operator(self, LCC_OP_POINT     , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_PLUS    : _lcc_commit_operator(self, LCC_OP_PLUS      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_MINUS   : _lcc_commit_operator(self, LCC_OP_MINUS     , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_STAR    : _lcc_commit_operator(self, LCC_OP_STAR      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_SLASH   : _lcc_commit_operator(self, LCC_OP_SLASH     , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_PERCENT : _lcc_commit_operator(self, LCC_OP_PERCENT   , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_EQU     : _lcc_commit_operator(self, LCC_OP_ASSIGN    , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_GT      : _lcc_commit_operator(self, LCC_OP_GT        , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_GT_GT   : _lcc_commit_operator(self, LCC_OP_BSHR      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_LT      : _lcc_commit_operator(self, LCC_OP_LT        , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_LT_LT   : _lcc_commit_operator(self, LCC_OP_BSHL      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_EXCL    : _lcc_commit_operator(self, LCC_OP_LNOT      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_AMP     : _lcc_commit_operator(self, LCC_OP_BAND      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_BAR     : _lcc_commit_operator(self, LCC_OP_BOR       , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_CARET   : _lcc_commit_operator(self, LCC_OP_BXOR      , 1); break;
-            case LCC_LX_SUBSTATE_OPERATOR_HASH    : _lcc_commit_operator(self, LCC_OP_STRINGIZE , 1); break;
+        /* check for token types */
+        switch (token->type)
+        {
+            case LCC_TK_IDENT    : break;
+            case LCC_TK_LITERAL  : if (token->kind > LCC_LT_STRING) return 0; break;
+            case LCC_TK_OPERATOR : if (token->kind > LCC_OP_CONCAT) return 0; break;
+            default              : return 0;
         }
+    }
 
-        /* EOF or EOL when parsing compiler directive, commit it */
-        if (self->flags & LCC_LXF_DIRECTIVE)
-            self->state = LCC_LX_STATE_COMMIT;
-        else
-            self->state = LCC_LX_STATE_ACCEPT;
+    /* the cache file is valid */
+    return 1;
+}
 
-        /* clear those flags */
-        self->flags &= ~LCC_LXF_EOF;
-        self->flags &= ~LCC_LXF_EOL;
-        return;
-    }
+static char _lcc_tc_load(struct _lcc_file_cache_t *self, char *stale)
+{
+    /* open the cache file */
+    struct stat st;
+    int fd = open(self->fname->buf, O_RDONLY);
 
-    /* check for sub-state */
-    switch (self->substate)
+    /* no cache for this file yet */
+    if (fd < 0)
+        return 0;
+
+    /* it exists, but may not be usable */
+    *stale = 1;
+
+    /* must have a complete header */
+    if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(_lcc_tc_header_t)))
     {
-        /* initial sub-state */
-        case LCC_LX_SUBSTATE_NULL:
-        {
-            /* check for character */
-            switch (self->ch)
-            {
-                /* identifiers */
-                case '_':
-                case 'a' ... 'z':
-                case 'A' ... 'Z':
-                {
-                    self->substate = LCC_LX_SUBSTATE_NAME;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+        close(fd);
+        return 0;
+    }
 
-                /* chars */
-                case '\'':
-                {
-                    self->flags |= LCC_LXF_CHAR_SEQ;
-                    self->substate = LCC_LX_SUBSTATE_STRING;
-                    break;
-                }
+    /* map the entire cache file */
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
 
-                /* strings */
-                case '"':
-                {
-                    self->flags &= ~LCC_LXF_CHAR_SEQ;
-                    self->substate = LCC_LX_SUBSTATE_STRING;
-                    break;
-                }
+    /* check for errors */
+    if (map == MAP_FAILED)
+        return 0;
 
-                /* zero, maybe decimal, hexadecimal or octal integer */
-                case '0':
-                {
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_ZERO;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* keep the mapping */
+    self->map = map;
+    self->map_size = (size_t)st.st_size;
 
-                /* numbers */
-                case '1' ... '9':
-                {
-                    self->substate = LCC_LX_SUBSTATE_NUMBER;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* validate the contents */
+    if (!(_lcc_tc_check(self)))
+    {
+        munmap(self->map, self->map_size);
+        self->map = NULL;
+        self->nlines = 0;
+        return 0;
+    }
 
-                /* maybe a decimal number, or a simple point */
-                case '.':
-                {
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_OR_OP;
-                    break;
-                }
+    /* cache is up to date */
+    *stale = 0;
+    return 1;
+}
 
-                /* single-character operators */
-                case '~':
-                case '(':
-                case ')':
-                case '[':
-                case ']':
-                case '{':
-                case '}':
-                case ':':
-                case ',':
-                case ';':
-                case '?':
-                {
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "missing_default_case"
+static struct _lcc_file_cache_t *_lcc_tc_open(lcc_lexer_t *self, lcc_file_t *file, lcc_string_t *path)
+{
+    /* only memory-mapped files with contents are cached */
+    struct stat st;
+    if (!(file->flags & LCC_FF_MMAP) || !(file->size) || stat(path->buf, &st))
+        return NULL;
 
-                    /* assign operators */
-                    switch (self->ch)
-                    {
-                        case '~': _lcc_commit_operator(self, LCC_OP_BINV     , 1); break;
-                        case '(': _lcc_commit_operator(self, LCC_OP_LBRACKET , 1); break;
-                        case ')': _lcc_commit_operator(self, LCC_OP_RBRACKET , 1); break;
-                        case '[': _lcc_commit_operator(self, LCC_OP_LINDEX   , 1); break;
-                        case ']': _lcc_commit_operator(self, LCC_OP_RINDEX   , 1); break;
-                        case '{': _lcc_commit_operator(self, LCC_OP_LBLOCK   , 1); break;
-                        case '}': _lcc_commit_operator(self, LCC_OP_RBLOCK   , 1); break;
-                        case ':': _lcc_commit_operator(self, LCC_OP_COLON    , 1); break;
-                        case ',': _lcc_commit_operator(self, LCC_OP_COMMA    , 1); break;
-                        case ';': _lcc_commit_operator(self, LCC_OP_SEMICOLON, 1); break;
-                        case '?': _lcc_commit_operator(self, LCC_OP_QUESTION , 1); break;
-                    }
+    /* hash of the entire file content */
+    char stale = 0;
+    lcc_string_t data = { .ref = -1, .buf = file->data, .len = file->size, .hash = 0 };
+    lcc_token_cache_t *tc = self->tcache;
+    struct _lcc_file_cache_t *fc = malloc(sizeof(struct _lcc_file_cache_t));
+
+    /* the key of this file */
+    fc->key = (_lcc_tc_header_t) {
+        .magic    = LCC_TC_MAGIC,
+        .size     = file->size,
+        .hash     = lcc_string_hash(&data),
+        .check    = 0,
+        .mtime    = st.st_mtim.tv_sec,
+        .mtime_ns = st.st_mtim.tv_nsec,
+        .gnuext   = self->gnuext,
+        .path     = path->len,
+        .lines    = 0,
+        .tokens   = 0,
+        .strings  = 0,
+        .reserved = 0,
+    };
 
-#pragma clang diagnostic pop
+    /* cache files are named after the source path */
+    fc->path = lcc_string_ref(path);
+    fc->fname = lcc_string_from_format("%s/%016zx.ltc", tc->path->buf, lcc_string_hash(path));
+
+    /* nothing mapped yet */
+    fc->map = NULL;
+    fc->map_size = 0;
+    fc->nlines = 0;
+    fc->strings = NULL;
+    fc->lines = NULL;
+    fc->tokens = NULL;
+
+    /* replay cursor */
+    fc->next = 0;
+    fc->clean = 0;
+    fc->line = NULL;
+
+    /* recorder */
+    fc->row = 0;
+    fc->diags = 0;
+    fc->active = 0;
+    fc->ntokens = 0;
+    fc->nstrings = 0;
+    fc->mismatches = 0;
+    lcc_array_init(&(fc->rec_lines), sizeof(_lcc_tc_line_t), NULL, NULL);
+    lcc_array_init(&(fc->rec_tokens), sizeof(_lcc_tc_token_t), NULL, NULL);
+    lcc_token_buffer_init(&(fc->rec_strings));
+
+    /* replay valid caches, unless verifying */
+    if (_lcc_tc_load(fc, &stale))
+    {
+        tc->hits++;
+        fc->replay = !(tc->flags & LCC_TCF_VERIFY);
+        fc->record = (tc->flags & LCC_TCF_VERIFY) != 0;
+    }
+    else
+    {
+        tc->misses++;
+        tc->stale += stale;
+        fc->replay = 0;
+        fc->record = 1;
+    }
 
-                    /* for sure this is the only character */
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    return;
-                }
+    /* cache for this file */
+    return fc;
+}
 
-                /* multi-character operators */
-                case '+': self->substate = LCC_LX_SUBSTATE_OPERATOR_PLUS; break;
-                case '-': self->substate = LCC_LX_SUBSTATE_OPERATOR_MINUS; break;
-                case '*': self->substate = LCC_LX_SUBSTATE_OPERATOR_STAR; break;
-                case '/': self->substate = LCC_LX_SUBSTATE_OPERATOR_SLASH; break;
-                case '%': self->substate = LCC_LX_SUBSTATE_OPERATOR_PERCENT; break;
-                case '=': self->substate = LCC_LX_SUBSTATE_OPERATOR_EQU; break;
-                case '>': self->substate = LCC_LX_SUBSTATE_OPERATOR_GT; break;
-                case '<': self->substate = LCC_LX_SUBSTATE_OPERATOR_LT; break;
-                case '!': self->substate = LCC_LX_SUBSTATE_OPERATOR_EXCL; break;
-                case '&': self->substate = LCC_LX_SUBSTATE_OPERATOR_AMP; break;
-                case '|': self->substate = LCC_LX_SUBSTATE_OPERATOR_BAR; break;
-                case '^': self->substate = LCC_LX_SUBSTATE_OPERATOR_CARET; break;
+static inline uint32_t _lcc_tc_string(struct _lcc_file_cache_t *self, const char *buf, size_t len)
+{
+    uint32_t ret = self->rec_strings.len;
+    lcc_token_buffer_append_from_size(&(self->rec_strings), buf, len);
+    return ret;
+}
 
-                /* token stringize */
-                case '#':
-                {
-                    /* preprocessor operators */
-                    if (self->flags & LCC_LXF_DIRECTIVE)
-                    {
-                        self->state = LCC_LX_STATE_SHIFT;
-                        self->substate = LCC_LX_SUBSTATE_OPERATOR_HASH;
-                        break;
-                    }
+static inline char _lcc_tc_same_str(const char *p, size_t plen, size_t pskip, const char *q, size_t qlen, size_t qskip)
+{
+    /* the left over source is only a prefix if it fits */
+    pskip = (pskip <= plen) ? pskip : 0;
+    qskip = (qskip <= qlen) ? qskip : 0;
 
-                    /* directives allowed */
-                    if (!(self->file->flags & LCC_FF_LNODIR))
-                    {
-                        self->state = LCC_LX_STATE_GOT_DIRECTIVE;
-                        self->substate = LCC_LX_SUBSTATE_NULL;
-                        return;
-                    }
+    /* compare the rest of the strings */
+    return (plen - pskip == qlen - qskip) && !(memcmp(p + pskip, q + qskip, qlen - qskip));
+}
 
-                    /* otherwise it's an error */
-                    _lcc_lexer_error(self, "Invalid character '#'");
-                    return;
-                }
+static char _lcc_tc_same(struct _lcc_file_cache_t *self, size_t row, const _lcc_tc_line_t *line)
+{
+    /* only compare lines that are valid in both */
+    if ((row >= self->nlines) || !(self->lines[row].flags & LCC_TCL_VALID))
+        return 1;
 
-                /* other characters */
-                default:
-                {
-                    /* whitespaces, skip it */
-                    if (isspace(self->ch))
-                        break;
+    /* the cached line */
+    const char *rs = self->rec_strings.buf;
+    const _lcc_tc_line_t *old = &(self->lines[row]);
+
+    /* the left over source goes to the first token, or to
+     * the tail of lines without tokens, so it's skipped there */
+    size_t pskip = old->lead_len;
+    size_t qskip = line->lead_len;
+
+    /* check for line info, tails without tokens contain the left over source */
+    if ((old->flags != line->flags) ||
+        (old->count != line->count) ||
+        !(_lcc_tc_same_str(
+            self->strings + old->tail, old->tail_len, line->count ? 0 : pskip,
+            rs + line->tail, line->tail_len, line->count ? 0 : qskip)))
+        return 0;
 
-                    /* GNU ext :: dollar in identifier */
-                    if ((self->ch == '$') && (self->gnuext & LCC_LX_GNUX_DOLLAR_IDENT))
-                    {
-                        self->substate = LCC_LX_SUBSTATE_NAME;
-                        lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                        break;
-                    }
+    /* check for every token */
+    for (size_t i = 0; i < line->count; i++)
+    {
+        const _lcc_tc_token_t *p = &(self->tokens[old->first + i]);
+        const _lcc_tc_token_t *q = lcc_array_get(&(self->rec_tokens), line->first + i);
+
+        /* compare everything except string offsets and the left over source */
+        if ((p->type != q->type) ||
+            (p->kind != q->kind) ||
+            (p->col != q->col) ||
+            (p->acol != q->acol) ||
+            (p->val_len != q->val_len) ||
+            memcmp(self->strings + p->val, rs + q->val, q->val_len) ||
+            !(_lcc_tc_same_str(self->strings + p->src, p->src_len, i ? 0 : pskip, rs + q->src, q->src_len, i ? 0 : qskip)))
+            return 0;
+    }
 
-                    /* other unknown characters */
-                    _LCC_WRONG_CHAR("Invalid character")
-                    return;
-                }
-            }
+    /* tokens are identical, the left over source may still differ,
+     * which only depends on what comes before this line */
+    if ((old->lead_len != line->lead_len) ||
+        memcmp(self->strings + old->lead, rs + line->lead, line->lead_len))
+        return 2;
 
-            /* continue shifting */
-            self->state = LCC_LX_STATE_SHIFT;
-            break;
-        }
+    /* lines are identical */
+    return 1;
+}
 
-        /* identifiers */
-        case LCC_LX_SUBSTATE_NAME:
+static char _lcc_tc_replay(lcc_lexer_t *self, lcc_file_t *file, const char *buf, size_t len)
+{
+    /* the line being replayed */
+    struct _lcc_file_cache_t *fc = file->cache;
+    const _lcc_tc_line_t *line = fc->line;
+
+    /* entering a new line, record it's location */
+    if ((file != self->loc_file) || (file->row != self->loc_row))
+        _lcc_loc_line(self, file, file->row, file->col);
+
+    /* replay the next token */
+    if (fc->next < line->first + line->count)
+    {
+        lcc_token_t *token;
+        const _lcc_tc_token_t *tk = &(fc->tokens[fc->next++]);
+        const char *val = fc->strings + tk->val;
+        lcc_string_t *src = lcc_string_from_buffer(fc->strings + tk->src, tk->src_len);
+
+        /* create the token as if it's committed */
+        switch (tk->type)
         {
-            /* it's a valid identifier */
-            if ((self->ch == '_') ||
-                ((self->ch >= 'a') && (self->ch <= 'z')) ||
-                ((self->ch >= 'A') && (self->ch <= 'Z')) ||
-                ((self->ch >= '0') && (self->ch <= '9')) ||
-                ((self->ch == '$') && (self->gnuext & LCC_LX_GNUX_DOLLAR_IDENT)))
+            case LCC_TK_IDENT:
             {
-                self->state = LCC_LX_STATE_SHIFT;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                token = lcc_token_from_ident(src, _lcc_intern_buffer(self, val, tk->val_len));
                 break;
             }
 
-            /* commit the identifier */
-            if (!(_lcc_commit_ident(self, 0)))
-                return;
+            case LCC_TK_OPERATOR:
+            {
+                token = lcc_token_from_operator(src, tk->kind);
+                break;
+            }
 
-            /* keep the character */
-            self->state = LCC_LX_STATE_ACCEPT_KEEP;
-            break;
+            default:
+            {
+                switch (tk->kind)
+                {
+                    case LCC_LT_CHAR   : token = lcc_token_from_char(src, lcc_string_from_buffer(val, tk->val_len), (self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR) != 0); break;
+                    case LCC_LT_STRING : token = lcc_token_from_string(src, lcc_string_from_buffer(val, tk->val_len), (self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR) != 0); break;
+                    default            : token = _lcc_token_from_number_lazy(src, lcc_string_from_buffer(val, tk->val_len), tk->kind); break;
+                }
+
+                break;
+            }
         }
 
-        /* chars or strings */
-        case LCC_LX_SUBSTATE_STRING:
+        /* move to where it's committed */
+        self->ch = buf[tk->acol];
+        self->loc = self->loc_base + tk->acol;
+        self->loc_token = self->loc_base + tk->col;
+        file->col = tk->acol + 1;
+
+        /* attach to token chain */
+        token->loc = self->loc_token;
+        lcc_token_attach(&(self->tokens), token);
+
+        /* tokens terminated by the line ending are accepted after the line */
+        if ((fc->next < line->first + line->count) || !(line->flags & LCC_TCL_EOL))
         {
-            switch (self->ch)
-            {
-                /* end of string */
-                case '"':
-                {
-                    /* ignore when parsing chars */
-                    if (self->flags & LCC_LXF_CHAR_SEQ)
-                        goto _lcc_label_string_generic_char;
+            self->state = LCC_LX_STATE_ACCEPT;
+            return 1;
+        }
+    }
 
-                    /* accept as strings */
-                    _lcc_commit_string(self, 1);
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    break;
-                }
+    /* leave the source as if the line is lexed */
+    lcc_token_buffer_append_from_size(&(self->source), fc->strings + line->tail, line->tail_len);
+    self->tcache->lines++;
 
-                /* end of chars */
-                case '\'':
-                {
-                    /* ignore when parsing strings */
-                    if (!(self->flags & LCC_LXF_CHAR_SEQ))
-                        goto _lcc_label_string_generic_char;
+    /* move to the line ending */
+    fc->line = NULL;
+    file->col = len;
+    self->ch = buf[len - 1];
+    self->loc = self->loc_base + len - 1;
+    return 1;
+}
 
-                    /* chars cannot be empty */
-                    if (!(self->token_buffer.len))
-                    {
-                        _lcc_lexer_error(self, "Empty character constant");
-                        return;
-                    }
+static char _lcc_tc_shift(lcc_lexer_t *self, lcc_file_t *file, const char *buf, size_t len, char drop)
+{
+    /* in the middle of a cached line */
+    struct _lcc_file_cache_t *fc = file->cache;
+    const _lcc_tc_line_t *line;
+
+    /* continue replaying */
+    if (fc->line)
+        return _lcc_tc_replay(self, file, buf, len);
+
+    /* lines must start right after a line ending, outside of any token or directive */
+    if (drop || file->col || !len ||
+        (file->row != fc->clean) ||
+        (self->substate != LCC_LX_SUBSTATE_NULL) ||
+        (self->flags & LCC_LXF_DIRECTIVE))
+        return 0;
 
-                    /* accept as chars */
-                    _lcc_commit_chars(self, 1);
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    break;
-                }
+    /* replay cached lines, the left over source must also match */
+    if (fc->replay)
+    {
+        /* check if the line is cached */
+        if ((file->row >= fc->nlines) ||
+            !((line = &(fc->lines[file->row]))->flags & LCC_TCL_VALID) ||
+            (line->lead_len != self->source.len) ||
+            memcmp(fc->strings + line->lead, self->source.buf, line->lead_len))
+            return 0;
 
-                /* escape characters */
-                case '\\':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+        /* the left over source goes to the first token */
+        fc->line = line;
+        fc->next = line->first;
+        lcc_token_buffer_reset(&(self->source));
+        return _lcc_tc_replay(self, file, buf, len);
+    }
 
-                /* generic characters */
-                default:
-                _lcc_label_string_generic_char:
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
-            }
+    /* string offsets are 32-bit */
+    if (fc->rec_strings.len > UINT32_MAX / 2)
+        fc->record = 0;
 
-            break;
-        }
+    /* record this line, dropping incomplete ones */
+    if (fc->record)
+    {
+        fc->rec_tokens.count = fc->ntokens;
+        fc->rec_strings.len = fc->nstrings;
+        fc->row = file->row;
+        fc->diags = self->diags;
+        fc->active = 1;
+        fc->current = (_lcc_tc_line_t) {
+            .flags    = 0,
+            .first    = fc->rec_tokens.count,
+            .count    = 0,
+            .lead     = _lcc_tc_string(fc, self->source.buf, self->source.len),
+            .lead_len = self->source.len,
+            .tail     = 0,
+            .tail_len = 0,
+            .reserved = 0,
+        };
+    }
 
-        /* escape characters */
-        case LCC_LX_SUBSTATE_STRING_ESCAPE:
-        {
-            switch (self->ch)
-            {
-                /* normal escape characters */
-                case 'a':
-                case 'b':
-                case 'e':
-                case 'f':
-                case 'n':
-                case 'r':
-                case 't':
-                case 'v':
-                case '?':
-                case '"':
-                case '\'':
-                case '\\':
-                {
-                    /* "\e" escape character (should have GNU extension enabled) */
-                    if ((self->ch == 'e') && !(self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR))
-                        goto _lcc_string_escape_unknown;
+    /* lex the line normally */
+    return 0;
+}
 
-                    /* end of escape sequence */
-                    self->substate = LCC_LX_SUBSTATE_STRING;
-                    break;
-                }
+static void _lcc_tc_token(lcc_lexer_t *self, lcc_token_t *token)
+{
+    /* only tokens of the line being recorded */
+    lcc_file_t *file = self->file;
+    struct _lcc_file_cache_t *fc = file->cache;
 
-                /* hexadecimal escape characters */
-                case 'x':
-                case 'X':
-                {
-                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_HEX;
-                    break;
-                }
+    /* check for recording line */
+    if (!(fc->active) || (fc->row != file->row))
+        return;
 
-                /* octal escape characters */
-                case '0' ... '3':
-                {
-                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_2;
-                    break;
-                }
+    /* tokens must start and end within this line */
+    if ((token->loc < self->loc_base) || (self->loc < token->loc))
+    {
+        fc->active = 0;
+        return;
+    }
 
-                /* octal escape characters (two digits only) */
-                case '4' ... '7':
-                {
-                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3;
-                    break;
-                }
+    /* token position and source */
+    _lcc_tc_token_t tk = {
+        .type     = token->type,
+        .kind     = 0,
+        .col      = token->loc - self->loc_base,
+        .acol     = self->loc - self->loc_base,
+        .reserved = 0,
+        .src      = _lcc_tc_string(fc, token->src->buf, token->src->len),
+        .src_len  = token->src->len,
+        .val      = 0,
+        .val_len  = 0,
+    };
 
-                /* other unknown characters */
-                default:
-                _lcc_string_escape_unknown:
-                {
-                    self->substate = LCC_LX_SUBSTATE_STRING;
-                    _LCC_WRONG_CHAR("Unknown escape character")
-                    break;
-                }
-            }
+    /* operators only need their kind */
+    if (token->type == LCC_TK_OPERATOR)
+        tk.kind = token->operator;
 
-            /* append to token buffer */
-            self->state = LCC_LX_STATE_SHIFT;
-            lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            break;
-        }
+    /* identifiers and literals keep the token buffer */
+    else
+    {
+        char *buf = self->token_buffer.buf;
+        size_t len = self->token_buffer.len;
 
-        /* hexadecimal escape characters (first and second digit) */
-        case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX:
-        case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_D:
-        {
-            switch (self->ch)
-            {
-                /* hexadecimal digits */
-                case '0' ... '9':
-                case 'a' ... 'f':
-                case 'A' ... 'F':
-                {
-                    /* move to next substate */
-                    if (self->substate == LCC_LX_SUBSTATE_STRING_ESCAPE_HEX)
-                        self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_D;
-                    else
-                        self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_E;
+        /* usually the tail of the token source */
+        if ((len <= tk.src_len) && !(memcmp(fc->rec_strings.buf + tk.src + tk.src_len - len, buf, len)))
+            tk.val = tk.src + tk.src_len - len;
+        else
+            tk.val = _lcc_tc_string(fc, buf, len);
 
-                    /* shift more characters */
-                    self->state = LCC_LX_STATE_SHIFT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+        /* literal types are kept as well */
+        tk.val_len = len;
+        tk.kind = (token->type == LCC_TK_LITERAL) ? token->literal.type : 0;
+    }
 
-                /* other unknown characters */
-                default:
-                {
-                    _LCC_WRONG_CHAR("Invalid hexadecimal digit")
-                    return;
-                }
-            }
+    /* check if the token is terminated by the line ending */
+    if (self->flags & LCC_LXF_EOL)
+        fc->current.flags |= LCC_TCL_EOL;
+    else
+        fc->current.flags &= ~LCC_TCL_EOL;
 
-            break;
-        }
+    /* add to recorded tokens */
+    lcc_array_append(&(fc->rec_tokens), &tk);
+}
 
-        /* hexadecimal escape characters (end of digits) */
-        case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_E:
-        {
-            switch (self->ch)
-            {
-                /* hexadecimal digits */
-                case '0' ... '9':
-                case 'a' ... 'f':
-                case 'A' ... 'F':
-                {
-                    _lcc_lexer_error(self, "Hex escape sequence out of range");
-                    break;
-                }
+static void _lcc_tc_next_line(lcc_lexer_t *self, lcc_file_t *file)
+{
+    /* the next line starts right after a line ending */
+    struct _lcc_file_cache_t *fc = file->cache;
+    fc->clean = file->row + 1;
 
-                /* other unknown characters */
-                default:
-                {
-                    self->state = LCC_LX_STATE_GOT_CHAR;
-                    self->substate = LCC_LX_SUBSTATE_STRING;
-                    break;
-                }
-            }
+    /* check for recording line */
+    if (!(fc->active) || (fc->row != file->row))
+        return;
 
-            break;
-        }
+    /* the line must be accepted, without any diagnostics */
+    fc->active = 0;
+    if ((self->state != LCC_LX_STATE_ACCEPT) ||
+        (self->flags & LCC_LXF_DIRECTIVE) ||
+        (self->diags != fc->diags))
+        return;
 
-        /* octal escape characters (second and third digit) */
-        case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_2:
-        case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3:
-        {
-            if ((self->ch < '0') || (self->ch > '7'))
-            {
-                self->state = LCC_LX_STATE_GOT_CHAR;
-                self->substate = LCC_LX_SUBSTATE_STRING;
-            }
-            else if (self->substate == LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3)
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_STRING;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            }
-            else
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            }
+    /* complete the line */
+    fc->current.flags |= LCC_TCL_VALID;
+    fc->current.count = fc->rec_tokens.count - fc->current.first;
+    fc->current.tail = _lcc_tc_string(fc, self->source.buf, self->source.len);
+    fc->current.tail_len = self->source.len;
 
-            break;
-        }
+    /* rows without records are not valid */
+    while (fc->rec_lines.count < file->row)
+        lcc_array_append(&(fc->rec_lines), &(_lcc_tc_line_t){ .flags = 0 });
 
-        /* numbers */
-        case LCC_LX_SUBSTATE_NUMBER:
-        case LCC_LX_SUBSTATE_NUMBER_DECIMAL:
+    /* add to recorded lines */
+    fc->ntokens = fc->rec_tokens.count;
+    fc->nstrings = fc->rec_strings.len;
+    lcc_array_append(&(fc->rec_lines), &(fc->current));
+
+    /* compare with the cache in verification mode, lines that only differ in
+     * the left over source are not mismatches, the cache is still correct */
+    if (fc->map)
+    {
+        switch (_lcc_tc_same(fc, file->row, &(fc->current)))
         {
-            switch (self->ch)
-            {
-                /* decimal point */
-                case '.':
-                {
-                    /* already decimal number, stop here */
-                    if (self->substate == LCC_LX_SUBSTATE_NUMBER_DECIMAL)
-                        goto _lcc_label_number_end;
+            case 0: fc->mismatches++; self->tcache->mismatches++; break;
+            case 2: self->tcache->leads++; break;
+        }
+    }
+}
 
-                    /* otherwise mark as decimal number */
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+static char _lcc_file_replace(const char *fname, const char *buf, size_t size)
+{
+    /* write to a temporary file, and move it into place atomically */
+    int fd;
+    ssize_t ret = -1;
+    lcc_string_t *tmp = lcc_string_from_format("%s.XXXXXX", fname);
 
-                /* decimal number (scientific notation) */
-                case 'e':
-                case 'E':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* write the entire file */
+    if ((fd = mkstemp(tmp->buf)) >= 0)
+    {
+        fchmod(fd, 0644);
+        ret = write(fd, buf, size);
+        ret = close(fd) ? -1 : ret;
+    }
 
-                /* digits */
-                case '0' ... '9':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* move into place, or remove the incomplete file */
+    char ok = ((size_t)ret == size) && !(rename(tmp->buf, fname));
+    if (!ok && (fd >= 0))
+        unlink(tmp->buf);
 
-                /* float specifier */
-                case 'f':
-                case 'F':
-                {
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    _lcc_commit_number(self, LCC_LT_FLOAT, 1);
-                    break;
-                }
+    /* release the name */
+    lcc_string_unref(tmp);
+    return ok;
+}
 
-                /* unsigned specifier */
-                case 'u':
-                case 'U':
-                {
-                    /* doesn't make sense with floating points */
-                    if (self->substate == LCC_LX_SUBSTATE_NUMBER_DECIMAL)
-                        goto _lcc_label_number_end;
+static void _lcc_tc_store(lcc_lexer_t *self, lcc_file_t *file)
+{
+    /* only recorded files, verified ones are written only on mismatches */
+    struct _lcc_file_cache_t *fc = file->cache;
+    if (!(fc->record) || (fc->map && !(fc->mismatches)))
+        return;
 
-                    /* mark as unsigned integer */
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* header of the cache file */
+    _lcc_tc_header_t hdr = fc->key;
+    fc->record = 0;
+
+    /* size of each section */
+    size_t base = (sizeof(_lcc_tc_header_t) + hdr.path + 7) & ~(size_t)7;
+    size_t nline = fc->rec_lines.count * sizeof(_lcc_tc_line_t);
+    size_t ntoken = fc->ntokens * sizeof(_lcc_tc_token_t);
+    size_t size = base + nline + ntoken + fc->nstrings;
+    char *buf = calloc(1, size);
+
+    /* build the entire file in memory */
+    memcpy(buf + sizeof(_lcc_tc_header_t), fc->path->buf, fc->path->len);
+    memcpy(buf + base, fc->rec_lines.items, nline);
+    memcpy(buf + base + nline, fc->rec_tokens.items, ntoken);
+    memcpy(buf + base + nline + ntoken, fc->rec_strings.buf, fc->nstrings);
+
+    /* hash of the contents */
+    lcc_string_t body = {
+        .ref  = -1,
+        .buf  = buf + sizeof(_lcc_tc_header_t),
+        .len  = size - sizeof(_lcc_tc_header_t),
+        .hash = 0,
+    };
 
-                /* long specifier */
-                case 'l':
-                case 'L':
-                {
-                    /* long double, that's it, stop here */
-                    if (self->substate == LCC_LX_SUBSTATE_NUMBER_DECIMAL)
-                    {
-                        self->state = LCC_LX_STATE_ACCEPT;
-                        lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                        _lcc_commit_number(self, LCC_LT_LONGDOUBLE, 1);
-                    }
-                    else
-                    {
-                        self->state = LCC_LX_STATE_SHIFT;
-                        self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
-                        lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    }
+    /* complete the header */
+    hdr.lines = fc->rec_lines.count;
+    hdr.tokens = fc->ntokens;
+    hdr.strings = fc->nstrings;
+    hdr.check = lcc_string_hash(&body);
+    memcpy(buf, &hdr, sizeof(_lcc_tc_header_t));
 
-                    break;
-                }
+    /* write the cache file */
+    if (_lcc_file_replace(fc->fname->buf, buf, size))
+        self->tcache->stores++;
 
-                /* other characters, commit the number */
-                default:
-                _lcc_label_number_end:
-                {
-                    /* move to next character */
-                    if (self->substate == LCC_LX_SUBSTATE_NUMBER)
-                        _lcc_commit_number(self, LCC_LT_INT, 0);
-                    else
-                        _lcc_commit_number(self, LCC_LT_DOUBLE, 0);
+    /* release the buffer */
+    free(buf);
+}
 
-                    /* accept but keep this character */
-                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                    break;
-                }
-            }
+static inline lcc_string_t *_lcc_dump_token(lcc_lexer_t *self)
+{
+    char *p = self->token_buffer.buf;
+    size_t n = self->token_buffer.len;
+    return lcc_string_from_buffer(p, n);
+}
 
-            break;
-        }
+static inline lcc_string_t *_lcc_swap_source(lcc_lexer_t *self, char keep_tail)
+{
+    /* remove last char as needed */
+    char *buf = self->source.buf;
+    size_t len = self->source.len;
+    size_t size = (len && !keep_tail) ? len - 1 : len;
 
-        /* zero, maybe decimal, hexadecimal or octal integer */
-        case LCC_LX_SUBSTATE_NUMBER_ZERO:
-        {
-            switch (self->ch)
-            {
-                /* decimal point */
-                case '.':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* copy out the token source, and reuse the buffer */
+    lcc_string_t *old = lcc_string_from_buffer(buf, size);
+    lcc_token_buffer_reset(&(self->source));
+    return old;
+}
 
-                /* decimal number (scientific notation) */
-                case 'e':
-                case 'E':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+static inline char _lcc_commit_ident(lcc_lexer_t *self, char keep_tail)
+{
+    /* check for preprocessor reserved identifiers */
+    if ((!(self->flags & LCC_LXDF_DEFINE_VAR) ||                /* must be variadic macro */
+          (self->flags & LCC_LXDF_DEFINE_NVAR) ||               /* but must not be named variadic macro */
+         !(self->flags & LCC_LXDF_DEFINE_FINE)) &&              /* must finish parsing the declaration */
+        (!(strcmp(self->token_buffer.buf, "__VA_ARGS__")) ||    /* must not be "__VA_ARGS__" */
+         ((self->gnuext & LCC_LX_GNUX_VA_OPT_MACRO) &&          /* with "__VA_OPT__" extension enabled, */
+          !(strcmp(self->token_buffer.buf, "__VA_OPT__")))))    /* must not be "__VA_OPT__" */
+    {
+        _lcc_lexer_error(self, "'%s' is not allowed here", self->token_buffer.buf);
+        return 0;
+    }
 
-                /* binary specifier */
-                case 'b':
-                case 'B':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* create a new token */
+    lcc_token_t *token = lcc_token_from_ident(
+        _lcc_swap_source(self, keep_tail),
+        _lcc_intern_buffer(self, self->token_buffer.buf, self->token_buffer.len)
+    );
 
-                /* hexadecimal specifier */
-                case 'x':
-                case 'X':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* attach to token chain */
+    token->loc = self->loc_token;
+    lcc_token_attach(&(self->tokens), token);
 
-                /* octal digits */
-                case '0' ... '7':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* remember the token for the token cache */
+    if (self->file->cache)
+        _lcc_tc_token(self, token);
 
-                /* '8' and '9' are not valid octal digits */
-                case '8':
-                case '9':
-                {
-                    _lcc_lexer_error(self, "Invalid octal digit '%c'", self->ch);
-                    break;
-                }
+    /* reuse the token buffer */
+    lcc_token_buffer_reset(&(self->token_buffer));
+    return 1;
+}
 
-                /* float specifier */
-                case 'f':
-                case 'F':
-                {
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    _lcc_commit_number(self, LCC_LT_FLOAT, 1);
-                    break;
-                }
+static inline void _lcc_commit_chars(lcc_lexer_t *self, char keep_tail)
+{
+    /* create a new token */
+    lcc_token_t *token = lcc_token_from_char(
+        _lcc_swap_source(self, keep_tail),
+        _lcc_dump_token(self),
+        (self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR) != 0
+    );
 
-                /* unsigned specifier */
-                case 'u':
-                case 'U':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* check for multi-character constant */
+    if (token->literal.v_char->len > 1)
+        _lcc_lexer_warning(self, "Multi-character character constant");
 
-                /* long specifier */
-                case 'l':
-                case 'L':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* attach to token chain */
+    token->loc = self->loc_token;
+    lcc_token_attach(&(self->tokens), token);
 
-                /* other characters, commit a single zero */
-                default:
-                {
-                    _lcc_commit_number(self, LCC_LT_INT, 0);
-                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                    break;
-                }
-            }
+    /* remember the token for the token cache */
+    if (self->file->cache)
+        _lcc_tc_token(self, token);
 
-            break;
-        }
+    /* reuse the token buffer */
+    lcc_token_buffer_reset(&(self->token_buffer));
+}
 
-        /* decimal number or a simple point */
-        case LCC_LX_SUBSTATE_NUMBER_OR_OP:
-        {
-            /* maybe ellipsis operator */
-            if (self->ch == '.')
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_OPERATOR_ELLIPSIS;
-                break;
-            }
+static inline void _lcc_commit_string(lcc_lexer_t *self, char keep_tail)
+{
+    /* create a new token */
+    lcc_token_t *token = lcc_token_from_string(
+        _lcc_swap_source(self, keep_tail),
+        _lcc_dump_token(self),
+        (self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR) != 0
+    );
 
-            /* not a valid digit, accept as a "." operator */
-            if (!(isdigit(self->ch)))
-            {
-                self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                _lcc_commit_operator(self, LCC_OP_POINT, 0);
-                break;
-            }
+    /* attach to token chain */
+    token->loc = self->loc_token;
+    lcc_token_attach(&(self->tokens), token);
 
-            /* also add the missing point */
-            self->state = LCC_LX_STATE_SHIFT;
-            self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL;
-            lcc_token_buffer_append(&(self->token_buffer), '.');
-            lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            break;
-        }
+    /* remember the token for the token cache */
+    if (self->file->cache)
+        _lcc_tc_token(self, token);
 
-        /* binary or hexadecimal integers */
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN:
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D:
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX:
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D:
-        {
-            /* binary integers */
-            if (((self->ch == '0') ||
-                 (self->ch == '1')) &&
-                ((self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN) ||
-                 (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D)))
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                break;
-            }
+    /* reuse the token buffer */
+    lcc_token_buffer_reset(&(self->token_buffer));
+}
 
-            /* hexadecimal integers */
-            if ((((self->ch >= '0') && (self->ch <= '9')) ||
-                 ((self->ch >= 'a') && (self->ch <= 'f')) ||
-                 ((self->ch >= 'A') && (self->ch <= 'F'))) &&
-                ((self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX) ||
-                 (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D)))
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                break;
-            }
+static inline void _lcc_commit_number(lcc_lexer_t *self, lcc_literal_type_t type, char keep_tail)
+{
+    /* create new tokens */
+    lcc_token_t *token = _lcc_token_from_number_lazy(
+        _lcc_swap_source(self, keep_tail),
+        _lcc_dump_token(self),
+        type
+    );
 
-            /* check for binary digits */
-            if (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN)
-            {
-                _LCC_WRONG_CHAR("Invalid binary digit")
-                return;
-            }
+    /* attach to token chain */
+    token->loc = self->loc_token;
+    lcc_token_attach(&(self->tokens), token);
 
-            /* check for hexadecimal digits */
-            if (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX)
-            {
-                _LCC_WRONG_CHAR("Invalid hexadecimal digit")
-                return;
-            }
+    /* remember the token for the token cache */
+    if (self->file->cache)
+        _lcc_tc_token(self, token);
 
-            /* check for integer modifiers */
-            switch (self->ch)
-            {
-                /* unsigned specifier */
-                case 'u':
-                case 'U':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* reuse the token buffer */
+    lcc_token_buffer_reset(&(self->token_buffer));
+}
 
-                /* long specifier */
-                case 'l':
-                case 'L':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+static inline void _lcc_eval_literal(lcc_lexer_t *self, lcc_token_t *token)
+{
+    /* only deferred numbers need converting */
+    if ((token->type != LCC_TK_LITERAL) || !(token->literal.pending))
+        return;
 
-                /* not a specifier */
-                default:
-                {
-                    _lcc_commit_number(self, LCC_LT_INT, 0);
-                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                    break;
-                }
-            }
+    /* convert, overflows are reported at the literal itself */
+    if (!(lcc_literal_eval(&(token->literal))))
+    {
+        uint32_t loc = self->loc;
+        self->loc = token->loc ? token->loc : loc;
+        _lcc_lexer_warning(self, "Literal %s is out of range", token->literal.raw->buf);
+        self->loc = loc;
+    }
+}
 
-            break;
-        }
+static inline void _lcc_commit_operator(lcc_lexer_t *self, lcc_operator_t operator, char keep_tail)
+{
+    lcc_string_t *src = _lcc_swap_source(self, keep_tail);
+    lcc_token_t *token = lcc_token_from_operator(src, operator);
 
-        /* octal integers */
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT:
-        {
-            switch (self->ch)
-            {
-                /* unsigned specifier */
-                case 'u':
-                case 'U':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* attach to token chain */
+    token->loc = self->loc_token;
+    lcc_token_attach(&(self->tokens), token);
 
-                /* long specifier */
-                case 'l':
-                case 'L':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+    /* remember the token for the token cache */
+    if (self->file->cache)
+        _lcc_tc_token(self, token);
+}
 
-                /* octal digits */
-                case '0' ... '7':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+/** Character Transitions **/
 
-                /* other characters */
-                default:
-                {
-                    _lcc_commit_number(self, LCC_LT_INT, 0);
-                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                    break;
-                }
-            }
+enum
+{
+    _LCC_CC_OTHER,          /* not in transition table */
+    _LCC_CC_SPACE,
+    _LCC_CC_ALPHA,          /* letters and "_" */
+    _LCC_CC_ZERO,
+    _LCC_CC_DIGIT,          /* "1" to "9" */
+    _LCC_CC_POINT,
+    _LCC_CC_PLUS,
+    _LCC_CC_MINUS,
+    _LCC_CC_STAR,
+    _LCC_CC_SLASH,
+    _LCC_CC_PERCENT,
+    _LCC_CC_EQU,
+    _LCC_CC_GT,
+    _LCC_CC_LT,
+    _LCC_CC_EXCL,
+    _LCC_CC_AMP,
+    _LCC_CC_BAR,
+    _LCC_CC_CARET,
+    _LCC_CC_TILDE,
+    _LCC_CC_LBRACKET,
+    _LCC_CC_RBRACKET,
+    _LCC_CC_LINDEX,
+    _LCC_CC_RINDEX,
+    _LCC_CC_LBLOCK,
+    _LCC_CC_RBLOCK,
+    _LCC_CC_COLON,
+    _LCC_CC_COMMA,
+    _LCC_CC_SEMICOLON,
+    _LCC_CC_QUESTION,
+    _LCC_CC_COUNT,
+};
 
-            break;
-        }
+static const uint8_t _LCC_CHAR_CLASS[256] = {
+    [' ' ] = _LCC_CC_SPACE,
+    ['\t'] = _LCC_CC_SPACE,
+    ['\n'] = _LCC_CC_SPACE,
+    ['\v'] = _LCC_CC_SPACE,
+    ['\f'] = _LCC_CC_SPACE,
+    ['\r'] = _LCC_CC_SPACE,
+    ['_' ] = _LCC_CC_ALPHA,
+    ['a' ... 'z'] = _LCC_CC_ALPHA,
+    ['A' ... 'Z'] = _LCC_CC_ALPHA,
+    ['0' ] = _LCC_CC_ZERO,
+    ['1' ... '9'] = _LCC_CC_DIGIT,
+    ['.' ] = _LCC_CC_POINT,
+    ['+' ] = _LCC_CC_PLUS,
+    ['-' ] = _LCC_CC_MINUS,
+    ['*' ] = _LCC_CC_STAR,
+    ['/' ] = _LCC_CC_SLASH,
+    ['%' ] = _LCC_CC_PERCENT,
+    ['=' ] = _LCC_CC_EQU,
+    ['>' ] = _LCC_CC_GT,
+    ['<' ] = _LCC_CC_LT,
+    ['!' ] = _LCC_CC_EXCL,
+    ['&' ] = _LCC_CC_AMP,
+    ['|' ] = _LCC_CC_BAR,
+    ['^' ] = _LCC_CC_CARET,
+    ['~' ] = _LCC_CC_TILDE,
+    ['(' ] = _LCC_CC_LBRACKET,
+    [')' ] = _LCC_CC_RBRACKET,
+    ['[' ] = _LCC_CC_LINDEX,
+    [']' ] = _LCC_CC_RINDEX,
+    ['{' ] = _LCC_CC_LBLOCK,
+    ['}' ] = _LCC_CC_RBLOCK,
+    [':' ] = _LCC_CC_COLON,
+    [',' ] = _LCC_CC_COMMA,
+    [';' ] = _LCC_CC_SEMICOLON,
+    ['?' ] = _LCC_CC_QUESTION,
+};
 
-        /* unsigned specifier */
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_U:
-        {
-            if ((self->ch != 'l') && (self->ch != 'L'))
-            {
-                _lcc_commit_number(self, LCC_LT_UINT, 0);
-                self->state = LCC_LX_STATE_ACCEPT_KEEP;
-            }
-            else
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_UL;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            }
+/* transition actions, the lower 8 bits are either the next sub-state or the operator */
+#define _LCC_TR_SHIFT       0x0100      /* shift to next sub-state */
+#define _LCC_TR_ACCEPT      0x0200      /* accept the operator with this character */
+#define _LCC_TR_KEEP        0x0300      /* accept the operator without this character */
+#define _LCC_TR_MASK        0x0300
+#define _LCC_TR_APPEND      0x0400      /* append this character to token buffer */
+#define _LCC_TR_NONE        0x0800      /* handled by _lcc_handle_substate(), overrides the default */
+
+#define S(substate)         (_LCC_TR_SHIFT | LCC_LX_SUBSTATE_ ## substate)
+#define SA(substate)        (_LCC_TR_SHIFT | _LCC_TR_APPEND | LCC_LX_SUBSTATE_ ## substate)
+#define A(operator)         (_LCC_TR_ACCEPT | LCC_OP_ ## operator)
+#define K(operator)         (_LCC_TR_KEEP | LCC_OP_ ## operator)
+
+/* every sub-state has a row in both tables below */
+#define _LCC_SUBSTATE_COUNT (LCC_LX_SUBSTATE_COMMENT_BLOCK_END + 1)
+
+/* sub-state x character class, 0 means the default action of the sub-state */
+static const uint16_t _LCC_TRANSITIONS[_LCC_SUBSTATE_COUNT][_LCC_CC_COUNT] = {
+    [LCC_LX_SUBSTATE_NULL] = {
+        [_LCC_CC_SPACE    ] = S(NULL),
+        [_LCC_CC_ALPHA    ] = SA(NAME),
+        [_LCC_CC_ZERO     ] = SA(NUMBER_ZERO),
+        [_LCC_CC_DIGIT    ] = SA(NUMBER),
+        [_LCC_CC_POINT    ] = S(NUMBER_OR_OP),
+        [_LCC_CC_PLUS     ] = S(OPERATOR_PLUS),
+        [_LCC_CC_MINUS    ] = S(OPERATOR_MINUS),
+        [_LCC_CC_STAR     ] = S(OPERATOR_STAR),
+        [_LCC_CC_SLASH    ] = S(OPERATOR_SLASH),
+        [_LCC_CC_PERCENT  ] = S(OPERATOR_PERCENT),
+        [_LCC_CC_EQU      ] = S(OPERATOR_EQU),
+        [_LCC_CC_GT       ] = S(OPERATOR_GT),
+        [_LCC_CC_LT       ] = S(OPERATOR_LT),
+        [_LCC_CC_EXCL     ] = S(OPERATOR_EXCL),
+        [_LCC_CC_AMP      ] = S(OPERATOR_AMP),
+        [_LCC_CC_BAR      ] = S(OPERATOR_BAR),
+        [_LCC_CC_CARET    ] = S(OPERATOR_CARET),
+        [_LCC_CC_TILDE    ] = A(BINV),
+        [_LCC_CC_LBRACKET ] = A(LBRACKET),
+        [_LCC_CC_RBRACKET ] = A(RBRACKET),
+        [_LCC_CC_LINDEX   ] = A(LINDEX),
+        [_LCC_CC_RINDEX   ] = A(RINDEX),
+        [_LCC_CC_LBLOCK   ] = A(LBLOCK),
+        [_LCC_CC_RBLOCK   ] = A(RBLOCK),
+        [_LCC_CC_COLON    ] = A(COLON),
+        [_LCC_CC_COMMA    ] = A(COMMA),
+        [_LCC_CC_SEMICOLON] = A(SEMICOLON),
+        [_LCC_CC_QUESTION ] = A(QUESTION),
+    },
+
+    /* identifiers, the rest is handled by _lcc_handle_substate() */
+    [LCC_LX_SUBSTATE_NAME] = {
+        [_LCC_CC_ALPHA] = SA(NAME),
+        [_LCC_CC_ZERO ] = SA(NAME),
+        [_LCC_CC_DIGIT] = SA(NAME),
+    },
+
+    /* + ++ += */
+    [LCC_LX_SUBSTATE_OPERATOR_PLUS] = {
+        [_LCC_CC_PLUS] = A(INCR),
+        [_LCC_CC_EQU ] = A(IADD),
+    },
+
+    /* - -- -> -= */
+    [LCC_LX_SUBSTATE_OPERATOR_MINUS] = {
+        [_LCC_CC_MINUS] = A(DECR),
+        [_LCC_CC_GT   ] = A(DEREF),
+        [_LCC_CC_EQU  ] = A(ISUB),
+    },
+
+    /* * *= */
+    [LCC_LX_SUBSTATE_OPERATOR_STAR] = {
+        [_LCC_CC_EQU] = A(IMUL),
+    },
+
+    /* block comment, line comment or "/", "/=" */
+    [LCC_LX_SUBSTATE_OPERATOR_SLASH] = {
+        [_LCC_CC_STAR ] = S(COMMENT_BLOCK),
+        [_LCC_CC_SLASH] = S(COMMENT_LINE),
+        [_LCC_CC_EQU  ] = A(IDIV),
+    },
+
+    /* % %= */
+    [LCC_LX_SUBSTATE_OPERATOR_PERCENT] = {
+        [_LCC_CC_EQU] = A(IMOD),
+    },
+
+    /* = == */
+    [LCC_LX_SUBSTATE_OPERATOR_EQU] = {
+        [_LCC_CC_EQU] = A(EQ),
+    },
+
+    /* > >> >= >>= */
+    [LCC_LX_SUBSTATE_OPERATOR_GT] = {
+        [_LCC_CC_GT ] = S(OPERATOR_GT_GT),
+        [_LCC_CC_EQU] = A(GEQ),
+    },
+
+    /* >> >>= */
+    [LCC_LX_SUBSTATE_OPERATOR_GT_GT] = {
+        [_LCC_CC_EQU] = A(ISHR),
+    },
+
+    /* < << <= <<=, "#include <...>" is handled by _lcc_handle_substate() */
+    [LCC_LX_SUBSTATE_OPERATOR_LT] = {
+        [_LCC_CC_LT ] = S(OPERATOR_LT_LT),
+        [_LCC_CC_EQU] = A(LEQ),
+    },
+
+    /* << <<= */
+    [LCC_LX_SUBSTATE_OPERATOR_LT_LT] = {
+        [_LCC_CC_EQU] = A(ISHL),
+    },
+
+    /* ! != */
+    [LCC_LX_SUBSTATE_OPERATOR_EXCL] = {
+        [_LCC_CC_EQU] = A(NEQ),
+    },
+
+    /* & && &= */
+    [LCC_LX_SUBSTATE_OPERATOR_AMP] = {
+        [_LCC_CC_AMP] = A(LAND),
+        [_LCC_CC_EQU] = A(IAND),
+    },
+
+    /* | || |= */
+    [LCC_LX_SUBSTATE_OPERATOR_BAR] = {
+        [_LCC_CC_BAR] = A(LOR),
+        [_LCC_CC_EQU] = A(IOR),
+    },
+
+    /* ^ ^= */
+    [LCC_LX_SUBSTATE_OPERATOR_CARET] = {
+        [_LCC_CC_EQU] = A(IXOR),
+    },
+
+    /* block comment, "*" maybe the end of it */
+    [LCC_LX_SUBSTATE_COMMENT_BLOCK] = {
+        [_LCC_CC_STAR] = S(COMMENT_BLOCK_END),
+    },
+
+    /* we might have multiple stars before "/", which is handled by _lcc_handle_substate() */
+    [LCC_LX_SUBSTATE_COMMENT_BLOCK_END] = {
+        [_LCC_CC_STAR ] = S(COMMENT_BLOCK_END),
+        [_LCC_CC_SLASH] = _LCC_TR_NONE,
+    },
+};
 
-            break;
-        }
+/* actions for characters not listed in the transition table, 0 means it's handled by _lcc_handle_substate() */
+static const uint16_t _LCC_TR_DEFAULTS[_LCC_SUBSTATE_COUNT] = {
+    [LCC_LX_SUBSTATE_OPERATOR_PLUS    ] = K(PLUS),
+    [LCC_LX_SUBSTATE_OPERATOR_MINUS   ] = K(MINUS),
+    [LCC_LX_SUBSTATE_OPERATOR_STAR    ] = K(STAR),
+    [LCC_LX_SUBSTATE_OPERATOR_SLASH   ] = K(SLASH),
+    [LCC_LX_SUBSTATE_OPERATOR_PERCENT ] = K(PERCENT),
+    [LCC_LX_SUBSTATE_OPERATOR_EQU     ] = K(ASSIGN),
+    [LCC_LX_SUBSTATE_OPERATOR_GT      ] = K(GT),
+    [LCC_LX_SUBSTATE_OPERATOR_GT_GT   ] = K(BSHR),
+    [LCC_LX_SUBSTATE_OPERATOR_LT      ] = K(LT),
+    [LCC_LX_SUBSTATE_OPERATOR_LT_LT   ] = K(BSHL),
+    [LCC_LX_SUBSTATE_OPERATOR_EXCL    ] = K(LNOT),
+    [LCC_LX_SUBSTATE_OPERATOR_AMP     ] = K(BAND),
+    [LCC_LX_SUBSTATE_OPERATOR_BAR     ] = K(BOR),
+    [LCC_LX_SUBSTATE_OPERATOR_CARET   ] = K(BXOR),
+    [LCC_LX_SUBSTATE_COMMENT_LINE     ] = S(COMMENT_LINE),
+    [LCC_LX_SUBSTATE_COMMENT_BLOCK    ] = S(COMMENT_BLOCK),
+    [LCC_LX_SUBSTATE_COMMENT_BLOCK_END] = S(COMMENT_BLOCK),
+};
 
-        /* long specifier */
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_L:
+#undef S
+#undef SA
+#undef A
+#undef K
+
+static inline char _lcc_handle_transition(lcc_lexer_t *self)
+{
+    /* "#include <...>" file names are not operators */
+    if ((self->substate == LCC_LX_SUBSTATE_OPERATOR_LT) && (self->flags & LCC_LXDN_INCLUDE))
+        return 0;
+
+    /* lookup the transition table, unlisted characters take the default action */
+    uint16_t tr = _LCC_TRANSITIONS[self->substate][_LCC_CHAR_CLASS[(uint8_t)self->ch]];
+    tr = tr ? tr : _LCC_TR_DEFAULTS[self->substate];
+
+    /* perform the transition action */
+    switch (tr & _LCC_TR_MASK)
+    {
+        /* not in transition table */
+        default:
+            return 0;
+
+        /* shift to next sub-state */
+        case _LCC_TR_SHIFT:
         {
-            if ((self->ch != 'l') && (self->ch != 'L'))
-            {
-                _lcc_commit_number(self, LCC_LT_LONG, 0);
-                self->state = LCC_LX_STATE_ACCEPT_KEEP;
-            }
-            else
-            {
-                self->state = LCC_LX_STATE_ACCEPT;
+            /* append to token buffer as needed */
+            if (tr & _LCC_TR_APPEND)
                 lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                _lcc_commit_number(self, LCC_LT_LONGLONG, 1);
-            }
 
-            break;
+            /* shift next character */
+            self->state = LCC_LX_STATE_SHIFT;
+            self->substate = tr & 0xff;
+            return 1;
         }
 
-        /* unsigned long specifier */
-        case LCC_LX_SUBSTATE_NUMBER_INTEGER_UL:
+        /* accept the operator with this character */
+        case _LCC_TR_ACCEPT:
         {
-            if ((self->ch != 'l') && (self->ch != 'L'))
-            {
-                _lcc_commit_number(self, LCC_LT_ULONG, 0);
-                self->state = LCC_LX_STATE_ACCEPT_KEEP;
-            }
-            else
-            {
-                self->state = LCC_LX_STATE_ACCEPT;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                _lcc_commit_number(self, LCC_LT_ULONGLONG, 1);
-            }
+            self->state = LCC_LX_STATE_ACCEPT;
+            _lcc_commit_operator(self, tr & 0xff, 1);
+            return 1;
+        }
 
-            break;
+        /* accept the operator, and keep this character */
+        case _LCC_TR_KEEP:
+        {
+            self->state = LCC_LX_STATE_ACCEPT_KEEP;
+            _lcc_commit_operator(self, tr & 0xff, 0);
+            return 1;
         }
+    }
+}
 
-        /* scientific notation of decimal numbers */
-        case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI:
+static void _lcc_handle_substate(lcc_lexer_t *self)
+{
+    /* check for EOF and EOL flags */
+    if ((self->flags & LCC_LXF_EOF) ||
+        (self->flags & LCC_LXF_EOL))
+    {
+        /* check for sub-state */
+        switch (self->substate)
         {
-            switch (self->ch)
+            /* in the middle of nothing, just ignore it */
+            case LCC_LX_SUBSTATE_NULL:
+                break;
+
+            /* clear source buffer when line comment ends */
+            case LCC_LX_SUBSTATE_COMMENT_LINE:
             {
-                /* "signed" exponent */
-                case '+':
-                case '-':
-                {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP_SIGN;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
-                }
+                lcc_token_buffer_reset(&(self->source));
+                break;
+            }
 
-                /* "unsigned" exponent */
-                case '0' ... '9':
+            /* block comment */
+            case LCC_LX_SUBSTATE_COMMENT_BLOCK:
+            case LCC_LX_SUBSTATE_COMMENT_BLOCK_END:
+            {
+                /* fire a warning when meets EOF */
+                if (self->flags & LCC_LXF_EOF)
                 {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    _lcc_lexer_warning(self, "EOF when parsing block comment");
                     break;
                 }
 
-                /* other characters are prohibited */
-                default:
-                {
-                    _lcc_lexer_error(self, "'+', '-' or digits expected");
-                    break;
-                }
+                /* otherwise shift pass the line ending */
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK;
+                return;
             }
 
-            break;
-        }
-
-        /* scientific notation of decimal numbers - exponent part */
-        case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP:
-        {
-            switch (self->ch)
+            /* in the middle of parsing identifiers, accept or commit it */
+            case LCC_LX_SUBSTATE_NAME:
             {
-                /* float specifier */
-                case 'f':
-                case 'F':
-                {
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    _lcc_commit_number(self, LCC_LT_FLOAT, 1);
-                    break;
-                }
-
-                /* long double specifier */
-                case 'l':
-                case 'L':
-                {
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    _lcc_commit_number(self, LCC_LT_LONGDOUBLE, 1);
+                if (_lcc_commit_ident(self, 1))
                     break;
-                }
+                else
+                    return;
+            }
 
-                /* digits */
-                case '0' ... '9':
+            /* in the middle of parsing tokens */
+            case LCC_LX_SUBSTATE_STRING:
+            case LCC_LX_SUBSTATE_STRING_ESCAPE:
+            case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX:
+            case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_D:
+            case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_E:
+            case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_2:
+            case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3:
+            case LCC_LX_SUBSTATE_INCLUDE_FILE:
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN:
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX:
+            case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI:
+            case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP_SIGN:
+            case LCC_LX_SUBSTATE_OPERATOR_ELLIPSIS:
+            {
+                /* not a directive, it's an error */
+                if (!(self->flags & LCC_LXF_DIRECTIVE))
                 {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP;
-                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
-                    break;
+                    _lcc_lexer_error(self, "Unexpected %s", (self->flags & LCC_LXF_EOF) ? "EOF" : "EOL");
+                    return;
                 }
 
-                /* other characters */
-                default:
-                {
-                    _lcc_commit_number(self, LCC_LT_DOUBLE, 0);
-                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                    break;
-                }
+                /* commit as string, but give a warning */
+                _lcc_commit_string(self, 1);
+                _lcc_lexer_warning(self, "Invalid preprocessor token");
+                break;
             }
 
-            break;
-        }
-
-        /* scientific notation of decimal numbers - sign of exponent part */
-        case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP_SIGN:
-        {
-            /* must be digits */
-            if (!(isdigit(self->ch)))
+            /* in the middle of parsing integers */
+            case LCC_LX_SUBSTATE_NUMBER:
+            case LCC_LX_SUBSTATE_NUMBER_ZERO:
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D:
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D:
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT:
             {
-                _lcc_lexer_error(self, "Digits expected");
+                _lcc_commit_number(self, LCC_LT_INT, 1);
                 break;
             }
 
-            /* move to exponent state */
-            self->state = LCC_LX_STATE_SHIFT;
-            self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP;
-            lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            break;
-        }
-
-        /** very complex operator logic **/
-
-#define KEEP(keep_token) default:               \
-{                                               \
-    self->state = LCC_LX_STATE_ACCEPT_KEEP;     \
-    _lcc_commit_operator(self, keep_token, 0);  \
-    break;                                      \
-}
-
-#define SHIFT(expect, shift) case expect:       \
-{                                               \
-    self->state = LCC_LX_STATE_SHIFT;           \
-    self->substate = shift;                     \
-    break;                                      \
-}
-
-#define ACCEPT(expect, ac_token) case expect:   \
-{                                               \
-    self->state = LCC_LX_STATE_ACCEPT;          \
-    _lcc_commit_operator(self, ac_token, 1);    \
-    break;                                      \
-}
-
-#define AC_K(                       \
-    expect, ac_token,               \
-    keep_token)                     \
-{                                   \
-    switch (self->ch)               \
-    {                               \
-        KEEP(keep_token)            \
-        ACCEPT(expect, ac_token)    \
-    }                               \
-                                    \
-    break;                          \
-}
-
-#define AC2_K(                      \
-    expect1, ac_token1,             \
-    expect2, ac_token2,             \
-    keep_token)                     \
-{                                   \
-    switch (self->ch)               \
-    {                               \
-        KEEP(keep_token)            \
-        ACCEPT(expect1, ac_token1)  \
-        ACCEPT(expect2, ac_token2)  \
-    }                               \
-                                    \
-    break;                          \
-}
-
-        /* one- or two-character operators */
-        case LCC_LX_SUBSTATE_OPERATOR_STAR    : AC_K('=', LCC_OP_IMUL, LCC_OP_STAR   )  /* * *= */
-        case LCC_LX_SUBSTATE_OPERATOR_PERCENT : AC_K('=', LCC_OP_IMOD, LCC_OP_PERCENT)  /* % %= */
-        case LCC_LX_SUBSTATE_OPERATOR_EQU     : AC_K('=', LCC_OP_EQ  , LCC_OP_ASSIGN )  /* = == */
-        case LCC_LX_SUBSTATE_OPERATOR_EXCL    : AC_K('=', LCC_OP_NEQ , LCC_OP_LNOT   )  /* ! != */
-        case LCC_LX_SUBSTATE_OPERATOR_CARET   : AC_K('=', LCC_OP_IXOR, LCC_OP_BXOR   )  /* ^ ^= */
-
-        /* one- or two-character and incremental operators */
-        case LCC_LX_SUBSTATE_OPERATOR_PLUS    : AC2_K('+', LCC_OP_INCR, '=', LCC_OP_IADD, LCC_OP_PLUS )     /* + ++ += */
-        case LCC_LX_SUBSTATE_OPERATOR_AMP     : AC2_K('&', LCC_OP_LAND, '=', LCC_OP_IAND, LCC_OP_BAND )     /* & && &= */
-        case LCC_LX_SUBSTATE_OPERATOR_BAR     : AC2_K('|', LCC_OP_LOR , '=', LCC_OP_IOR , LCC_OP_BOR  )     /* | || |= */
-
-        /* bit-shifting operators */
-        case LCC_LX_SUBSTATE_OPERATOR_GT_GT   : AC_K('=', LCC_OP_ISHR, LCC_OP_BSHR)     /* >> >>= */
-        case LCC_LX_SUBSTATE_OPERATOR_LT_LT   : AC_K('=', LCC_OP_ISHL, LCC_OP_BSHL)     /* << <<= */
-
-        /* - -- -> -= */
-        case LCC_LX_SUBSTATE_OPERATOR_MINUS:
-        {
-            switch (self->ch)
+            /* in the middle of parsing integers (unsigned) */
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_U:
             {
-                KEEP(LCC_OP_MINUS)
-                ACCEPT('=', LCC_OP_ISUB)
-                ACCEPT('-', LCC_OP_DECR)
-                ACCEPT('>', LCC_OP_DEREF)
+                _lcc_commit_number(self, LCC_LT_UINT, 1);
+                break;
             }
 
-            break;
-        }
-
-        /* > >> >= >>= */
-        case LCC_LX_SUBSTATE_OPERATOR_GT:
-        {
-            switch (self->ch)
+            /* in the middle of parsing integers (long) */
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_L:
             {
-                KEEP(LCC_OP_GT)
-                SHIFT('>', LCC_LX_SUBSTATE_OPERATOR_GT_GT)
-                ACCEPT('=', LCC_OP_GEQ)
+                _lcc_commit_number(self, LCC_LT_LONG, 1);
+                break;
             }
 
-            break;
-        }
-
-        /* < << <= <<=, or #include <...> file name */
-        case LCC_LX_SUBSTATE_OPERATOR_LT:
-        {
-            /* treat as file name when parsing "#include" directive */
-            if (self->flags & LCC_LXDN_INCLUDE)
+            /* in the middle of parsing integers (unsigned long) */
+            case LCC_LX_SUBSTATE_NUMBER_INTEGER_UL:
             {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->flags |= LCC_LXDF_INCLUDE_SYS;
-                self->substate = LCC_LX_SUBSTATE_INCLUDE_FILE;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                _lcc_commit_number(self, LCC_LT_ULONG, 1);
+                break;
             }
-            else
+
+            /* in the middle of parsing floats (double) */
+            case LCC_LX_SUBSTATE_NUMBER_DECIMAL:
+            case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP:
             {
-                switch (self->ch)
-                {
-                    KEEP(LCC_OP_LT)
-                    SHIFT('<', LCC_LX_SUBSTATE_OPERATOR_LT_LT)
-                    ACCEPT('=', LCC_OP_LEQ)
-                }
+                _lcc_commit_number(self, LCC_LT_DOUBLE, 1);
+                break;
             }
 
-            break;
+            /* in the middle of parsing operators, accept or commit what already got */
+            case LCC_LX_SUBSTATE_NUMBER_OR_OP     : _lcc_commit_operator(self, LCC_OP_POINT     , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_PLUS    : _lcc_commit_operator(self, LCC_OP_PLUS      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_MINUS   : _lcc_commit_operator(self, LCC_OP_MINUS     , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_STAR    : _lcc_commit_operator(self, LCC_OP_STAR      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_SLASH   : _lcc_commit_operator(self, LCC_OP_SLASH     , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_PERCENT : _lcc_commit_operator(self, LCC_OP_PERCENT   , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_EQU     : _lcc_commit_operator(self, LCC_OP_ASSIGN    , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_GT      : _lcc_commit_operator(self, LCC_OP_GT        , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_GT_GT   : _lcc_commit_operator(self, LCC_OP_BSHR      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_LT      : _lcc_commit_operator(self, LCC_OP_LT        , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_LT_LT   : _lcc_commit_operator(self, LCC_OP_BSHL      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_EXCL    : _lcc_commit_operator(self, LCC_OP_LNOT      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_AMP     : _lcc_commit_operator(self, LCC_OP_BAND      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_BAR     : _lcc_commit_operator(self, LCC_OP_BOR       , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_CARET   : _lcc_commit_operator(self, LCC_OP_BXOR      , 1); break;
+            case LCC_LX_SUBSTATE_OPERATOR_HASH    : _lcc_commit_operator(self, LCC_OP_STRINGIZE , 1); break;
         }
 
-#undef KEEP
-#undef SHIFT
-#undef ACCEPT
-#undef AC_K
-#undef AC2_K
+        /* EOF or EOL when parsing compiler directive, commit it */
+        if (self->flags & LCC_LXF_DIRECTIVE)
+            self->state = LCC_LX_STATE_COMMIT;
+        else
+            self->state = LCC_LX_STATE_ACCEPT;
 
-        /* include file name (#include <...> only) */
-        case LCC_LX_SUBSTATE_INCLUDE_FILE:
-        {
-            if (self->ch == '>')
-            {
-                _lcc_commit_string(self, 1);
-                self->state = LCC_LX_STATE_ACCEPT;
-            }
-            else
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                lcc_token_buffer_append(&(self->token_buffer), self->ch);
-            }
+        /* clear those flags */
+        self->flags &= ~LCC_LXF_EOF;
+        self->flags &= ~LCC_LXF_EOL;
+        return;
+    }
 
-            break;
-        }
+    /* most transitions are table-driven */
+    if (_lcc_handle_transition(self))
+        return;
 
-        /* block comment, line comment or "/", "/=" */
-        case LCC_LX_SUBSTATE_OPERATOR_SLASH:
+    /* check for sub-state */
+    switch (self->substate)
+    {
+        /* initial sub-state */
+        case LCC_LX_SUBSTATE_NULL:
         {
+            /* check for character */
             switch (self->ch)
             {
-                /* /= */
-                case '=':
+                /* chars */
+                case '\'':
                 {
-                    self->state = LCC_LX_STATE_ACCEPT;
-                    _lcc_commit_operator(self, LCC_OP_IDIV, 1);
+                    self->flags |= LCC_LXF_CHAR_SEQ;
+                    self->substate = LCC_LX_SUBSTATE_STRING;
                     break;
                 }
 
-                /* line comment */
-                case '/':
+                /* strings */
+                case '"':
                 {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_COMMENT_LINE;
+                    self->flags &= ~LCC_LXF_CHAR_SEQ;
+                    self->substate = LCC_LX_SUBSTATE_STRING;
                     break;
                 }
 
-                /* block comment */
-                case '*':
+                /* token stringize */
+                case '#':
                 {
-                    self->state = LCC_LX_STATE_SHIFT;
-                    self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK;
-                    break;
+                    /* preprocessor operators */
+                    if (self->flags & LCC_LXF_DIRECTIVE)
+                    {
+                        self->state = LCC_LX_STATE_SHIFT;
+                        self->substate = LCC_LX_SUBSTATE_OPERATOR_HASH;
+                        break;
+                    }
+
+                    /* directives allowed */
+                    if (!(self->file->flags & LCC_FF_LNODIR))
+                    {
+                        self->state = LCC_LX_STATE_GOT_DIRECTIVE;
+                        self->substate = LCC_LX_SUBSTATE_NULL;
+                        return;
+                    }
+
+                    /* otherwise it's an error */
+                    _lcc_lexer_error(self, "Invalid character '#'");
+                    return;
                 }
 
-                /* / */
+                /* other characters */
                 default:
                 {
-                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                    _lcc_commit_operator(self, LCC_OP_SLASH, 0);
-                    break;
+                    /* GNU ext :: dollar in identifier */
+                    if ((self->ch == '$') && (self->gnuext & LCC_LX_GNUX_DOLLAR_IDENT))
+                    {
+                        self->substate = LCC_LX_SUBSTATE_NAME;
+                        lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                        break;
+                    }
+
+                    /* other unknown characters */
+                    _LCC_WRONG_CHAR("Invalid character")
+                    return;
                 }
             }
 
+            /* continue shifting */
+            self->state = LCC_LX_STATE_SHIFT;
             break;
         }
 
-        /* macro operators */
-        case LCC_LX_SUBSTATE_OPERATOR_HASH:
+        /* identifiers */
+        case LCC_LX_SUBSTATE_NAME:
         {
-            if (self->ch == '#')
-            {
-                self->state = LCC_LX_STATE_ACCEPT;
-                _lcc_commit_operator(self, LCC_OP_CONCAT, 1);
-            }
-            else
+            /* it's a valid identifier */
+            if ((self->ch == '_') ||
+                ((self->ch >= 'a') && (self->ch <= 'z')) ||
+                ((self->ch >= 'A') && (self->ch <= 'Z')) ||
+                ((self->ch >= '0') && (self->ch <= '9')) ||
+                ((self->ch == '$') && (self->gnuext & LCC_LX_GNUX_DOLLAR_IDENT)))
             {
-                self->state = LCC_LX_STATE_ACCEPT_KEEP;
-                _lcc_commit_operator(self, LCC_OP_STRINGIZE, 0);
+                self->state = LCC_LX_STATE_SHIFT;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                break;
             }
 
+            /* commit the identifier */
+            if (!(_lcc_commit_ident(self, 0)))
+                return;
+
+            /* keep the character */
+            self->state = LCC_LX_STATE_ACCEPT_KEEP;
             break;
         }
 
-        /* ellipsis operator */
-        case LCC_LX_SUBSTATE_OPERATOR_ELLIPSIS:
-        {
-            /* the third character must be "." */
-            if (self->ch != '.')
+        /* chars or strings */
+        case LCC_LX_SUBSTATE_STRING:
+        {
+            switch (self->ch)
             {
-                _LCC_WRONG_CHAR("Invalid character")
-                return;
+                /* end of string */
+                case '"':
+                {
+                    /* ignore when parsing chars */
+                    if (self->flags & LCC_LXF_CHAR_SEQ)
+                        goto _lcc_label_string_generic_char;
+
+                    /* accept as strings */
+                    _lcc_commit_string(self, 1);
+                    self->state = LCC_LX_STATE_ACCEPT;
+                    break;
+                }
+
+                /* end of chars */
+                case '\'':
+                {
+                    /* ignore when parsing strings */
+                    if (!(self->flags & LCC_LXF_CHAR_SEQ))
+                        goto _lcc_label_string_generic_char;
+
+                    /* chars cannot be empty */
+                    if (!(self->token_buffer.len))
+                    {
+                        _lcc_lexer_error(self, "Empty character constant");
+                        return;
+                    }
+
+                    /* accept as chars */
+                    _lcc_commit_chars(self, 1);
+                    self->state = LCC_LX_STATE_ACCEPT;
+                    break;
+                }
+
+                /* escape characters */
+                case '\\':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* generic characters */
+                default:
+                _lcc_label_string_generic_char:
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
             }
 
-            /* accept as ellipsis operator */
-            self->state = LCC_LX_STATE_ACCEPT;
-            _lcc_commit_operator(self, LCC_OP_ELLIPSIS, 1);
             break;
         }
 
-        /* line comment, ignore every character on this line from now on */
-        case LCC_LX_SUBSTATE_COMMENT_LINE:
+        /* escape characters */
+        case LCC_LX_SUBSTATE_STRING_ESCAPE:
         {
+            switch (self->ch)
+            {
+                /* normal escape characters */
+                case 'a':
+                case 'b':
+                case 'e':
+                case 'f':
+                case 'n':
+                case 'r':
+                case 't':
+                case 'v':
+                case '?':
+                case '"':
+                case '\'':
+                case '\\':
+                {
+                    /* "\e" escape character (should have GNU extension enabled) */
+                    if ((self->ch == 'e') && !(self->gnuext & LCC_LX_GNUX_ESCAPE_CHAR))
+                        goto _lcc_string_escape_unknown;
+
+                    /* end of escape sequence */
+                    self->substate = LCC_LX_SUBSTATE_STRING;
+                    break;
+                }
+
+                /* hexadecimal escape characters */
+                case 'x':
+                case 'X':
+                {
+                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_HEX;
+                    break;
+                }
+
+                /* octal escape characters */
+                case '0' ... '3':
+                {
+                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_2;
+                    break;
+                }
+
+                /* octal escape characters (two digits only) */
+                case '4' ... '7':
+                {
+                    self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3;
+                    break;
+                }
+
+                /* other unknown characters */
+                default:
+                _lcc_string_escape_unknown:
+                {
+                    self->substate = LCC_LX_SUBSTATE_STRING;
+                    _LCC_WRONG_CHAR("Unknown escape character")
+                    break;
+                }
+            }
+
+            /* append to token buffer */
             self->state = LCC_LX_STATE_SHIFT;
-            self->substate = LCC_LX_SUBSTATE_COMMENT_LINE;
+            lcc_token_buffer_append(&(self->token_buffer), self->ch);
             break;
         }
 
-        /* block comment */
-        case LCC_LX_SUBSTATE_COMMENT_BLOCK:
+        /* hexadecimal escape characters (first and second digit) */
+        case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX:
+        case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_D:
         {
-            self->state = LCC_LX_STATE_SHIFT;
-            self->substate = (self->ch == '*') ? LCC_LX_SUBSTATE_COMMENT_BLOCK_END : LCC_LX_SUBSTATE_COMMENT_BLOCK;
+            switch (self->ch)
+            {
+                /* hexadecimal digits */
+                case '0' ... '9':
+                case 'a' ... 'f':
+                case 'A' ... 'F':
+                {
+                    /* move to next substate */
+                    if (self->substate == LCC_LX_SUBSTATE_STRING_ESCAPE_HEX)
+                        self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_D;
+                    else
+                        self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_E;
+
+                    /* shift more characters */
+                    self->state = LCC_LX_STATE_SHIFT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* other unknown characters */
+                default:
+                {
+                    _LCC_WRONG_CHAR("Invalid hexadecimal digit")
+                    return;
+                }
+            }
+
             break;
         }
 
-        /* block comment end */
-        case LCC_LX_SUBSTATE_COMMENT_BLOCK_END:
+        /* hexadecimal escape characters (end of digits) */
+        case LCC_LX_SUBSTATE_STRING_ESCAPE_HEX_E:
         {
-            /* block comment ends */
-            if (self->ch == '/')
+            switch (self->ch)
             {
-                /* clear source buffer */
-                self->source->len = 0;
-                self->source->buf[0] = 0;
+                /* hexadecimal digits */
+                case '0' ... '9':
+                case 'a' ... 'f':
+                case 'A' ... 'F':
+                {
+                    _lcc_lexer_error(self, "Hex escape sequence out of range");
+                    break;
+                }
 
-                /* shift to next state */
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_NULL;
-                break;
+                /* other unknown characters */
+                default:
+                {
+                    self->state = LCC_LX_STATE_GOT_CHAR;
+                    self->substate = LCC_LX_SUBSTATE_STRING;
+                    break;
+                }
             }
 
-            /* we might have multiple stars before "/" character */
-            if (self->ch != '*')
+            break;
+        }
+
+        /* octal escape characters (second and third digit) */
+        case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_2:
+        case LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3:
+        {
+            if ((self->ch < '0') || (self->ch > '7'))
+            {
+                self->state = LCC_LX_STATE_GOT_CHAR;
+                self->substate = LCC_LX_SUBSTATE_STRING;
+            }
+            else if (self->substate == LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3)
             {
                 self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK;
-                break;
+                self->substate = LCC_LX_SUBSTATE_STRING;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
             }
             else
             {
                 self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK_END;
-                break;
+                self->substate = LCC_LX_SUBSTATE_STRING_ESCAPE_OCT_3;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
             }
-        }
-    }
-}
 
-#undef _LCC_WRONG_CHAR
-
-/* evaluator declarations */
+            break;
+        }
 
-static char _lcc_eval_factor  (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_term    (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_expr    (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_shift   (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_order   (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_equal   (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_bit_and (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_bit_xor (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_bit_or  (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_bool_and(lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
-static char _lcc_eval_bool_or (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+        /* numbers */
+        case LCC_LX_SUBSTATE_NUMBER:
+        case LCC_LX_SUBSTATE_NUMBER_DECIMAL:
+        {
+            switch (self->ch)
+            {
+                /* decimal point */
+                case '.':
+                {
+                    /* already decimal number, stop here */
+                    if (self->substate == LCC_LX_SUBSTATE_NUMBER_DECIMAL)
+                        goto _lcc_label_number_end;
 
-/* evaluator implementations */
+                    /* otherwise mark as decimal number */
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
 
-#define _LCC_OP_0(op)               _LCC_TUPLE_ITEM_AT(op, 0)
-#define _LCC_OP_1(op)               _LCC_TUPLE_ITEM_AT(op, 1)
+                /* decimal number (scientific notation) */
+                case 'e':
+                case 'E':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
 
-#define _LCC_OP_OR_1_I              ()
-#define _LCC_OP_OR_2_I              (||,)
+                /* digits */
+                case '0' ... '9':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* float specifier */
+                case 'f':
+                case 'F':
+                {
+                    self->state = LCC_LX_STATE_ACCEPT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    _lcc_commit_number(self, LCC_LT_FLOAT, 1);
+                    break;
+                }
+
+                /* unsigned specifier */
+                case 'u':
+                case 'U':
+                {
+                    /* doesn't make sense with floating points */
+                    if (self->substate == LCC_LX_SUBSTATE_NUMBER_DECIMAL)
+                        goto _lcc_label_number_end;
+
+                    /* mark as unsigned integer */
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* long specifier */
+                case 'l':
+                case 'L':
+                {
+                    /* long double, that's it, stop here */
+                    if (self->substate == LCC_LX_SUBSTATE_NUMBER_DECIMAL)
+                    {
+                        self->state = LCC_LX_STATE_ACCEPT;
+                        lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                        _lcc_commit_number(self, LCC_LT_LONGDOUBLE, 1);
+                    }
+                    else
+                    {
+                        self->state = LCC_LX_STATE_SHIFT;
+                        self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
+                        lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    }
+
+                    break;
+                }
+
+                /* other characters, commit the number */
+                default:
+                _lcc_label_number_end:
+                {
+                    /* move to next character */
+                    if (self->substate == LCC_LX_SUBSTATE_NUMBER)
+                        _lcc_commit_number(self, LCC_LT_INT, 0);
+                    else
+                        _lcc_commit_number(self, LCC_LT_DOUBLE, 0);
+
+                    /* accept but keep this character */
+                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                    break;
+                }
+            }
+
+            break;
+        }
+
+        /* zero, maybe decimal, hexadecimal or octal integer */
+        case LCC_LX_SUBSTATE_NUMBER_ZERO:
+        {
+            switch (self->ch)
+            {
+                /* decimal point */
+                case '.':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* decimal number (scientific notation) */
+                case 'e':
+                case 'E':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* binary specifier */
+                case 'b':
+                case 'B':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* hexadecimal specifier */
+                case 'x':
+                case 'X':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* octal digits */
+                case '0' ... '7':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* '8' and '9' are not valid octal digits */
+                case '8':
+                case '9':
+                {
+                    _lcc_lexer_error(self, "Invalid octal digit '%c'", self->ch);
+                    break;
+                }
+
+                /* float specifier */
+                case 'f':
+                case 'F':
+                {
+                    self->state = LCC_LX_STATE_ACCEPT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    _lcc_commit_number(self, LCC_LT_FLOAT, 1);
+                    break;
+                }
+
+                /* unsigned specifier */
+                case 'u':
+                case 'U':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* long specifier */
+                case 'l':
+                case 'L':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* other characters, commit a single zero */
+                default:
+                {
+                    _lcc_commit_number(self, LCC_LT_INT, 0);
+                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                    break;
+                }
+            }
+
+            break;
+        }
+
+        /* decimal number or a simple point */
+        case LCC_LX_SUBSTATE_NUMBER_OR_OP:
+        {
+            /* maybe ellipsis operator */
+            if (self->ch == '.')
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_OPERATOR_ELLIPSIS;
+                break;
+            }
+
+            /* not a valid digit, accept as a "." operator */
+            if (!(isdigit(self->ch)))
+            {
+                self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                _lcc_commit_operator(self, LCC_OP_POINT, 0);
+                break;
+            }
+
+            /* also add the missing point */
+            self->state = LCC_LX_STATE_SHIFT;
+            self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL;
+            lcc_token_buffer_append(&(self->token_buffer), '.');
+            lcc_token_buffer_append(&(self->token_buffer), self->ch);
+            break;
+        }
+
+        /* binary or hexadecimal integers */
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN:
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D:
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX:
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D:
+        {
+            /* binary integers */
+            if (((self->ch == '0') ||
+                 (self->ch == '1')) &&
+                ((self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN) ||
+                 (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D)))
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN_D;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                break;
+            }
+
+            /* hexadecimal integers */
+            if ((((self->ch >= '0') && (self->ch <= '9')) ||
+                 ((self->ch >= 'a') && (self->ch <= 'f')) ||
+                 ((self->ch >= 'A') && (self->ch <= 'F'))) &&
+                ((self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX) ||
+                 (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D)))
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX_D;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                break;
+            }
+
+            /* check for binary digits */
+            if (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_BIN)
+            {
+                _LCC_WRONG_CHAR("Invalid binary digit")
+                return;
+            }
+
+            /* check for hexadecimal digits */
+            if (self->substate == LCC_LX_SUBSTATE_NUMBER_INTEGER_HEX)
+            {
+                _LCC_WRONG_CHAR("Invalid hexadecimal digit")
+                return;
+            }
+
+            /* check for integer modifiers */
+            switch (self->ch)
+            {
+                /* unsigned specifier */
+                case 'u':
+                case 'U':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* long specifier */
+                case 'l':
+                case 'L':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* not a specifier */
+                default:
+                {
+                    _lcc_commit_number(self, LCC_LT_INT, 0);
+                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                    break;
+                }
+            }
+
+            break;
+        }
+
+        /* octal integers */
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT:
+        {
+            switch (self->ch)
+            {
+                /* unsigned specifier */
+                case 'u':
+                case 'U':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_U;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* long specifier */
+                case 'l':
+                case 'L':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_L;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* octal digits */
+                case '0' ... '7':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_OCT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* other characters */
+                default:
+                {
+                    _lcc_commit_number(self, LCC_LT_INT, 0);
+                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                    break;
+                }
+            }
+
+            break;
+        }
+
+        /* unsigned specifier */
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_U:
+        {
+            if ((self->ch != 'l') && (self->ch != 'L'))
+            {
+                _lcc_commit_number(self, LCC_LT_UINT, 0);
+                self->state = LCC_LX_STATE_ACCEPT_KEEP;
+            }
+            else
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_NUMBER_INTEGER_UL;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+            }
+
+            break;
+        }
+
+        /* long specifier */
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_L:
+        {
+            if ((self->ch != 'l') && (self->ch != 'L'))
+            {
+                _lcc_commit_number(self, LCC_LT_LONG, 0);
+                self->state = LCC_LX_STATE_ACCEPT_KEEP;
+            }
+            else
+            {
+                self->state = LCC_LX_STATE_ACCEPT;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                _lcc_commit_number(self, LCC_LT_LONGLONG, 1);
+            }
+
+            break;
+        }
+
+        /* unsigned long specifier */
+        case LCC_LX_SUBSTATE_NUMBER_INTEGER_UL:
+        {
+            if ((self->ch != 'l') && (self->ch != 'L'))
+            {
+                _lcc_commit_number(self, LCC_LT_ULONG, 0);
+                self->state = LCC_LX_STATE_ACCEPT_KEEP;
+            }
+            else
+            {
+                self->state = LCC_LX_STATE_ACCEPT;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                _lcc_commit_number(self, LCC_LT_ULONGLONG, 1);
+            }
+
+            break;
+        }
+
+        /* scientific notation of decimal numbers */
+        case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI:
+        {
+            switch (self->ch)
+            {
+                /* "signed" exponent */
+                case '+':
+                case '-':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP_SIGN;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* "unsigned" exponent */
+                case '0' ... '9':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* other characters are prohibited */
+                default:
+                {
+                    _lcc_lexer_error(self, "'+', '-' or digits expected");
+                    break;
+                }
+            }
+
+            break;
+        }
+
+        /* scientific notation of decimal numbers - exponent part */
+        case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP:
+        {
+            switch (self->ch)
+            {
+                /* float specifier */
+                case 'f':
+                case 'F':
+                {
+                    self->state = LCC_LX_STATE_ACCEPT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    _lcc_commit_number(self, LCC_LT_FLOAT, 1);
+                    break;
+                }
+
+                /* long double specifier */
+                case 'l':
+                case 'L':
+                {
+                    self->state = LCC_LX_STATE_ACCEPT;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    _lcc_commit_number(self, LCC_LT_LONGDOUBLE, 1);
+                    break;
+                }
+
+                /* digits */
+                case '0' ... '9':
+                {
+                    self->state = LCC_LX_STATE_SHIFT;
+                    self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP;
+                    lcc_token_buffer_append(&(self->token_buffer), self->ch);
+                    break;
+                }
+
+                /* other characters */
+                default:
+                {
+                    _lcc_commit_number(self, LCC_LT_DOUBLE, 0);
+                    self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                    break;
+                }
+            }
+
+            break;
+        }
+
+        /* scientific notation of decimal numbers - sign of exponent part */
+        case LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP_SIGN:
+        {
+            /* must be digits */
+            if (!(isdigit(self->ch)))
+            {
+                _lcc_lexer_error(self, "Digits expected");
+                break;
+            }
+
+            /* move to exponent state */
+            self->state = LCC_LX_STATE_SHIFT;
+            self->substate = LCC_LX_SUBSTATE_NUMBER_DECIMAL_SCI_EXP;
+            lcc_token_buffer_append(&(self->token_buffer), self->ch);
+            break;
+        }
+
+        /** very complex operator logic **/
+
+        /* "<" when parsing "#include" directive, it's a file name */
+        case LCC_LX_SUBSTATE_OPERATOR_LT:
+        {
+            self->state = LCC_LX_STATE_SHIFT;
+            self->flags |= LCC_LXDF_INCLUDE_SYS;
+            self->substate = LCC_LX_SUBSTATE_INCLUDE_FILE;
+            lcc_token_buffer_append(&(self->token_buffer), self->ch);
+            break;
+        }
+
+        /* include file name (#include <...> only) */
+        case LCC_LX_SUBSTATE_INCLUDE_FILE:
+        {
+            if (self->ch == '>')
+            {
+                _lcc_commit_string(self, 1);
+                self->state = LCC_LX_STATE_ACCEPT;
+            }
+            else
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                lcc_token_buffer_append(&(self->token_buffer), self->ch);
+            }
+
+            break;
+        }
+
+        /* macro operators */
+        case LCC_LX_SUBSTATE_OPERATOR_HASH:
+        {
+            if (self->ch == '#')
+            {
+                self->state = LCC_LX_STATE_ACCEPT;
+                _lcc_commit_operator(self, LCC_OP_CONCAT, 1);
+            }
+            else
+            {
+                self->state = LCC_LX_STATE_ACCEPT_KEEP;
+                _lcc_commit_operator(self, LCC_OP_STRINGIZE, 0);
+            }
+
+            break;
+        }
+
+        /* ellipsis operator */
+        case LCC_LX_SUBSTATE_OPERATOR_ELLIPSIS:
+        {
+            /* the third character must be "." */
+            if (self->ch != '.')
+            {
+                _LCC_WRONG_CHAR("Invalid character")
+                return;
+            }
+
+            /* accept as ellipsis operator */
+            self->state = LCC_LX_STATE_ACCEPT;
+            _lcc_commit_operator(self, LCC_OP_ELLIPSIS, 1);
+            break;
+        }
+
+        /* fully table-driven sub-states */
+        case LCC_LX_SUBSTATE_OPERATOR_PLUS:
+        case LCC_LX_SUBSTATE_OPERATOR_MINUS:
+        case LCC_LX_SUBSTATE_OPERATOR_STAR:
+        case LCC_LX_SUBSTATE_OPERATOR_SLASH:
+        case LCC_LX_SUBSTATE_OPERATOR_PERCENT:
+        case LCC_LX_SUBSTATE_OPERATOR_EQU:
+        case LCC_LX_SUBSTATE_OPERATOR_GT:
+        case LCC_LX_SUBSTATE_OPERATOR_GT_GT:
+        case LCC_LX_SUBSTATE_OPERATOR_LT_LT:
+        case LCC_LX_SUBSTATE_OPERATOR_EXCL:
+        case LCC_LX_SUBSTATE_OPERATOR_AMP:
+        case LCC_LX_SUBSTATE_OPERATOR_BAR:
+        case LCC_LX_SUBSTATE_OPERATOR_CARET:
+        case LCC_LX_SUBSTATE_COMMENT_LINE:
+        case LCC_LX_SUBSTATE_COMMENT_BLOCK:
+        {
+            fprintf(stderr, "*** FATAL: missing transition for sub-state %d\n", self->substate);
+            abort();
+        }
+
+        /* block comment end */
+        case LCC_LX_SUBSTATE_COMMENT_BLOCK_END:
+        {
+            /* block comment ends */
+            if (self->ch == '/')
+            {
+                /* clear source buffer */
+                lcc_token_buffer_reset(&(self->source));
+
+                /* shift to next state */
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+                break;
+            }
+
+            /* we might have multiple stars before "/" character */
+            if (self->ch != '*')
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK;
+                break;
+            }
+            else
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_COMMENT_BLOCK_END;
+                break;
+            }
+        }
+    }
+}
+
+#undef _LCC_WRONG_CHAR
+
+/* evaluator declarations */
+
+static char _lcc_eval_factor  (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_term    (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_expr    (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_shift   (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_order   (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_equal   (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_bit_and (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_bit_xor (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_bit_or  (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_bool_and(lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+static char _lcc_eval_bool_or (lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end);
+
+/* evaluator implementations */
+
+#define _LCC_OP_0(op)               _LCC_TUPLE_ITEM_AT(op, 0)
+#define _LCC_OP_1(op)               _LCC_TUPLE_ITEM_AT(op, 1)
+
+#define _LCC_OP_OR_1_I              ()
+#define _LCC_OP_OR_2_I              (||,)
 #define _LCC_OP_OR_3_I              (||, ||,)
 #define _LCC_OP_OR_4_I              (||, ||, ||,)
 #define _LCC_OP_OR_I(n, i)          _LCC_TUPLE_ITEM_AT(_LCC_OP_OR_ ## n ## _I, i)
 #define _LCC_OP_OR(n, i)            _LCC_OP_OR_I(n, i)
 
-#define _LCC_OP_CHECK_I(i, n, op)   _LCC_OP_OR(n, i) ((*token)->operator == _LCC_OP_0(op))
-#define _LCC_OP_CHECK(...)          _LCC_FOR_EACH(_LCC_OP_CHECK_I, _LCC_VA_NARGS(__VA_ARGS__), __VA_ARGS__)
+#define _LCC_OP_CHECK_I(i, n, op)   _LCC_OP_OR(n, i) ((*token)->operator == _LCC_OP_0(op))
+#define _LCC_OP_CHECK(...)          _LCC_FOR_EACH(_LCC_OP_CHECK_I, _LCC_VA_NARGS(__VA_ARGS__), __VA_ARGS__)
+
+#define _LCC_OP_CASE_I(i, n, op)    case _LCC_OP_0(op): lhs = _LCC_OP_1(op); break;
+#define _LCC_OP_CASE(...)           _LCC_FOR_EACH(_LCC_OP_CASE_I, ?, __VA_ARGS__)
+
+#define _LCC_NZ(val, msg)           ({  \
+    /* check for zero */                \
+    if (!val)                           \
+    {                                   \
+        _lcc_lexer_error(self, #msg);   \
+        return 0;                       \
+    }                                   \
+                                        \
+    /* the verified value */            \
+    rhs;                                \
+})
+
+#define _LCC_SLASH_Z                Division by zero in preprocessor expression
+#define _LCC_PERCENT_Z              Remainder by zero in preprocessor expression
+
+#define _LCC_OP_S(op)               lhs op rhs
+#define _LCC_OP_Z(op, msg)          lhs op _LCC_NZ(rhs, msg)
+#define _LCC_MK_OP(name, op)        (LCC_OP_ ## name, _LCC_OP_S(op))
+#define _LCC_MK_NZ(name, op)        (LCC_OP_ ## name, _LCC_OP_Z(op, _LCC_ ## name ## _Z))
+
+#define _LCC_EVAL_OP(name, super, ...)                                          \
+static char _lcc_eval_ ## name(                                                 \
+    lcc_lexer_t *self,                                                          \
+    intmax_t *result,                                                           \
+    lcc_token_t **token,                                                        \
+    lcc_token_t *end)                                                           \
+{                                                                               \
+    intmax_t lhs;                                                               \
+    intmax_t rhs;                                                               \
+    lcc_operator_t op;                                                          \
+                                                                                \
+    /* evaluate left-hand side operand */                                       \
+    if (!(_lcc_eval_ ## super(self, &lhs, token, end)))                         \
+        return 0;                                                               \
+                                                                                \
+    /* search for every operator */                                             \
+    while ((*token) != end)                                                     \
+    {                                                                           \
+        /* must be an operator */                                               \
+        if ((*token)->type != LCC_TK_OPERATOR)                                  \
+        {                                                                       \
+            _lcc_lexer_error(self, "Invalid preprocessor expression token");    \
+            return 0;                                                           \
+        }                                                                       \
+                                                                                \
+        /* doesn't care other operators */                                      \
+        if (!(_LCC_OP_CHECK(__VA_ARGS__)))                                      \
+            break;                                                              \
+                                                                                \
+        /* skip the operator */                                                 \
+        op = (*token)->operator;                                                \
+        *token = (*token)->next;                                                \
+                                                                                \
+        /* evaluate right-hand side operand */                                  \
+        if (!(_lcc_eval_ ## super(self, &rhs, token, end)))                     \
+            return 0;                                                           \
+                                                                                \
+        /* apply operators */                                                   \
+        switch (op)                                                             \
+        {                                                                       \
+            /* auto-generated cases */                                          \
+            _LCC_OP_CASE(__VA_ARGS__)                                           \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    /* evaluation successful */                                                 \
+    *result = lhs;                                                              \
+    return 1;                                                                   \
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wswitch"
+
+_LCC_EVAL_OP(term    , factor  , _LCC_MK_OP(STAR, * ), _LCC_MK_NZ(SLASH, / ), _LCC_MK_NZ(PERCENT, %))
+_LCC_EVAL_OP(expr    , term    , _LCC_MK_OP(PLUS, + ), _LCC_MK_OP(MINUS, - ))
+_LCC_EVAL_OP(shift   , expr    , _LCC_MK_OP(BSHL, <<), _LCC_MK_OP(BSHR , >>))
+_LCC_EVAL_OP(order   , shift   , _LCC_MK_OP(GT  , > ), _LCC_MK_OP(GEQ  , >=), _LCC_MK_OP(LT, <), _LCC_MK_OP(LEQ, <=))
+_LCC_EVAL_OP(equal   , order   , _LCC_MK_OP(EQ  , ==), _LCC_MK_OP(NEQ  , !=))
+_LCC_EVAL_OP(bit_and , equal   , _LCC_MK_OP(BAND, & ))
+_LCC_EVAL_OP(bit_xor , bit_and , _LCC_MK_OP(BXOR, ^ ))
+_LCC_EVAL_OP(bit_or  , bit_xor , _LCC_MK_OP(BOR , | ))
+_LCC_EVAL_OP(bool_and, bit_or  , _LCC_MK_OP(LAND, &&))
+_LCC_EVAL_OP(bool_or , bool_and, _LCC_MK_OP(LOR , ||))
+
+#pragma clang diagnostic pop
+
+#undef _LCC_OP_0
+#undef _LCC_OP_1
+#undef _LCC_OP_OR_1_I
+#undef _LCC_OP_OR_2_I
+#undef _LCC_OP_OR_3_I
+#undef _LCC_OP_OR_4_I
+#undef _LCC_OP_OR_I
+#undef _LCC_OP_OR
+#undef _LCC_OP_CHECK_I
+#undef _LCC_OP_CHECK
+#undef _LCC_OP_CASE_I
+#undef _LCC_OP_CASE
+#undef _LCC_SLASH_Z
+#undef _LCC_PERCENT_Z
+#undef _LCC_OP_S
+#undef _LCC_OP_Z
+#undef _LCC_MK_OP
+#undef _LCC_MK_NZ
+#undef _LCC_EVAL_OP
+
+static char _lcc_eval_factor(lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end)
+{
+    /* must have at least 1 token */
+    if ((*token) == end)
+    {
+        _lcc_lexer_error(self, "Expected value in expression");
+        return 0;
+    }
+
+    /* check for token type */
+    switch ((*token)->type)
+    {
+        /* EOF, should not happen */
+        case LCC_TK_EOF:
+        {
+            fprintf(stderr, "*** FATAL: EOF when parsing factor\n");
+            abort();
+        }
+
+        /* normal macros are been substituted beforewards,
+         * no identifier but undefined one may appear here,
+         * which expands to zero according to the standard */
+        case LCC_TK_IDENT:
+        {
+            /* check for undefined function-like macros */
+            if (((*token)->next != end) &&
+                ((*token)->next->type == LCC_TK_OPERATOR) &&
+                ((*token)->next->operator == LCC_OP_LBRACKET))
+            {
+                _lcc_lexer_error(self, "Function-like macro '%s' is not defined", (*token)->ident->buf);
+                return 0;
+            }
+
+            /* undefined object-like macro expands to zero */
+            *token = (*token)->next;
+            *result = 0;
+            break;
+        }
+
+        /* simple "#pragma" directives cannot appear here since
+         * directives cannot nesting inside another directive, so if
+         * this happens, it must be expanded from "_Pragma" psudo-macro */
+        case LCC_TK_PRAGMA:
+        {
+            _lcc_lexer_error(self, "'_Pragma' is not allowed here");
+            return 0;
+        }
+
+        /* literal constant */
+        case LCC_TK_LITERAL:
+        {
+            /* convert the value on first use */
+            _lcc_eval_literal(self, *token);
+
+            /* check for literal type */
+            switch ((*token)->literal.type)
+            {
+                /* integer constants */
+                case LCC_LT_INT       : *result = (intmax_t)((*token)->literal.v_int);       break;
+                case LCC_LT_LONG      : *result = (intmax_t)((*token)->literal.v_long);      break;
+                case LCC_LT_LONGLONG  : *result = (intmax_t)((*token)->literal.v_longlong);  break;
+                case LCC_LT_UINT      : *result = (intmax_t)((*token)->literal.v_uint);      break;
+                case LCC_LT_ULONG     : *result = (intmax_t)((*token)->literal.v_ulong);     break;
+                case LCC_LT_ULONGLONG : *result = (intmax_t)((*token)->literal.v_ulonglong); break;
+
+                /* floating-point numbers are not allowed */
+                case LCC_LT_FLOAT:
+                case LCC_LT_DOUBLE:
+                case LCC_LT_LONGDOUBLE:
+                {
+                    _lcc_lexer_error(self, "Floating-point in preprocessor expression");
+                    return 0;
+                }
+
+                /* character sequence */
+                case LCC_LT_CHAR:
+                {
+                    /* final value and character pointer */
+                    intmax_t val = 0;
+                    lcc_string_t *s = (*token)->literal.v_char;
+
+                    /* convert to integer */
+                    if (s->len <= sizeof(intmax_t))
+                        memcpy(&val, s->buf, s->len);
+                    else
+                        memcpy(&val, s->buf + s->len - sizeof(intmax_t), sizeof(intmax_t));
+
+                    /* skip the literal */
+                    *token = (*token)->next;
+                    *result = val;
+                    break;
+                }
+
+                /* string literals are not allowed either */
+                case LCC_LT_STRING:
+                {
+                    _lcc_lexer_error(self, "Invalid token at start of a preprocessor expression");
+                    return 0;
+                }
+            }
+
+            /* skip the literal */
+            *token = (*token)->next;
+            break;
+        }
+
+        /* keywords are generated after preprocessing,
+         * thus must not appear here, or something went wrong */
+        case LCC_TK_KEYWORD:
+        {
+            fprintf(stderr, "*** FATAL: keywords in preprocessor tokens\n");
+            abort();
+        }
+
+        /* maybe prefix operators */
+        case LCC_TK_OPERATOR:
+        {
+            /* save operator first */
+            intmax_t val;
+            lcc_operator_t op = (*token)->operator;
+
+            /* skip the operator first */
+            val = 0;
+            *token = (*token)->next;
+
+            /* check for sub-expression */
+            if (op == LCC_OP_LBRACKET)
+            {
+                /* evaluate sub-expression */
+                if (!(_lcc_eval_bool_or(self, result, token, end)))
+                    return 0;
+
+                /* should ends with ")" */
+                if (((*token) == end) ||
+                    ((*token)->type != LCC_TK_OPERATOR) ||
+                    ((*token)->operator != LCC_OP_RBRACKET))
+                {
+                    _lcc_lexer_error(self, "Expected ')' in preprocessor expression");
+                    return 0;
+                }
+
+                /* skip the ")" */
+                *token = (*token)->next;
+                break;
+            }
+
+            /* evaluate sub-factor */
+            if (!(_lcc_eval_factor(self, &val, token, end)))
+                return 0;
+
+            /* apply operators */
+            switch (op)
+            {
+                /* four possible unary operators */
+                case LCC_OP_PLUS : break;
+                case LCC_OP_MINUS: val = -val; break;
+                case LCC_OP_BINV : val = ~val; break;
+                case LCC_OP_LNOT : val = !val; break;
+
+                /* other operators are not allowed */
+                default:
+                {
+                    _lcc_lexer_error(self, "Invalid token at start of a preprocessor expression");
+                    return 0;
+                }
+            }
+
+            /* store the result */
+            *result = val;
+            break;
+        }
+    }
+
+    /* evaluation successful */
+    return 1;
+}
+
+static char _lcc_eval_tokens(lcc_lexer_t *self, intmax_t *result)
+{
+    lcc_token_t *token = self->tokens.next;
+    return _lcc_eval_bool_or(self, result, &token, &(self->tokens));
+}
+
+#define _LCC_FETCH_TOKEN(self, efmt, ...)                   \
+({                                                          \
+    /* should have at least 1 argument */                   \
+    if (self->tokens.next == &(self->tokens))               \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+                                                            \
+    /* extract the token */                                 \
+    self->tokens.next;                                      \
+})
+
+#define _LCC_DETACH_TOKEN(self, efmt, ...)                  \
+({                                                          \
+    /* should have at least 1 argument */                   \
+    if (self->tokens.next == &(self->tokens))               \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+                                                            \
+    /* detach the token */                                  \
+    lcc_token_detach(self->tokens.next);                    \
+})
+
+#define _LCC_ENSURE_IDENT(self, token, efmt, ...)           \
+({                                                          \
+    /* must be an identifier */                             \
+    if (token->type != LCC_TK_IDENT)                        \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+                                                            \
+    /* extract the token */                                 \
+    token->ident;                                           \
+})
+
+#define _LCC_ENSURE_RAWINT(self, token, efmt, ...)          \
+({                                                          \
+    /* must be an long long literal */                      \
+    if ((token->type != LCC_TK_LITERAL) ||                  \
+        ((token->literal.type != LCC_LT_INT) &&             \
+         (token->literal.type != LCC_LT_LONG) &&            \
+         (token->literal.type != LCC_LT_LONGLONG) &&        \
+         (token->literal.type != LCC_LT_UINT) &&            \
+         (token->literal.type != LCC_LT_ULONG) &&           \
+         (token->literal.type != LCC_LT_ULONGLONG)))        \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+                                                            \
+    /* extract the token */                                 \
+    token->literal.raw;                                     \
+})
+
+#define _LCC_ENSURE_RAWSTR(self, token, efmt, ...)          \
+({                                                          \
+    /* must be a string literal */                          \
+    if ((token->type != LCC_TK_LITERAL) ||                  \
+        (token->literal.type != LCC_LT_STRING))             \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+                                                            \
+    /* extract the token */                                 \
+    token->literal.raw;                                     \
+})
+
+#define _LCC_ENSURE_STRING(self, token, efmt, ...)          \
+({                                                          \
+    /* must be a string literal */                          \
+    if ((token->type != LCC_TK_LITERAL) ||                  \
+        (token->literal.type != LCC_LT_STRING))             \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+                                                            \
+    /* extract the token */                                 \
+    token->literal.v_string;                                \
+})
+
+#define _LCC_ENSURE_OPERATOR(self, token, op, efmt, ...)    \
+({                                                          \
+    /* must be an operator */                               \
+    if ((token->type != LCC_TK_OPERATOR) ||                 \
+        (token->operator != op))                            \
+    {                                                       \
+        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
+        return;                                             \
+    }                                                       \
+})
+
+static inline _lcc_sym_t *_lcc_sym_ref(_lcc_sym_t *self)
+{
+    /* frozen symbols are never written */
+    if (self->ref >= 0)
+        self->ref++;
+
+    return self;
+}
+
+static inline _lcc_sym_t *_lcc_sym_new(
+    long flags,
+    lcc_token_t *body,
+    lcc_string_t *name,
+    lcc_string_t *vaname,
+    const lcc_string_array_t *args,
+    _lcc_macro_extension_fn *ext)
+{
+    _lcc_sym_t *new = malloc(sizeof(_lcc_sym_t));
+    new->ref = 1;
+    new->ext = ext;
+    new->body = body;
+    new->name = name;
+    new->args = *args;
+    new->flags = flags;
+    new->vaname = vaname;
+
+    /* symbols live long, don't waste memory */
+    lcc_array_shrink_to_fit(&(new->args.array));
+    return new;
+}
+
+static void _lcc_sym_free(_lcc_sym_t *self)
+{
+    /* frozen symbols are released by the shared table */
+    if (self->ref < 0)
+        return;
+
+    /* decrease reference */
+    if (!(--(self->ref)))
+    {
+        /* extensions have no body */
+        if (self->body)
+            lcc_token_clear(self->body);
+
+        /* extensions have no variadic argument name either */
+        if (self->vaname)
+            lcc_string_unref(self->vaname);
+
+        /* clear other fields */
+        lcc_string_unref(self->name);
+        lcc_string_array_free(&(self->args));
+        free(self);
+    }
+}
+
+static void _lcc_psym_dtor(lcc_map_t *self, void *value, void *data)
+{
+    /* undefined symbols are masked with NULL */
+    _lcc_sym_t **sym = value;
+    if (*sym) _lcc_sym_free(*sym);
+}
+
+static lcc_string_t *_lcc_psyms_string(lcc_psyms_t *self, lcc_string_t *str)
+{
+    /* already frozen, by this table or the parent */
+    if (str->ref < 0)
+        return str;
+
+    /* freeze in place, other references become no-ops */
+    lcc_string_freeze(str);
+    lcc_array_append(&(self->strings), &str);
+    return str;
+}
+
+static void _lcc_psyms_token(lcc_psyms_t *self, lcc_token_t *token)
+{
+    /* freeze the source */
+    _lcc_psyms_string(self, token->src);
+
+    /* freeze the value by type */
+    switch (token->type)
+    {
+        /* no strings */
+        case LCC_TK_EOF:
+        case LCC_TK_KEYWORD:
+        case LCC_TK_OPERATOR:
+            break;
+
+        /* identifiers */
+        case LCC_TK_IDENT:
+        {
+            _lcc_psyms_string(self, token->ident);
+            break;
+        }
+
+        /* pragmas, along with the arguments */
+        case LCC_TK_PRAGMA:
+        {
+            _lcc_psyms_string(self, token->pragma.name);
+
+            /* freeze every argument */
+            for (lcc_token_t *p = token->pragma.args->next; p != token->pragma.args; p = p->next)
+                _lcc_psyms_token(self, p);
+
+            break;
+        }
+
+        /* literals */
+        case LCC_TK_LITERAL:
+        {
+            /* numbers must be converted, nobody writes to frozen tokens */
+            lcc_literal_eval(&(token->literal));
+            _lcc_psyms_string(self, token->literal.raw);
+
+            /* character sequences and strings */
+            if (token->literal.type == LCC_LT_CHAR)
+                _lcc_psyms_string(self, token->literal.v_char);
+            else if (token->literal.type == LCC_LT_STRING)
+                _lcc_psyms_string(self, token->literal.v_string);
+
+            break;
+        }
+    }
+}
+
+static _lcc_sym_t *_lcc_psyms_sym(lcc_psyms_t *self, _lcc_sym_t *sym)
+{
+    /* symbols built by lcc_lexer_add_macro() usually have no pool tokens */
+    char steal = (sym->ref == 1) && (!(sym->body) || !(sym->body->pool));
+
+    /* check every body token */
+    for (lcc_token_t *p = sym->body ? sym->body->next : NULL; steal && (p != sym->body); p = p->next)
+        if (p->pool)
+            steal = 0;
+
+    /* only referenced by the lexer, freeze in place */
+    if (steal)
+    {
+        /* names and argument names */
+        _lcc_psyms_string(self, sym->name);
+        _lcc_psyms_string(self, sym->vaname ? sym->vaname : sym->name);
+
+        /* every argument names */
+        for (size_t i = 0; i < sym->args.array.count; i++)
+            _lcc_psyms_string(self, lcc_string_array_get(&(sym->args), i));
+
+        /* every body tokens */
+        for (lcc_token_t *p = sym->body ? sym->body->next : NULL; p && (p != sym->body); p = p->next)
+            _lcc_psyms_token(self, p);
+
+        /* owned by this table */
+        sym->ref = -1;
+        lcc_array_append(&(self->owned), &sym);
+        return sym;
+    }
+
+    /* create a frozen copy */
+    _lcc_sym_t *new = malloc(sizeof(_lcc_sym_t));
+    new->ref = -1;
+    new->ext = sym->ext;
+    new->body = NULL;
+    new->name = _lcc_psyms_string(self, sym->name);
+    new->flags = sym->flags;
+    new->vaname = sym->vaname ? _lcc_psyms_string(self, sym->vaname) : NULL;
+
+    /* argument names, strings are shared */
+    lcc_string_array_init(&(new->args));
+    lcc_array_reserve(&(new->args.array), sym->args.array.count);
+
+    /* freeze every argument name */
+    for (size_t i = 0; i < sym->args.array.count; i++)
+        lcc_string_array_append(&(new->args), _lcc_psyms_string(self, lcc_string_array_get(&(sym->args), i)));
+
+    /* extensions have no body */
+    if (!(sym->body))
+    {
+        lcc_array_append(&(self->owned), &new);
+        return new;
+    }
+
+    /* copy the body, tokens are allocated from heap */
+    new->body = lcc_token_new();
+
+    /* freeze every body token */
+    for (lcc_token_t *p = sym->body->next; p != sym->body; p = p->next)
+    {
+        lcc_token_t *token = lcc_token_copy(p);
+        _lcc_psyms_token(self, token);
+        lcc_token_attach(new->body, token);
+    }
+
+    /* owned by this table */
+    lcc_array_append(&(self->owned), &new);
+    return new;
+}
+
+static void _lcc_psyms_free(lcc_psyms_t *self)
+{
+    /* symbols are released with the owner array */
+    lcc_map_free(&(self->syms));
+    lcc_array_free(&(self->loc_lines));
+    lcc_string_array_free(&(self->loc_names));
+
+    /* release frozen symbols */
+    for (size_t i = 0; i < self->owned.count; i++)
+    {
+        _lcc_sym_t *sym = *(_lcc_sym_t **)lcc_array_get(&(self->owned), i);
+        sym->ref = 1;
+        _lcc_sym_free(sym);
+    }
+
+    /* release frozen strings */
+    for (size_t i = 0; i < self->strings.count; i++)
+    {
+        lcc_string_t *str = *(lcc_string_t **)lcc_array_get(&(self->strings), i);
+        lcc_string_thaw(str);
+        lcc_string_unref(str);
+    }
+
+    /* release the parent */
+    if (self->parent)
+        lcc_psyms_unref(self->parent);
+
+    /* clear the arrays */
+    lcc_array_free(&(self->owned));
+    lcc_array_free(&(self->strings));
+    free(self);
+}
+
+void lcc_psyms_unref(lcc_psyms_t *self)
+{
+    if (!(__atomic_sub_fetch(&(self->ref), 1, __ATOMIC_ACQ_REL)))
+        _lcc_psyms_free(self);
+}
+
+lcc_psyms_t *lcc_psyms_ref(lcc_psyms_t *self)
+{
+    __atomic_add_fetch(&(self->ref), 1, __ATOMIC_RELAXED);
+    return self;
+}
+
+static void _lcc_psyms_freeze(lcc_lexer_t *self)
+{
+    /* nothing changed by this lexer, keep sharing the base */
+    self->base_ready = 1;
+    if (!(self->psyms.count))
+        return;
+
+    /* create a new table on top of the base */
+    lcc_psyms_t *psyms = malloc(sizeof(lcc_psyms_t));
+    psyms->ref = 1;
+    psyms->parent = self->base;
+    lcc_map_init(&(psyms->syms), sizeof(_lcc_sym_t *), NULL, NULL);
+    lcc_array_init(&(psyms->owned), sizeof(_lcc_sym_t *), NULL, NULL);
+    lcc_array_init(&(psyms->strings), sizeof(lcc_string_t *), NULL, NULL);
+    lcc_array_init(&(psyms->loc_lines), sizeof(lcc_lexer_line_t), NULL, NULL);
+    lcc_string_array_init(&(psyms->loc_names));
+
+    /* body locations are only meaningful with the line table */
+    psyms->loc = self->loc;
+    lcc_array_reserve(&(psyms->loc_lines), self->loc_lines.count);
+    memcpy(psyms->loc_lines.items, self->loc_lines.items, self->loc_lines.count * sizeof(lcc_lexer_line_t));
+    psyms->loc_lines.count = self->loc_lines.count;
+
+    /* file names are shared with this lexer */
+    for (size_t i = 0; i < self->loc_names.array.count; i++)
+        lcc_string_array_append(&(psyms->loc_names), _lcc_psyms_string(psyms, lcc_string_array_get(&(self->loc_names), i)));
+
+    /* frozen tokens must not come from the lexer pool */
+    lcc_map_t *base = self->base ? &(self->base->syms) : NULL;
+    lcc_token_pool_t *pool = lcc_token_pool_swap(NULL);
+
+    /* inherit symbols from the base, unless changed by this lexer */
+    for (size_t i = 0; base && (i < base->capacity); i++)
+    {
+        /* only copy those are in-use */
+        if (base->bucket[i].flags != LCC_MAP_FLAGS_USED)
+            continue;
+
+        /* masked by this lexer */
+        if (lcc_map_get(&(self->psyms), base->bucket[i].key, NULL))
+            continue;
+
+        /* shared with the base */
+        lcc_map_set(&(psyms->syms), base->bucket[i].key, NULL, base->values + i * base->value_size);
+    }
+
+    /* freeze symbols of this lexer */
+    for (size_t i = 0; i < self->psyms.capacity; i++)
+    {
+        /* only freeze those are in-use */
+        if (self->psyms.bucket[i].flags != LCC_MAP_FLAGS_USED)
+            continue;
+
+        /* undefined symbols are simply dropped */
+        _lcc_sym_t *sym = *(_lcc_sym_t **)(self->psyms.values + i * self->psyms.value_size);
+        if (!sym) continue;
+
+        /* add to the new table */
+        sym = _lcc_psyms_sym(psyms, sym);
+        lcc_map_set(&(psyms->syms), sym->name, NULL, &sym);
+    }
+
+    /* restore the lexer pool */
+    lcc_token_pool_swap(pool);
+
+    /* everything is in the new table now */
+    lcc_map_free(&(self->psyms));
+    lcc_map_init(&(self->psyms), sizeof(_lcc_sym_t *), _lcc_psym_dtor, NULL);
+    self->base = psyms;
+}
+
+static inline _lcc_sym_t *_lcc_psym_get(lcc_lexer_t *self, lcc_string_t *name)
+{
+    /* symbols changed by this lexer */
+    _lcc_sym_t **sym;
+    if (lcc_map_get(&(self->psyms), name, (void **)&sym))
+        return *sym;
+
+    /* shared pre-defined symbols */
+    if (self->base && lcc_map_get(&(self->base->syms), name, (void **)&sym))
+        return *sym;
+
+    /* not defined */
+    return NULL;
+}
+
+static inline void _lcc_psym_remove(lcc_lexer_t *self, lcc_string_t *name)
+{
+    /* shared symbols are masked with an empty one, local ones are simply removed */
+    if (self->base && lcc_map_get(&(self->base->syms), name, NULL))
+        lcc_map_set(&(self->psyms), name, NULL, &(_lcc_sym_t *){ NULL });
+    else
+        lcc_map_pop(&(self->psyms), name, NULL);
+}
+
+static void _lcc_psym_apply(lcc_lexer_t *self, lcc_map_t *syms)
+{
+    /* apply every change, each name appears only once */
+    for (size_t i = 0; i < syms->capacity; i++)
+    {
+        /* only apply those are in-use */
+        if (syms->bucket[i].flags != LCC_MAP_FLAGS_USED)
+            continue;
+
+        /* symbol to add, or NULL to remove */
+        lcc_string_t *name = syms->bucket[i].key;
+        _lcc_sym_t *sym = *(_lcc_sym_t **)(syms->values + i * syms->value_size);
+
+        /* add or remove the symbol */
+        if (sym)
+            lcc_map_set(&(self->psyms), name, NULL, &sym);
+        else
+            _lcc_psym_remove(self, name);
+    }
+
+    /* symbols are moved into `psyms` */
+    syms->dtor_fn = NULL;
+    lcc_map_free(syms);
+    lcc_map_init(syms, sizeof(_lcc_sym_t *), _lcc_psym_dtor, NULL);
+}
+
+static void _lcc_psym_commit(lcc_lexer_t *self)
+{
+    /* nothing added by lcc_lexer_add_macro() */
+    if (self->defines.count)
+        _lcc_psym_apply(self, &(self->defines));
+}
+
+static void _lcc_preamble_commit(lcc_lexer_t *self)
+{
+    /* nothing loaded by lcc_lexer_load_preamble() */
+    if (self->preamble.count)
+        _lcc_psym_apply(self, &(self->preamble));
+}
+
+static inline char _lcc_psym_expanding(lcc_lexer_t *self, _lcc_sym_t *sym)
+{
+    /* macros being expanded, shared symbols cannot be marked */
+    _lcc_sym_t **syms = self->expanding.items;
+
+    /* the nesting is usually shallow */
+    for (size_t i = 0; i < self->expanding.count; i++)
+        if (syms[i] == sym)
+            return 1;
+
+    /* not expanding */
+    return 0;
+}
+
+static void _lcc_file_free(lcc_file_t *self)
+{
+    /* release the mapping, shared ones are released by the last user */
+    if (self->source)
+        _lcc_source_unref(self->source);
+    else if (self->flags & LCC_FF_MMAP)
+    {
+        if (self->data) munmap(self->data, self->size);
+        lcc_array_free(&(self->index));
+    }
+
+    /* release the guard name if any */
+    if (self->guard)
+        lcc_string_unref(self->guard);
+
+    /* release the token cache if any */
+    if (self->cache)
+        _lcc_tc_free(self->cache);
+
+    /* clear other fields */
+    lcc_string_unref(self->name);
+    lcc_string_unref(self->display);
+    lcc_string_array_free(&(self->lines));
+}
+
+static inline char _lcc_file_guarded(lcc_lexer_t *self, dev_t dev, ino_t ino)
+{
+    /* files marked with "#pragma once" are never included again */
+    lcc_string_t **guard;
+    lcc_string_t *key = _lcc_file_key(dev, ino);
+    char found = lcc_set_contains(&(self->once), key);
+
+    /* otherwise find the include guard of this file,
+     * skip the file only if the guard macro is still defined */
+    if (!found && lcc_map_get(&(self->guards), key, (void **)&guard))
+        found = _lcc_psym_get(self, *guard) != NULL;
+
+    /* release the key */
+    lcc_string_unref(key);
+    return found;
+}
+
+static inline char _lcc_push_file(lcc_lexer_t *self, lcc_string_t *path)
+{
+    /* try load the file, possibly shared with other lexers */
+    lcc_file_t file = self->scache ? lcc_source_cache_open(self->scache, path->buf) : lcc_file_open(path->buf);
+
+    /* check if it is loaded */
+    if (file.flags & LCC_FF_INVALID)
+        return 0;
+
+    /* included files may use the token cache */
+    if (self->tcache)
+        file.cache = _lcc_tc_open(self, &file, path);
+
+    /* push to file stack */
+    lcc_array_append(&(self->files), &file);
+    self->file = lcc_array_top(&(self->files));
+    self->loc_file = NULL;
+    return 1;
+}
+
+static inline void _lcc_move_tokens(lcc_token_t *to, lcc_token_t *from)
+{
+    to->prev = from->prev;
+    to->next = from->next;
+    to->prev->next = to;
+    to->next->prev = to;
+    from->prev = from;
+    from->next = from;
+}
+
+static inline lcc_string_t *_lcc_path_concat(lcc_string_t *base, lcc_string_t *name)
+{
+    /* `name` is an absolute path */
+    if (name->buf[0] == '/')
+        return lcc_string_ref(name);
+
+    /* otherwise make a copy of base first */
+    char last = base->buf[base->len - 1];
+    lcc_string_t *ret = lcc_string_copy(base);
+
+    /* append path delimiter if needed */
+    if (last != '/')
+        lcc_string_append_from(ret, "/");
+
+    /* then append name */
+    lcc_string_append(ret, name);
+    return ret;
+}
+
+static inline lcc_string_t *_lcc_make_message(lcc_lexer_t *self)
+{
+    /* no tokens */
+    if (self->tokens.next == &(self->tokens))
+        return lcc_string_from("");
+
+    /* a single string, use it's content directly */
+    if ((self->tokens.next->next == &(self->tokens)) &&
+        (self->tokens.next->type == LCC_TK_LITERAL) &&
+        (self->tokens.next->literal.type == LCC_LT_STRING))
+    {
+        /* make a reference to the content */
+        lcc_token_t *t = self->tokens.next;
+        lcc_string_t *s = lcc_string_ref(t->literal.v_string);
+
+        /* clear the token */
+        lcc_token_free(t);
+        return s;
+    }
+
+    /* message string */
+    lcc_token_t *p;
+    lcc_string_t *s = lcc_string_new(0);
+
+    /* concat each token */
+    while ((p = self->tokens.next) != &(self->tokens))
+    {
+        lcc_string_append_unref(s, lcc_token_str(p));
+        lcc_string_append_from(s, " ");
+        lcc_token_free(p);
+    }
+
+    /* remove the last space */
+    s->buf[--s->len] = 0;
+    return s;
+}
+
+static inline lcc_string_t *_lcc_path_dirname(lcc_string_t *name)
+{
+    /* get it's directory name */
+    char *buf = strndup(name->buf, name->len);
+    lcc_string_t *ret = lcc_string_from(dirname(buf));
+
+    /* free the string buffer */
+    free(buf);
+    return ret;
+}
+
+static inline char _lcc_probe_include(lcc_string_t *dir, lcc_string_t *fname, _lcc_include_t *inc)
+{
+    /* make the full path */
+    struct stat st;
+    lcc_string_t *path = _lcc_path_concat(dir, fname);
+
+    /* check if the file exists */
+    if (stat(path->buf, &st))
+    {
+        lcc_string_unref(path);
+        return 0;
+    }
+
+    /* found, record it's path and identity */
+    inc->dev = st.st_dev;
+    inc->ino = st.st_ino;
+    inc->path = path;
+    return 1;
+}
+
+static char _lcc_search_include(
+    lcc_lexer_t     *self,
+    lcc_string_t    *dir,
+    lcc_string_t    *fname,
+    char             sys,
+    char             next,
+    _lcc_include_t  *inc)
+{
+    /* for "#include_next" support */
+    char load = 1;
+    dev_t fdev = 0;
+    ino_t fino = 0;
+
+    /* check for "#include_next" */
+    if (next)
+    {
+        /* try to read directory info of current file */
+        struct stat st;
+        if (stat(dir->buf, &st))
+            return 0;
+
+        /* don't load immediately if it's a system include file */
+        if (sys)
+            load = 0;
+
+        /* record the directory identity */
+        fdev = st.st_dev;
+        fino = st.st_ino;
+    }
+
+    /* search for user directory if needed */
+    if (!next && !sys && _lcc_probe_include(dir, fname, inc))
+        return 1;
+
+    /* search in system include directories */
+    for (size_t i = 0; i < self->include_paths.array.count; i++)
+    {
+        char doload = load;
+        struct stat st;
+        lcc_string_t *idir = lcc_string_array_get(&(self->include_paths), i);
+
+        /* it's "include_next" */
+        if (next)
+        {
+            /* try to read it's info */
+            if (stat(idir->buf, &st))
+                continue;
+
+            /* check for the same directory */
+            if ((st.st_dev == fdev) &&
+                (st.st_ino == fino))
+            {
+                load = 0;
+                doload = 1;
+            }
+        }
+
+        /* check for load flag */
+        if (load && _lcc_probe_include(idir, fname, inc))
+            return 1;
+
+        /* update load flag after this directory */
+        load = doload;
+    }
+
+    /* not found */
+    return 1;
+}
+
+static _lcc_include_t *_lcc_find_include(lcc_lexer_t *self, lcc_string_t *fname, char check_only)
+{
+    /* search mode */
+    char sys = (self->flags & LCC_LXDF_INCLUDE_SYS) != 0;
+    char next = (self->flags & LCC_LXDF_INCLUDE_NEXT) != 0;
+
+    /* system includes doesn't depend on the current directory */
+    _lcc_include_t *inc;
+    lcc_string_t *dir = (sys && !next) ? lcc_string_from("") : _lcc_path_dirname(self->file->name);
+
+    /* cache key, the current directory also decides the start
+     * index for "#include_next", so it doesn't need to be included,
+     * the generation changes whenever a search path is added */
+    lcc_string_t *key = lcc_string_from_format(
+        "%c%c|%zu|%s|%s",
+        sys ? 's' : 'q',
+        next ? 'n' : 'i',
+        self->include_gen,
+        dir->buf,
+        fname->buf
+    );
+
+    /* already resolved */
+    if (lcc_map_get(&(self->include_cache), key, (void **)&inc))
+    {
+        lcc_string_unref(dir);
+        lcc_string_unref(key);
+        return inc;
+    }
+
+    /* negative lookups are also cached */
+    _lcc_include_t val = {
+        .dev = 0,
+        .ino = 0,
+        .path = NULL,
+    };
+
+    /* perform the actual search */
+    if (!(_lcc_search_include(self, dir, fname, sys, next, &val)))
+    {
+        /* errors are muted under "check only" mode */
+        if (!check_only)
+            _lcc_lexer_error(self, "Cannot read directory '%s': [%d] %s", dir->buf, errno, _LCC_STRERROR(errno));
+
+        /* directory errors are not cached */
+        lcc_string_unref(dir);
+        lcc_string_unref(key);
+        return NULL;
+    }
+
+    /* add to cache */
+    lcc_map_set(&(self->include_cache), key, NULL, &val);
+    lcc_map_get(&(self->include_cache), key, (void **)&inc);
+
+    /* release the strings */
+    lcc_string_unref(dir);
+    lcc_string_unref(key);
+    return inc;
+}
+
+static char _lcc_load_include(lcc_lexer_t *self, lcc_string_t *fname, char check_only)
+{
+    /* check file path for "#include_next" */
+    if ((fname->buf[0] == '/') &&
+        (self->flags & LCC_LXDF_INCLUDE_NEXT))
+    {
+        self->flags &= ~LCC_LXDF_INCLUDE_NEXT;
+        _lcc_lexer_warning(self, "#include_next with absolute path");
+    }
+
+    /* check file stack for "#include_next" */
+    if ((self->flags & LCC_LXDF_INCLUDE_NEXT) &&
+        (self->files.count == 1))
+        _lcc_lexer_warning(self, "#include_next in primary source file");
+
+    /* resolve the include file */
+    _lcc_include_t *inc = _lcc_find_include(self, fname, check_only);
+
+    /* directory errors */
+    if (!inc)
+        return 0;
+
+    /* not found */
+    if (!(inc->path))
+    {
+        /* errors are muted under "check only" mode */
+        if (check_only)
+            return 0;
+
+        /* otherwise raise error as intended */
+        _lcc_lexer_error(self, "Cannot open include file '%s': [%d] %s", fname->buf, ENOENT, _LCC_STRERROR(ENOENT));
+        return 0;
+    }
+
+    /* don't actually load under "check only" mode */
+    if (check_only)
+        return 1;
+
+    /* guarded file, including it again yields nothing */
+    if (_lcc_file_guarded(self, inc->dev, inc->ino))
+    {
+        self->guard_skips++;
+        return 1;
+    }
+
+    /* push to file stack */
+    if (_lcc_push_file(self, inc->path))
+        return 1;
+
+    /* found, but not loaded, it's an error */
+    _lcc_lexer_error(self, "Cannot open include file '%s': [%d] %s", fname->buf, errno, _LCC_STRERROR(errno));
+    return 0;
+}
+
+static lcc_token_t *_lcc_next_arg(lcc_token_t *begin, lcc_token_t *end, char allow_comma)
+{
+    /* parentheses nesting level */
+    size_t level = 0;
+    lcc_token_t *last = begin;
+
+    /* find the last token of this argument */
+    while (last != end)
+    {
+        /* maybe "," "(" or ")" operator */
+        if (last->type == LCC_TK_OPERATOR)
+        {
+            /* checking for matched parentheses */
+            if ((level == 0) &&
+                (last->operator == LCC_OP_RBRACKET))
+                return last;
+
+            /* checking for comma delimiter */
+            if (allow_comma &&
+                (level == 0) &&
+                (last->operator == LCC_OP_COMMA))
+                return last;
+
+            /* parentheses matching */
+            if (last->operator == LCC_OP_LBRACKET) level++;
+            if (last->operator == LCC_OP_RBRACKET) level--;
+        }
+
+        /* move to next token */
+        last = last->next;
+    }
+
+    /* encountered end of tokens, but still not found */
+    return NULL;
+}
+
+static char _lcc_macro_cat(lcc_lexer_t *self, lcc_token_t *begin, lcc_token_t *end)
+{
+    /* reset token pointers */
+    lcc_token_t *a;
+    lcc_token_t *b;
+    lcc_token_t *t = begin;
+
+    /* pass 2: apply concatenation */
+    while (t != end)
+    {
+        /* only care about "##" operator */
+        if ((t->type != LCC_TK_OPERATOR) ||
+            (t->operator != LCC_OP_CONCAT))
+        {
+            t = t->next;
+            continue;
+        }
+
+        /* detach the previous and next token */
+        a = lcc_token_detach(t->prev);
+        b = lcc_token_detach(t->next);
+
+        /* remove the "##" operator */
+        t = t->next;
+        lcc_token_free(t->prev);
+
+        /* both identifiers */
+        if ((a->type == LCC_TK_IDENT) &&
+            (b->type == LCC_TK_IDENT))
+        {
+            /* identifiers are interned, build a new one */
+            lcc_string_t *ident = lcc_string_copy(a->ident);
+            lcc_string_append(ident, b->ident);
+
+            /* append with the next token */
+            lcc_string_append(a->src, b->src);
+            lcc_string_unref(a->ident);
+            a->ident = _lcc_intern_string(self, ident);
+
+            /* attach the new token */
+            lcc_token_free(b);
+            lcc_token_attach(t, a);
+            continue;
+        }
+
+        /* identifier with integer, never forms a keyword */
+        if ((a->type == LCC_TK_IDENT) &&
+            (b->type == LCC_TK_LITERAL) &&
+            ((b->literal.type == LCC_LT_INT) ||
+             (b->literal.type == LCC_LT_LONG) ||
+             (b->literal.type == LCC_LT_LONGLONG) ||
+             (b->literal.type == LCC_LT_UINT) ||
+             (b->literal.type == LCC_LT_ULONG) ||
+             (b->literal.type == LCC_LT_ULONGLONG)))
+        {
+            /* identifiers are interned, build a new one */
+            lcc_string_t *ident = lcc_string_copy(a->ident);
+            lcc_string_append(ident, b->literal.raw);
+
+            /* append with the next token */
+            lcc_string_append(a->src, b->src);
+            lcc_string_unref(a->ident);
+            a->ident = _lcc_intern_string(self, ident);
+
+            /* attach the new token */
+            lcc_token_free(b);
+            lcc_token_attach(t, a);
+            continue;
+        }
+
+        /* both operators */
+        if ((a->type == LCC_TK_OPERATOR) &&
+            (b->type == LCC_TK_OPERATOR))
+        {
+
+#define _OP(a, b)                   (((uint32_t)a << 16u) | (uint32_t)b)
+#define _DEL(tk)                    lcc_token_free(tk)
+#define _ADD(list, tk)              lcc_token_attach(list, tk)
+#define _NEW(name, op)              lcc_token_from_operator(lcc_string_from(name), (op))
+#define _MAP(op1, op2, name, rop)   case _OP(op1, op2): { _DEL(a); _DEL(b); _ADD(t, _NEW(name, rop)); continue; }
+
+            /* switch on compond operators */
+            switch (_OP(a->operator, b->operator))
+            {
+                _MAP(LCC_OP_MINUS   , LCC_OP_GT     , "->"  , LCC_OP_DEREF  )   /* "-" ## ">" -> "->" */
+                _MAP(LCC_OP_PLUS    , LCC_OP_PLUS   , "++"  , LCC_OP_INCR   )   /* "+" ## "+" -> "++" */
+                _MAP(LCC_OP_MINUS   , LCC_OP_MINUS  , "--"  , LCC_OP_DECR   )   /* "-" ## "-" -> "--" */
+                _MAP(LCC_OP_GT      , LCC_OP_GT     , ">>"  , LCC_OP_BSHR   )   /* "<" ## "<" -> "<<" */
+                _MAP(LCC_OP_LT      , LCC_OP_LT     , "<<"  , LCC_OP_BSHL   )   /* ">" ## ">" -> ">>" */
+                _MAP(LCC_OP_BAND    , LCC_OP_BAND   , "&&"  , LCC_OP_LAND   )   /* "&" ## "&" -> "&&" */
+                _MAP(LCC_OP_BOR     , LCC_OP_BOR    , "||"  , LCC_OP_LOR    )   /* "|" ## "|" -> "||" */
+                _MAP(LCC_OP_PLUS    , LCC_OP_ASSIGN , "+="  , LCC_OP_IADD   )   /* "+" ## "=" -> "+=" */
+                _MAP(LCC_OP_MINUS   , LCC_OP_ASSIGN , "-="  , LCC_OP_ISUB   )   /* "-" ## "=" -> "-=" */
+                _MAP(LCC_OP_STAR    , LCC_OP_ASSIGN , "*="  , LCC_OP_IMUL   )   /* "*" ## "=" -> "*=" */
+                _MAP(LCC_OP_SLASH   , LCC_OP_ASSIGN , "/="  , LCC_OP_IDIV   )   /* "/" ## "=" -> "/=" */
+                _MAP(LCC_OP_PERCENT , LCC_OP_ASSIGN , "%="  , LCC_OP_IMOD   )   /* "/" ## "=" -> "/=" */
+                _MAP(LCC_OP_BAND    , LCC_OP_ASSIGN , "&="  , LCC_OP_IAND   )   /* "&" ## "=" -> "&=" */
+                _MAP(LCC_OP_BOR     , LCC_OP_ASSIGN , "|="  , LCC_OP_IOR    )   /* "|" ## "=" -> "|=" */
+                _MAP(LCC_OP_BXOR    , LCC_OP_ASSIGN , "^="  , LCC_OP_IXOR   )   /* "^" ## "=" -> "^=" */
+                _MAP(LCC_OP_GT      , LCC_OP_ASSIGN , ">="  , LCC_OP_GEQ    )   /* ">" ## "=" -> ">=" */
+                _MAP(LCC_OP_LT      , LCC_OP_ASSIGN , "<="  , LCC_OP_LEQ    )   /* "<" ## "=" -> "<=" */
+                _MAP(LCC_OP_ASSIGN  , LCC_OP_ASSIGN , "=="  , LCC_OP_EQ     )   /* "=" ## "=" -> "==" */
+                _MAP(LCC_OP_LNOT    , LCC_OP_ASSIGN , "!="  , LCC_OP_NEQ    )   /* "!" ## "=" -> "!=" */
+                _MAP(LCC_OP_LT      , LCC_OP_LEQ    , "<<=" , LCC_OP_ISHL   )   /* "<" ## "<=" -> "<<=" */
+                _MAP(LCC_OP_GT      , LCC_OP_GEQ    , ">>=" , LCC_OP_ISHR   )   /* ">" ## ">=" -> ">>=" */
+                _MAP(LCC_OP_BSHL    , LCC_OP_ASSIGN , "<<=" , LCC_OP_ISHL   )   /* "<<" ## "=" -> "<<=" */
+                _MAP(LCC_OP_BSHR    , LCC_OP_ASSIGN , ">>=" , LCC_OP_ISHR   )   /* ">>" ## "=" -> ">>=" */
+
+                /* other unknown operators */
+                default:
+                {
+                    const char *op1 = lcc_token_op_name(a->operator);
+                    const char *op2 = lcc_token_op_name(b->operator);
+                    _lcc_lexer_error(self, "'%s%s' is an invalid preprocessor token", op1, op2);
+                    return 0;
+                }
+            }
+
+#undef _OP
+#undef _DEL
+#undef _ADD
+#undef _NEW
+#undef _MAP
+
+        }
+
+        /* otherwise it's an error, dump the token */
+        lcc_string_t *tk1 = lcc_token_str(a);
+        lcc_string_t *tk2 = lcc_token_str(b);
+
+        /* throw the error */
+        _lcc_lexer_error(self, "'%s%s' is an invalid preprocessor token", tk1->buf, tk2->buf);
+        lcc_string_unref(tk1);
+        lcc_string_unref(tk2);
+        return 0;
+    }
+
+    /* concatenation finished */
+    return 1;
+}
+
+static void _lcc_macro_disp(lcc_token_t **pos, lcc_token_t **next, lcc_token_t *begin, lcc_token_t *end)
+{
+    /* first token */
+    lcc_token_t *h = *pos;
+    lcc_token_t *p = begin;
+    lcc_token_t *q = h->next;
+
+    /* make a copy of each token, then attach to anchor */
+    while (p != end)
+    {
+        lcc_token_attach(q, lcc_token_copy(p));
+        p = p->next;
+    }
+
+    /* replace the old anchor */
+    *pos = h->next;
+    *next = q;
+    lcc_token_free(h);
+}
+
+static char _lcc_macro_scan(
+    lcc_lexer_t *self,
+    lcc_token_t *begin,
+    lcc_token_t *end,
+    char        *has_defined
+);
+
+static char _lcc_macro_attach(
+    lcc_lexer_t *self,
+    lcc_token_t *input,
+    lcc_token_t *head,
+    lcc_token_t *begin,
+    lcc_token_t *end,
+    char        *has_defined)
+{
+    /* header tokens */
+    lcc_token_t *t = begin;
+    lcc_token_t *h = head->prev;
+
+    /* perform substitution */
+    while (t != end)
+    {
+        lcc_token_attach(head, lcc_token_copy(t));
+        t = t->next;
+    }
+
+    /* only expand when not concatenating */
+    if (((input->next->type != LCC_TK_OPERATOR) ||
+         (input->next->operator != LCC_OP_CONCAT)) &&
+        !(_lcc_macro_scan(self, h->next, head, has_defined)))
+        return 0;
+
+    return 1;
+}
+
+static char _lcc_macro_func(
+    lcc_lexer_t  *self,
+    lcc_token_t  *head,
+    _lcc_sym_t   *sym,
+    size_t        argc,
+    lcc_token_t **argv,
+    char         *has_defined)
+{
+    /* substitution result */
+    ssize_t m;
+    ssize_t n;
+    lcc_token_t *p = sym->body->next;
+
+    /* pass 1: apply parameter substitution and stringize */
+    while (p != sym->body)
+    {
+        /* argument subtitution */
+        if ((p->type == LCC_TK_IDENT) &&
+            ((n = _lcc_arg_index(&(sym->args), p->ident)) >= 0))
+        {
+            /* special case of "<arg> ## ..." where <arg> is nothing
+             * skip the argument identifier, along with the "##" operator */
+            if ((p->next->type == LCC_TK_OPERATOR) &&
+                (p->next->operator == LCC_OP_CONCAT) &&
+                (argv[n]->next == argv[n + 1]))
+            {
+                p = p->next->next;
+                continue;
+            }
+
+            /* beginning and ending tokens */
+            lcc_token_t *to = argv[n + 1];
+            lcc_token_t *from = argv[n]->next;
+
+            /* attach token sequence, then substitute as needed */
+            if (!(_lcc_macro_attach(self, p, head, from, to, has_defined)))
+                return 0;
+
+            /* skip the token */
+            p = p->next;
+            continue;
+        }
+
+        /* variadic argument substitution */
+        if ((p->type == LCC_TK_IDENT) &&
+            (p->ident == sym->vaname))
+        {
+            /* special case of "<varg> ## ..." where <varg> is nothing,
+             * skip the variadic argument identifier, along with the "##" operator */
+            if ((p->next->type == LCC_TK_OPERATOR) &&
+                (p->next->operator == LCC_OP_CONCAT) &&
+                ((argc <= sym->args.array.count) ||
+                 (argv[sym->args.array.count]->next == argv[argc])))
+            {
+                p = p->next->next;
+                continue;
+            }
+
+            /* attach all variadic arguments, including comma */
+            if (argc > sym->args.array.count)
+            {
+                /* beginning and ending tokens */
+                lcc_token_t *to = argv[argc];
+                lcc_token_t *from = argv[sym->args.array.count]->next;
+
+                /* attach token sequence, then substitute as needed */
+                if (!(_lcc_macro_attach(self, p, head, from, to, has_defined)))
+                    return 0;
+            }
+
+            /* skip the token */
+            p = p->next;
+            continue;
+        }
+
+        /* special case of concatenating with empty arguments */
+        if ((p->type == LCC_TK_OPERATOR) &&                                         /* first token must be an operator */
+            (p->operator == LCC_OP_CONCAT) &&                                       /* which must be a concatenation operator */
+            (p->next->type == LCC_TK_IDENT) &&                                      /* second token must be an identifier */
+            ((((n = _lcc_arg_index(&(sym->args), p->next->ident)) >= 0) &&  /* which must be an argument name */
+              (argv[n]->next == argv[n + 1])) ||                                    /* and this argument expands to nothing */
+             ((p->next->ident == sym->vaname) &&                     /* or the name equals to varg name */
+              ((argc <= sym->args.array.count) ||                                   /* and we don't have excess arguments to deal with */
+               (argv[sym->args.array.count]->next == argv[argc])))))                /* or we just have an empty variadic list */
+        {
+            p = p->next->next;
+            continue;
+        }
+
+        /* special case of ", ## <vargs>" */
+        if ((p->type == LCC_TK_OPERATOR) &&                         /* first token must be an operator */
+            (p->operator == LCC_OP_COMMA) &&                        /* which must be "," operator */
+            (p->next->type == LCC_TK_OPERATOR) &&                   /* second token must also be an operator */
+            (p->next->operator == LCC_OP_CONCAT) &&                 /* which must be "##" operator */
+            (p->next->next->type == LCC_TK_IDENT) &&                /* third token must be an identifier */
+            (p->next->next->ident == sym->vaname))   /* and is same with variadic argument name */
+        {
+            /* remove the "," if <vargs> is empty */
+            if (argc == sym->args.array.count)
+            {
+                p = p->next->next->next;
+                continue;
+            }
+            else
+            {
+                lcc_token_attach(head, lcc_token_copy(p));
+                p = p->next->next;
+                continue;
+            }
+        }
+
+        /* only apply when this extension enabled */
+        if (self->gnuext & LCC_LX_GNUX_VA_OPT_MACRO)
+        {
+            /* special case of "__VA_OPT__(...)" */
+            if ((p->type == LCC_TK_IDENT) &&
+                !(strcmp(p->ident->buf, "__VA_OPT__")))
+            {
+                /* check for next token */
+                if ((p->next == sym->body) ||
+                    (p->next->type != LCC_TK_OPERATOR) ||
+                    (p->next->operator != LCC_OP_LBRACKET))
+                {
+                    _lcc_lexer_error(self, "Missing '(' after '__VA_OPT__'");
+                    return 0;
+                }
+
+                /* move past the "(" */
+                p = p->next;
+                p = p->next;
+
+                /* search pointers */
+                size_t nbrk = 1;
+                lcc_token_t *end = p;
+
+                /* counting brackets */
+                while (nbrk && (end != sym->body))
+                {
+                    /* must be an operator */
+                    if (end->type == LCC_TK_OPERATOR)
+                    {
+                        if (end->operator == LCC_OP_LBRACKET) nbrk++;
+                        if (end->operator == LCC_OP_RBRACKET) nbrk--;
+                    }
+
+                    /* move to next token */
+                    end = end->next;
+                }
+
+                /* check for bracket balancing */
+                if (nbrk)
+                {
+                    _lcc_lexer_error(self, "Unterminated function-like macro invocation");
+                    return 0;
+                }
 
-#define _LCC_OP_CASE_I(i, n, op)    case _LCC_OP_0(op): lhs = _LCC_OP_1(op); break;
-#define _LCC_OP_CASE(...)           _LCC_FOR_EACH(_LCC_OP_CASE_I, ?, __VA_ARGS__)
+                /* have variadic arguments, expand to something */
+                if (((argc > sym->args.array.count) &&
+                    (argv[sym->args.array.count]->next != argv[argc])))
+                    for (lcc_token_t *t = p; t->next != end; t = t->next)
+                        lcc_token_attach(head, lcc_token_copy(t));
 
-#define _LCC_NZ(val, msg)           ({  \
-    /* check for zero */                \
-    if (!val)                           \
-    {                                   \
-        _lcc_lexer_error(self, #msg);   \
-        return 0;                       \
-    }                                   \
-                                        \
-    /* the verified value */            \
-    rhs;                                \
-})
+                /* move to next token */
+                p = end;
+                continue;
+            }
+        }
 
-#define _LCC_SLASH_Z                Division by zero in preprocessor expression
-#define _LCC_PERCENT_Z              Remainder by zero in preprocessor expression
+        /* concatenation, don't expand the following argument */
+        if ((p->type == LCC_TK_OPERATOR) &&
+            (p->operator == LCC_OP_CONCAT) &&
+            (p->next->type == LCC_TK_IDENT) &&
+            ((n = _lcc_arg_index(&(sym->args), p->next->ident)) >= 0))
+        {
+            /* skip the "##" and the identifier */
+            lcc_token_attach(head, lcc_token_copy(p));
+            p = p->next->next;
 
-#define _LCC_OP_S(op)               lhs op rhs
-#define _LCC_OP_Z(op, msg)          lhs op _LCC_NZ(rhs, msg)
-#define _LCC_MK_OP(name, op)        (LCC_OP_ ## name, _LCC_OP_S(op))
-#define _LCC_MK_NZ(name, op)        (LCC_OP_ ## name, _LCC_OP_Z(op, _LCC_ ## name ## _Z))
+            /* beginning and ending tokens */
+            lcc_token_t *to = argv[n + 1];
+            lcc_token_t *from = argv[n]->next;
 
-#define _LCC_EVAL_OP(name, super, ...)                                          \
-static char _lcc_eval_ ## name(                                                 \
-    lcc_lexer_t *self,                                                          \
-    intmax_t *result,                                                           \
-    lcc_token_t **token,                                                        \
-    lcc_token_t *end)                                                           \
-{                                                                               \
-    intmax_t lhs;                                                               \
-    intmax_t rhs;                                                               \
-    lcc_operator_t op;                                                          \
-                                                                                \
-    /* evaluate left-hand side operand */                                       \
-    if (!(_lcc_eval_ ## super(self, &lhs, token, end)))                         \
-        return 0;                                                               \
-                                                                                \
-    /* search for every operator */                                             \
-    while ((*token) != end)                                                     \
-    {                                                                           \
-        /* must be an operator */                                               \
-        if ((*token)->type != LCC_TK_OPERATOR)                                  \
-        {                                                                       \
-            _lcc_lexer_error(self, "Invalid preprocessor expression token");    \
-            return 0;                                                           \
-        }                                                                       \
-                                                                                \
-        /* doesn't care other operators */                                      \
-        if (!(_LCC_OP_CHECK(__VA_ARGS__)))                                      \
-            break;                                                              \
-                                                                                \
-        /* skip the operator */                                                 \
-        op = (*token)->operator;                                                \
-        *token = (*token)->next;                                                \
-                                                                                \
-        /* evaluate right-hand side operand */                                  \
-        if (!(_lcc_eval_ ## super(self, &rhs, token, end)))                     \
-            return 0;                                                           \
-                                                                                \
-        /* apply operators */                                                   \
-        switch (op)                                                             \
-        {                                                                       \
-            /* auto-generated cases */                                          \
-            _LCC_OP_CASE(__VA_ARGS__)                                           \
-        }                                                                       \
-    }                                                                           \
-                                                                                \
-    /* evaluation successful */                                                 \
-    *result = lhs;                                                              \
-    return 1;                                                                   \
-}
+            /* copy directly without expansion */
+            while (from != to)
+            {
+                lcc_token_attach(head, lcc_token_copy(from));
+                from = from->next;
+            }
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wswitch"
+            /* continue scanning */
+            continue;
+        }
 
-_LCC_EVAL_OP(term    , factor  , _LCC_MK_OP(STAR, * ), _LCC_MK_NZ(SLASH, / ), _LCC_MK_NZ(PERCENT, %))
-_LCC_EVAL_OP(expr    , term    , _LCC_MK_OP(PLUS, + ), _LCC_MK_OP(MINUS, - ))
-_LCC_EVAL_OP(shift   , expr    , _LCC_MK_OP(BSHL, <<), _LCC_MK_OP(BSHR , >>))
-_LCC_EVAL_OP(order   , shift   , _LCC_MK_OP(GT  , > ), _LCC_MK_OP(GEQ  , >=), _LCC_MK_OP(LT, <), _LCC_MK_OP(LEQ, <=))
-_LCC_EVAL_OP(equal   , order   , _LCC_MK_OP(EQ  , ==), _LCC_MK_OP(NEQ  , !=))
-_LCC_EVAL_OP(bit_and , equal   , _LCC_MK_OP(BAND, & ))
-_LCC_EVAL_OP(bit_xor , bit_and , _LCC_MK_OP(BXOR, ^ ))
-_LCC_EVAL_OP(bit_or  , bit_xor , _LCC_MK_OP(BOR , | ))
-_LCC_EVAL_OP(bool_and, bit_or  , _LCC_MK_OP(LAND, &&))
-_LCC_EVAL_OP(bool_or , bool_and, _LCC_MK_OP(LOR , ||))
+        /* apply stringnize */
+        if ((p->type == LCC_TK_OPERATOR) &&
+            (p->operator == LCC_OP_STRINGIZE))
+        {
+            /* must be an identifier after "#" */
+            if (p->next->type != LCC_TK_IDENT)
+            {
+                _lcc_lexer_error(self, "'#' is not followed by a macro parameter");
+                return 0;
+            }
 
-#pragma clang diagnostic pop
+            /* it's an argument */
+            if ((n = _lcc_arg_index(&(sym->args), p->next->ident)) >= 0)
+                m = n + 1;
 
-#undef _LCC_OP_0
-#undef _LCC_OP_1
-#undef _LCC_OP_OR_1_I
-#undef _LCC_OP_OR_2_I
-#undef _LCC_OP_OR_3_I
-#undef _LCC_OP_OR_4_I
-#undef _LCC_OP_OR_I
-#undef _LCC_OP_OR
-#undef _LCC_OP_CHECK_I
-#undef _LCC_OP_CHECK
-#undef _LCC_OP_CASE_I
-#undef _LCC_OP_CASE
-#undef _LCC_SLASH_Z
-#undef _LCC_PERCENT_Z
-#undef _LCC_OP_S
-#undef _LCC_OP_Z
-#undef _LCC_MK_OP
-#undef _LCC_MK_NZ
-#undef _LCC_EVAL_OP
+            /* variadic argument */
+            else if ((p->next->ident == sym->vaname))
+            {
+                m = argc;
+                n = sym->args.array.count;
+            }
 
-static char _lcc_eval_factor(lcc_lexer_t *self, intmax_t *result, lcc_token_t **token, lcc_token_t *end)
-{
-    /* must have at least 1 token */
-    if ((*token) == end)
-    {
-        _lcc_lexer_error(self, "Expected value in expression");
-        return 0;
+            /* otherwise it's an error */
+            else
+            {
+                _lcc_lexer_error(self, "'#' is not followed by a macro parameter");
+                return 0;
+            }
+
+            /* create a new string */
+            lcc_token_t *t = argv[n]->next;
+            lcc_string_t *v = lcc_string_new(0);
+            lcc_string_t *s;
+
+            /* concat each part of token strings */
+            while (t != argv[m])
+            {
+                lcc_string_append(v, t->src);
+                t = t->next;
+            }
+
+            /* remove whitespaces */
+            s = v;
+            v = lcc_string_trim(s);
+            lcc_string_unref(s);
+
+            /* skip to next token, and add a new token */
+            p = p->next->next;
+            lcc_token_attach(head, lcc_token_from_raw(v, lcc_string_ref(v)));
+            continue;
+        }
+
+        /* copy directly */
+        lcc_token_attach(head, lcc_token_copy(p));
+        p = p->next;
     }
 
-    /* check for token type */
-    switch ((*token)->type)
+    /* pass 2: handle concatenation */
+    return _lcc_macro_cat(self, head->next, head);
+}
+
+static char _lcc_macro_scan(lcc_lexer_t *self, lcc_token_t *begin, lcc_token_t *end, char *has_defined)
+{
+    /* first token */
+    _lcc_sym_t *sym;
+    lcc_token_t *next;
+    lcc_token_t *token = begin;
+
+    /* scan every token */
+    while (token != end)
     {
-        /* EOF, should not happen */
-        case LCC_TK_EOF:
+        /* must be a valid macro */
+        if ((token->type != LCC_TK_IDENT) ||                                /* must be an identifier */
+            !(sym = _lcc_psym_get(self, token->ident)) ||                   /* must be defined */
+            ((sym->flags & LCC_LXDF_DEFINE_SYS) &&                       /* special case of builtin macros */
+             !(strcmp(sym->name->buf, "defined")) &&                     /* actually, "defined" macro */
+             !(self->flags & (LCC_LXDN_IF | LCC_LXDN_ELIF))))               /* only available in "#if" or "#elif" */
         {
-            fprintf(stderr, "*** FATAL: EOF when parsing factor\n");
-            abort();
+            token = token->next;
+            continue;
+        }
+
+        /* call the extension if any */
+        if (sym->ext)
+        {
+            if (!(sym->ext(self, &token, end)))
+                return 0;
+            else
+                continue;
+        }
+
+        /* self-ref macros */
+        if (token->ref || _lcc_psym_expanding(self, sym))
+        {
+            token->ref = 1;
+            token = token->next;
+            continue;
+        }
+
+        /* object-like macro */
+        if (sym->flags & LCC_LXDF_DEFINE_O)
+        {
+            /* replace the name */
+            _lcc_macro_disp(
+                &token,
+                &next,
+                sym->body->next,
+                sym->body
+            );
+
+            /* handle concatenation */
+            if (!(_lcc_macro_cat(self, token, next)))
+                return 0;
         }
+        else
+        {
+            /* function-like macro, must follows a "(" operator */
+            if ((token->next == end) ||
+                (token->next->type != LCC_TK_OPERATOR) ||
+                (token->next->operator != LCC_OP_LBRACKET))
+            {
+                token = token->next;
+                continue;
+            }
 
-        /* normal macros are been substituted beforewards,
-         * no identifier but undefined one may appear here,
-         * which expands to zero according to the standard */
-        case LCC_TK_IDENT:
-        {
-            /* check for undefined function-like macros */
-            if (((*token)->next != end) &&
-                ((*token)->next->type == LCC_TK_OPERATOR) &&
-                ((*token)->next->operator == LCC_OP_LBRACKET))
+            /* argument begin */
+            lcc_token_t *head;
+            lcc_token_t *start = token->next->next;
+
+            /* check for EOF */
+            if (start == end)
             {
-                _lcc_lexer_error(self, "Function-like macro '%s' is not defined", (*token)->ident->buf);
+                _lcc_lexer_error(self, "Unterminated function-like macro invocation");
                 return 0;
             }
 
-            /* undefined object-like macro expands to zero */
-            *token = (*token)->next;
-            *result = 0;
-            break;
-        }
+            /* formal argument pointers */
+            size_t argp = 0;
+            size_t argcap = sym->args.array.count + 1;
 
-        /* simple "#pragma" directives cannot appear here since
-         * directives cannot nesting inside another directive, so if
-         * this happens, it must be expanded from "_Pragma" psudo-macro */
-        case LCC_TK_PRAGMA:
-        {
-            _lcc_lexer_error(self, "'_Pragma' is not allowed here");
-            return 0;
-        }
+            /* argument buffer */
+            lcc_token_t *delim;
+            lcc_token_t **argvp = malloc(argcap * sizeof(lcc_token_t *));
 
-        /* literal constant */
-        case LCC_TK_LITERAL:
-        {
-            /* check for literal type */
-            switch ((*token)->literal.type)
-            {
-                /* integer constants */
-                case LCC_LT_INT       : *result = (intmax_t)((*token)->literal.v_int);       break;
-                case LCC_LT_LONG      : *result = (intmax_t)((*token)->literal.v_long);      break;
-                case LCC_LT_LONGLONG  : *result = (intmax_t)((*token)->literal.v_longlong);  break;
-                case LCC_LT_UINT      : *result = (intmax_t)((*token)->literal.v_uint);      break;
-                case LCC_LT_ULONG     : *result = (intmax_t)((*token)->literal.v_ulong);     break;
-                case LCC_LT_ULONGLONG : *result = (intmax_t)((*token)->literal.v_ulonglong); break;
+            /* make a stub delimiter */
+            argvp[0] = token->next;
+            memset(argvp + 1, 0, (argcap - 1) * sizeof(lcc_token_t *));
 
-                /* floating-point numbers are not allowed */
-                case LCC_LT_FLOAT:
-                case LCC_LT_DOUBLE:
-                case LCC_LT_LONGDOUBLE:
+            /* macro pre-scan */
+            do
+            {
+                /* find next end of argument */
+                if (!(delim = _lcc_next_arg(start, end, 1)))
                 {
-                    _lcc_lexer_error(self, "Floating-point in preprocessor expression");
+                    free(argvp);
+                    _lcc_lexer_error(self, "Unterminated function-like macro invocation");
                     return 0;
                 }
 
-                /* character sequence */
-                case LCC_LT_CHAR:
-                {
-                    /* final value and character pointer */
-                    intmax_t val = 0;
-                    lcc_string_t *s = (*token)->literal.v_char;
-
-                    /* convert to integer */
-                    if (s->len <= sizeof(intmax_t))
-                        memcpy(&val, s->buf, s->len);
-                    else
-                        memcpy(&val, s->buf + s->len - sizeof(intmax_t), sizeof(intmax_t));
-
-                    /* skip the literal */
-                    *token = (*token)->next;
-                    *result = val;
-                    break;
-                }
-
-                /* string literals are not allowed either */
-                case LCC_LT_STRING:
+                /* expand argument buffer as needed */
+                if (argp >= argcap - 1)
                 {
-                    _lcc_lexer_error(self, "Invalid token at start of a preprocessor expression");
-                    return 0;
+                    argcap *= 2;
+                    argvp = realloc(argvp, argcap * sizeof(lcc_token_t *));
                 }
-            }
-
-            /* skip the literal */
-            *token = (*token)->next;
-            break;
-        }
 
-        /* keywords are generated after preprocessing,
-         * thus must not appear here, or something went wrong */
-        case LCC_TK_KEYWORD:
-        {
-            fprintf(stderr, "*** FATAL: keywords in preprocessor tokens\n");
-            abort();
-        }
+                /* skip the comma */
+                start = delim->next;
+                argvp[++argp] = delim;
 
-        /* maybe prefix operators */
-        case LCC_TK_OPERATOR:
-        {
-            /* save operator first */
-            intmax_t val;
-            lcc_operator_t op = (*token)->operator;
+            /* until encounter ")" */
+            } while ((delim->type != LCC_TK_OPERATOR) ||
+                     (delim->operator != LCC_OP_RBRACKET));
 
-            /* skip the operator first */
-            val = 0;
-            *token = (*token)->next;
+            /* no arguments when calling empty function-like macros */
+            if ((argp == 1) &&
+                (argvp[0]->next == argvp[1]) &&
+                (sym->args.array.count == 0))
+                argp = 0;
 
-            /* check for sub-expression */
-            if (op == LCC_OP_LBRACKET)
+            /* not enough arguments */
+            if (argp < sym->args.array.count)
             {
-                /* evaluate sub-expression */
-                if (!(_lcc_eval_bool_or(self, result, token, end)))
-                    return 0;
-
-                /* should ends with ")" */
-                if (((*token) == end) ||
-                    ((*token)->type != LCC_TK_OPERATOR) ||
-                    ((*token)->operator != LCC_OP_RBRACKET))
-                {
-                    _lcc_lexer_error(self, "Expected ')' in preprocessor expression");
-                    return 0;
-                }
-
-                /* skip the ")" */
-                *token = (*token)->next;
-                break;
+                free(argvp);
+                _lcc_lexer_error(self, "Too few arguments provided to function-like macro invocation");
+                return 0;
             }
 
-            /* evaluate sub-factor */
-            if (!(_lcc_eval_factor(self, &val, token, end)))
+            /* too many arguments */
+            if ((argp > sym->args.array.count) &&
+                !(sym->flags & LCC_LXDF_DEFINE_VAR))
+            {
+                free(argvp);
+                _lcc_lexer_error(self, "Too many arguments provided to function-like macro invocation");
                 return 0;
+            }
 
-            /* apply operators */
-            switch (op)
+            /* don't expand self-ref macros */
+            if (token->ref || _lcc_psym_expanding(self, sym))
             {
-                /* four possible unary operators */
-                case LCC_OP_PLUS : break;
-                case LCC_OP_MINUS: val = -val; break;
-                case LCC_OP_BINV : val = ~val; break;
-                case LCC_OP_LNOT : val = !val; break;
-
-                /* other operators are not allowed */
-                default:
-                {
-                    _lcc_lexer_error(self, "Invalid token at start of a preprocessor expression");
-                    return 0;
-                }
+                free(argvp);
+                token->ref = 1;
+                token = delim->next;
+                continue;
             }
 
-            /* store the result */
-            *result = val;
-            break;
-        }
-    }
-
-    /* evaluation successful */
-    return 1;
-}
-
-static char _lcc_eval_tokens(lcc_lexer_t *self, intmax_t *result)
-{
-    lcc_token_t *token = self->tokens.next;
-    return _lcc_eval_bool_or(self, result, &token, &(self->tokens));
-}
-
-#define _LCC_FETCH_TOKEN(self, efmt, ...)                   \
-({                                                          \
-    /* should have at least 1 argument */                   \
-    if (self->tokens.next == &(self->tokens))               \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-                                                            \
-    /* extract the token */                                 \
-    self->tokens.next;                                      \
-})
+            /* perform function-like macro expansion */
+            if (!(_lcc_macro_func(self, (head = lcc_token_new()), sym, argp, argvp, has_defined)))
+            {
+                free(argvp);
+                lcc_token_clear(head);
+                return 0;
+            }
 
-#define _LCC_DETACH_TOKEN(self, efmt, ...)                  \
-({                                                          \
-    /* should have at least 1 argument */                   \
-    if (self->tokens.next == &(self->tokens))               \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-                                                            \
-    /* detach the token */                                  \
-    lcc_token_detach(self->tokens.next);                    \
-})
+            /* out with the original tokens */
+            while (token->next != delim)
+                lcc_token_free(token->next);
 
-#define _LCC_ENSURE_IDENT(self, token, efmt, ...)           \
-({                                                          \
-    /* must be an identifier */                             \
-    if (token->type != LCC_TK_IDENT)                        \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-                                                            \
-    /* extract the token */                                 \
-    token->ident;                                           \
-})
+            /* in with the substitution */
+            lcc_token_free(delim);
+            _lcc_macro_disp(&token, &next, head->next, head);
 
-#define _LCC_ENSURE_RAWINT(self, token, efmt, ...)          \
-({                                                          \
-    /* must be an long long literal */                      \
-    if ((token->type != LCC_TK_LITERAL) ||                  \
-        ((token->literal.type != LCC_LT_INT) &&             \
-         (token->literal.type != LCC_LT_LONG) &&            \
-         (token->literal.type != LCC_LT_LONGLONG) &&        \
-         (token->literal.type != LCC_LT_UINT) &&            \
-         (token->literal.type != LCC_LT_ULONG) &&           \
-         (token->literal.type != LCC_LT_ULONGLONG)))        \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-                                                            \
-    /* extract the token */                                 \
-    token->literal.raw;                                     \
-})
+            /* release bitmap and endpoint pointers */
+            free(argvp);
+            lcc_token_clear(head);
+        }
 
-#define _LCC_ENSURE_RAWSTR(self, token, efmt, ...)          \
-({                                                          \
-    /* must be a string literal */                          \
-    if ((token->type != LCC_TK_LITERAL) ||                  \
-        (token->literal.type != LCC_LT_STRING))             \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-                                                            \
-    /* extract the token */                                 \
-    token->literal.raw;                                     \
-})
+        /* check the substitution result as needed */
+        if (!(*has_defined))
+        {
+            /* scan every token */
+            for (lcc_token_t *p = token; p != next; p = p->next)
+            {
+                /* check for expanded "defined" macro */
+                if ((p->type == LCC_TK_IDENT) && !(strcmp(p->ident->buf, "defined")))
+                {
+                    *has_defined = 1;
+                    break;
+                }
+            }
+        }
 
-#define _LCC_ENSURE_STRING(self, token, efmt, ...)          \
-({                                                          \
-    /* must be a string literal */                          \
-    if ((token->type != LCC_TK_LITERAL) ||                  \
-        (token->literal.type != LCC_LT_STRING))             \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-                                                            \
-    /* extract the token */                                 \
-    token->literal.v_string;                                \
-})
+        /* move one token backward to prevent dangling pointer */
+        token = token->prev;
+        lcc_array_append(&(self->expanding), &sym);
 
-#define _LCC_ENSURE_OPERATOR(self, token, op, efmt, ...)    \
-({                                                          \
-    /* must be an operator */                               \
-    if ((token->type != LCC_TK_OPERATOR) ||                 \
-        (token->operator != op))                            \
-    {                                                       \
-        _lcc_lexer_error(self, efmt, ## __VA_ARGS__);       \
-        return;                                             \
-    }                                                       \
-})
+        /* scan again for nested macros */
+        if (!(_lcc_macro_scan(self, token->next, next, has_defined)))
+        {
+            self->expanding.count--;
+            return 0;
+        }
 
-static inline _lcc_sym_t *_lcc_sym_ref(_lcc_sym_t *self)
-{
-    self->ref++;
-    return self;
+        /* move to next token */
+        token = next;
+        self->expanding.count--;
+    }
+
+    /* substitution successful */
+    return 1;
 }
 
-static inline _lcc_sym_t *_lcc_sym_new(
-    long flags,
-    lcc_token_t *body,
-    lcc_string_t *name,
-    lcc_string_t *vaname,
-    lcc_string_array_t *args,
-    _lcc_macro_extension_fn *ext)
+static char _lcc_macro_subst(lcc_lexer_t *self, lcc_token_t *begin, lcc_token_t *end)
 {
-    _lcc_sym_t *new = malloc(sizeof(_lcc_sym_t));
-    new->ref = 1;
-    new->ext = ext;
-    new->body = body;
-    new->name = name;
-    new->args = *args;
-    new->flags = flags;
-    new->vaname = vaname;
-    return new;
+    /* evaluate the macro */
+    char warn = 0;
+    char result = 0;
+    lcc_token_t *head = begin->prev;
+
+    /* do a macro prescan, the scan the token
+     * sequence again for macros to be expanded */
+    if (_lcc_macro_scan(self, begin, end, &warn))
+        if (_lcc_macro_scan(self, head->next, end, &warn))
+            result = 1;
+
+    /* check for warnings */
+    if (!warn)
+        return result;
+
+    /* throw out the warning */
+    _lcc_lexer_warning(self, "Macro expansion producing 'defined' has undefined behavior");
+    return result;
 }
 
-static void _lcc_sym_free(_lcc_sym_t *self)
+static void _lcc_handle_define(lcc_lexer_t *self)
 {
-    /* decrease reference */
-    if (!(--(self->ref)))
+    /* directive name not yet set */
+    if (!(self->flags & LCC_LXDF_DEFINE_NS))
     {
-        /* extensions have no body */
-        if (self->body)
-            lcc_token_clear(self->body);
+        /* must be an identifier */
+        if (self->tokens.next->type != LCC_TK_IDENT)
+        {
+            _lcc_lexer_error(self, "Macro name must be an identifier");
+            return;
+        }
 
-        /* extensions have no variadic argument name either */
-        if (self->vaname)
-            lcc_string_unref(self->vaname);
+        /* which must not be "defined" (which is
+         * the only reserved word for preprocessor) */
+        if (!(strcmp(self->tokens.next->ident->buf, "defined")))
+        {
+            _lcc_lexer_error(self, "'defined' is not a valid macro name");
+            return;
+        }
 
-        /* clear other fields */
-        lcc_string_unref(self->name);
-        lcc_string_array_free(&(self->args));
-        free(self);
+        /* set a special flag after macro name parsed successfully
+         * required for identifying object-like or function-like macro */
+        self->flags |= LCC_LXDF_DEFINE_NS;
+        self->defstate = LCC_LX_DEFSTATE_INIT;
+        self->macro_name = lcc_string_ref(self->tokens.next->ident);
+        self->macro_vaname = _lcc_intern_from(self, "__VA_ARGS__");
+
+        /* remove the identifier from tokens */
+        lcc_token_free(self->tokens.next);
+        lcc_string_array_init(&(self->macro_args));
+        return;
     }
-}
 
-static void _lcc_file_free(lcc_file_t *self)
-{
-    lcc_string_unref(self->name);
-    lcc_string_unref(self->display);
-    lcc_string_array_free(&(self->lines));
-}
+    /* only respond to function-like macros that are not checked */
+    if ((self->flags & LCC_LXDF_DEFINE_O) ||
+        (self->flags & LCC_LXDF_DEFINE_FINE))
+        return;
 
-static inline char _lcc_push_file(lcc_lexer_t *self, lcc_string_t *path, char check_only)
-{
-    /* try load the file */
-    char *name = path->buf;
-    lcc_file_t file = lcc_file_open(name);
+    /* transfer the state machine */
+    switch (self->defstate)
+    {
+        /* initial state */
+        case LCC_LX_DEFSTATE_INIT:
+        {
+            _LCC_ENSURE_OPERATOR(self, self->tokens.next, LCC_OP_LBRACKET, "'(' expected");
+            self->defstate = LCC_LX_DEFSTATE_PUSH_ARG;
+            lcc_token_free(self->tokens.next);
+            break;
+        }
 
-    /* check if it is loaded */
-    if (file.flags & LCC_FF_INVALID)
-        return 0;
+        /* push argument */
+        case LCC_LX_DEFSTATE_PUSH_ARG:
+        {
+            /* may be identifier or "..." variadic specifier */
+            switch (self->tokens.next->type)
+            {
+                /* named argument */
+                case LCC_TK_IDENT:
+                {
+                    /* check for existing names */
+                    if (_lcc_arg_index(&(self->macro_args), self->tokens.next->ident) >= 0)
+                    {
+                        _lcc_lexer_error(self, "Duplicated macro argument: %s", self->tokens.next->ident->buf);
+                        return;
+                    }
 
-    /* don't actually load under "check only" mode */
-    if (check_only)
-    {
-        _lcc_file_free(&file);
-        return 1;
-    }
+                    /* move to next state */
+                    self->defstate = LCC_LX_DEFSTATE_DELIM_OR_END;
+                    lcc_string_array_append(&(self->macro_args), lcc_string_ref(self->tokens.next->ident));
+                    break;
+                }
 
-    /* push to file stack */
-    lcc_array_append(&(self->files), &file);
-    self->file = lcc_array_top(&(self->files));
-    return 1;
-}
+                /* maybe variadic specifier */
+                case LCC_TK_OPERATOR:
+                {
+                    /* maybe a macro with no arguments */
+                    if (self->tokens.next->operator == LCC_OP_RBRACKET)
+                    {
+                        self->flags |= LCC_LXDF_DEFINE_FINE;
+                        break;
+                    }
 
-static inline char _lcc_file_exists(lcc_string_t *path)
-{
-    struct stat st;
-    return stat(path->buf, &st) == 0;
-}
+                    /* otherwise can only be ellipsis */
+                    if (self->tokens.next->operator != LCC_OP_ELLIPSIS)
+                    {
+                        _lcc_lexer_error(self, "Identifier or '...' expected");
+                        return;
+                    }
+
+                    /* cannot have more arguments */
+                    self->flags |= LCC_LXDF_DEFINE_VAR;
+                    self->defstate = LCC_LX_DEFSTATE_END;
+                    break;
+                }
+
+                /* otherwise it's an error */
+                default:
+                {
+                    _lcc_lexer_error(self, "Identifier or '...' expected");
+                    return;
+                }
+            }
+
+            /* release the token */
+            lcc_token_free(self->tokens.next);
+            break;
+        }
+
+        /* delimiter or end of argument */
+        case LCC_LX_DEFSTATE_DELIM_OR_END:
+        {
+            /* either way, it must be an operator */
+            if (self->tokens.next->type != LCC_TK_OPERATOR)
+            {
+                _lcc_lexer_error(self, "')', ',' or '...' expected");
+                return;
+            }
+
+            /* check for the operators */
+            switch (self->tokens.next->operator)
+            {
+                /* more arguments */
+                case LCC_OP_COMMA:
+                {
+                    self->defstate = LCC_LX_DEFSTATE_PUSH_ARG;
+                    break;
+                }
+
+                /* end of arguments */
+                case LCC_OP_RBRACKET:
+                {
+                    self->flags |= LCC_LXDF_DEFINE_FINE;
+                    break;
+                }
 
-static inline void _lcc_move_tokens(lcc_token_t *to, lcc_token_t *from)
-{
-    to->prev = from->prev;
-    to->next = from->next;
-    to->prev->next = to;
-    to->next->prev = to;
-    from->prev = from;
-    from->next = from;
-}
+                /* named variadic arguments */
+                case LCC_OP_ELLIPSIS:
+                {
+                    /* replace the variadic argument name */
+                    lcc_string_unref(self->macro_vaname);
+                    self->macro_vaname = lcc_string_array_pop(&(self->macro_args));
 
-static inline lcc_string_t *_lcc_path_concat(lcc_string_t *base, lcc_string_t *name)
-{
-    /* `name` is an absolute path */
-    if (name->buf[0] == '/')
-        return lcc_string_ref(name);
+                    /* cannot have more arguments */
+                    self->flags |= LCC_LXDF_DEFINE_VAR;
+                    self->flags |= LCC_LXDF_DEFINE_NVAR;
+                    self->defstate = LCC_LX_DEFSTATE_END;
+                    break;
+                }
 
-    /* otherwise make a copy of base first */
-    char last = base->buf[base->len - 1];
-    lcc_string_t *ret = lcc_string_copy(base);
+                /* otherwise it's an error */
+                default:
+                {
+                    _lcc_lexer_error(self, "')', ',' or '...' expected");
+                    return;
+                }
+            }
 
-    /* append path delimiter if needed */
-    if (last != '/')
-        lcc_string_append_from(ret, "/");
+            /* release the token */
+            lcc_token_free(self->tokens.next);
+            break;
+        }
 
-    /* then append name */
-    lcc_string_append(ret, name);
-    return ret;
+        /* dead end */
+        case LCC_LX_DEFSTATE_END:
+        {
+            _LCC_ENSURE_OPERATOR(self, self->tokens.next, LCC_OP_RBRACKET, "')' expected");
+            self->flags |= LCC_LXDF_DEFINE_FINE;
+            lcc_token_free(self->tokens.next);
+            break;
+        }
+    }
 }
 
-static inline lcc_string_t *_lcc_make_message(lcc_lexer_t *self)
+static void _lcc_handle_condition(lcc_lexer_t *self)
 {
-    /* no tokens */
-    if (self->tokens.next == &(self->tokens))
-        return lcc_string_from("");
-
-    /* a single string, use it's content directly */
-    if ((self->tokens.next->next == &(self->tokens)) &&
-        (self->tokens.next->type == LCC_TK_LITERAL) &&
-        (self->tokens.next->literal.type == LCC_LT_STRING))
+    /* end of file encountered */
+    if (self->flags & LCC_LXF_EOF)
     {
-        /* make a reference to the content */
-        lcc_token_t *t = self->tokens.next;
-        lcc_string_t *s = lcc_string_ref(t->literal.v_string);
-
-        /* clear the token */
-        lcc_token_free(t);
-        return s;
+        _lcc_lexer_error(self, "Unterminated conditional directive");
+        return;
     }
 
-    /* message string */
-    lcc_token_t *p;
-    lcc_string_t *s = lcc_string_new(0);
-
-    /* concat each token */
-    while ((p = self->tokens.next) != &(self->tokens))
+    /* end of line encountered, reset state if needed */
+    while (self->flags & LCC_LXF_EOL)
     {
-        lcc_string_append_unref(s, lcc_token_str(p));
-        lcc_string_append_from(s, " ");
-        lcc_token_free(p);
-    }
+        /* check for current status */
+        switch (self->condstate)
+        {
+            /* idle state */
+            case LCC_LX_CONDSTATE_IDLE:
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+                return;
+            }
 
-    /* remove the last space */
-    s->buf[--s->len] = 0;
-    return s;
-}
+            /* "#else" */
+            case LCC_LX_CONDSTATE_ELSE:
+            {
+                /* not on root level */
+                if (self->cond_level != 1)
+                {
+                    self->condstate = LCC_LX_CONDSTATE_IDLE;
+                    break;
+                }
 
-static inline lcc_string_t *_lcc_path_dirname(lcc_string_t *name)
-{
-    /* get it's directory name */
-    char *buf = strndup(name->buf, name->len);
-    lcc_string_t *ret = lcc_string_from(dirname(buf));
+                /* insert an "#else" preprocessor directive, the line ending
+                 * is consumed, so the next line starts with a clean source */
+                self->flags &= ~LCC_LXF_EOL;
+                self->flags |= LCC_LXF_DIRECTIVE;
+                self->flags |= LCC_LXDN_ELSE;
 
-    /* free the string buffer */
-    free(buf);
-    return ret;
-}
+                /* commit the directive */
+                self->state = LCC_LX_STATE_COMMIT;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+                return;
+            }
 
-static char _lcc_load_include(lcc_lexer_t *self, lcc_string_t *fname, char check_only)
-{
-    /* for "#include_next" support */
-    char load = 1;
-    char next = 0;
-    char found = 0;
-    dev_t fdev = 0;
-    ino_t fino = 0;
+            /* "#endif" */
+            case LCC_LX_CONDSTATE_ENDIF:
+            {
+                /* not on root level */
+                if (--self->cond_level)
+                {
+                    self->condstate = LCC_LX_CONDSTATE_IDLE;
+                    break;
+                }
 
-    /* check file path for "#include_next" */
-    if ((fname->buf[0] == '/') &&
-        (self->flags & LCC_LXDF_INCLUDE_NEXT))
-    {
-        self->flags &= ~LCC_LXDF_INCLUDE_NEXT;
-        _lcc_lexer_warning(self, "#include_next with absolute path");
-    }
+                /* insert an "#endif" preprocessor directive, the line ending
+                 * is consumed, so the next line starts with a clean source */
+                self->flags &= ~LCC_LXF_EOL;
+                self->flags |= LCC_LXF_DIRECTIVE;
+                self->flags |= LCC_LXDN_ENDIF;
 
-    /* check for "#include_next" */
-    if (self->flags & LCC_LXDF_INCLUDE_NEXT)
-    {
-        /* check file stack */
-        if (self->files.count == 1)
-            _lcc_lexer_warning(self, "#include_next in primary source file");
+                /* commit the directive */
+                self->state = LCC_LX_STATE_COMMIT;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+                return;
+            }
 
-        /* calculate include path from current file */
-        struct stat st = {};
-        lcc_string_t *dir = _lcc_path_dirname(self->file->name);
+            /* "#ifdef" or "#ifndef" */
+            case LCC_LX_CONDSTATE_IFDEF:
+            {
+                _lcc_lexer_error(self, "Missing macro name");
+                return;
+            }
 
-        /* try to read it's info */
-        if (stat(dir->buf, &st))
-        {
-            /* errors are muted under "check only" mode */
-            if (check_only)
+            /* new-line is permitted in block comments */
+            case LCC_LX_CONDSTATE_BLOCK_COMMENT:
+            case LCC_LX_CONDSTATE_BLOCK_COMMENT_END:
             {
-                lcc_string_unref(dir);
-                return 0;
+                self->state = LCC_LX_STATE_SHIFT;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+                self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT;
+                return;
             }
 
-            /* otherwise raise error as intended */
-            _lcc_lexer_error(self, "Cannot read directory '%s': [%d] %s", dir->buf, errno, strerror(errno));
-            lcc_string_unref(dir);
-            return 0;
+            /* reset state for other status */
+            default:
+            {
+                self->condstate = self->savestate;
+                self->savestate = LCC_LX_CONDSTATE_IDLE;
+                break;
+            }
         }
-
-        /* don't load immediately if it's a system include file */
-        if (self->flags & LCC_LXDF_INCLUDE_SYS)
-            load = 0;
-
-        /* mark as "include_next" */
-        next = 1;
-        fdev = st.st_dev;
-        fino = st.st_ino;
-        lcc_string_unref(dir);
     }
 
-    /* search for user directory if needed */
-    if (!next && !(self->flags & LCC_LXDF_INCLUDE_SYS))
+    /* check condition state */
+    while (1)
     {
-        /* calculate include path from current file */
-        char loaded = 0;
-        lcc_string_t *dir = _lcc_path_dirname(self->file->name);
-        lcc_string_t *path = _lcc_path_concat(dir, fname);
-
-        /* push to file stack if exists */
-        if (_lcc_file_exists(path))
+        char again = 0;
+        switch (self->condstate)
         {
-            found = 1;
-            loaded = _lcc_push_file(self, path, check_only);
-        }
+            /* idle state, drop characters as needed */
+            case LCC_LX_CONDSTATE_IDLE:
+            {
+                switch (self->ch)
+                {
+                    /* "/" or "#" encountered */
+                    case '/': self->condstate = LCC_LX_CONDSTATE_SLASH; break;
+                    case '#': self->condstate = LCC_LX_CONDSTATE_DIRECTIVE; break;
 
-        /* release the strings */
-        lcc_string_unref(dir);
-        lcc_string_unref(path);
+                    /* other characters */
+                    default:
+                    {
+                        /* not a space, this is a normal source line */
+                        if (!(isspace(self->ch)))
+                            self->condstate = LCC_LX_CONDSTATE_SOURCE;
+
+                        break;
+                    }
+                }
+
+                /* IDLE state can only be transfered to SOURCE state */
+                self->savestate = LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
+
+            /* "/" encountered, maybe line comment or block comment */
+            case LCC_LX_CONDSTATE_SLASH:
+            {
+                switch (self->ch)
+                {
+                    /* line comments or block comments */
+                    case '/': self->condstate = LCC_LX_CONDSTATE_LINE_COMMENT; break;
+                    case '*': self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT; break;
+
+                    /* everything else */
+                    default:
+                    {
+                        again = 1;
+                        self->condstate = self->savestate;
+                        break;
+                    }
+                }
+
+                break;
+            }
+
+            /* normal source line */
+            case LCC_LX_CONDSTATE_SOURCE:
+            {
+                /* "/" encountered, maybe line comment or block comment */
+                if (self->ch == '/')
+                {
+                    self->condstate = LCC_LX_CONDSTATE_SLASH;
+                    self->savestate = LCC_LX_CONDSTATE_SOURCE;
+                }
 
-        /* found, but not loaded, it's an error */
-        if (found && !loaded)
-        {
-            /* errors are muted under "check only" mode */
-            if (check_only)
-                return 0;
+                break;
+            }
 
-            /* otherwise raise error as intended */
-            _lcc_lexer_error(self, "Cannot open include file '%s': [%d] %s", fname->buf, errno, strerror(errno));
-            return 0;
-        }
-    }
+            /* "#" encountered, maybe a directive */
+            case LCC_LX_CONDSTATE_DIRECTIVE:
+            {
+                switch (self->ch)
+                {
+                    /* "e" or "i" encountered */
+                    case 'e': self->condstate = LCC_LX_CONDSTATE_E; break;
+                    case 'i': self->condstate = LCC_LX_CONDSTATE_I; break;
 
-    /* search in system include directories */
-    for (size_t i = 0; !found && (i < self->include_paths.array.count); i++)
-    {
-        char loaded = 0;
-        char doload = load;
-        struct stat st = {};
+                    /* other characters */
+                    default:
+                    {
+                        /* not a space, this is a normal source line */
+                        if (!(isspace(self->ch)))
+                            self->condstate = LCC_LX_CONDSTATE_SOURCE;
 
-        /* make the full path */
-        lcc_string_t *dir = lcc_string_array_get(&(self->include_paths), i);
-        lcc_string_t *path = _lcc_path_concat(dir, fname);
+                        break;
+                    }
+                }
 
-        /* it's "include_next" */
-        if (next)
-        {
-            /* try to read it's info */
-            if (stat(dir->buf, &st))
-            {
-                lcc_string_unref(path);
-                continue;
+                break;
             }
 
-            /* check for the same file */
-            if ((st.st_dev == fdev) &&
-                (st.st_ino == fino))
+            /* line comment, keep this state until next line */
+            case LCC_LX_CONDSTATE_LINE_COMMENT:
+                break;
+
+            /* block comment, check for "*" character */
+            case LCC_LX_CONDSTATE_BLOCK_COMMENT:
             {
-                load = 0;
-                doload = 1;
+                /* "*" encountered, maybe end of block comment */
+                if (self->ch == '*')
+                    self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT_END;
+
+                break;
             }
-        }
 
-        /* check for load flag */
-        if (load)
-        {
-            /* push to file stack if exists */
-            if (_lcc_file_exists(path))
+            /* maybe end of block comment, only if we meet "/" */
+            case LCC_LX_CONDSTATE_BLOCK_COMMENT_END:
             {
-                found = 1;
-                loaded = _lcc_push_file(self, path, check_only);
-            }
-        }
+                /* "/" encountered, block comment ends here */
+                if (self->ch == '/')
+                    self->condstate = self->savestate;
 
-        /* update load flag after loading this file */
-        load = doload;
-        lcc_string_unref(path);
+                /* otherwise it's a false trigger, so revert
+                 * back to block comment state, but we need to check
+                 * such state that have multiple stars before a slash */
+                else if (self->ch != '*')
+                    self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT;
 
-        /* found, but not loaded, it's an error */
-        if (found && !loaded)
-        {
-            /* errors are muted under "check only" mode */
-            if (check_only)
-                return 0;
+                break;
+            }
 
-            /* otherwise raise error as intended */
-            _lcc_lexer_error(self, "Cannot open include file '%s': [%d] %s", fname->buf, errno, strerror(errno));
-            return 0;
-        }
-    }
+            /* "#e(ndif|l(se|if))" */
+            case LCC_LX_CONDSTATE_E:
+            {
+                switch (self->ch)
+                {
+                    case 'n': self->condstate = LCC_LX_CONDSTATE_EN; break;
+                    case 'l': self->condstate = LCC_LX_CONDSTATE_EL; break;
+                    default : self->condstate = LCC_LX_CONDSTATE_SOURCE; break;
+                }
 
-    /* found, and loaded successfully */
-    if (found)
-        return 1;
+                break;
+            }
 
-    /* errors are muted under "check only" mode */
-    if (check_only)
-        return 0;
+            /* "#el(se|if) */
+            case LCC_LX_CONDSTATE_EL:
+            {
+                switch (self->ch)
+                {
+                    case 'i': self->condstate = LCC_LX_CONDSTATE_ELI; break;
+                    case 's': self->condstate = LCC_LX_CONDSTATE_ELS; break;
+                    default : self->condstate = LCC_LX_CONDSTATE_SOURCE; break;
+                }
 
-    /* still not found, it's an error */
-    _lcc_lexer_error(self, "Cannot open include file '%s': [%d] %s", fname->buf, ENOENT, strerror(ENOENT));
-    return 0;
-}
+                break;
+            }
 
-static lcc_token_t *_lcc_next_arg(lcc_token_t *begin, lcc_token_t *end, char allow_comma)
-{
-    /* parentheses nesting level */
-    size_t level = 0;
-    lcc_token_t *last = begin;
+            /* "#els(e)" */
+            case LCC_LX_CONDSTATE_ELS:
+            {
+                self->condstate = (self->ch == 'e') ? LCC_LX_CONDSTATE_ELSE : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-    /* find the last token of this argument */
-    while (last != end)
-    {
-        /* maybe "," "(" or ")" operator */
-        if (last->type == LCC_TK_OPERATOR)
-        {
-            /* checking for matched parentheses */
-            if ((level == 0) &&
-                (last->operator == LCC_OP_RBRACKET))
-                return last;
+            /* "#eli(f)" */
+            case LCC_LX_CONDSTATE_ELI:
+            {
+                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_ELIF : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-            /* checking for comma delimiter */
-            if (allow_comma &&
-                (level == 0) &&
-                (last->operator == LCC_OP_COMMA))
-                return last;
+            /* "#elif" */
+            case LCC_LX_CONDSTATE_ELIF:
+            {
+                /* should be a space character */
+                if (!(isspace(self->ch)) || (self->cond_level != 1))
+                {
+                    self->condstate = LCC_LX_CONDSTATE_SOURCE;
+                    break;
+                }
 
-            /* parentheses matching */
-            if (last->operator == LCC_OP_LBRACKET) level++;
-            if (last->operator == LCC_OP_RBRACKET) level--;
-        }
+                /* insert an "#elif" preprocessor directive */
+                self->flags |= LCC_LXF_DIRECTIVE;
+                self->flags |= LCC_LXDN_ELIF;
+                break;
+            }
 
-        /* move to next token */
-        last = last->next;
-    }
+            /* "#en(dif)" */
+            case LCC_LX_CONDSTATE_EN:
+            {
+                self->condstate = (self->ch == 'd') ? LCC_LX_CONDSTATE_END : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-    /* encountered end of tokens, but still not found */
-    return NULL;
-}
+            /* "#end(if)" */
+            case LCC_LX_CONDSTATE_END:
+            {
+                self->condstate = (self->ch == 'i') ? LCC_LX_CONDSTATE_ENDI : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-static char _lcc_macro_cat(lcc_lexer_t *self, lcc_token_t *begin, lcc_token_t *end)
-{
-    /* reset token pointers */
-    lcc_token_t *a;
-    lcc_token_t *b;
-    lcc_token_t *t = begin;
+            /* "#endi(f)" */
+            case LCC_LX_CONDSTATE_ENDI:
+            {
+                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_ENDIF : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-    /* pass 2: apply concatenation */
-    while (t != end)
-    {
-        /* only care about "##" operator */
-        if ((t->type != LCC_TK_OPERATOR) ||
-            (t->operator != LCC_OP_CONCAT))
-        {
-            t = t->next;
-            continue;
-        }
+            /* "#else" and "#endif" */
+            case LCC_LX_CONDSTATE_ELSE:
+            case LCC_LX_CONDSTATE_ENDIF:
+            {
+                /* should be spaces */
+                if (isspace(self->ch))
+                    break;
 
-        /* detach the previous and next token */
-        a = lcc_token_detach(t->prev);
-        b = lcc_token_detach(t->next);
+                /* not even comments */
+                if (self->ch != '/')
+                {
+                    _lcc_lexer_error(self, "Redundent directive parameter");
+                    return;
+                }
 
-        /* remove the "##" operator */
-        t = t->next;
-        lcc_token_free(t->prev);
+                /* go parsing comments */
+                self->savestate = self->condstate;
+                self->condstate = LCC_LX_CONDSTATE_SLASH;
+                break;
+            }
 
-        /* both identifiers */
-        if ((a->type == LCC_TK_IDENT) &&
-            (b->type == LCC_TK_IDENT))
-        {
-            /* append with the next token */
-            lcc_string_append(a->src, b->src);
-            lcc_string_append(a->ident, b->ident);
+            /* "#i(f((n)?def)?) */
+            case LCC_LX_CONDSTATE_I:
+            {
+                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_IF : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-            /* attach the new token */
-            lcc_token_free(b);
-            lcc_token_attach(t, a);
-            continue;
-        }
+            /* "#if((n)?def)?" */
+            case LCC_LX_CONDSTATE_IF:
+            {
+                switch (self->ch)
+                {
+                    /* "d" or "n" encountered */
+                    case 'd': self->condstate = LCC_LX_CONDSTATE_IFD; break;
+                    case 'n': self->condstate = LCC_LX_CONDSTATE_IFN; break;
 
-        /* identifier with integer, never forms a keyword */
-        if ((a->type == LCC_TK_IDENT) &&
-            (b->type == LCC_TK_LITERAL) &&
-            ((b->literal.type == LCC_LT_INT) ||
-             (b->literal.type == LCC_LT_LONG) ||
-             (b->literal.type == LCC_LT_LONGLONG) ||
-             (b->literal.type == LCC_LT_UINT) ||
-             (b->literal.type == LCC_LT_ULONG) ||
-             (b->literal.type == LCC_LT_ULONGLONG)))
-        {
-            /* append with the next token */
-            lcc_string_append(a->src, b->src);
-            lcc_string_append(a->ident, b->literal.raw);
+                    /* other characters */
+                    default:
+                    {
+                        /* is a space, commit as "#if" */
+                        if (isspace(self->ch))
+                            self->cond_level++;
 
-            /* attach the new token */
-            lcc_token_free(b);
-            lcc_token_attach(t, a);
-            continue;
-        }
+                        /* mark as source line */
+                        self->condstate = LCC_LX_CONDSTATE_SOURCE;
+                        break;
+                    }
+                }
 
-        /* both operators */
-        if ((a->type == LCC_TK_OPERATOR) &&
-            (b->type == LCC_TK_OPERATOR))
-        {
+                break;
+            }
 
-#define _OP(a, b)                   (((uint32_t)a << 16u) | (uint32_t)b)
-#define _DEL(tk)                    lcc_token_free(tk)
-#define _ADD(list, tk)              lcc_token_attach(list, tk)
-#define _NEW(name, op)              lcc_token_from_operator(lcc_string_from(name), (op))
-#define _MAP(op1, op2, name, rop)   case _OP(op1, op2): { _DEL(a); _DEL(b); _ADD(t, _NEW(name, rop)); continue; }
+            /* "#ifn(def)" */
+            case LCC_LX_CONDSTATE_IFN:
+            {
+                self->condstate = (self->ch == 'd') ? LCC_LX_CONDSTATE_IFD : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-            /* switch on compond operators */
-            switch (_OP(a->operator, b->operator))
+            /* "#ifd(ef)" or "#ifnd(ef)" */
+            case LCC_LX_CONDSTATE_IFD:
             {
-                _MAP(LCC_OP_MINUS   , LCC_OP_GT     , "->"  , LCC_OP_DEREF  )   /* "-" ## ">" -> "->" */
-                _MAP(LCC_OP_PLUS    , LCC_OP_PLUS   , "++"  , LCC_OP_INCR   )   /* "+" ## "+" -> "++" */
-                _MAP(LCC_OP_MINUS   , LCC_OP_MINUS  , "--"  , LCC_OP_DECR   )   /* "-" ## "-" -> "--" */
-                _MAP(LCC_OP_GT      , LCC_OP_GT     , ">>"  , LCC_OP_BSHR   )   /* "<" ## "<" -> "<<" */
-                _MAP(LCC_OP_LT      , LCC_OP_LT     , "<<"  , LCC_OP_BSHL   )   /* ">" ## ">" -> ">>" */
-                _MAP(LCC_OP_BAND    , LCC_OP_BAND   , "&&"  , LCC_OP_LAND   )   /* "&" ## "&" -> "&&" */
-                _MAP(LCC_OP_BOR     , LCC_OP_BOR    , "||"  , LCC_OP_LOR    )   /* "|" ## "|" -> "||" */
-                _MAP(LCC_OP_PLUS    , LCC_OP_ASSIGN , "+="  , LCC_OP_IADD   )   /* "+" ## "=" -> "+=" */
-                _MAP(LCC_OP_MINUS   , LCC_OP_ASSIGN , "-="  , LCC_OP_ISUB   )   /* "-" ## "=" -> "-=" */
-                _MAP(LCC_OP_STAR    , LCC_OP_ASSIGN , "*="  , LCC_OP_IMUL   )   /* "*" ## "=" -> "*=" */
-                _MAP(LCC_OP_SLASH   , LCC_OP_ASSIGN , "/="  , LCC_OP_IDIV   )   /* "/" ## "=" -> "/=" */
-                _MAP(LCC_OP_PERCENT , LCC_OP_ASSIGN , "%="  , LCC_OP_IMOD   )   /* "/" ## "=" -> "/=" */
-                _MAP(LCC_OP_BAND    , LCC_OP_ASSIGN , "&="  , LCC_OP_IAND   )   /* "&" ## "=" -> "&=" */
-                _MAP(LCC_OP_BOR     , LCC_OP_ASSIGN , "|="  , LCC_OP_IOR    )   /* "|" ## "=" -> "|=" */
-                _MAP(LCC_OP_BXOR    , LCC_OP_ASSIGN , "^="  , LCC_OP_IXOR   )   /* "^" ## "=" -> "^=" */
-                _MAP(LCC_OP_GT      , LCC_OP_ASSIGN , ">="  , LCC_OP_GEQ    )   /* ">" ## "=" -> ">=" */
-                _MAP(LCC_OP_LT      , LCC_OP_ASSIGN , "<="  , LCC_OP_LEQ    )   /* "<" ## "=" -> "<=" */
-                _MAP(LCC_OP_ASSIGN  , LCC_OP_ASSIGN , "=="  , LCC_OP_EQ     )   /* "=" ## "=" -> "==" */
-                _MAP(LCC_OP_LNOT    , LCC_OP_ASSIGN , "!="  , LCC_OP_NEQ    )   /* "!" ## "=" -> "!=" */
-                _MAP(LCC_OP_LT      , LCC_OP_LEQ    , "<<=" , LCC_OP_ISHL   )   /* "<" ## "<=" -> "<<=" */
-                _MAP(LCC_OP_GT      , LCC_OP_GEQ    , ">>=" , LCC_OP_ISHR   )   /* ">" ## ">=" -> ">>=" */
-                _MAP(LCC_OP_BSHL    , LCC_OP_ASSIGN , "<<=" , LCC_OP_ISHL   )   /* "<<" ## "=" -> "<<=" */
-                _MAP(LCC_OP_BSHR    , LCC_OP_ASSIGN , ">>=" , LCC_OP_ISHR   )   /* ">>" ## "=" -> ">>=" */
+                self->condstate = (self->ch == 'e') ? LCC_LX_CONDSTATE_IFDE : LCC_LX_CONDSTATE_SOURCE;
+                break;
+            }
 
-                /* other unknown operators */
-                default:
-                {
-                    const char *op1 = lcc_token_op_name(a->operator);
-                    const char *op2 = lcc_token_op_name(b->operator);
-                    _lcc_lexer_error(self, "'%s%s' is an invalid preprocessor token", op1, op2);
-                    return 0;
-                }
+            /* "#ifde(f)" or "#ifnde(f)" */
+            case LCC_LX_CONDSTATE_IFDE:
+            {
+                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_IFDEF : LCC_LX_CONDSTATE_SOURCE;
+                break;
             }
 
-#undef _OP
-#undef _DEL
-#undef _ADD
-#undef _NEW
-#undef _MAP
+            /* "#ifdef" or "#ifndef" */
+            case LCC_LX_CONDSTATE_IFDEF:
+            {
+                /* should have a space */
+                if (isspace(self->ch))
+                    break;
+
+                /* maybe comments */
+                if (self->ch == '/')
+                {
+                    self->condstate = LCC_LX_CONDSTATE_SLASH;
+                    self->savestate = LCC_LX_CONDSTATE_IFDEF;
+                    break;
+                }
 
+                /* mark as source line */
+                self->condstate = LCC_LX_CONDSTATE_SOURCE;
+                self->cond_level++;
+                break;
+            }
         }
 
-        /* otherwise it's an error, dump the token */
-        lcc_string_t *tk1 = lcc_token_str(a);
-        lcc_string_t *tk2 = lcc_token_str(b);
+        /* check for "try again" flag */
+        if (again)
+            continue;
 
-        /* throw the error */
-        _lcc_lexer_error(self, "'%s%s' is an invalid preprocessor token", tk1->buf, tk2->buf);
-        lcc_string_unref(tk1);
-        lcc_string_unref(tk2);
-        return 0;
+        /* shift next character */
+        self->state = LCC_LX_STATE_SHIFT;
+        self->substate = LCC_LX_SUBSTATE_NULL;
+        break;
     }
-
-    /* concatenation finished */
-    return 1;
 }
 
-static void _lcc_macro_disp(lcc_token_t **pos, lcc_token_t **next, lcc_token_t *begin, lcc_token_t *end)
+static void _lcc_handle_directive(lcc_lexer_t *self)
 {
-    /* first token */
-    lcc_token_t *h = *pos;
-    lcc_token_t *p = begin;
-    lcc_token_t *q = h->next;
-
-    /* make a copy of each token, then attach to anchor */
-    while (p != end)
+    switch (self->flags & LCC_LXDN_MASK)
     {
-        lcc_token_attach(q, lcc_token_copy(p));
-        p = p->next;
-    }
+        /* update directive name if it's the first token */
+        case 0:
+        {
+            /* maybe a null directive */
+            if (self->tokens.prev == &(self->tokens))
+            {
+                self->flags |= LCC_LXDN_NULL;
+                break;
+            }
 
-    /* replace the old anchor */
-    *pos = h->next;
-    *next = q;
-    lcc_token_free(h);
-}
+            /* get the directive name token */
+            lcc_string_t *name = _LCC_ENSURE_IDENT(self, self->tokens.next, "Directive name expected");
+            const _lcc_directive_bits_t *pb;
 
-static char _lcc_macro_scan(
-    lcc_lexer_t *self,
-    lcc_token_t *begin,
-    lcc_token_t *end,
-    char        *has_defined
-);
+            /* find directive by name */
+            for (pb = DIRECTIVES; pb->name; pb++)
+                if (!(strcmp(pb->name, name->buf)))
+                    break;
 
-static char _lcc_macro_attach(
-    lcc_lexer_t *self,
-    lcc_token_t *input,
-    lcc_token_t *head,
-    lcc_token_t *begin,
-    lcc_token_t *end,
-    char        *has_defined)
-{
-    /* header tokens */
-    lcc_token_t *t = begin;
-    lcc_token_t *h = head->prev;
+            /* no such directive */
+            if (!(pb->name))
+            {
+                _lcc_lexer_error(self, "Unknown compiler directive '%s'", name->buf);
+                return;
+            }
 
-    /* perform substitution */
-    while (t != end)
-    {
-        lcc_token_attach(head, lcc_token_copy(t));
-        t = t->next;
-    }
+            /* set the name bit, and remove the token */
+            self->flags |= pb->bits;
+            lcc_token_free(self->tokens.prev);
+            break;
+        }
 
-    /* only expand when not concatenating */
-    if (((input->next->type != LCC_TK_OPERATOR) ||
-         (input->next->operator != LCC_OP_CONCAT)) &&
-        !(_lcc_macro_scan(self, h->next, head, has_defined)))
-        return 0;
+        /* these directives are not handled here */
+        case LCC_LXDN_NULL:
+        case LCC_LXDN_INCLUDE:
+        case LCC_LXDN_UNDEF:
+        case LCC_LXDN_IF:
+        case LCC_LXDN_IFDEF:
+        case LCC_LXDN_IFNDEF:
+        case LCC_LXDN_ELIF:
+        case LCC_LXDN_ELSE:
+        case LCC_LXDN_ENDIF:
+        case LCC_LXDN_PRAGMA:
+        case LCC_LXDN_ERROR:
+        case LCC_LXDN_WARNING:
+        case LCC_LXDN_LINE:
+        case LCC_LXDN_SCCS:
+            break;
 
-    return 1;
+        /* "#define" directive */
+        case LCC_LXDN_DEFINE:
+        {
+            _lcc_handle_define(self);
+            break;
+        }
+
+        /* unknown bit-mask, should not happen */
+        default:
+        {
+            fprintf(stderr, "*** FATAL: unknown directive flags %.16lx\n", self->flags);
+            abort();
+        }
+    }
 }
 
-static char _lcc_macro_func(
-    lcc_lexer_t  *self,
-    lcc_token_t  *head,
-    _lcc_sym_t   *sym,
-    size_t        argc,
-    lcc_token_t **argv,
-    char         *has_defined)
+static inline char _lcc_is_operator(lcc_token_t *token, lcc_token_t *end, lcc_operator_t operator)
 {
-    /* substitution result */
-    ssize_t m;
-    ssize_t n;
-    lcc_token_t *p = sym->body->next;
-
-    /* pass 1: apply parameter substitution and stringize */
-    while (p != sym->body)
-    {
-        /* argument subtitution */
-        if ((p->type == LCC_TK_IDENT) &&
-            ((n = lcc_string_array_index(&(sym->args), p->ident)) >= 0))
-        {
-            /* special case of "<arg> ## ..." where <arg> is nothing
-             * skip the argument identifier, along with the "##" operator */
-            if ((p->next->type == LCC_TK_OPERATOR) &&
-                (p->next->operator == LCC_OP_CONCAT) &&
-                (argv[n]->next == argv[n + 1]))
-            {
-                p = p->next->next;
-                continue;
-            }
+    return (token != end) &&
+           (token->type == LCC_TK_OPERATOR) &&
+           (token->operator == operator);
+}
 
-            /* beginning and ending tokens */
-            lcc_token_t *to = argv[n + 1];
-            lcc_token_t *from = argv[n]->next;
+static lcc_string_t *_lcc_guard_name(lcc_lexer_t *self)
+{
+    lcc_token_t *end = &(self->tokens);
+    lcc_token_t *token = self->tokens.next;
 
-            /* attach token sequence, then substitute as needed */
-            if (!(_lcc_macro_attach(self, p, head, from, to, has_defined)))
-                return 0;
+    /* "#if !defined GUARD" or "#if !defined(GUARD)" */
+    if ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_IF)
+    {
+        /* must starts with "!" */
+        if (!(_lcc_is_operator(token, end, LCC_OP_LNOT)))
+            return NULL;
 
-            /* skip the token */
-            p = p->next;
-            continue;
-        }
+        /* followed by "defined" */
+        if (((token = token->next) == end) ||
+            (token->type != LCC_TK_IDENT) ||
+            (strcmp(token->ident->buf, "defined") != 0))
+            return NULL;
 
-        /* variadic argument substitution */
-        if ((p->type == LCC_TK_IDENT) &&
-            lcc_string_equals(p->ident, sym->vaname))
+        /* macro name might be quoted with "(" and ")" */
+        if (_lcc_is_operator((token = token->next), end, LCC_OP_LBRACKET))
         {
-            /* special case of "<varg> ## ..." where <varg> is nothing,
-             * skip the variadic argument identifier, along with the "##" operator */
-            if ((p->next->type == LCC_TK_OPERATOR) &&
-                (p->next->operator == LCC_OP_CONCAT) &&
-                ((argc <= sym->args.array.count) ||
-                 (argv[sym->args.array.count]->next == argv[argc])))
-            {
-                p = p->next->next;
-                continue;
-            }
+            /* must be closed right after the name */
+            if (((token = token->next) == end) ||
+                !(_lcc_is_operator(token->next, end, LCC_OP_RBRACKET)) ||
+                (token->next->next != end))
+                return NULL;
 
-            /* attach all variadic arguments, including comma */
-            if (argc > sym->args.array.count)
-            {
-                /* beginning and ending tokens */
-                lcc_token_t *to = argv[argc];
-                lcc_token_t *from = argv[sym->args.array.count]->next;
+            /* the ")" is the new end */
+            end = token->next;
+        }
+    }
 
-                /* attach token sequence, then substitute as needed */
-                if (!(_lcc_macro_attach(self, p, head, from, to, has_defined)))
-                    return 0;
-            }
+    /* must be a single identifier */
+    if ((token == end) ||
+        (token->next != end) ||
+        (token->type != LCC_TK_IDENT))
+        return NULL;
+    else
+        return token->ident;
+}
 
-            /* skip the token */
-            p = p->next;
-            continue;
-        }
+static void _lcc_guard_directive(lcc_lexer_t *self)
+{
+    lcc_file_t *file = self->file;
+    lcc_string_t *guard;
 
-        /* special case of concatenating with empty arguments */
-        if ((p->type == LCC_TK_OPERATOR) &&                                         /* first token must be an operator */
-            (p->operator == LCC_OP_CONCAT) &&                                       /* which must be a concatenation operator */
-            (p->next->type == LCC_TK_IDENT) &&                                      /* second token must be an identifier */
-            ((((n = lcc_string_array_index(&(sym->args), p->next->ident)) >= 0) &&  /* which must be an argument name */
-              (argv[n]->next == argv[n + 1])) ||                                    /* and this argument expands to nothing */
-             (lcc_string_equals(p->next->ident, sym->vaname) &&                     /* or the name equals to varg name */
-              ((argc <= sym->args.array.count) ||                                   /* and we don't have excess arguments to deal with */
-               (argv[sym->args.array.count]->next == argv[argc])))))                /* or we just have an empty variadic list */
+    /* check for include guard state */
+    switch (file->guard_state)
+    {
+        /* the first directive must be the include guard */
+        case LCC_FG_INIT:
         {
-            p = p->next->next;
-            continue;
-        }
+            /* null directives are harmless */
+            if ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_NULL)
+                break;
 
-        /* special case of ", ## <vargs>" */
-        if ((p->type == LCC_TK_OPERATOR) &&                         /* first token must be an operator */
-            (p->operator == LCC_OP_COMMA) &&                        /* which must be "," operator */
-            (p->next->type == LCC_TK_OPERATOR) &&                   /* second token must also be an operator */
-            (p->next->operator == LCC_OP_CONCAT) &&                 /* which must be "##" operator */
-            (p->next->next->type == LCC_TK_IDENT) &&                /* third token must be an identifier */
-            lcc_string_equals(p->next->next->ident, sym->vaname))   /* and is same with variadic argument name */
-        {
-            /* remove the "," if <vargs> is empty */
-            if (argc == sym->args.array.count)
-            {
-                p = p->next->next->next;
-                continue;
-            }
-            else
+            /* not an include guard */
+            if ((((self->flags & LCC_LXDN_MASK) != LCC_LXDN_IF) &&
+                 ((self->flags & LCC_LXDN_MASK) != LCC_LXDN_IFNDEF)) ||
+                !(guard = _lcc_guard_name(self)))
             {
-                lcc_token_attach(head, lcc_token_copy(p));
-                p = p->next->next;
-                continue;
+                file->guard_state = LCC_FG_NONE;
+                break;
             }
+
+            /* it opens a new conditional level */
+            file->guard = lcc_string_ref(guard);
+            file->guard_level = self->eval_stack.count + 1;
+            file->guard_state = LCC_FG_OPEN;
+            break;
         }
 
-        /* only apply when this extension enabled */
-        if (self->gnuext & LCC_LX_GNUX_VA_OPT_MACRO)
+        /* inside the include guard, wait for the matching "#endif" */
+        case LCC_FG_OPEN:
         {
-            /* special case of "__VA_OPT__(...)" */
-            if ((p->type == LCC_TK_IDENT) &&
-                !(strcmp(p->ident->buf, "__VA_OPT__")))
+            /* not on the guard level */
+            if (self->eval_stack.count != file->guard_level)
+                break;
+
+            /* check for directive type */
+            switch (self->flags & LCC_LXDN_MASK)
             {
-                /* check for next token */
-                if ((p->next == sym->body) ||
-                    (p->next->type != LCC_TK_OPERATOR) ||
-                    (p->next->operator != LCC_OP_LBRACKET))
-                {
-                    _lcc_lexer_error(self, "Missing '(' after '__VA_OPT__'");
-                    return 0;
-                }
+                case LCC_LXDN_ELIF:
+                case LCC_LXDN_ELSE:
+                    file->guard_state = LCC_FG_NONE;
+                    break;
 
-                /* move past the "(" */
-                p = p->next;
-                p = p->next;
+                case LCC_LXDN_ENDIF:
+                    file->guard_state = LCC_FG_DONE;
+                    break;
+            }
 
-                /* search pointers */
-                size_t nbrk = 1;
-                lcc_token_t *end = p;
+            break;
+        }
 
-                /* counting brackets */
-                while (nbrk && (end != sym->body))
-                {
-                    /* must be an operator */
-                    if (end->type == LCC_TK_OPERATOR)
-                    {
-                        if (end->operator == LCC_OP_LBRACKET) nbrk++;
-                        if (end->operator == LCC_OP_RBRACKET) nbrk--;
-                    }
+        /* nothing but null directives is allowed after the guard */
+        case LCC_FG_DONE:
+        {
+            if ((self->flags & LCC_LXDN_MASK) != LCC_LXDN_NULL)
+                file->guard_state = LCC_FG_NONE;
 
-                    /* move to next token */
-                    end = end->next;
-                }
+            break;
+        }
 
-                /* check for bracket balancing */
-                if (nbrk)
-                {
-                    _lcc_lexer_error(self, "Unterminated function-like macro invocation");
-                    return 0;
-                }
+        /* not guarded */
+        case LCC_FG_NONE:
+            break;
+    }
+}
 
-                /* have variadic arguments, expand to something */
-                if (((argc > sym->args.array.count) &&
-                    (argv[sym->args.array.count]->next != argv[argc])))
-                    for (lcc_token_t *t = p; t->next != end; t = t->next)
-                        lcc_token_attach(head, lcc_token_copy(t));
+static void _lcc_guard_commit(lcc_lexer_t *self, lcc_file_t *file)
+{
+    /* must be a fully guarded file with known identity */
+    if ((file->guard_state != LCC_FG_DONE) ||
+        !(file->flags & LCC_FF_IDENT))
+        return;
 
-                /* move to next token */
-                p = end;
-                continue;
-            }
-        }
+    /* map file identity to the guard macro */
+    lcc_string_t *key = _lcc_file_key(file->dev, file->ino);
+    lcc_string_t *guard = lcc_string_ref(file->guard);
 
-        /* concatenation, don't expand the following argument */
-        if ((p->type == LCC_TK_OPERATOR) &&
-            (p->operator == LCC_OP_CONCAT) &&
-            (p->next->type == LCC_TK_IDENT) &&
-            ((n = lcc_string_array_index(&(sym->args), p->next->ident)) >= 0))
-        {
-            /* skip the "##" and the identifier */
-            lcc_token_attach(head, lcc_token_copy(p));
-            p = p->next->next;
+    /* replace the old guard if any */
+    lcc_map_set(&(self->guards), key, NULL, &guard);
+    lcc_string_unref(key);
+}
 
-            /* beginning and ending tokens */
-            lcc_token_t *to = argv[n + 1];
-            lcc_token_t *from = argv[n]->next;
+static void _lcc_commit_directive(lcc_lexer_t *self)
+{
+    /* directives may yield tokens (for example, "#pragma") */
+    lcc_token_t yields = {
+        .prev = &yields,
+        .next = &yields,
+    };
 
-            /* copy directly without expansion */
-            while (from != to)
-            {
-                lcc_token_attach(head, lcc_token_copy(from));
-                from = from->next;
-            }
+    /* track the include guard of current file */
+    _lcc_guard_directive(self);
 
-            /* continue scanning */
-            continue;
-        }
+    /* check directive type */
+    switch (self->flags & LCC_LXDN_MASK)
+    {
+        /* "#" directive (null directive, does nothing) */
+        case LCC_LXDN_NULL:
+            break;
 
-        /* apply stringnize */
-        if ((p->type == LCC_TK_OPERATOR) &&
-            (p->operator == LCC_OP_STRINGIZE))
+        /* "#include" directive */
+        case LCC_LXDN_INCLUDE:
         {
-            /* must be an identifier after "#" */
-            if (p->next->type != LCC_TK_IDENT)
-            {
-                _lcc_lexer_error(self, "'#' is not followed by a macro parameter");
-                return 0;
-            }
+            /* perform a macro expansion first */
+            if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))))
+                return;
 
-            /* it's an argument */
-            if ((n = lcc_string_array_index(&(sym->args), p->next->ident)) >= 0)
-                m = n + 1;
+            /* extract the file name */
+            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing include file name");
+            lcc_string_t *fname = _LCC_ENSURE_RAWSTR(self, token, "Include file name must be a string");
 
-            /* variadic argument */
-            else if (lcc_string_equals(p->next->ident, sym->vaname))
+            /* remove the '"' on either side */
+            fname->buf[--fname->len] = 0;
+            memmove(fname->buf, fname->buf + 1, fname->len--);
+
+            /* load the include file */
+            if (_lcc_load_include(self, fname, 0))
             {
-                m = argc;
-                n = sym->args.array.count;
+                lcc_token_free(token);
+                break;
             }
-
-            /* otherwise it's an error */
             else
             {
-                _lcc_lexer_error(self, "'#' is not followed by a macro parameter");
-                return 0;
+                lcc_token_free(token);
+                return;
             }
+        }
 
-            /* create a new string */
-            lcc_token_t *t = argv[n]->next;
-            lcc_string_t *v = lcc_string_new(0);
-            lcc_string_t *s;
-
-            /* concat each part of token strings */
-            while (t != argv[m])
+        /* "#define" directive */
+        case LCC_LXDN_DEFINE:
+        {
+            /* identifier must be set */
+            if (!(self->flags & LCC_LXDF_DEFINE_NS))
             {
-                lcc_string_append(v, t->src);
-                t = t->next;
+                _lcc_lexer_error(self, "Missing macro name");
+                return;
             }
 
-            /* remove whitespaces */
-            s = v;
-            v = lcc_string_trim(s);
-            lcc_string_unref(s);
-
-            /* skip to next token, and add a new token */
-            p = p->next->next;
-            lcc_token_attach(head, lcc_token_from_raw(v, lcc_string_ref(v)));
-            continue;
-        }
-
-        /* copy directly */
-        lcc_token_attach(head, lcc_token_copy(p));
-        p = p->next;
-    }
-
-    /* pass 2: handle concatenation */
-    return _lcc_macro_cat(self, head->next, head);
-}
+            /* create a new symbol */
+            _lcc_sym_t *old = NULL;
+            _lcc_sym_t *sym = _lcc_sym_new(
+                self->flags,
+                lcc_token_new(),
+                self->macro_name,
+                self->macro_vaname,
+                &(self->macro_args),
+                NULL
+            );
 
-static char _lcc_macro_scan(lcc_lexer_t *self, lcc_token_t *begin, lcc_token_t *end, char *has_defined)
-{
-    /* first token */
-    _lcc_sym_t **sym;
-    lcc_token_t *next;
-    lcc_token_t *token = begin;
+            /* make sure we have at least 1 flag set */
+            if (!(sym->flags & LCC_LXDF_DEFINE_F))
+                sym->flags |= LCC_LXDF_DEFINE_O;
 
-    /* scan every token */
-    while (token != end)
-    {
-        /* must be a valid macro */
-        if ((token->type != LCC_TK_IDENT) ||                                /* must be an identifier */
-            !(lcc_map_get(&(self->psyms), token->ident, (void **)&sym)) ||  /* must be defined */
-            (((*sym)->flags & LCC_LXDF_DEFINE_SYS) &&                       /* special case of builtin macros */
-             !(strcmp((*sym)->name->buf, "defined")) &&                     /* actually, "defined" macro */
-             !(self->flags & (LCC_LXDN_IF | LCC_LXDN_ELIF))))               /* only available in "#if" or "#elif" */
-        {
-            token = token->next;
-            continue;
-        }
+            /* check for pre-included file */
+            if (self->file->flags & LCC_FF_SYS)
+                sym->flags |= LCC_LXDF_DEFINE_SYS;
 
-        /* call the extension if any */
-        if ((*sym)->ext)
-        {
-            if (!((*sym)->ext(self, &token, end)))
-                return 0;
-            else
-                continue;
-        }
+            /* move everything remaining to macro body */
+            if (self->tokens.next != &(self->tokens))
+                _lcc_move_tokens(sym->body, &(self->tokens));
 
-        /* self-ref macros */
-        if (token->ref || ((*sym)->flags & LCC_LXDF_DEFINE_USING))
-        {
-            token->ref = 1;
-            token = token->next;
-            continue;
-        }
+            /* add to predefined symbols, shared ones are masked by the local one,
+             * the replaced local symbol (if any) is the same as the old symbol */
+            old = _lcc_psym_get(self, self->macro_name);
+            lcc_map_set(&(self->psyms), self->macro_name, &(_lcc_sym_t *){ NULL }, &sym);
 
-        /* object-like macro */
-        if ((*sym)->flags & LCC_LXDF_DEFINE_O)
-        {
-            /* replace the name */
-            _lcc_macro_disp(
-                &token,
-                &next,
-                (*sym)->body->next,
-                (*sym)->body
-            );
+            /* not defined before */
+            if (!old)
+                break;
 
-            /* handle concatenation */
-            if (!(_lcc_macro_cat(self, token, next)))
-                return 0;
-        }
-        else
-        {
-            /* function-like macro, must follows a "(" operator */
-            if ((token->next == end) ||
-                (token->next->type != LCC_TK_OPERATOR) ||
-                (token->next->operator != LCC_OP_LBRACKET))
+            /* no warnings for system macros overriding user macros */
+            if (sym->flags & LCC_LXDF_DEFINE_SYS)
             {
-                token = token->next;
-                continue;
+                _lcc_sym_free(old);
+                break;
             }
 
-            /* argument begin */
-            lcc_token_t *head;
-            lcc_token_t *start = token->next->next;
-
-            /* check for EOF */
-            if (start == end)
+            /* check for built-in macro */
+            if (old->flags & LCC_LXDF_DEFINE_SYS)
             {
-                _lcc_lexer_error(self, "Unterminated function-like macro invocation");
-                return 0;
+                _lcc_sym_free(old);
+                _lcc_lexer_warning(self, "Redefining builtin macro '%s'", self->macro_name->buf);
+                break;
             }
 
-            /* formal argument pointers */
-            size_t argp = 0;
-            size_t argcap = (*sym)->args.array.count + 1;
+            /* two headers */
+            lcc_token_t *a = sym->body->next;
+            lcc_token_t *b = old->body->next;
 
-            /* argument buffer */
-            lcc_token_t *delim;
-            lcc_token_t **argvp = malloc(argcap * sizeof(lcc_token_t *));
+            /* compare each token */
+            while ((a != sym->body) && (b != old->body) && lcc_token_equals(a, b))
+            {
+                a = a->next;
+                b = b->next;
+            }
 
-            /* make a stub delimiter */
-            argvp[0] = token->next;
-            memset(argvp + 1, 0, (argcap - 1) * sizeof(lcc_token_t *));
+            /* redefine to same token sequence doesn't considered as "macro redefined" */
+            if ((a != sym->body) ||
+                (b != old->body) ||
+                (sym->flags != old->flags) ||
+                (sym->args.array.count != old->args.array.count))
+                _lcc_lexer_warning(self, "Symbol '%s' redefined", self->macro_name->buf);
 
-            /* macro pre-scan */
-            do
+            /* also check argument names */
+            for (size_t i = 0; i < sym->args.array.count; i++)
             {
-                /* find next end of argument */
-                if (!(delim = _lcc_next_arg(start, end, 1)))
-                {
-                    free(argvp);
-                    _lcc_lexer_error(self, "Unterminated function-like macro invocation");
-                    return 0;
-                }
+                /* get argument name at index `i` */
+                lcc_string_t *n1 = lcc_string_array_get(&(sym->args), i);
+                lcc_string_t *n2 = lcc_string_array_get(&(old->args), i);
 
-                /* expand argument buffer as needed */
-                if (argp >= argcap - 1)
+                /* should be the same */
+                if (!(lcc_string_equals(n1, n2)))
                 {
-                    argcap *= 2;
-                    argvp = realloc(argvp, argcap * sizeof(lcc_token_t *));
+                    _lcc_lexer_warning(self, "Symbol '%s' redefined", self->macro_name->buf);
+                    break;
                 }
-
-                /* skip the comma */
-                start = delim->next;
-                argvp[++argp] = delim;
-
-            /* until encounter ")" */
-            } while ((delim->type != LCC_TK_OPERATOR) ||
-                     (delim->operator != LCC_OP_RBRACKET));
-
-            /* no arguments when calling empty function-like macros */
-            if ((argp == 1) &&
-                (argvp[0]->next == argvp[1]) &&
-                ((*sym)->args.array.count == 0))
-                argp = 0;
-
-            /* not enough arguments */
-            if (argp < (*sym)->args.array.count)
-            {
-                free(argvp);
-                _lcc_lexer_error(self, "Too few arguments provided to function-like macro invocation");
-                return 0;
             }
 
-            /* too many arguments */
-            if ((argp > (*sym)->args.array.count) &&
-                !((*sym)->flags & LCC_LXDF_DEFINE_VAR))
-            {
-                free(argvp);
-                _lcc_lexer_error(self, "Too many arguments provided to function-like macro invocation");
-                return 0;
-            }
+            /* release the old symbol */
+            _lcc_sym_free(old);
+            break;
+        }
 
-            /* don't expand self-ref macros */
-            if (token->ref || ((*sym)->flags & LCC_LXDF_DEFINE_USING))
+        /* "#undef" directive */
+        case LCC_LXDN_UNDEF:
+        {
+            /* extract the macro name */
+            _lcc_sym_t *sym;
+            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing macro name");
+            lcc_string_t *macro = _LCC_ENSURE_IDENT(self, token, "Macro name must be an identifier");
+
+            /* check for macro name */
+            if (!(strcmp(macro->buf, "defined")))
             {
-                free(argvp);
-                token->ref = 1;
-                token = delim->next;
-                continue;
+                lcc_token_free(token);
+                _lcc_lexer_error(self, "'defined' is not a valid macro name");
+                return;
             }
 
-            /* perform function-like macro expansion */
-            if (!(_lcc_macro_func(self, (head = lcc_token_new()), *sym, argp, argvp, has_defined)))
+            /* check for macro existance */
+            if (!(sym = _lcc_psym_get(self, macro)))
             {
-                free(argvp);
-                lcc_token_clear(head);
-                return 0;
+                lcc_token_free(token);
+                break;
             }
 
-            /* out with the original tokens */
-            while (token->next != delim)
-                lcc_token_free(token->next);
+            /* check for macro type */
+            if (sym->flags & LCC_LXDF_DEFINE_SYS)
+                _lcc_lexer_warning(self, "Undefining builtin macro '%s'", macro->buf);
 
-            /* in with the substitution */
-            lcc_token_free(delim);
-            _lcc_macro_disp(&token, &next, head->next, head);
+            /* release the symbol */
+            _lcc_psym_remove(self, macro);
 
-            /* release bitmap and endpoint pointers */
-            free(argvp);
-            lcc_token_clear(head);
+            /* release the token */
+            lcc_token_free(token);
+            break;
         }
 
-        /* check the substitution result as needed */
-        if (!(*has_defined))
+        /* "#if" and "#elif" directives */
+        case LCC_LXDN_IF:
+        case LCC_LXDN_ELIF:
         {
-            /* scan every token */
-            for (lcc_token_t *p = token; p != next; p = p->next)
+            _lcc_val_t val = {};
+            _lcc_val_t *pval = &val;
+            lcc_array_t *stack = &(self->eval_stack);
+
+            /* "#elif" branch */
+            if ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_ELIF)
             {
-                /* check for expanded "defined" macro */
-                if ((p->type == LCC_TK_IDENT) && !(strcmp(p->ident->buf, "defined")))
+                /* read the stack top */
+                if (!(pval = lcc_array_top(stack)))
                 {
-                    *has_defined = 1;
+                    _lcc_lexer_error(self, "#elif without #if");
+                    return;
+                }
+
+                /* discard "#elif" branch as needed */
+                if (pval->discard)
+                {
+                    /* clear all tokens */
+                    while (self->tokens.next != &(self->tokens))
+                        lcc_token_free(self->tokens.next);
+
+                    /* force an inactive branch */
+                    pval->value = 0;
+                    self->condstate = LCC_LX_CONDSTATE_IDLE;
+                    self->cond_level = 1;
                     break;
                 }
             }
-        }
 
-        /* move one token backward to prevent dangling pointer */
-        token = token->prev;
-        (*sym)->flags |= LCC_LXDF_DEFINE_USING;
+            /* perform a substitution, then evaluate token sequence */
+            if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))) ||
+                !(_lcc_eval_tokens(self, &(pval->value))))
+                return;
 
-        /* scan again for nested macros */
-        if (!(_lcc_macro_scan(self, token->next, next, has_defined)))
-        {
-            (*sym)->flags &= ~LCC_LXDF_DEFINE_USING;
-            return 0;
-        }
+            /* clear all tokens after evaluation */
+            while (self->tokens.next != &(self->tokens))
+                lcc_token_free(self->tokens.next);
 
-        /* move to next token */
-        token = next;
-        (*sym)->flags &= ~LCC_LXDF_DEFINE_USING;
-    }
+            /* set discard flags for remaining branches */
+            if (pval->value)
+                pval->discard = 1;
 
-    /* substitution successful */
-    return 1;
-}
+            /* append new if "#if" */
+            if ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_IF)
+                lcc_array_append(&(self->eval_stack), pval);
 
-static char _lcc_macro_subst(lcc_lexer_t *self, lcc_token_t *begin, lcc_token_t *end)
-{
-    /* evaluate the macro */
-    char warn = 0;
-    char result = 0;
-    lcc_token_t *head = begin->prev;
+            /* push new value, and set conditional lexer state */
+            self->condstate = LCC_LX_CONDSTATE_IDLE;
+            self->cond_level = 1;
+            break;
+        }
+
+        /* "#ifdef" and "#ifndef" directives */
+        case LCC_LXDN_IFDEF:
+        case LCC_LXDN_IFNDEF:
+        {
+            /* extract the macro name */
+            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing macro name");
+            lcc_string_t *macro = _LCC_ENSURE_IDENT(self, token, "Macro name must be an identifier");
 
-    /* do a macro prescan, the scan the token
-     * sequence again for macros to be expanded */
-    if (_lcc_macro_scan(self, begin, end, &warn))
-        if (_lcc_macro_scan(self, head->next, end, &warn))
-            result = 1;
+            /* check for macro name */
+            if (!(strcmp(macro->buf, "defined")))
+            {
+                lcc_token_free(token);
+                _lcc_lexer_error(self, "'defined' is not a valid macro name");
+                return;
+            }
 
-    /* check for warnings */
-    if (!warn)
-        return result;
+            /* check for defination */
+            char has_sym = _lcc_psym_get(self, macro) != NULL;
+            char flag_ifdef = ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_IFDEF);
 
-    /* throw out the warning */
-    _lcc_lexer_warning(self, "Macro expansion producing 'defined' has undefined behavior");
-    return result;
-}
+            /* build a new value */
+            _lcc_val_t value = {
+                .value = (has_sym == flag_ifdef) ? 1 : 0,
+                .discard = (has_sym == flag_ifdef),
+            };
 
-static void _lcc_handle_define(lcc_lexer_t *self)
-{
-    /* directive name not yet set */
-    if (!(self->flags & LCC_LXDF_DEFINE_NS))
-    {
-        /* must be an identifier */
-        if (self->tokens.next->type != LCC_TK_IDENT)
-        {
-            _lcc_lexer_error(self, "Macro name must be an identifier");
-            return;
+            /* conditional lexer state */
+            self->condstate = LCC_LX_CONDSTATE_IDLE;
+            self->cond_level = 1;
+
+            /* release the token, and push the new value onto eval stack */
+            lcc_token_free(token);
+            lcc_array_append(&(self->eval_stack), &value);
+            break;
         }
 
-        /* which must not be "defined" (which is
-         * the only reserved word for preprocessor) */
-        if (!(strcmp(self->tokens.next->ident->buf, "defined")))
+        /* "#else" directive */
+        case LCC_LXDN_ELSE:
         {
-            _lcc_lexer_error(self, "'defined' is not a valid macro name");
-            return;
-        }
+            /* extract the last value on stack */
+            _lcc_val_t *value;
+            lcc_array_t *stack = &(self->eval_stack);
 
-        /* set a special flag after macro name parsed successfully
-         * required for identifying object-like or function-like macro */
-        self->flags |= LCC_LXDF_DEFINE_NS;
-        self->defstate = LCC_LX_DEFSTATE_INIT;
-        self->macro_name = lcc_string_ref(self->tokens.next->ident);
-        self->macro_vaname = lcc_string_from("__VA_ARGS__");
+            /* nothing on stack, that's an error */
+            if (!(value = lcc_array_top(stack)))
+            {
+                _lcc_lexer_error(self, "#else without #if");
+                return;
+            }
 
-        /* remove the identifier from tokens */
-        lcc_token_free(self->tokens.next);
-        lcc_string_array_init(&(self->macro_args));
-        return;
-    }
+            /* invert condition to emulate "else" if not discarding */
+            if (value->discard)
+                value->value = 0;
+            else
+                value->value = !(value->value);
 
-    /* only respond to function-like macros that are not checked */
-    if ((self->flags & LCC_LXDF_DEFINE_O) ||
-        (self->flags & LCC_LXDF_DEFINE_FINE))
-        return;
+            /* restart conditional lexer */
+            self->condstate = LCC_LX_CONDSTATE_IDLE;
+            self->cond_level = 1;
+            break;
+        }
 
-    /* transfer the state machine */
-    switch (self->defstate)
-    {
-        /* initial state */
-        case LCC_LX_DEFSTATE_INIT:
+        /* "#endif" directive */
+        case LCC_LXDN_ENDIF:
         {
-            _LCC_ENSURE_OPERATOR(self, self->tokens.next, LCC_OP_LBRACKET, "'(' expected");
-            self->defstate = LCC_LX_DEFSTATE_PUSH_ARG;
-            lcc_token_free(self->tokens.next);
-            break;
+            /* pop the last value from eval stack */
+            if (lcc_array_pop(&(self->eval_stack), NULL))
+                break;
+
+            /* nothing on stack, that's an error */
+            _lcc_lexer_error(self, "#endif without #if");
+            return;
         }
 
-        /* push argument */
-        case LCC_LX_DEFSTATE_PUSH_ARG:
+        /* "#pragma" directive */
+        case LCC_LXDN_PRAGMA:
         {
-            /* may be identifier or "..." variadic specifier */
-            switch (self->tokens.next->type)
+            /* extract the pragma name */
+            lcc_token_t *head = lcc_token_new();
+            lcc_token_t *token = _LCC_DETACH_TOKEN(self, "Missing pragma name");
+            lcc_string_t *pragma = _LCC_ENSURE_IDENT(self, token, "Pragma name must be an identifier");
+
+            /* "#pragma once" marks current file as included */
+            if (!(strcmp(pragma->buf, "once")) &&
+                (self->tokens.next == &(self->tokens)))
             {
-                /* named argument */
-                case LCC_TK_IDENT:
+                /* file identity is required */
+                if (self->file->flags & LCC_FF_IDENT)
                 {
-                    /* check for existing names */
-                    if (lcc_string_array_index(&(self->macro_args), self->tokens.next->ident) >= 0)
-                    {
-                        _lcc_lexer_error(self, "Duplicated macro argument: %s", self->tokens.next->ident->buf);
-                        return;
-                    }
-
-                    /* move to next state */
-                    self->defstate = LCC_LX_DEFSTATE_DELIM_OR_END;
-                    lcc_string_array_append(&(self->macro_args), lcc_string_ref(self->tokens.next->ident));
-                    break;
+                    lcc_string_t *key = _lcc_file_key(self->file->dev, self->file->ino);
+                    lcc_set_add(&(self->once), key);
+                    lcc_string_unref(key);
                 }
 
-                /* maybe variadic specifier */
-                case LCC_TK_OPERATOR:
-                {
-                    /* maybe a macro with no arguments */
-                    if (self->tokens.next->operator == LCC_OP_RBRACKET)
-                    {
-                        self->flags |= LCC_LXDF_DEFINE_FINE;
-                        break;
-                    }
+                /* no tokens are yielded */
+                lcc_token_free(head);
+                lcc_token_free(token);
+                break;
+            }
 
-                    /* otherwise can only be ellipsis */
-                    if (self->tokens.next->operator != LCC_OP_ELLIPSIS)
-                    {
-                        _lcc_lexer_error(self, "Identifier or '...' expected");
-                        return;
-                    }
+            /* copy all the arguments if any */
+            if (self->tokens.next != &(self->tokens))
+                _lcc_move_tokens(head, &(self->tokens));
 
-                    /* cannot have more arguments */
-                    self->flags |= LCC_LXDF_DEFINE_VAR;
-                    self->defstate = LCC_LX_DEFSTATE_END;
-                    break;
-                }
+            /* yields a "pragma" token */
+            lcc_token_attach(&yields, lcc_token_pragma(lcc_string_ref(pragma), head));
+            lcc_token_free(token);
+            break;
+        }
 
-                /* otherwise it's an error */
-                default:
-                {
-                    _lcc_lexer_error(self, "Identifier or '...' expected");
-                    return;
-                }
-            }
+        /* "#error" directive */
+        case LCC_LXDN_ERROR:
+        {
+            lcc_string_t *s = _lcc_make_message(self);
+            _lcc_lexer_error(self, "%s", s->buf);
+            lcc_string_unref(s);
+            return;
+        }
 
-            /* release the token */
-            lcc_token_free(self->tokens.next);
+        /* "#warning" directive */
+        case LCC_LXDN_WARNING:
+        {
+            lcc_string_t *s = _lcc_make_message(self);
+            _lcc_lexer_warning(self, "%s", s->buf);
+            lcc_string_unref(s);
             break;
         }
 
-        /* delimiter or end of argument */
-        case LCC_LX_DEFSTATE_DELIM_OR_END:
+        /* "#line" directive */
+        case LCC_LXDN_LINE:
         {
-            /* either way, it must be an operator */
-            if (self->tokens.next->type != LCC_TK_OPERATOR)
-            {
-                _lcc_lexer_error(self, "')', ',' or '...' expected");
+            /* perform a macro expansion first */
+            if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))))
                 return;
-            }
 
-            /* check for the operators */
-            switch (self->tokens.next->operator)
+            /* extract the line number */
+            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing line number");
+            lcc_string_t *lineno = _LCC_ENSURE_RAWINT(self, token, "#line directive requires a positive integer argument");
+
+            /* also extract file name if any */
+            if (token->next != &(self->tokens))
             {
-                /* more arguments */
-                case LCC_OP_COMMA:
-                {
-                    self->defstate = LCC_LX_DEFSTATE_PUSH_ARG;
-                    break;
-                }
+                /* extract the token */
+                lcc_token_t *next = token->next;
+                lcc_string_t *fname = _LCC_ENSURE_RAWSTR(self, next, "Invalid filename for #line directive");
 
-                /* end of arguments */
-                case LCC_OP_RBRACKET:
-                {
-                    self->flags |= LCC_LXDF_DEFINE_FINE;
-                    break;
-                }
+                /* extract the file name */
+                fname = lcc_string_ref(fname);
+                lcc_token_free(token->next);
 
-                /* named variadic arguments */
-                case LCC_OP_ELLIPSIS:
-                {
-                    /* replace the variadic argument name */
-                    lcc_string_unref(self->macro_vaname);
-                    self->macro_vaname = lcc_string_array_pop(&(self->macro_args));
+                /* remove '"' on either side */
+                fname->buf[--fname->len] = 0;
+                memmove(fname->buf, fname->buf + 1, fname->len--);
 
-                    /* cannot have more arguments */
-                    self->flags |= LCC_LXDF_DEFINE_VAR;
-                    self->flags |= LCC_LXDF_DEFINE_NVAR;
-                    self->defstate = LCC_LX_DEFSTATE_END;
-                    break;
-                }
+                /* replace current display name */
+                lcc_string_unref(self->file->display);
+                self->file->display = fname;
+            }
 
-                /* otherwise it's an error */
-                default:
-                {
-                    _lcc_lexer_error(self, "')', ',' or '...' expected");
-                    return;
-                }
+            /* check line number */
+            if ((lineno->len == 1) && (lineno->buf[0] == '0'))
+                _lcc_lexer_warning(self, "#line directive interprets number as decimal, not octal");
+
+            /* try convert to integer */
+            char *endp = NULL;
+            long long val = strtoll(lineno->buf, &endp, 10);
+
+            /* check for conversion result */
+            if (endp && (*endp))
+            {
+                lcc_token_free(token);
+                _lcc_lexer_error(self, "#line directive requires a simple digit sequence");
+                return;
             }
 
-            /* release the token */
-            lcc_token_free(self->tokens.next);
+            /* update line number, then release the token */
+            self->file->offset = val - self->file->row - 1;
+            lcc_token_free(token);
             break;
         }
 
-        /* dead end */
-        case LCC_LX_DEFSTATE_END:
+        /* "#sccs" directive */
+        case LCC_LXDN_SCCS:
         {
-            _LCC_ENSURE_OPERATOR(self, self->tokens.next, LCC_OP_RBRACKET, "')' expected");
-            self->flags |= LCC_LXDF_DEFINE_FINE;
-            lcc_token_free(self->tokens.next);
+            /* extract the SCCS message */
+            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing SCCS message");
+            lcc_string_t *message = _LCC_ENSURE_STRING(self, token, "SCCS message must be a string");
+
+            /* add to SCCS messages and release the token */
+            lcc_string_array_append(&(self->sccs_msgs), lcc_string_ref(message));
+            lcc_token_free(token);
             break;
         }
+
+        /* unknown bit-mask, should not happen */
+        default:
+        {
+            fprintf(stderr, "*** FATAL: unknown directive flags %.16lx\n", self->flags);
+            abort();
+        }
     }
-}
 
-static void _lcc_handle_condition(lcc_lexer_t *self)
-{
-    /* end of file encountered */
-    if (self->flags & LCC_LXF_EOF)
+    /* clear directive flags */
+    self->flags &= LCC_LXF_MASK;
+    self->flags &= ~LCC_LXF_DIRECTIVE;
+
+    /* should be no more tokens left */
+    if (self->tokens.next != &(self->tokens))
     {
-        _lcc_lexer_error(self, "Unterminated conditional directive");
+        _lcc_lexer_error(self, "Redundent directive parameter");
         return;
     }
 
-    /* end of line encountered, reset state if needed */
-    while (self->flags & LCC_LXF_EOL)
-    {
-        /* check for current status */
-        switch (self->condstate)
-        {
-            /* idle state */
-            case LCC_LX_CONDSTATE_IDLE:
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_NULL;
-                return;
-            }
+    /* directives may yield tokens, append those tokens */
+    if (yields.next != &yields)
+        _lcc_move_tokens(&(self->tokens), &yields);
 
-            /* "#else" */
-            case LCC_LX_CONDSTATE_ELSE:
-            {
-                /* not on root level */
-                if (self->cond_level != 1)
-                {
-                    self->condstate = LCC_LX_CONDSTATE_IDLE;
-                    break;
-                }
+    /* reset state and sub-state */
+    self->state = LCC_LX_STATE_SHIFT;
+    self->substate = LCC_LX_SUBSTATE_NULL;
+}
 
-                /* insert an "#else" preprocessor directive */
-                self->flags |= LCC_LXF_DIRECTIVE;
-                self->flags |= LCC_LXDN_ELSE;
+#undef _LCC_FETCH_TOKEN
+#undef _LCC_ENSURE_IDENT
+#undef _LCC_ENSURE_RAWSTR
+#undef _LCC_ENSURE_STRING
+#undef _LCC_ENSURE_OPERATOR
 
-                /* commit the directive */
-                self->state = LCC_LX_STATE_COMMIT;
-                self->substate = LCC_LX_SUBSTATE_NULL;
-                return;
-            }
+#define _LCC_MACRO_EXT(name)                \
+    static char __lcc_macro_ext_ ## name(   \
+        lcc_lexer_t *self,                  \
+        lcc_token_t **begin,                \
+        lcc_token_t *end                    \
+    )
 
-            /* "#endif" */
-            case LCC_LX_CONDSTATE_ENDIF:
-            {
-                /* not on root level */
-                if (--self->cond_level)
-                {
-                    self->condstate = LCC_LX_CONDSTATE_IDLE;
-                    break;
-                }
+#define _LCC_MACRO_EXT_P(name)              \
+    static char __lcc_macro_ext_ ## name(   \
+        lcc_lexer_t *self,                  \
+        lcc_token_t **begin,                \
+        lcc_token_t *end                    \
+    )                                       \
+    {                                       \
+        *begin = (*begin)->next;            \
+        return 1;                           \
+    }
 
-                /* insert an "#endif" preprocessor directive */
-                self->flags |= LCC_LXF_DIRECTIVE;
-                self->flags |= LCC_LXDN_ENDIF;
+#define _LCC_ADD_MACRO_EXT_F(ext_name) {                        \
+    _lcc_sym_t *__sym_macro_ext_ ## ext_name = _lcc_sym_new(    \
+        LCC_LXDF_DEFINE_SYS | LCC_LXDF_DEFINE_F,                \
+        NULL,                                                   \
+        _lcc_intern_from(self, # ext_name),                     \
+        NULL,                                                   \
+        &LCC_STRING_ARRAY_STATIC_INIT,                          \
+        &__lcc_macro_ext_ ## ext_name                           \
+    );                                                          \
+                                                                \
+    lcc_map_set(                                                \
+        &(self->psyms),                                         \
+        __sym_macro_ext_ ## ext_name->name,                     \
+        NULL,                                                   \
+        &__sym_macro_ext_ ## ext_name                           \
+    );                                                          \
+}
 
-                /* commit the directive */
-                self->state = LCC_LX_STATE_COMMIT;
-                self->substate = LCC_LX_SUBSTATE_NULL;
-                return;
-            }
+#define _LCC_ADD_MACRO_EXT_O(ext_name) {                        \
+    _lcc_sym_t *__sym_macro_ext_ ## ext_name = _lcc_sym_new(    \
+        LCC_LXDF_DEFINE_SYS | LCC_LXDF_DEFINE_O,                \
+        NULL,                                                   \
+        _lcc_intern_from(self, # ext_name),                     \
+        NULL,                                                   \
+        &LCC_STRING_ARRAY_STATIC_INIT,                          \
+        &__lcc_macro_ext_ ## ext_name                           \
+    );                                                          \
+                                                                \
+    lcc_map_set(                                                \
+        &(self->psyms),                                         \
+        __sym_macro_ext_ ## ext_name->name,                     \
+        NULL,                                                   \
+        &__sym_macro_ext_ ## ext_name                           \
+    );                                                          \
+}
 
-            /* "#ifdef" or "#ifndef" */
-            case LCC_LX_CONDSTATE_IFDEF:
-            {
-                _lcc_lexer_error(self, "Missing macro name");
-                return;
-            }
+static inline void _lcc_range_subst(lcc_token_t **from, lcc_token_t *to, lcc_token_t *token)
+{
+    /* remove old tokens */
+    while ((*from)->next != to)
+        lcc_token_free((*from)->next);
 
-            /* new-line is permitted in block comments */
-            case LCC_LX_CONDSTATE_BLOCK_COMMENT:
-            case LCC_LX_CONDSTATE_BLOCK_COMMENT_END:
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->substate = LCC_LX_SUBSTATE_NULL;
-                self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT;
-                return;
-            }
+    /* replace the old token */
+    lcc_token_free(*from);
+    lcc_token_attach((*from = to), token);
+}
 
-            /* reset state for other status */
-            default:
-            {
-                self->condstate = self->savestate;
-                self->savestate = LCC_LX_CONDSTATE_IDLE;
-                break;
-            }
-        }
+static inline void _lcc_single_subst(lcc_token_t **at, lcc_token_t *token)
+{
+    /* substitute a single token (from self to next), keeping the location */
+    token->loc = (*at)->loc;
+    _lcc_range_subst(at, (*at)->next, token);
+}
+
+static inline lcc_string_t *_lcc_extract_ident(
+    lcc_lexer_t  *self,
+    lcc_token_t **begin,
+    lcc_token_t  *end,
+    lcc_token_t **tail,
+    const char   *name)
+{
+    /* token sequences */
+    lcc_token_t *n0 = *begin;
+    lcc_token_t *n1 = n0->next;
+    lcc_token_t *n2 = n1->next;
+    lcc_token_t *n3 = n2->next;
+    lcc_string_t *ident;
+
+    /* the first token must be an identifier */
+    if (n0->type != LCC_TK_IDENT)
+    {
+        fprintf(stderr, "*** FATAL: non-identifier macro\n");
+        abort();
     }
 
-    /* check condition state */
-    while (1)
+    /* check for beginning "(" */
+    if ((n1 == end) ||
+        (n1->type != LCC_TK_OPERATOR) ||
+        (n1->operator != LCC_OP_LBRACKET))
     {
-        char again = 0;
-        switch (self->condstate)
-        {
-            /* idle state, drop characters as needed */
-            case LCC_LX_CONDSTATE_IDLE:
-            {
-                switch (self->ch)
-                {
-                    /* "/" or "#" encountered */
-                    case '/': self->condstate = LCC_LX_CONDSTATE_SLASH; break;
-                    case '#': self->condstate = LCC_LX_CONDSTATE_DIRECTIVE; break;
+        _lcc_lexer_error(self, "Missing '(' after '%s'", name);
+        return NULL;
+    }
 
-                    /* other characters */
-                    default:
-                    {
-                        /* not a space, this is a normal source line */
-                        if (!(isspace(self->ch)))
-                            self->condstate = LCC_LX_CONDSTATE_SOURCE;
+    /* check for EOL */
+    if ((n2 == end) || (n3 == end))
+    {
+        _lcc_lexer_error(self, "Unterminated function-like macro invocation");
+        return NULL;
+    }
 
-                        break;
-                    }
-                }
+    /* check for identifier type */
+    if (n2->type != LCC_TK_IDENT)
+    {
+        _lcc_lexer_error(self, "'%s' requires a single parenthesized identifier", name);
+        return NULL;
+    }
 
-                /* IDLE state can only be transfered to SOURCE state */
-                self->savestate = LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+    /* check for ending ")" */
+    if ((n3->type != LCC_TK_OPERATOR) ||
+        (n3->operator != LCC_OP_RBRACKET))
+    {
+        _lcc_lexer_error(self, "Missing ')' after identifier");
+        return NULL;
+    }
+
+    /* store the tail and name */
+    *tail = *begin = n3->next;
+    ident = lcc_string_ref(n2->ident);
 
-            /* "/" encountered, maybe line comment or block comment */
-            case LCC_LX_CONDSTATE_SLASH:
-            {
-                switch (self->ch)
-                {
-                    /* line comments or block comments */
-                    case '/': self->condstate = LCC_LX_CONDSTATE_LINE_COMMENT; break;
-                    case '*': self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT; break;
+    /* release tokens */
+    lcc_token_free(n0);
+    lcc_token_free(n1);
+    lcc_token_free(n2);
+    lcc_token_free(n3);
+    return ident;
+}
 
-                    /* everything else */
-                    default:
-                    {
-                        again = 1;
-                        self->condstate = self->savestate;
-                        break;
-                    }
-                }
+static inline lcc_string_t *_lcc_extract_literal_str(
+    lcc_lexer_t  *self,
+    lcc_token_t **begin,
+    lcc_token_t  *end,
+    lcc_token_t **tail,
+    const char   *name)
+{
+    /* token sequences */
+    lcc_token_t *n0 = *begin;
+    lcc_token_t *n1 = n0->next;
+    lcc_token_t *n2 = n1->next;
+    lcc_token_t *n3 = n2->next;
+    lcc_string_t *result;
 
-                break;
-            }
+    /* the first token must be an identifier */
+    if (n0->type != LCC_TK_IDENT)
+    {
+        fprintf(stderr, "*** FATAL: non-identifier macro\n");
+        abort();
+    }
 
-            /* normal source line */
-            case LCC_LX_CONDSTATE_SOURCE:
-            {
-                /* "/" encountered, maybe line comment or block comment */
-                if (self->ch == '/')
-                {
-                    self->condstate = LCC_LX_CONDSTATE_SLASH;
-                    self->savestate = LCC_LX_CONDSTATE_SOURCE;
-                }
+    /* check for beginning "(" */
+    if ((n1 == end) ||
+        (n1->type != LCC_TK_OPERATOR) ||
+        (n1->operator != LCC_OP_LBRACKET))
+    {
+        _lcc_lexer_error(self, "Missing '(' after '%s'", name);
+        return NULL;
+    }
 
-                break;
-            }
+    /* check for EOL */
+    if ((n2 == end) || (n3 == end))
+    {
+        _lcc_lexer_error(self, "Unterminated function-like macro invocation");
+        return NULL;
+    }
 
-            /* "#" encountered, maybe a directive */
-            case LCC_LX_CONDSTATE_DIRECTIVE:
-            {
-                switch (self->ch)
-                {
-                    /* "e" or "i" encountered */
-                    case 'e': self->condstate = LCC_LX_CONDSTATE_E; break;
-                    case 'i': self->condstate = LCC_LX_CONDSTATE_I; break;
+    /* check for string literal */
+    if ((n2->type != LCC_TK_LITERAL) ||
+        (n2->literal.type != LCC_LT_STRING))
+    {
+        _lcc_lexer_error(self, "'%s' takes a parenthesized string literal", name);
+        return NULL;
+    }
 
-                    /* other characters */
-                    default:
-                    {
-                        /* not a space, this is a normal source line */
-                        if (!(isspace(self->ch)))
-                            self->condstate = LCC_LX_CONDSTATE_SOURCE;
+    /* check for ending ")" */
+    if ((n3->type != LCC_TK_OPERATOR) ||
+        (n3->operator != LCC_OP_RBRACKET))
+    {
+        _lcc_lexer_error(self, "Missing ')' after string literal");
+        return NULL;
+    }
 
-                        break;
-                    }
-                }
+    /* store the tail and detach the token */
+    *tail = *begin = n3->next;
+    result = lcc_string_ref(n2->literal.raw);
 
-                break;
-            }
+    /* release tokens */
+    lcc_token_free(n0);
+    lcc_token_free(n1);
+    lcc_token_free(n2);
+    lcc_token_free(n3);
+    return result;
+}
 
-            /* line comment, keep this state until next line */
-            case LCC_LX_CONDSTATE_LINE_COMMENT:
-                break;
+/** Object-like built-in macros **/
 
-            /* block comment, check for "*" character */
-            case LCC_LX_CONDSTATE_BLOCK_COMMENT:
-            {
-                /* "*" encountered, maybe end of block comment */
-                if (self->ch == '*')
-                    self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT_END;
+_LCC_MACRO_EXT(__FILE__)
+{
+    /* decode current file name */
+    lcc_string_t *fname;
+    lcc_lexer_locate(self, self->loc, &fname, NULL, NULL);
 
-                break;
-            }
+    /* dump file name */
+    lcc_string_t *src = lcc_string_ref(fname);
+    lcc_string_t *value = lcc_string_ref(fname);
 
-            /* maybe end of block comment, only if we meet "/" */
-            case LCC_LX_CONDSTATE_BLOCK_COMMENT_END:
-            {
-                /* "/" encountered, block comment ends here */
-                if (self->ch == '/')
-                    self->condstate = self->savestate;
+    /* replace the old token */
+    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
+    return 1;
+}
 
-                /* otherwise it's a false trigger, so revert
-                 * back to block comment state, but we need to check
-                 * such state that have multiple stars before a slash */
-                else if (self->ch != '*')
-                    self->condstate = LCC_LX_CONDSTATE_BLOCK_COMMENT;
+_LCC_MACRO_EXT(__LINE__)
+{
+    size_t row;
+    lcc_lexer_locate(self, self->loc, NULL, &row, NULL);
+    _lcc_single_subst(begin, lcc_token_from_int(row));
+    return 1;
+}
 
-                break;
-            }
+_LCC_MACRO_EXT(__DATE__)
+{
+    char s[32] = {};
+    time_t ts;
+    struct tm tm;
 
-            /* "#e(ndif|l(se|if))" */
-            case LCC_LX_CONDSTATE_E:
-            {
-                switch (self->ch)
-                {
-                    case 'n': self->condstate = LCC_LX_CONDSTATE_EN; break;
-                    case 'l': self->condstate = LCC_LX_CONDSTATE_EL; break;
-                    default : self->condstate = LCC_LX_CONDSTATE_SOURCE; break;
-                }
+    /* read current time */
+    if ((time(&ts) < 0) || !(localtime_r(&ts, &tm)))
+        strcpy(s, "??? ?? ????");
+    else
+        strftime(s, sizeof(s), "%b %e %Y", &tm);
 
-                break;
-            }
+    /* create date string */
+    lcc_string_t *src = lcc_string_from(s);
+    lcc_string_t *value = lcc_string_from(s);
 
-            /* "#el(se|if) */
-            case LCC_LX_CONDSTATE_EL:
-            {
-                switch (self->ch)
-                {
-                    case 'i': self->condstate = LCC_LX_CONDSTATE_ELI; break;
-                    case 's': self->condstate = LCC_LX_CONDSTATE_ELS; break;
-                    default : self->condstate = LCC_LX_CONDSTATE_SOURCE; break;
-                }
+    /* replace the old token */
+    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
+    return 1;
+}
 
-                break;
-            }
+_LCC_MACRO_EXT(__TIME__)
+{
+    char s[32] = {};
+    time_t ts;
+    struct tm tm;
 
-            /* "#els(e)" */
-            case LCC_LX_CONDSTATE_ELS:
-            {
-                self->condstate = (self->ch == 'e') ? LCC_LX_CONDSTATE_ELSE : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+    /* read current time */
+    if ((time(&ts) < 0) || !(localtime_r(&ts, &tm)))
+        strcpy(s, "??:??:??");
+    else
+        strftime(s, sizeof(s), "%T", &tm);
 
-            /* "#eli(f)" */
-            case LCC_LX_CONDSTATE_ELI:
-            {
-                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_ELIF : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+    /* create time string */
+    lcc_string_t *src = lcc_string_from(s);
+    lcc_string_t *value = lcc_string_from(s);
 
-            /* "#elif" */
-            case LCC_LX_CONDSTATE_ELIF:
-            {
-                /* should be a space character */
-                if (!(isspace(self->ch)) || (self->cond_level != 1))
-                {
-                    self->condstate = LCC_LX_CONDSTATE_SOURCE;
-                    break;
-                }
+    /* replace the old token */
+    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
+    return 1;
+}
 
-                /* insert an "#elif" preprocessor directive */
-                self->flags |= LCC_LXF_DIRECTIVE;
-                self->flags |= LCC_LXDN_ELIF;
-                break;
-            }
+_LCC_MACRO_EXT(__COUNTER__)
+{
+    _lcc_single_subst(begin, lcc_token_from_int(self->counter++));
+    return 1;
+}
 
-            /* "#en(dif)" */
-            case LCC_LX_CONDSTATE_EN:
-            {
-                self->condstate = (self->ch == 'd') ? LCC_LX_CONDSTATE_END : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+_LCC_MACRO_EXT(__TIMESTAMP__)
+{
+    char s[32] = {};
+    struct tm tm;
+    struct stat st;
+    lcc_string_t *fname;
 
-            /* "#end(if)" */
-            case LCC_LX_CONDSTATE_END:
-            {
-                self->condstate = (self->ch == 'i') ? LCC_LX_CONDSTATE_ENDI : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+    /* decode current file name */
+    lcc_lexer_locate(self, self->loc, &fname, NULL, NULL);
+
+    /* read current time */
+    if (stat(fname->buf, &st) ||
+        !(localtime_r(&(st.st_mtime), &tm)))
+        strcpy(s, "??? ??? ?? ??:??:?? ????");
+    else
+        strftime(s, sizeof(s), "%a %b %e %T %Y", &tm);
 
-            /* "#endi(f)" */
-            case LCC_LX_CONDSTATE_ENDI:
-            {
-                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_ENDIF : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+    /* create timestamp string */
+    lcc_string_t *src = lcc_string_from(s);
+    lcc_string_t *value = lcc_string_from(s);
 
-            /* "#else" and "#endif" */
-            case LCC_LX_CONDSTATE_ELSE:
-            case LCC_LX_CONDSTATE_ENDIF:
-            {
-                /* should be spaces */
-                if (isspace(self->ch))
-                    break;
+    /* replace the old token */
+    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
+    return 1;
+}
 
-                /* not even comments */
-                if (self->ch != '/')
-                {
-                    _lcc_lexer_error(self, "Redundent directive parameter");
-                    return;
-                }
+_LCC_MACRO_EXT(__BASE_FILE__)
+{
+    /* dump display name */
+    lcc_file_t *fp = self->files.items;
+    lcc_string_t *src = lcc_string_ref(fp->display);
+    lcc_string_t *value = lcc_string_ref(fp->display);
 
-                /* go parsing comments */
-                self->savestate = self->condstate;
-                self->condstate = LCC_LX_CONDSTATE_SLASH;
-                break;
-            }
+    /* replace the old token */
+    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
+    return 1;
+}
 
-            /* "#i(f((n)?def)?) */
-            case LCC_LX_CONDSTATE_I:
-            {
-                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_IF : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+_LCC_MACRO_EXT(__INCLUDE_LEVEL__)
+{
+    _lcc_single_subst(begin, lcc_token_from_int(self->files.count - 1));
+    return 1;
+}
 
-            /* "#if((n)?def)?" */
-            case LCC_LX_CONDSTATE_IF:
-            {
-                switch (self->ch)
-                {
-                    /* "d" or "n" encountered */
-                    case 'd': self->condstate = LCC_LX_CONDSTATE_IFD; break;
-                    case 'n': self->condstate = LCC_LX_CONDSTATE_IFN; break;
+/** Function-like built-in macros **/
 
-                    /* other characters */
-                    default:
-                    {
-                        /* is a space, commit as "#if" */
-                        if (isspace(self->ch))
-                            self->cond_level++;
+_LCC_MACRO_EXT(defined)
+{
+    char brk;
+    lcc_token_t *token = *begin;
+    lcc_string_t *ident;
 
-                        /* mark as source line */
-                        self->condstate = LCC_LX_CONDSTATE_SOURCE;
-                        break;
-                    }
-                }
+    /* check for next token */
+    if ((token = token->next) == end)
+    {
+        _lcc_lexer_error(self, "Macro name missing");
+        return 0;
+    }
 
-                break;
-            }
+    /* check for operator type */
+    switch (token->type)
+    {
+        /* "defined xxx" */
+        case LCC_TK_IDENT:
+        {
+            brk = 0;
+            token = token->next;
+            ident = lcc_string_ref(token->prev->ident);
+            break;
+        }
 
-            /* "#ifn(def)" */
-            case LCC_LX_CONDSTATE_IFN:
-            {
-                self->condstate = (self->ch == 'd') ? LCC_LX_CONDSTATE_IFD : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+        /* maybe "defined(xxx)" */
+        case LCC_TK_OPERATOR:
+        {
+            /* must be a "(" in this case */
+            if (token->operator != LCC_OP_LBRACKET)
+                goto _lcc_factor_not_ident;
 
-            /* "#ifd(ef)" or "#ifnd(ef)" */
-            case LCC_LX_CONDSTATE_IFD:
-            {
-                self->condstate = (self->ch == 'e') ? LCC_LX_CONDSTATE_IFDE : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+            /* skip the "(" */
+            brk = 1;
+            token = token->next;
 
-            /* "#ifde(f)" or "#ifnde(f)" */
-            case LCC_LX_CONDSTATE_IFDE:
-            {
-                self->condstate = (self->ch == 'f') ? LCC_LX_CONDSTATE_IFDEF : LCC_LX_CONDSTATE_SOURCE;
-                break;
-            }
+            /* then must be an identifier */
+            if (token->type != LCC_TK_IDENT)
+                goto _lcc_factor_not_ident;
 
-            /* "#ifdef" or "#ifndef" */
-            case LCC_LX_CONDSTATE_IFDEF:
-            {
-                /* should have a space */
-                if (isspace(self->ch))
-                    break;
+            /* extract the identifier */
+            token = token->next;
+            ident = lcc_string_ref(token->prev->ident);
+            break;
+        }
 
-                /* maybe comments */
-                if (self->ch == '/')
-                {
-                    self->condstate = LCC_LX_CONDSTATE_SLASH;
-                    self->savestate = LCC_LX_CONDSTATE_IFDEF;
-                    break;
-                }
+        /* otherwise it's an error */
+        default:
+        _lcc_factor_not_ident:
+        {
+            _lcc_lexer_error(self, "Macro name must be an identifier");
+            return 0;
+        }
+    }
 
-                /* mark as source line */
-                self->condstate = LCC_LX_CONDSTATE_SOURCE;
-                self->cond_level++;
-                break;
-            }
+    /* close bracket required */
+    if (brk)
+    {
+        /* check for close bracket */
+        if ((token->type != LCC_TK_OPERATOR) ||
+            (token->operator != LCC_OP_RBRACKET))
+        {
+            _lcc_lexer_error(self, "Missing ')' after 'defined'");
+            return 0;
         }
 
-        /* check for "try again" flag */
-        if (again)
-            continue;
+        /* skip the ")" */
+        token = token->next;
+    }
 
-        /* shift next character */
-        self->state = LCC_LX_STATE_SHIFT;
-        self->substate = LCC_LX_SUBSTATE_NULL;
-        break;
+    /* check for "defined" */
+    if (!(strcmp(ident->buf, "defined")))
+    {
+        _lcc_lexer_error(self, "'defined' is not a valid macro name");
+        lcc_string_unref(ident);
+        return 0;
     }
+
+    /* replace the old token */
+    _lcc_range_subst(begin, token, lcc_token_from_int(_lcc_psym_get(self, ident) != NULL));
+    lcc_string_unref(ident);
+    return 1;
 }
 
-static void _lcc_handle_directive(lcc_lexer_t *self)
+_LCC_MACRO_EXT(_Pragma)
 {
-    switch (self->flags & LCC_LXDN_MASK)
-    {
-        /* update directive name if it's the first token */
-        case 0:
-        {
-            /* maybe a null directive */
-            if (self->tokens.prev == &(self->tokens))
-            {
-                self->flags |= LCC_LXDN_NULL;
-                break;
-            }
+    /* extract the pragma literal */
+    lcc_token_t *tail;
+    lcc_string_t *value = _lcc_extract_literal_str(self, begin, end, &tail, "_Pragma");
 
-            /* get the directive name token */
-            lcc_string_t *name = _LCC_ENSURE_IDENT(self, self->tokens.next, "Directive name expected");
-            const _lcc_directive_bits_t *pb;
+    /* check for errors */
+    if (!value)
+        return 0;
 
-            /* find directive by name */
-            for (pb = DIRECTIVES; pb->name; pb++)
-                if (!(strcmp(pb->name, name->buf)))
-                    break;
+    /* make a copy of the string to translate '\\' and '\"' */
+    size_t n = 0;
+    lcc_string_t *pragma = lcc_string_copy(value);
 
-            /* no such directive */
-            if (!(pb->name))
-            {
-                _lcc_lexer_error(self, "Unknown compiler directive '%s'", name->buf);
-                return;
-            }
+    /* remove '"' on either side */
+    lcc_string_unref(value);
+    pragma->buf[--pragma->len] = 0;
+    memmove(pragma->buf, pragma->buf + 1, pragma->len--);
 
-            /* set the name bit, and remove the token */
-            self->flags |= pb->bits;
-            lcc_token_free(self->tokens.prev);
-            break;
-        }
+    /* buffer pointers */
+    char *p = pragma->buf;
+    char *q = pragma->buf;
 
-        /* these directives are not handled here */
-        case LCC_LXDN_NULL:
-        case LCC_LXDN_INCLUDE:
-        case LCC_LXDN_UNDEF:
-        case LCC_LXDN_IF:
-        case LCC_LXDN_IFDEF:
-        case LCC_LXDN_IFNDEF:
-        case LCC_LXDN_ELIF:
-        case LCC_LXDN_ELSE:
-        case LCC_LXDN_ENDIF:
-        case LCC_LXDN_PRAGMA:
-        case LCC_LXDN_ERROR:
-        case LCC_LXDN_WARNING:
-        case LCC_LXDN_LINE:
-        case LCC_LXDN_SCCS:
-            break;
+    /* translate until source string ends */
+    while (*p)
+    {
+        /* not an escape character, just copy as is */
+        if (*p != '\\')
+        {
+            n++;
+            *q++ = *p++;
+        }
 
-        /* "#define" directive */
-        case LCC_LXDN_DEFINE:
+        /* otherwise, check the next character */
+        else
         {
-            _lcc_handle_define(self);
-            break;
+            switch (*++p)
+            {
+                /* '_Pragma' only accepts '\\' and '\"' as escape sequences */
+                case '\\':
+                case '\"':
+                {
+                    n++;
+                    *q++ = *p++;
+                    break;
+                }
+
+                /* other characters are preserved along with the '\\' */
+                default:
+                {
+                    n++;
+                    *q++ = '\\';
+                    *q++ = *p++;
+                    break;
+                }
+            }
         }
 
-        /* unknown bit-mask, should not happen */
-        default:
+        /* "CR" or "LF" should not appear in pragma, otherwise it's a fatal error */
+        if ((q[-1] == '\r') || (q[-1] == '\n'))
         {
-            fprintf(stderr, "*** FATAL: unknown directive flags %.16lx\n", self->flags);
+            fprintf(stderr, "*** FATAL: new-line in pragma\n");
             abort();
         }
     }
-}
 
-static void _lcc_commit_directive(lcc_lexer_t *self)
-{
-    /* directives may yield tokens (for example, "#pragma") */
-    lcc_token_t yields = {
-        .prev = &yields,
-        .next = &yields,
+    /* terminate the pragma string */
+    *q = 0;
+    pragma->len = n;
+
+    /* dummy file for parsing pragma */
+    lcc_file_t file = {
+        .col = 0,
+        .row = 0,
+        .dev = 0,
+        .ino = 0,
+        .data = NULL,
+        .name = lcc_string_from("<pragma>"),
+        .scan = 0,
+        .size = 0,
+        .flags = LCC_FF_SYS,
+        .guard = NULL,
+        .cache = NULL,
+        .source = NULL,
+        .index = {},
+        .lines = LCC_STRING_ARRAY_STATIC_INIT,
+        .offset = 1,
+        .display = lcc_string_from("<pragma>"),
+        .guard_level = 0,
+        .guard_state = LCC_FG_INIT,
     };
 
-    /* check directive type */
-    switch (self->flags & LCC_LXDN_MASK)
+    /* only one line in the source */
+    lcc_string_array_append(&(file.lines), lcc_string_from_format("#pragma %s", pragma->buf));
+    lcc_string_unref(pragma);
+
+    /* buffer to save the current tokens */
+    lcc_file_t *fp;
+    lcc_token_t buffer = {
+        .prev = &buffer,
+        .next = &buffer,
+    };
+
+    /* move everything into buffer area */
+    if (self->tokens.next != &(self->tokens))
+        _lcc_move_tokens(&buffer, &(self->tokens));
+
+    /* load to file stack */
+    lcc_array_append(&(self->files), &file);
+    self->file = fp = lcc_array_top(&(self->files));
+    self->loc_file = NULL;
+
+    /* parse the pragma */
+    if (!(lcc_lexer_advance(self)))
+        return 0;
+
+    /* the file should've popped */
+    if (fp == self->file)
     {
-        /* "#" directive (null directive, does nothing) */
-        case LCC_LXDN_NULL:
-            break;
+        fprintf(stderr, "*** FATAL: pragma takes more than one advancing\n");
+        abort();
+    }
 
-        /* "#include" directive */
-        case LCC_LXDN_INCLUDE:
-        {
-            /* perform a macro expansion first */
-            if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))))
-                return;
+    /* save the newly generated tokens */
+    lcc_token_t head = {
+        .prev = &head,
+        .next = &head,
+    };
 
-            /* extract the file name */
-            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing include file name");
-            lcc_string_t *fname = _LCC_ENSURE_RAWSTR(self, token, "Include file name must be a string");
+    /* move everything into buffer area */
+    if (self->tokens.next != &(self->tokens))
+        _lcc_move_tokens(&head, &(self->tokens));
 
-            /* remove the '"' on either side */
-            fname->buf[--fname->len] = 0;
-            memmove(fname->buf, fname->buf + 1, fname->len--);
+    /* restore original tokens */
+    if (buffer.next != &buffer)
+        _lcc_move_tokens(&(self->tokens), &buffer);
 
-            /* load the include file */
-            if (_lcc_load_include(self, fname, 0))
-            {
-                lcc_token_free(token);
-                break;
-            }
-            else
-            {
-                lcc_token_free(token);
-                return;
-            }
-        }
+    /* no new tokens available */
+    if (head.next == &head)
+        return 1;
 
-        /* "#define" directive */
-        case LCC_LXDN_DEFINE:
-        {
-            /* identifier must be set */
-            if (!(self->flags & LCC_LXDF_DEFINE_NS))
-            {
-                _lcc_lexer_error(self, "Missing macro name");
-                return;
-            }
+    /* at most 1 token is allowed */
+    if (head.next->next != &head)
+    {
+        fprintf(stderr, "*** FATAL: pragma yields multiple tokens\n");
+        abort();
+    }
 
-            /* create a new symbol */
-            _lcc_sym_t *old = NULL;
-            _lcc_sym_t *sym = _lcc_sym_new(
-                self->flags,
-                lcc_token_new(),
-                self->macro_name,
-                self->macro_vaname,
-                &(self->macro_args),
-                NULL
-            );
+    /* substitute in the new token */
+    lcc_token_attach(*begin, lcc_token_detach(head.next));
+    return 1;
+}
 
-            /* make sure we have at least 1 flag set */
-            if (!(sym->flags & LCC_LXDF_DEFINE_F))
-                sym->flags |= LCC_LXDF_DEFINE_O;
+#define _LCC_FEATURE_CHECK(type)                                                                \
+{                                                                                               \
+    /* extract the identifier */                                                                \
+    lcc_token_t *tail;                                                                          \
+    lcc_string_t *ident = _lcc_extract_ident(self, begin, end, &tail, "__has_" #type);          \
+                                                                                                \
+    /* check for errors */                                                                      \
+    if (!ident)                                                                                 \
+        return 0;                                                                               \
+                                                                                                \
+    /* attach the result */                                                                     \
+    lcc_token_attach(tail, lcc_token_from_int(lcc_set_contains(&(self->type ## s), ident)));    \
+    lcc_string_unref(ident);                                                                    \
+    return 1;                                                                                   \
+}
 
-            /* check for pre-included file */
-            if (self->file->flags & LCC_FF_SYS)
-                sym->flags |= LCC_LXDF_DEFINE_SYS;
+_LCC_MACRO_EXT(__has_builtin  ) _LCC_FEATURE_CHECK(builtin  )
+_LCC_MACRO_EXT(__has_feature  ) _LCC_FEATURE_CHECK(feature  )
+_LCC_MACRO_EXT(__has_extension) _LCC_FEATURE_CHECK(extension)
 
-            /* move everything remaining to macro body */
-            if (self->tokens.next != &(self->tokens))
-                _lcc_move_tokens(sym->body, &(self->tokens));
+#undef _LCC_FEATURE_CHECK
 
-            /* add to predefined symbols */
-            if (!(lcc_map_set(&(self->psyms), self->macro_name, &old, &sym)))
-                break;
+static char _lcc_check_include(
+    lcc_lexer_t *self,
+    lcc_token_t **begin,
+    lcc_token_t *end,
+    char         is_next)
+{
+    /* skip "__has_include" */
+    lcc_token_t *next;
+    lcc_token_t *head = (*begin)->next;
 
-            /* no warnings for system macros overriding user macros */
-            if (sym->flags & LCC_LXDF_DEFINE_SYS)
-            {
-                _lcc_sym_free(old);
-                break;
-            }
+    /* token source and file path */
+    char is_sys = 1;
+    char is_macro = 0;
+    lcc_string_t *src;
+    lcc_string_t *path;
 
-            /* check for built-in macro */
-            if (old->flags & LCC_LXDF_DEFINE_SYS)
-            {
-                _lcc_sym_free(old);
-                _lcc_lexer_warning(self, "Redefining builtin macro '%s'", self->macro_name->buf);
-                break;
-            }
+    /* check for next token */
+    if ((head == end) ||
+        (head->type != LCC_TK_OPERATOR) ||
+        (head->operator != LCC_OP_LBRACKET))
+    {
+        _lcc_lexer_error(self, "Missing '(' after '__has_include'");
+        return 0;
+    }
 
-            /* two headers */
-            lcc_token_t *a = sym->body->next;
-            lcc_token_t *b = old->body->next;
+    /* may need macro expansion */
+    if (((head->next->type != LCC_TK_LITERAL) ||
+         (head->next->literal.type != LCC_LT_STRING)) &&
+        ((head->next->type != LCC_TK_OPERATOR) ||
+         (head->next->operator != LCC_OP_LT)))
+    {
+        /* could only be identifiers */
+        if (head->next->type != LCC_TK_IDENT)
+        {
+            _lcc_lexer_error(self, "Expected \"FILENAME\" or <FILENAME>");
+            return 0;
+        }
 
-            /* compare each token */
-            while ((a != sym->body) && (b != old->body) && lcc_token_equals(a, b))
-            {
-                a = a->next;
-                b = b->next;
-            }
+        /* search for next token */
+        if (!(next = _lcc_next_arg(head->next, end, 0)))
+        {
+            _lcc_lexer_error(self, "Expected value in expression");
+            return 0;
+        }
+
+        /* perform substitution */
+        if (!(is_macro = _lcc_macro_subst(self, head->next, next)))
+            return 0;
+    }
+
+    /* move to next token */
+    if ((next = head->next) == end)
+    {
+        _lcc_lexer_error(self, "Expected value in expression");
+        return 0;
+    }
 
-            /* redefine to same token sequence doesn't considered as "macro redefined" */
-            if ((a != sym->body) ||
-                (b != old->body) ||
-                (sym->flags != old->flags) ||
-                (sym->args.array.count != old->args.array.count))
-                _lcc_lexer_warning(self, "Symbol '%s' redefined", self->macro_name->buf);
+    /* __has_include[_next]("...") */
+    if ((next->type == LCC_TK_LITERAL) &&
+        (next->literal.type == LCC_LT_STRING))
+    {
+        /* copy the raw string */
+        path = lcc_string_copy(next->literal.raw);
+        next = next->next;
 
-            /* also check argument names */
-            for (size_t i = 0; i < sym->args.array.count; i++)
-            {
-                /* get argument name at index `i` */
-                lcc_string_t *n1 = lcc_string_array_get(&(sym->args), i);
-                lcc_string_t *n2 = lcc_string_array_get(&(old->args), i);
+        /* remove '"' on either side */
+        is_sys = 0;
+        path->buf[--path->len] = 0;
+        memmove(path->buf, path->buf + 1, path->len--);
+    }
 
-                /* should be the same */
-                if (!(lcc_string_equals(n1, n2)))
-                {
-                    _lcc_lexer_warning(self, "Symbol '%s' redefined", self->macro_name->buf);
-                    break;
-                }
-            }
+    /* __has_include[_next](<...>) */
+    else if ((next->type == LCC_TK_OPERATOR) &&
+             (next->operator == LCC_OP_LT))
+    {
+        /* create a new string */
+        path = lcc_string_new(0);
+        next = next->next;
 
-            /* release the old symbol */
-            _lcc_sym_free(old);
-            break;
+        /* concat every token before ">" */
+        while ((next != end) &&
+               ((next->type != LCC_TK_OPERATOR) ||
+                (next->operator != LCC_OP_GT)))
+        {
+            lcc_string_append(path, next->src);
+            next = next->next;
         }
 
-        /* "#undef" directive */
-        case LCC_LXDN_UNDEF:
+        /* check for end of tokens */
+        if (next == end)
         {
-            /* extract the macro name */
-            _lcc_sym_t sym;
-            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing macro name");
-            lcc_string_t *macro = _LCC_ENSURE_IDENT(self, token, "Macro name must be an identifier");
+            lcc_string_unref(path);
+            _lcc_lexer_error(self, "Expected \"FILENAME\" or <FILENAME>");
+            return 0;
+        }
 
-            /* check for macro name */
-            if (!(strcmp(macro->buf, "defined")))
-            {
-                lcc_token_free(token);
-                _lcc_lexer_error(self, "'defined' is not a valid macro name");
-                return;
-            }
+        /* remove whitespaces when substituted from macro */
+        if (is_macro)
+        {
+            src = path;
+            path = lcc_string_trim(src);
+            lcc_string_unref(src);
+        }
 
-            /* undefine the macro */
-            if (!(lcc_map_pop(&(self->psyms), macro, &sym)))
-            {
-                lcc_token_free(token);
-                break;
-            }
+        /* skip the ">" */
+        next = next->next;
+    }
 
-            /* check for macro type */
-            if (sym.flags & LCC_LXDF_DEFINE_SYS)
-                _lcc_lexer_warning(self, "Undefining builtin macro '%s'", macro->buf);
+    /* otherwise it's an error */
+    else
+    {
+        _lcc_lexer_error(self, "Expected \"FILENAME\" or <FILENAME>");
+        return 0;
+    }
 
-            /* release the token */
-            _lcc_sym_free(&sym);
-            lcc_token_free(token);
-            break;
-        }
+    /* must be a ")" */
+    if ((next->type != LCC_TK_OPERATOR) ||
+        (next->operator != LCC_OP_RBRACKET))
+    {
+        lcc_string_unref(path);
+        _lcc_lexer_error(self, "Missing ')' after '__has_include'");
+        return 0;
+    }
 
-        /* "#if" and "#elif" directives */
-        case LCC_LXDN_IF:
-        case LCC_LXDN_ELIF:
-        {
-            _lcc_val_t val = {};
-            _lcc_val_t *pval = &val;
-            lcc_array_t *stack = &(self->eval_stack);
+    /* set flags */
+    if (is_sys) self->flags |= LCC_LXDF_INCLUDE_SYS;
+    if (is_next) self->flags |= LCC_LXDF_INCLUDE_NEXT;
 
-            /* "#elif" branch */
-            if ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_ELIF)
-            {
-                /* read the stack top */
-                if (!(pval = lcc_array_top(stack)))
-                {
-                    _lcc_lexer_error(self, "#elif without #if");
-                    return;
-                }
+    /* try load the include file */
+    lcc_token_t *tail = next->next;
+    lcc_token_t *token = lcc_token_from_int(_lcc_load_include(self, path, 1));
 
-                /* discard "#elif" branch as needed */
-                if (pval->discard)
-                {
-                    /* clear all tokens */
-                    while (self->tokens.next != &(self->tokens))
-                        lcc_token_free(self->tokens.next);
+    /* reset flags */
+    if (is_sys) self->flags &= ~LCC_LXDF_INCLUDE_SYS;
+    if (is_next) self->flags &= ~LCC_LXDF_INCLUDE_NEXT;
 
-                    /* force an inactive branch */
-                    pval->value = 0;
-                    self->condstate = LCC_LX_CONDSTATE_IDLE;
-                    self->cond_level = 1;
-                    break;
-                }
-            }
+    /* replace the old token */
+    _lcc_range_subst(begin, tail, token);
+    lcc_string_unref(path);
+    return 1;
+}
 
-            /* perform a substitution, then evaluate token sequence */
-            if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))) ||
-                !(_lcc_eval_tokens(self, &(pval->value))))
-                return;
+_LCC_MACRO_EXT(__has_include)
+{
+    /* check as "#include" */
+    return _lcc_check_include(self, begin, end, 0);
+}
 
-            /* clear all tokens after evaluation */
-            while (self->tokens.next != &(self->tokens))
-                lcc_token_free(self->tokens.next);
+_LCC_MACRO_EXT(__has_include_next)
+{
+    /* check as "#include_next" */
+    return _lcc_check_include(self, begin, end, 1);
+}
 
-            /* set discard flags for remaining branches */
-            if (pval->value)
-                pval->discard = 1;
+/** Pseudo-macro "__func__" and "__FUNCTION__"
+ *
+ * neither of them is a macro
+ * the preprocessor does not know the name of the current function
+ * they will be replaced by the actual function name during syntax parsing
+ */
+_LCC_MACRO_EXT_P(__func__)
+_LCC_MACRO_EXT_P(__FUNCTION__)
 
-            /* append new if "#if" */
-            if ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_IF)
-                lcc_array_append(&(self->eval_stack), pval);
+static inline char _lcc_check_drop_char(lcc_lexer_t *self)
+{
+    /* most inner compiling section condition */
+    _lcc_val_t *value;
+    lcc_array_t *stack = &(self->eval_stack);
 
-            /* push new value, and set conditional lexer state */
-            self->condstate = LCC_LX_CONDSTATE_IDLE;
-            self->cond_level = 1;
-            break;
-        }
+    /* outside of condition compiling section,
+     * or parsing compiler directives */
+    if (!(value = lcc_array_top(stack)) ||
+        (self->flags & LCC_LXF_DIRECTIVE))
+        return 0;
+    else
+        return !(value->value);
+}
 
-        /* "#ifdef" and "#ifndef" directives */
-        case LCC_LXDN_IFDEF:
-        case LCC_LXDN_IFNDEF:
-        {
-            /* extract the macro name */
-            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing macro name");
-            lcc_string_t *macro = _LCC_ENSURE_IDENT(self, token, "Macro name must be an identifier");
+/* runs are mostly shorter than 16 characters, so the scanners stay on SSE2, which is
+ * always there on x86_64, wider vectors with a runtime CPU check are not any faster */
+#ifdef __SSE2__
 
-            /* check for macro name */
-            if (!(strcmp(macro->buf, "defined")))
-            {
-                lcc_token_free(token);
-                _lcc_lexer_error(self, "'defined' is not a valid macro name");
-                return;
-            }
+static inline __m128i _lcc_scan_range(__m128i v, char lo, char hi)
+{
+    /* characters above 0x7f are negative, thus never in range */
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1))
+    );
+}
 
-            /* check for defination */
-            char has_sym = lcc_map_get(&(self->psyms), macro, NULL);
-            char flag_ifdef = ((self->flags & LCC_LXDN_MASK) == LCC_LXDN_IFDEF);
+#endif
 
-            /* build a new value */
-            _lcc_val_t value = {
-                .value = (has_sym == flag_ifdef) ? 1 : 0,
-                .discard = (has_sym == flag_ifdef),
-            };
+static inline const char *_lcc_scan_space(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    /* 16 characters at a time */
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _lcc_scan_range(v, '\t', '\r'));
+        int mask = ~_mm_movemask_epi8(m) & 0xffff;
 
-            /* conditional lexer state */
-            self->condstate = LCC_LX_CONDSTATE_IDLE;
-            self->cond_level = 1;
+        /* found a non-space character */
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
 
-            /* release the token, and push the new value onto eval stack */
-            lcc_token_free(token);
-            lcc_array_append(&(self->eval_stack), &value);
-            break;
-        }
+    /* remaining characters */
+    while ((p < end) && ((*p == ' ') || ((*p >= '\t') && (*p <= '\r'))))
+        p++;
 
-        /* "#else" directive */
-        case LCC_LXDN_ELSE:
-        {
-            /* extract the last value on stack */
-            _lcc_val_t *value;
-            lcc_array_t *stack = &(self->eval_stack);
+    return p;
+}
 
-            /* nothing on stack, that's an error */
-            if (!(value = lcc_array_top(stack)))
-            {
-                _lcc_lexer_error(self, "#else without #if");
-                return;
-            }
+static inline const char *_lcc_scan_ident(const char *p, const char *end, char dollar)
+{
+#ifdef __SSE2__
+    /* 16 characters at a time */
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _lcc_scan_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+
+        /* digits, underscores and dollars (GNU ext) */
+        m = _mm_or_si128(m, _lcc_scan_range(v, '0', '9'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        m = dollar ? _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('$'))) : m;
+
+        /* found a non-identifier character */
+        int mask = ~_mm_movemask_epi8(m) & 0xffff;
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
 
-            /* invert condition to emulate "else" if not discarding */
-            if (value->discard)
-                value->value = 0;
-            else
-                value->value = !(value->value);
+    /* remaining characters */
+    while ((p < end) && ((*p == '_') ||
+                         ((*p >= 'a') && (*p <= 'z')) ||
+                         ((*p >= 'A') && (*p <= 'Z')) ||
+                         ((*p >= '0') && (*p <= '9')) ||
+                         ((*p == '$') && dollar)))
+        p++;
+
+    return p;
+}
+
+static inline const char *_lcc_scan_until(const char *p, const char *end, char a, char b, char c)
+{
+#ifdef __SSE2__
+    /* 16 characters at a time */
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(a));
 
-            /* restart conditional lexer */
-            self->condstate = LCC_LX_CONDSTATE_IDLE;
-            self->cond_level = 1;
-            break;
-        }
+        /* any of the three characters */
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
 
-        /* "#endif" directive */
-        case LCC_LXDN_ENDIF:
-        {
-            /* pop the last value from eval stack */
-            if (lcc_array_pop(&(self->eval_stack), NULL))
-                break;
+        /* found one of them */
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
 
-            /* nothing on stack, that's an error */
-            _lcc_lexer_error(self, "#endif without #if");
-            return;
-        }
+    /* remaining characters */
+    while ((p < end) && (*p != a) && (*p != b) && (*p != c))
+        p++;
 
-        /* "#pragma" directive */
-        case LCC_LXDN_PRAGMA:
-        {
-            /* extract the pragma name */
-            lcc_token_t *head = lcc_token_new();
-            lcc_token_t *token = _LCC_DETACH_TOKEN(self, "Missing pragma name");
-            lcc_string_t *pragma = _LCC_ENSURE_IDENT(self, token, "Pragma name must be an identifier");
+    return p;
+}
 
-            /* copy all the arguments if any */
-            if (self->tokens.next != &(self->tokens))
-                _lcc_move_tokens(head, &(self->tokens));
+static size_t _lcc_shift_run(lcc_lexer_t *self, lcc_file_t *file, const char *line, size_t len)
+{
+    const char *q;
+    const char *p = line + file->col;
+    const char *end = line + len;
 
-            /* yields a "pragma" token */
-            lcc_token_attach(&yields, lcc_token_pragma(lcc_string_ref(pragma), head));
-            lcc_token_free(token);
-            break;
-        }
+    /* "#define" needs the first character after macro name */
+    if ((self->flags & LCC_LXDN_DEFINE) &&
+        (self->flags & LCC_LXDF_DEFINE_MASK) == LCC_LXDF_DEFINE_NS)
+        return 0;
 
-        /* "#error" directive */
-        case LCC_LXDN_ERROR:
-        {
-            lcc_string_t *s = _lcc_make_message(self);
-            _lcc_lexer_error(self, "%s", s->buf);
-            lcc_string_unref(s);
-            return;
-        }
+    /* characters that don't change the sub-state, backslashes
+     * are always left to the lexer for line continuations */
+    switch (self->substate)
+    {
+        case LCC_LX_SUBSTATE_NULL          : q = _lcc_scan_space(p, end); break;
+        case LCC_LX_SUBSTATE_NAME          : q = _lcc_scan_ident(p, end, (self->gnuext & LCC_LX_GNUX_DOLLAR_IDENT) != 0); break;
+        case LCC_LX_SUBSTATE_STRING        : q = _lcc_scan_until(p, end, '"', '\'', '\\'); break;
+        case LCC_LX_SUBSTATE_COMMENT_LINE  : q = _lcc_scan_until(p, end, '\\', '\\', '\\'); break;
+        case LCC_LX_SUBSTATE_COMMENT_BLOCK : q = _lcc_scan_until(p, end, '*', '\\', '\\'); break;
+        default                            : return 0;
+    }
 
-        /* "#warning" directive */
-        case LCC_LXDN_WARNING:
-        {
-            lcc_string_t *s = _lcc_make_message(self);
-            _lcc_lexer_warning(self, "%s", s->buf);
-            lcc_string_unref(s);
-            break;
-        }
+    /* nothing to consume */
+    if (q == p)
+        return 0;
 
-        /* "#line" directive */
-        case LCC_LXDN_LINE:
-        {
-            /* perform a macro expansion first */
-            if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))))
-                return;
+    /* identifiers and strings keeps their characters */
+    if ((self->substate == LCC_LX_SUBSTATE_NAME) ||
+        (self->substate == LCC_LX_SUBSTATE_STRING))
+        lcc_token_buffer_append_from_size(&(self->token_buffer), p, q - p);
 
-            /* extract the line number */
-            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing line number");
-            lcc_string_t *lineno = _LCC_ENSURE_RAWINT(self, token, "#line directive requires a positive integer argument");
+    /* append to source buffer, as if shifted one by one */
+    lcc_token_buffer_append_from_size(&(self->source), p, q - p);
+    file->col += q - p;
 
-            /* also extract file name if any */
-            if (token->next != &(self->tokens))
-            {
-                /* extract the token */
-                lcc_token_t *next = token->next;
-                lcc_string_t *fname = _LCC_ENSURE_RAWSTR(self, next, "Invalid filename for #line directive");
+    /* the last consumed character */
+    self->ch = q[-1];
+    self->loc = self->loc_base + file->col - 1;
 
-                /* extract the file name */
-                fname = lcc_string_ref(fname);
-                lcc_token_free(token->next);
+    /* whitespaces may start a new token */
+    if (self->substate == LCC_LX_SUBSTATE_NULL)
+    {
+        self->loc_token = self->loc;
+        return q - p;
+    }
 
-                /* remove '"' on either side */
-                fname->buf[--fname->len] = 0;
-                memmove(fname->buf, fname->buf + 1, fname->len--);
+    /* not a space, prohibit compiler directive on this line */
+    if (!(file->flags & LCC_FF_LNODIR) && (_lcc_scan_space(p, q) != q))
+        file->flags |= LCC_FF_LNODIR;
 
-                /* replace current display name */
-                lcc_string_unref(self->file->display);
-                self->file->display = fname;
-            }
+    /* number of characters consumed */
+    return q - p;
+}
 
-            /* check line number */
-            if ((lineno->len == 1) && (lineno->buf[0] == '0'))
-                _lcc_lexer_warning(self, "#line directive interprets number as decimal, not octal");
+static inline char _lcc_check_pair(const char *p, const char *end, char first, char second)
+{
+    /* find every `first` character */
+    while ((p = memchr(p, first, end - p)) && (++p < end))
+        if (*p == second)
+            return 1;
 
-            /* try convert to integer */
-            char *endp = NULL;
-            long long val = strtoll(lineno->buf, &endp, 10);
+    /* not found */
+    return 0;
+}
 
-            /* check for conversion result */
-            if (endp && (*endp))
-            {
-                lcc_token_free(token);
-                _lcc_lexer_error(self, "#line directive requires a simple digit sequence");
-                return;
-            }
+static size_t _lcc_skip_lines(lcc_lexer_t *self, lcc_file_t *file)
+{
+    size_t len;
+    size_t row = 0;
+    size_t last = 0;
+    size_t size = 0;
+    const char *p;
+    const char *line;
+
+    /* only lines starting in idle state or inside block comments can be skipped as a whole */
+    if ((self->condstate != LCC_LX_CONDSTATE_IDLE) &&
+        (self->condstate != LCC_LX_CONDSTATE_BLOCK_COMMENT))
+        return 0;
 
-            /* update line number, then release the token */
-            self->file->offset = val - self->file->row - 1;
-            lcc_token_free(token);
+    /* check line by line, too long lines are reported by the lexer */
+    while (lcc_file_line(file, file->row, &line, &len) && (len <= LCC_LEXER_MAX_LINE_LEN))
+    {
+        /* end of this line */
+        const char *end = line + len;
+
+        /* line continuations join lines, leave them to the character skipper */
+        if (memchr(line, '\\', len))
             break;
-        }
 
-        /* "#sccs" directive */
-        case LCC_LXDN_SCCS:
+        /* inside block comments, only "*" followed by "/" matters */
+        if (self->condstate == LCC_LX_CONDSTATE_BLOCK_COMMENT)
         {
-            /* extract the SCCS message */
-            lcc_token_t *token = _LCC_FETCH_TOKEN(self, "Missing SCCS message");
-            lcc_string_t *message = _LCC_ENSURE_STRING(self, token, "SCCS message must be a string");
+            if (_lcc_check_pair(line, end, '*', '/'))
+                break;
+        }
+        else
+        {
+            /* skip leading spaces */
+            for (p = line; (p < end) && isspace(*p); p++);
 
-            /* add to SCCS messages and release the token */
-            lcc_string_array_append(&(self->sccs_msgs), lcc_string_ref(message));
-            lcc_token_free(token);
-            break;
+            /* maybe a directive */
+            if ((p < end) && (*p == '#'))
+            {
+                /* skip spaces after "#" */
+                for (p++; (p < end) && isspace(*p); p++);
+
+                /* "#e..." and "#i..." may be conditional directives */
+                if ((p < end) && ((*p == 'e') || (*p == 'i')))
+                    break;
+            }
+
+            /* block comments may span lines */
+            if (_lcc_check_pair(line, end, '/', '*'))
+                break;
         }
 
-        /* unknown bit-mask, should not happen */
-        default:
+        /* remember the last non-empty line */
+        if (len)
         {
-            fprintf(stderr, "*** FATAL: unknown directive flags %.16lx\n", self->flags);
-            abort();
+            row = file->row;
+            last = len;
         }
+
+        /* condition state doesn't change after this line, skip it */
+        size += len + 1;
+        file->row++;
     }
 
-    /* clear directive flags */
-    self->flags &= LCC_LXF_MASK;
-    self->flags &= ~LCC_LXF_DIRECTIVE;
+    /* locate the last skipped character, as if it was shifted */
+    if (last)
+    {
+        _lcc_loc_line(self, file, row, 0);
+        self->loc = self->loc_base + last - 1;
+    }
 
-    /* should be no more tokens left */
-    if (self->tokens.next != &(self->tokens))
+    /* update skipping counter */
+    if (size)
     {
-        _lcc_lexer_error(self, "Redundent directive parameter");
-        return;
+        self->skip_bytes += size;
+        file->flags &= ~LCC_FF_LNODIR;
     }
 
-    /* directives may yield tokens, append those tokens */
-    if (yields.next != &yields)
-        _lcc_move_tokens(&(self->tokens), &yields);
+    /* number of bytes skipped */
+    return size;
+}
 
-    /* reset state and sub-state */
-    self->state = LCC_LX_STATE_SHIFT;
-    self->substate = LCC_LX_SUBSTATE_NULL;
+static inline char _lcc_check_line_cont(lcc_file_t *fp, const char *buf, size_t len)
+{
+    /* check for every character after this */
+    for (size_t i = fp->col; i < len; i++)
+        if (!(isspace(buf[i])))
+            return 0;
+
+    /* it is a line continuation, but with whitespaces */
+    return 1;
 }
 
-#undef _LCC_FETCH_TOKEN
-#undef _LCC_ENSURE_IDENT
-#undef _LCC_ENSURE_RAWSTR
-#undef _LCC_ENSURE_STRING
-#undef _LCC_ENSURE_OPERATOR
+static void _lcc_file_dtor(lcc_array_t *self, void *item, void *data)
+{
+    lcc_file_t *fp = item;
+    _lcc_file_free(fp);
+}
 
-#define _LCC_MACRO_EXT(name)                \
-    static char __lcc_macro_ext_ ## name(   \
-        lcc_lexer_t *self,                  \
-        lcc_token_t **begin,                \
-        lcc_token_t *end                    \
-    )
+static void _lcc_guard_dtor(lcc_map_t *self, void *value, void *data)
+{
+    lcc_string_t **guard = value;
+    lcc_string_unref(*guard);
+}
 
-#define _LCC_MACRO_EXT_P(name)              \
-    static char __lcc_macro_ext_ ## name(   \
-        lcc_lexer_t *self,                  \
-        lcc_token_t **begin,                \
-        lcc_token_t *end                    \
-    )                                       \
-    {                                       \
-        *begin = (*begin)->next;            \
-        return 1;                           \
-    }
+static void _lcc_include_dtor(lcc_map_t *self, void *value, void *data)
+{
+    _lcc_include_t *inc = value;
+    if (inc->path) lcc_string_unref(inc->path);
+}
 
-#define _LCC_ADD_MACRO_EXT_F(ext_name) {                        \
-    _lcc_sym_t *__sym_macro_ext_ ## ext_name = _lcc_sym_new(    \
-        LCC_LXDF_DEFINE_SYS | LCC_LXDF_DEFINE_F,                \
-        NULL,                                                   \
-        lcc_string_from(# ext_name),                            \
-        NULL,                                                   \
-        &LCC_STRING_ARRAY_STATIC_INIT,                          \
-        &__lcc_macro_ext_ ## ext_name                           \
-    );                                                          \
-                                                                \
-    lcc_map_set(                                                \
-        &(self->psyms),                                         \
-        __sym_macro_ext_ ## ext_name->name,                     \
-        NULL,                                                   \
-        &__sym_macro_ext_ ## ext_name                           \
-    );                                                          \
+static void _lcc_sstack_dtor(lcc_map_t *self, void *value, void *data)
+{
+    lcc_array_t *stack = value;
+    lcc_array_free(stack);
 }
 
-#define _LCC_ADD_MACRO_EXT_O(ext_name) {                        \
-    _lcc_sym_t *__sym_macro_ext_ ## ext_name = _lcc_sym_new(    \
-        LCC_LXDF_DEFINE_SYS | LCC_LXDF_DEFINE_O,                \
-        NULL,                                                   \
-        lcc_string_from(# ext_name),                            \
-        NULL,                                                   \
-        &LCC_STRING_ARRAY_STATIC_INIT,                          \
-        &__lcc_macro_ext_ ## ext_name                           \
-    );                                                          \
-                                                                \
-    lcc_map_set(                                                \
-        &(self->psyms),                                         \
-        __sym_macro_ext_ ## ext_name->name,                     \
-        NULL,                                                   \
-        &__sym_macro_ext_ ## ext_name                           \
-    );                                                          \
+static inline lcc_file_t _lcc_define_file(void)
+{
+    /* pseudo-file for predefined macros */
+    lcc_file_t psrc = {
+        .col = 0,
+        .row = 0,
+        .dev = 0,
+        .ino = 0,
+        .data = NULL,
+        .name = lcc_string_from("<define>"),
+        .scan = 0,
+        .size = 0,
+        .flags = LCC_FF_SYS,
+        .guard = NULL,
+        .cache = NULL,
+        .source = NULL,
+        .index = {},
+        .lines = LCC_STRING_ARRAY_STATIC_INIT,
+        .offset = 1,
+        .display = lcc_string_from("<define>"),
+        .guard_level = 0,
+        .guard_state = LCC_FG_INIT,
+    };
+
+    /* lines are added by lcc_lexer_define() and lcc_lexer_undef() */
+    return psrc;
+}
+
+static void _lcc_lexer_rebase(lcc_lexer_t *self)
+{
+    /* location 0 is reserved for "unknown" */
+    uint32_t loc = 0;
+    size_t lines = 0;
+    size_t names = 1;
+
+    /* locations of the shared symbols */
+    if (self->base)
+    {
+        loc = self->base->loc;
+        lines = self->base->loc_lines.count;
+        names = self->base->loc_names.array.count;
+    }
+
+    /* drop everything after the shared part */
+    while (self->loc_names.array.count > names)
+        lcc_array_pop(&(self->loc_names.array), NULL);
+
+    /* new lexers copy the shared part, file names are frozen */
+    for (size_t i = self->loc_names.array.count; i < names; i++)
+        lcc_string_array_append(&(self->loc_names), lcc_string_array_get(&(self->base->loc_names), i));
+
+    /* the line table has no destructors */
+    if (self->loc_lines.count < lines)
+    {
+        lcc_array_reserve(&(self->loc_lines), lines);
+        memcpy(self->loc_lines.items, self->base->loc_lines.items, lines * sizeof(lcc_lexer_line_t));
+    }
+
+    /* reset the location state */
+    self->loc = loc;
+    self->loc_token = 0;
+    self->loc_row = 0;
+    self->loc_file = NULL;
+    self->loc_lines.count = lines;
 }
 
-static inline void _lcc_range_subst(lcc_token_t **from, lcc_token_t *to, lcc_token_t *token)
-{
-    /* remove old tokens */
-    while ((*from)->next != to)
-        lcc_token_free((*from)->next);
+void lcc_lexer_free(lcc_lexer_t *self)
+{
+    /* release all cached tokens */
+    while (self->tokens.next != &(self->tokens))
+        lcc_token_free(self->tokens.next);
+
+    /* clear feature tables */
+    lcc_set_free(&(self->builtins));
+    lcc_set_free(&(self->features));
+    lcc_set_free(&(self->extensions));
+
+    /* clear directive related tables */
+    lcc_map_free(&(self->psyms));
+    lcc_map_free(&(self->defines));
+    lcc_map_free(&(self->preamble));
+    lcc_map_free(&(self->sym_stacks));
+    lcc_array_free(&(self->expanding));
+    lcc_string_array_free(&(self->sccs_msgs));
+
+    /* clear complex state buffers */
+    lcc_set_free(&(self->once));
+    lcc_set_free(&(self->idents));
+    lcc_map_free(&(self->keywords));
+    lcc_map_free(&(self->guards));
+    lcc_map_free(&(self->include_cache));
+    lcc_array_free(&(self->files));
+    lcc_array_free(&(self->eval_stack));
 
-    /* replace the old token */
-    lcc_token_free(*from);
-    lcc_token_attach((*from = to), token);
-}
+    /* clear other tables */
+    lcc_token_buffer_free(&(self->source));
+    lcc_array_free(&(self->loc_lines));
+    lcc_string_array_free(&(self->loc_names));
+    lcc_token_buffer_free(&(self->token_buffer));
+    lcc_string_array_free(&(self->include_paths));
+    lcc_string_array_free(&(self->library_paths));
 
-static inline void _lcc_single_subst(lcc_token_t **at, lcc_token_t *token)
-{
-    /* substitute a single token (from self to next) */
-    _lcc_range_subst(at, (*at)->next, token);
+    /* release all token slabs at once */
+    lcc_token_pool_free(&(self->token_pool));
+
+    /* shared symbols may own strings used by every table above */
+    if (self->base)
+        lcc_psyms_unref(self->base);
 }
 
-static inline lcc_string_t *_lcc_extract_ident(
-    lcc_lexer_t  *self,
-    lcc_token_t **begin,
-    lcc_token_t  *end,
-    lcc_token_t **tail,
-    const char   *name)
+static void _lcc_lexer_setup(lcc_lexer_t *self, lcc_file_t file, lcc_psyms_t *base)
 {
-    /* token sequences */
-    lcc_token_t *n0 = *begin;
-    lcc_token_t *n1 = n0->next;
-    lcc_token_t *n2 = n1->next;
-    lcc_token_t *n3 = n2->next;
-    lcc_string_t *ident;
+    /* macro sources */
+    lcc_file_t psrc = _lcc_define_file();
 
-    /* the first token must be an identifier */
-    if (n0->type != LCC_TK_IDENT)
-    {
-        fprintf(stderr, "*** FATAL: non-identifier macro\n");
-        abort();
-    }
+    /* token slab pool */
+    lcc_token_pool_init(&(self->token_pool));
 
-    /* check for beginning "(" */
-    if ((n1 == end) ||
-        (n1->type != LCC_TK_OPERATOR) ||
-        (n1->operator != LCC_OP_LBRACKET))
-    {
-        _lcc_lexer_error(self, "Missing '(' after '%s'", name);
-        return NULL;
-    }
+    /* pre-defined symbols */
+    lcc_map_init(
+        &(self->psyms),
+        sizeof(_lcc_sym_t *),
+        _lcc_psym_dtor,
+        NULL
+    );
 
-    /* check for EOL */
-    if ((n2 == end) || (n3 == end))
-    {
-        _lcc_lexer_error(self, "Unterminated function-like macro invocation");
-        return NULL;
-    }
+    /* shared pre-defined symbols, and macros being expanded */
+    self->base = base;
+    self->base_ready = 0;
+    lcc_array_init(&(self->expanding), sizeof(_lcc_sym_t *), NULL, NULL);
 
-    /* check for identifier type */
-    if (n2->type != LCC_TK_IDENT)
-    {
-        _lcc_lexer_error(self, "'%s' requires a single parenthesized identifier", name);
-        return NULL;
-    }
+    /* symbols added directly, applied after the "<define>" pseudo-file */
+    lcc_map_init(
+        &(self->defines),
+        sizeof(_lcc_sym_t *),
+        _lcc_psym_dtor,
+        NULL
+    );
 
-    /* check for ending ")" */
-    if ((n3->type != LCC_TK_OPERATOR) ||
-        (n3->operator != LCC_OP_RBRACKET))
+    /* symbols loaded from a preamble, applied after the pre-defined ones */
+    lcc_map_init(
+        &(self->preamble),
+        sizeof(_lcc_sym_t *),
+        _lcc_psym_dtor,
+        NULL
+    );
+
+    /* identifier intern pool */
+    lcc_set_init(&(self->idents));
+    lcc_map_init(&(self->keywords), sizeof(lcc_keyword_t), NULL, NULL);
+
+    /* keyword table, keyed by interned names */
+    for (const _lcc_keyword_item_t *kw = KEYWORDS; kw->name; kw++)
     {
-        _lcc_lexer_error(self, "Missing ')' after identifier");
-        return NULL;
+        lcc_string_t *name = _lcc_intern_from(self, kw->name);
+        lcc_map_set(&(self->keywords), name, NULL, &(kw->keyword));
+        lcc_string_unref(name);
     }
 
-    /* store the tail and name */
-    *tail = *begin = n3->next;
-    ident = lcc_string_ref(n2->ident);
+    /* "#pragma once" files */
+    lcc_set_init(&(self->once));
 
-    /* release tokens */
-    lcc_token_free(n0);
-    lcc_token_free(n1);
-    lcc_token_free(n2);
-    lcc_token_free(n3);
-    return ident;
+    /* include guards */
+    lcc_map_init(
+        &(self->guards),
+        sizeof(lcc_string_t *),
+        _lcc_guard_dtor,
+        NULL
+    );
+
+    /* include path resolution cache */
+    self->include_gen = 0;
+    lcc_map_init(
+        &(self->include_cache),
+        sizeof(_lcc_include_t),
+        _lcc_include_dtor,
+        NULL
+    );
+
+    /* complex structures */
+    lcc_array_init(&(self->files), sizeof(lcc_file_t), _lcc_file_dtor, NULL);
+    lcc_array_init(&(self->eval_stack), sizeof(_lcc_val_t), NULL, NULL);
+
+    /* saved tokens for "#pragma push_macro/pop_macro" */
+    lcc_map_init(
+        &(self->sym_stacks),
+        sizeof(lcc_array_t),
+        _lcc_sstack_dtor,
+        NULL
+    );
+
+    /* feature sets */
+    lcc_set_init(&(self->builtins));
+    lcc_set_init(&(self->features));
+    lcc_set_init(&(self->extensions));
+
+    /* token list and token buffer */
+    lcc_token_init(&(self->tokens));
+    lcc_token_buffer_init(&(self->token_buffer));
+
+    /* other tables */
+    lcc_string_array_init(&(self->sccs_msgs));
+    lcc_string_array_init(&(self->include_paths));
+    lcc_string_array_init(&(self->library_paths));
+
+    /* add initial source files */
+    lcc_array_append(&(self->files), &file);
+    lcc_array_append(&(self->files), &psrc);
+
+    /* initial file info */
+    lcc_token_buffer_init(&(self->source));
+
+    /* source locations, location 0 is reserved for "unknown" */
+    self->loc = 0;
+    self->loc_base = 0;
+    self->loc_token = 0;
+    self->loc_row = 0;
+    self->loc_file = NULL;
+    lcc_array_init(&(self->loc_lines), sizeof(lcc_lexer_line_t), NULL, NULL);
+    lcc_string_array_init(&(self->loc_names));
+
+    /* shared symbols carry the locations of their bodies */
+    if (!base)
+        lcc_string_array_append(&(self->loc_names), lcc_string_ref(psrc.name));
+    else
+        _lcc_lexer_rebase(self);
+
+    /* initial lexer state */
+    self->ch = 0;
+    self->file = lcc_array_top(&(self->files));
+    self->state = LCC_LX_STATE_INIT;
+    self->substate = LCC_LX_SUBSTATE_NULL;
+
+    /* initial flags and GNU extensions */
+    self->flags = 0;
+    self->gnuext = 0;
+    self->counter = 0;
+    self->skip_bytes = 0;
+    self->guard_skips = 0;
+
+    /* token cache is optional */
+    self->tcache = NULL;
+    self->scache = NULL;
+
+    /* default error handling */
+    self->diags = 0;
+    self->error_fn = _lcc_error_default;
+    self->error_data = NULL;
 }
 
-static inline lcc_string_t *_lcc_extract_literal_str(
-    lcc_lexer_t  *self,
-    lcc_token_t **begin,
-    lcc_token_t  *end,
-    lcc_token_t **tail,
-    const char   *name)
+char lcc_lexer_init(lcc_lexer_t *self, lcc_file_t file)
 {
-    /* token sequences */
-    lcc_token_t *n0 = *begin;
-    lcc_token_t *n1 = n0->next;
-    lcc_token_t *n2 = n1->next;
-    lcc_token_t *n3 = n2->next;
-    lcc_string_t *result;
+    /* check for file flags */
+    if (file.flags & LCC_FF_INVALID)
+        return 0;
 
-    /* the first token must be an identifier */
-    if (n0->type != LCC_TK_IDENT)
-    {
-        fprintf(stderr, "*** FATAL: non-identifier macro\n");
-        abort();
-    }
+    /* everything except pre-defined symbols */
+    _lcc_lexer_setup(self, file, NULL);
 
-    /* check for beginning "(" */
-    if ((n1 == end) ||
-        (n1->type != LCC_TK_OPERATOR) ||
-        (n1->operator != LCC_OP_LBRACKET))
-    {
-        _lcc_lexer_error(self, "Missing '(' after '%s'", name);
-        return NULL;
-    }
+    /* version symbols */
+    lcc_lexer_define(self, "__LCC__", "1");
+    lcc_lexer_define(self, "__VERSION__", "\"LightCC 1.0 (GCC 4.8.3 compatiable)\"");
 
-    /* check for EOL */
-    if ((n2 == end) || (n3 == end))
-    {
-        _lcc_lexer_error(self, "Unterminated function-like macro invocation");
-        return NULL;
-    }
+    /* LightCC emulates GCC 4.8.3 */
+    lcc_lexer_define(self, "__GNUC__", "4");
+    lcc_lexer_define(self, "__GNUC_MINOR__", "8");
+    lcc_lexer_define(self, "__GNUC_PATCHLEVEL__", "3");
 
-    /* check for string literal */
-    if ((n2->type != LCC_TK_LITERAL) ||
-        (n2->literal.type != LCC_LT_STRING))
-    {
-        _lcc_lexer_error(self, "'%s' takes a parenthesized string literal", name);
-        return NULL;
-    }
+    /* standard defines */
+    lcc_lexer_define(self, "__STDC__", "1");
+    lcc_lexer_define(self, "__STDC_HOSTED__", "1");
+    lcc_lexer_define(self, "__STDC_VERSION__", "199901L");
 
-    /* check for ending ")" */
-    if ((n3->type != LCC_TK_OPERATOR) ||
-        (n3->operator != LCC_OP_RBRACKET))
-    {
-        _lcc_lexer_error(self, "Missing ')' after string literal");
-        return NULL;
-    }
+    /* data model */
+    lcc_lexer_define(self, "_LP64", "1");
+    lcc_lexer_define(self, "__LP64__", "1");
 
-    /* store the tail and detach the token */
-    *tail = *begin = n3->next;
-    result = lcc_string_ref(n2->literal.raw);
+    /* platform specific symbols */
+    lcc_lexer_define(self, "__unix__", "1");
+    lcc_lexer_define(self, "__amd64__", "1");
+    lcc_lexer_define(self, "__x86_64__", "1");
 
-    /* release tokens */
-    lcc_token_free(n0);
-    lcc_token_free(n1);
-    lcc_token_free(n2);
-    lcc_token_free(n3);
-    return result;
-}
+    /* assembler specified macros (LightCC uses GAS syntax) */
+    lcc_lexer_define(self, "__REGISTER_PREFIX__", "%");
+    lcc_lexer_define(self, "__USER_LABEL_PREFIX__", "_");
+
+#define _NAME_DEF(type)     #type
+#define _COPY_NAME(type)    lcc_lexer_define(self, #type, _NAME_DEF(type))
+
+#include "lcc_builtin_sizes.i"
+#include "lcc_builtin_types.i"
+#include "lcc_builtin_limits.i"
+#include "lcc_builtin_endians.i"
+
+#undef _NAME_DEF
+#undef _COPY_NAME
+
+    /* built-in object-like extensions */
+    _LCC_ADD_MACRO_EXT_O(__FILE__)
+    _LCC_ADD_MACRO_EXT_O(__LINE__)
+    _LCC_ADD_MACRO_EXT_O(__DATE__)
+    _LCC_ADD_MACRO_EXT_O(__TIME__)
+    _LCC_ADD_MACRO_EXT_O(__COUNTER__)
+    _LCC_ADD_MACRO_EXT_O(__TIMESTAMP__)
+    _LCC_ADD_MACRO_EXT_O(__BASE_FILE__)
+    _LCC_ADD_MACRO_EXT_O(__INCLUDE_LEVEL__)
+
+    /* built-in function-like extensions */
+    _LCC_ADD_MACRO_EXT_F(defined)
+    _LCC_ADD_MACRO_EXT_F(_Pragma)
+    _LCC_ADD_MACRO_EXT_F(__has_include)
+    _LCC_ADD_MACRO_EXT_F(__has_include_next)
 
-/** Object-like built-in macros **/
+    /* built-in feature testing macros */
+    _LCC_ADD_MACRO_EXT_F(__has_builtin)
+    _LCC_ADD_MACRO_EXT_F(__has_feature)
+    _LCC_ADD_MACRO_EXT_F(__has_extension)
 
-_LCC_MACRO_EXT(__FILE__)
+    /* pseudo-macro "__func__" and "__FUNCTION__" */
+    _LCC_ADD_MACRO_EXT_O(__func__)
+    _LCC_ADD_MACRO_EXT_O(__FUNCTION__)
+    return 1;
+}
+
+char lcc_lexer_init_shared(lcc_lexer_t *self, lcc_file_t file, lcc_psyms_t *psyms)
 {
-    /* dump file name */
-    lcc_string_t *src = lcc_string_ref(self->fname);
-    lcc_string_t *value = lcc_string_ref(self->fname);
+    /* check for file flags */
+    if (file.flags & LCC_FF_INVALID)
+        return 0;
 
-    /* replace the old token */
-    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
+    /* symbols are already there, but the "<define>" pseudo-file
+     * is still needed for symbols defined by this lexer */
+    _lcc_lexer_setup(self, file, lcc_psyms_ref(psyms));
     return 1;
 }
 
-_LCC_MACRO_EXT(__LINE__)
+lcc_psyms_t *lcc_lexer_psyms(lcc_lexer_t *self)
 {
-    _lcc_single_subst(begin, lcc_token_from_int(self->row));
-    return 1;
+    /* not frozen yet */
+    if (!(self->base_ready) || !(self->base))
+        return NULL;
+
+    /* add a new reference */
+    return lcc_psyms_ref(self->base);
 }
 
-_LCC_MACRO_EXT(__DATE__)
+char lcc_lexer_reset(lcc_lexer_t *self, lcc_file_t file)
 {
-    char s[32] = {};
-    time_t ts;
-    struct tm tm;
+    /* check for file flags */
+    if (file.flags & LCC_FF_INVALID)
+        return 0;
 
-    /* read current time */
-    if ((time(&ts) < 0) || !(localtime_r(&ts, &tm)))
-        strcpy(s, "??? ?? ????");
-    else
-        strftime(s, sizeof(s), "%b %e %Y", &tm);
+    /* pre-defined symbols must be complete */
+    if (!(self->base_ready))
+    {
+        _lcc_file_free(&file);
+        return 0;
+    }
 
-    /* create date string */
-    lcc_string_t *src = lcc_string_from(s);
-    lcc_string_t *value = lcc_string_from(s);
+    /* release all cached tokens */
+    while (self->tokens.next != &(self->tokens))
+        lcc_token_free(self->tokens.next);
 
-    /* replace the old token */
-    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
-    return 1;
-}
+    /* close all opened files */
+    while (lcc_array_pop(&(self->files), NULL));
+    while (lcc_array_pop(&(self->sccs_msgs.array), NULL));
 
-_LCC_MACRO_EXT(__TIME__)
-{
-    char s[32] = {};
-    time_t ts;
-    struct tm tm;
+    /* "#pragma once" and "#pragma push_macro" are per translation unit */
+    lcc_set_free(&(self->once));
+    lcc_set_init(&(self->once));
+    lcc_map_free(&(self->sym_stacks));
+    lcc_map_init(&(self->sym_stacks), sizeof(lcc_array_t), _lcc_sstack_dtor, NULL);
 
-    /* read current time */
-    if ((time(&ts) < 0) || !(localtime_r(&ts, &tm)))
-        strcpy(s, "??:??:??");
-    else
-        strftime(s, sizeof(s), "%T", &tm);
+    /* drop symbols changed by this translation unit, shared ones are untouched */
+    lcc_map_free(&(self->psyms));
+    lcc_map_free(&(self->defines));
+    lcc_map_free(&(self->preamble));
+    lcc_map_init(&(self->psyms), sizeof(_lcc_sym_t *), _lcc_psym_dtor, NULL);
+    lcc_map_init(&(self->defines), sizeof(_lcc_sym_t *), _lcc_psym_dtor, NULL);
+    lcc_map_init(&(self->preamble), sizeof(_lcc_sym_t *), _lcc_psym_dtor, NULL);
+
+    /* keep locations of the pre-defined symbols, drop everything after */
+    self->expanding.count = 0;
+    _lcc_lexer_rebase(self);
+
+    /* the new main file, and an empty "<define>" pseudo-file
+     * for symbols that only apply to this translation unit */
+    lcc_file_t psrc = _lcc_define_file();
+    lcc_array_append(&(self->files), &file);
+    lcc_array_append(&(self->files), &psrc);
 
-    /* create time string */
-    lcc_string_t *src = lcc_string_from(s);
-    lcc_string_t *value = lcc_string_from(s);
+    /* reset buffers and evaluation stack, memory is kept */
+    self->eval_stack.count = 0;
+    lcc_token_buffer_reset(&(self->source));
+    lcc_token_buffer_reset(&(self->token_buffer));
 
-    /* replace the old token */
-    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
-    return 1;
-}
+    /* initial lexer state */
+    self->ch = 0;
+    self->file = lcc_array_top(&(self->files));
+    self->state = LCC_LX_STATE_INIT;
+    self->substate = LCC_LX_SUBSTATE_NULL;
 
-_LCC_MACRO_EXT(__COUNTER__)
-{
-    _lcc_single_subst(begin, lcc_token_from_int(self->counter++));
+    /* reset flags and counters, GNU extensions are kept */
+    self->flags = 0;
+    self->counter = 0;
+    self->skip_bytes = 0;
+    self->guard_skips = 0;
     return 1;
 }
 
-_LCC_MACRO_EXT(__TIMESTAMP__)
+static inline lcc_token_t *_lcc_lexer_shift(lcc_lexer_t *self)
 {
-    char s[32] = {};
-    struct tm tm;
-    struct stat st;
+    /* shift one token from lexer token list */
+    lcc_token_t *next = self->tokens.next;
+    lcc_token_t *token = lcc_token_detach(next);
 
-    /* read current time */
-    if (stat(self->fname->buf, &st) ||
-        !(localtime_r(&(st.st_mtime), &tm)))
-        strcpy(s, "??? ??? ?? ??:??:?? ????");
-    else
-        strftime(s, sizeof(s), "%a %b %e %T %Y", &tm);
+    /* numbers leaving the lexer must have their values */
+    _lcc_eval_literal(self, token);
 
-    /* create timestamp string */
-    lcc_string_t *src = lcc_string_from(s);
-    lcc_string_t *value = lcc_string_from(s);
+    /* keyword conversion, the hash is cached in interned identifiers */
+    lcc_keyword_t *keyword;
+    if ((token->type == LCC_TK_IDENT) &&
+        (lcc_map_get(&(self->keywords), token->ident, (void **)&keyword)))
+    {
+        /* found the keyword, upgrade to keyword token */
+        lcc_string_unref(token->ident);
+        token->type = LCC_TK_KEYWORD;
+        token->keyword = *keyword;
+    }
 
-    /* replace the old token */
-    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
-    return 1;
+    /* token maybe converted */
+    return token;
 }
 
-_LCC_MACRO_EXT(__BASE_FILE__)
+lcc_token_t *lcc_lexer_next(lcc_lexer_t *self)
 {
-    /* dump display name */
-    lcc_file_t *fp = self->files.items;
-    lcc_string_t *src = lcc_string_ref(fp->display);
-    lcc_string_t *value = lcc_string_ref(fp->display);
+    /* advance lexer if no tokens remaining */
+    if (self->tokens.next == &(self->tokens))
+        if (!(lcc_lexer_advance(self)))
+            return NULL;
 
-    /* replace the old token */
-    _lcc_single_subst(begin, lcc_token_from_raw(src, value));
-    return 1;
+    /* still no more tokens */
+    if (self->tokens.next == &(self->tokens))
+        return NULL;
+
+    /* shift one token */
+    return _lcc_lexer_shift(self);
 }
 
-_LCC_MACRO_EXT(__INCLUDE_LEVEL__)
+static lcc_token_t *_lcc_lexer_advance(lcc_lexer_t *self)
 {
-    _lcc_single_subst(begin, lcc_token_from_int(self->files.count - 1));
-    return 1;
-}
+    for (;;)
+    {
+        switch (self->state)
+        {
+            /* initial lexer state */
+            case LCC_LX_STATE_INIT:
+            {
+                self->state = LCC_LX_STATE_SHIFT;
+                self->file->flags &= ~LCC_FF_LNODIR;
+                lcc_token_buffer_reset(&(self->token_buffer));
+                break;
+            }
 
-/** Function-like built-in macros **/
+            /* shift-in character */
+            case LCC_LX_STATE_SHIFT:
+            {
+                /* get the current line */
+                size_t len;
+                const char *line;
+                lcc_file_t *file = self->file;
 
-_LCC_MACRO_EXT(defined)
-{
-    char brk;
-    lcc_token_t *token = *begin;
-    lcc_string_t *ident;
+                /* line out of range, it's EOF
+                 * pop the current file from file stack */
+                if (!(lcc_file_line(file, file->row, &line, &len)))
+                {
+                    self->state = LCC_LX_STATE_POP_FILE;
+                    break;
+                }
 
-    /* check for next token */
-    if ((token = token->next) == end)
-    {
-        _lcc_lexer_error(self, "Macro name missing");
-        return 0;
-    }
+                /* limit maximum line length */
+                if (len > LCC_LEXER_MAX_LINE_LEN)
+                {
+                    _lcc_lexer_error(self, "Line too long");
+                    break;
+                }
 
-    /* check for operator type */
-    switch (token->type)
-    {
-        /* "defined xxx" */
-        case LCC_TK_IDENT:
-        {
-            brk = 0;
-            token = token->next;
-            ident = lcc_string_ref(token->prev->ident);
-            break;
-        }
+                /* skip entire lines in false conditional blocks */
+                if (!(file->col) && _lcc_check_drop_char(self) && _lcc_skip_lines(self, file))
+                    break;
+
+                /* cached lines are replayed, or recorded for later */
+                if (file->cache && _lcc_tc_shift(self, file, line, len, _lcc_check_drop_char(self)))
+                    break;
+
+                /* EOL, move to next line */
+                if (file->col >= len)
+                {
+                    self->state = LCC_LX_STATE_NEXT_LINE;
+                    break;
+                }
+
+                /* entering a new line, record it's location */
+                if ((file != self->loc_file) || (file->row != self->loc_row))
+                    _lcc_loc_line(self, file, file->row, file->col);
+
+                /* consume runs of characters in bulk */
+                if (!(_lcc_check_drop_char(self)) && _lcc_shift_run(self, file, line, len))
+                    break;
+
+                /* read the current character */
+                self->ch = line[file->col];
+                self->loc = self->loc_base + file->col++;
+
+                /* check current character */
+                if (self->ch != '\\')
+                {
+                    self->state = LCC_LX_STATE_GOT_CHAR;
+                    break;
+                }
+
+                /* line continuation, move to next line */
+                if (file->col == len)
+                {
+                    self->state = LCC_LX_STATE_NEXT_LINE_CONT;
+                    break;
+                }
+
+                /* check if it's a generic character */
+                if (!(_lcc_check_line_cont(file, line, len)))
+                {
+                    self->state = LCC_LX_STATE_GOT_CHAR;
+                    break;
+                }
+
+                /* line continuation, but with whitespaces after "\\",
+                 * issue a warning and move to next line */
+                self->state = LCC_LX_STATE_NEXT_LINE_CONT;
+                _lcc_lexer_warning(self, "Whitespaces after line continuation");
+                break;
+            }
+
+            /* pop file from file stack */
+            case LCC_LX_STATE_POP_FILE:
+            {
+                /* check for substitution status */
+                if (self->flags & LCC_LXF_SUBST)
+                {
+                    _lcc_lexer_error(self, "Unterminated function-like macro invocation");
+                    break;
+                }
+
+                /* check for EOS (End-Of-Source) */
+                if (self->flags & LCC_LXF_EOS)
+                {
+                    /* check for unterminated conditional directives */
+                    if (self->eval_stack.count)
+                    {
+                        _lcc_lexer_error(self, "Unterminated conditional directive");
+                        break;
+                    }
+
+                    /* move to end of source */
+                    self->state = LCC_LX_STATE_END;
+                    self->substate = LCC_LX_SUBSTATE_NULL;
+                    break;
+                }
+
+                /* set EOF flags to flush the preprocessor */
+                if (!(_lcc_check_drop_char(self)))
+                {
+                    self->flags |= LCC_LXF_EOF;
+                    _lcc_handle_substate(self);
+                }
+                else
+                {
+                    self->flags |= LCC_LXF_EOF;
+                    _lcc_handle_condition(self);
+                }
+
+                /* no files left, it's an EOS (End-Of-Source) */
+                if (self->files.count == 1)
+                {
+                    self->flags |= LCC_LXF_EOS;
+                    break;
+                }
 
-        /* maybe "defined(xxx)" */
-        case LCC_TK_OPERATOR:
-        {
-            /* must be a "(" in this case */
-            if (token->operator != LCC_OP_LBRACKET)
-                goto _lcc_factor_not_ident;
+                /* pre-defined symbols are complete after the "<define>" pseudo-file */
+                if ((self->files.count == 2) &&
+                    (self->file->flags & LCC_FF_SYS))
+                {
+                    /* symbols added directly go after the textual ones */
+                    _lcc_psym_commit(self);
 
-            /* skip the "(" */
-            brk = 1;
-            token = token->next;
+                    /* share them with other lexers */
+                    if (!(self->base_ready))
+                        _lcc_psyms_freeze(self);
 
-            /* then must be an identifier */
-            if (token->type != LCC_TK_IDENT)
-                goto _lcc_factor_not_ident;
+                    /* the preamble is on top of them */
+                    _lcc_preamble_commit(self);
+                }
 
-            /* extract the identifier */
-            token = token->next;
-            ident = lcc_string_ref(token->prev->ident);
-            break;
-        }
+                /* save the token cache of this file */
+                if (self->file->cache)
+                    _lcc_tc_store(self, self->file);
 
-        /* otherwise it's an error */
-        default:
-        _lcc_factor_not_ident:
-        {
-            _lcc_lexer_error(self, "Macro name must be an identifier");
-            return 0;
-        }
-    }
+                /* remember the include guard of this file */
+                _lcc_guard_commit(self, self->file);
 
-    /* close bracket required */
-    if (brk)
-    {
-        /* check for close bracket */
-        if ((token->type != LCC_TK_OPERATOR) ||
-            (token->operator != LCC_OP_RBRACKET))
-        {
-            _lcc_lexer_error(self, "Missing ')' after 'defined'");
-            return 0;
-        }
+                /* pop the file from stack */
+                if (!(lcc_array_pop(&(self->files), NULL)))
+                {
+                    fprintf(stderr, "*** FATAL: empty file stack\n");
+                    abort();
+                }
 
-        /* skip the ")" */
-        token = token->next;
-    }
+                /* get the new stack top */
+                self->file = lcc_array_top(&(self->files));
+                self->loc_file = NULL;
+                self->file->flags &= ~LCC_FF_LNODIR;
+                break;
+            }
 
-    /* check for "defined" */
-    if (!(strcmp(ident->buf, "defined")))
-    {
-        _lcc_lexer_error(self, "'defined' is not a valid macro name");
-        lcc_string_unref(ident);
-        return 0;
-    }
+            /* move to next line */
+            case LCC_LX_STATE_NEXT_LINE:
+            {
+                /* in condition compilation section,
+                 * whereas this section is not compiled */
+                if (!(_lcc_check_drop_char(self)))
+                {
+                    self->flags |= LCC_LXF_EOL;
+                    _lcc_handle_substate(self);
+                }
+                else
+                {
+                    self->flags |= LCC_LXF_EOL;
+                    _lcc_handle_condition(self);
+                }
 
-    /* replace the old token */
-    _lcc_range_subst(begin, token, lcc_token_from_int(lcc_map_get(&(self->psyms), ident, NULL)));
-    lcc_string_unref(ident);
-    return 1;
-}
+                /* finish the cached line */
+                if (self->file->cache)
+                    _lcc_tc_next_line(self, self->file);
 
-_LCC_MACRO_EXT(_Pragma)
-{
-    /* extract the pragma literal */
-    lcc_token_t *tail;
-    lcc_string_t *value = _lcc_extract_literal_str(self, begin, end, &tail, "_Pragma");
+                /* move to next line */
+                self->file->row++;
+                self->file->col = 0;
+                self->file->flags &= ~LCC_FF_LNODIR;
+                break;
+            }
 
-    /* check for errors */
-    if (!value)
-        return 0;
+            /* move to next line (line continuation) */
+            case LCC_LX_STATE_NEXT_LINE_CONT:
+            {
+                /* continued lines are never cached */
+                if (self->file->cache)
+                    self->file->cache->active = 0;
 
-    /* make a copy of the string to translate '\\' and '\"' */
-    size_t n = 0;
-    lcc_string_t *pragma = lcc_string_copy(value);
+                /* move to next line */
+                self->file->row++;
+                self->file->col = 0;
+                self->state = LCC_LX_STATE_SHIFT;
+                break;
+            }
 
-    /* remove '"' on either side */
-    lcc_string_unref(value);
-    pragma->buf[--pragma->len] = 0;
-    memmove(pragma->buf, pragma->buf + 1, pragma->len--);
+            /* we got a new character */
+            case LCC_LX_STATE_GOT_CHAR:
+            {
+                /* in condition compilation section,
+                 * whereas this section is not compiled */
+                if (_lcc_check_drop_char(self))
+                {
+                    self->flags &= ~LCC_LXF_EOF;
+                    self->flags &= ~LCC_LXF_EOL;
+                    _lcc_handle_condition(self);
+                }
+                else
+                {
+                    /* Special Case :: "#define" compiler directive
+                     * distingush object-like and function-like macros */
+                    if ((self->flags & LCC_LXDN_DEFINE) &&
+                        (self->flags & LCC_LXDF_DEFINE_MASK) == LCC_LXDF_DEFINE_NS)
+                    {
+                        if (self->ch == '(')
+                            self->flags |= LCC_LXDF_DEFINE_F;
+                        else
+                            self->flags |= LCC_LXDF_DEFINE_O;
+                    }
 
-    /* buffer pointers */
-    char *p = pragma->buf;
-    char *q = pragma->buf;
+                    /* append last character if not EOF or EOL */
+                    if (!(self->flags & (LCC_LXF_EOF | LCC_LXF_EOL)))
+                        lcc_token_buffer_append(&(self->source), self->ch);
 
-    /* translate until source string ends */
-    while (*p)
-    {
-        /* not an escape character, just copy as is */
-        if (*p != '\\')
-        {
-            n++;
-            *q++ = *p++;
-        }
+                    /* a new token may start from here */
+                    if (self->substate == LCC_LX_SUBSTATE_NULL)
+                        self->loc_token = self->loc;
 
-        /* otherwise, check the next character */
-        else
-        {
-            switch (*++p)
+                    /* handle all sub-states */
+                    self->flags &= ~LCC_LXF_EOF;
+                    self->flags &= ~LCC_LXF_EOL;
+                    _lcc_handle_substate(self);
+
+                    /* not a space, prohibit compiler directive on this line */
+                    if (!(isspace(self->ch)))
+                        self->file->flags |= LCC_FF_LNODIR;
+                }
+
+                break;
+            }
+
+            /* we got a compiler directive */
+            case LCC_LX_STATE_GOT_DIRECTIVE:
             {
-                /* '_Pragma' only accepts '\\' and '\"' as escape sequences */
-                case '\\':
-                case '\"':
-                {
-                    n++;
-                    *q++ = *p++;
+                self->state = LCC_LX_STATE_SHIFT;
+                self->flags |= LCC_LXF_DIRECTIVE;
+                self->file->flags |= LCC_FF_LNODIR;
+                break;
+            }
+
+            /* commit parsed compiler directive */
+            case LCC_LX_STATE_COMMIT:
+            {
+                /* handle the token first */
+                _lcc_handle_directive(self);
+                self->file->flags &= ~LCC_FF_LNODIR;
+
+                /* rejected, don't commit */
+                if (self->state == LCC_LX_STATE_REJECT)
                     break;
-                }
 
-                /* other characters are preserved along with the '\\' */
-                default:
+                /* commit the directive */
+                _lcc_commit_directive(self);
+                break;
+            }
+
+            /* token accepted */
+            case LCC_LX_STATE_ACCEPT:
+            case LCC_LX_STATE_ACCEPT_KEEP:
+            {
+                /* shift next character if needed */
+                self->state = (self->state == LCC_LX_STATE_ACCEPT) ? LCC_LX_STATE_SHIFT : LCC_LX_STATE_GOT_CHAR;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+
+                /* still parsing directives, don't accept now */
+                if (self->flags & LCC_LXF_DIRECTIVE)
                 {
-                    n++;
-                    *q++ = '\\';
-                    *q++ = *p++;
+                    _lcc_handle_directive(self);
                     break;
                 }
-            }
-        }
-
-        /* "CR" or "LF" should not appear in pragma, otherwise it's a fatal error */
-        if ((q[-1] == '\r') || (q[-1] == '\n'))
-        {
-            fprintf(stderr, "*** FATAL: new-line in pragma\n");
-            abort();
-        }
-    }
 
-    /* terminate the pragma string */
-    *q = 0;
-    pragma->len = n;
+                /* nothing to accept, equivalent to SHIFT or GOT_CHAR */
+                if (self->tokens.next == &(self->tokens))
+                    break;
 
-    /* dummy file for parsing pragma */
-    lcc_file_t file = {
-        .col = 0,
-        .row = 0,
-        .name = lcc_string_from("<pragma>"),
-        .flags = LCC_FF_SYS,
-        .lines = LCC_STRING_ARRAY_STATIC_INIT,
-        .offset = 1,
-        .display = lcc_string_from("<pragma>"),
-    };
+                /* tokens outside of the include guard */
+                if (self->file->guard_state != LCC_FG_OPEN)
+                    self->file->guard_state = LCC_FG_NONE;
 
-    /* only one line in the source */
-    lcc_string_array_append(&(file.lines), lcc_string_from_format("#pragma %s", pragma->buf));
-    lcc_string_unref(pragma);
+                /* get the newly accepted token */
+                _lcc_sym_t *sym;
+                lcc_token_t *token = self->tokens.prev;
 
-    /* buffer to save the current tokens */
-    lcc_file_t *fp;
-    lcc_token_t buffer = {
-        .prev = &buffer,
-        .next = &buffer,
-    };
+                /* check for macro substitution */
+                if (!(self->flags & LCC_LXF_SUBST) &&                       /* not substituting */
+                     (token->type == LCC_TK_IDENT) &&                       /* is a valid identifier */
+                     (sym = _lcc_psym_get(self, token->ident)))             /* which is also a macro name */
+                {
+                    /* function-like macro, expect a "(" operator */
+                    if (sym->flags & LCC_LXDF_DEFINE_F)
+                    {
+                        self->flags |= LCC_LXF_SUBST;
+                        self->subst_level = 0;
+                        break;
+                    }
+                }
+                else
+                {
+                    /* still not substiting */
+                    if (!(self->flags & LCC_LXF_SUBST))
+                        return &(self->tokens);
 
-    /* move everything into buffer area */
-    if (self->tokens.next != &(self->tokens))
-        _lcc_move_tokens(&buffer, &(self->tokens));
+                    /* looking for the first bracket */
+                    if (!(self->subst_level) &&
+                        !((token->type == LCC_TK_OPERATOR) &&
+                          (token->operator == LCC_OP_LBRACKET)))
+                    {
+                        self->flags &= ~LCC_LXF_SUBST;
+                        return &(self->tokens);
+                    }
 
-    /* load to file stack */
-    lcc_array_append(&(self->files), &file);
-    self->file = fp = lcc_array_top(&(self->files));
+                    /* not an operator, just append to token chain */
+                    if (token->type != LCC_TK_OPERATOR)
+                        break;
 
-    /* parse the pragma */
-    if (!(lcc_lexer_advance(self)))
-        return 0;
+                    /* "(" operator */
+                    if (token->operator == LCC_OP_LBRACKET)
+                        self->subst_level++;
 
-    /* the file should've popped */
-    if (fp == self->file)
-    {
-        fprintf(stderr, "*** FATAL: pragma takes more than one advancing\n");
-        abort();
-    }
+                    /* ")" operator */
+                    if (token->operator == LCC_OP_RBRACKET)
+                        self->subst_level--;
 
-    /* save the newly generated tokens */
-    lcc_token_t head = {
-        .prev = &head,
-        .next = &head,
-    };
+                    /* still in macro invocation */
+                    if (self->subst_level)
+                        break;
+                }
 
-    /* move everything into buffer area */
-    if (self->tokens.next != &(self->tokens))
-        _lcc_move_tokens(&head, &(self->tokens));
+                /* reset substitution status */
+                self->flags &= ~LCC_LXF_SUBST;
+                self->subst_level = 0;
 
-    /* restore original tokens */
-    if (buffer.next != &buffer)
-        _lcc_move_tokens(&(self->tokens), &buffer);
+                /* perform substitution */
+                if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))) ||
+                    (self->tokens.next == &(self->tokens)))
+                    break;
+                else
+                    return &(self->tokens);
+            }
 
-    /* no new tokens available */
-    if (head.next == &head)
-        return 1;
+            /* token rejected */
+            case LCC_LX_STATE_REJECT:
+            {
+                self->state = LCC_LX_STATE_END;
+                self->substate = LCC_LX_SUBSTATE_NULL;
+                return NULL;
+            }
 
-    /* at most 1 token is allowed */
-    if (head.next->next != &head)
-    {
-        fprintf(stderr, "*** FATAL: pragma yields multiple tokens\n");
-        abort();
+            /* end of lexing, emit an EOF token */
+            case LCC_LX_STATE_END:
+                return &(self->tokens);
+        }
     }
-
-    /* substitute in the new token */
-    lcc_token_attach(*begin, lcc_token_detach(head.next));
-    return 1;
-}
-
-#define _LCC_FEATURE_CHECK(type)                                                                \
-{                                                                                               \
-    /* extract the identifier */                                                                \
-    lcc_token_t *tail;                                                                          \
-    lcc_string_t *ident = _lcc_extract_ident(self, begin, end, &tail, "__has_" #type);          \
-                                                                                                \
-    /* check for errors */                                                                      \
-    if (!ident)                                                                                 \
-        return 0;                                                                               \
-                                                                                                \
-    /* attach the result */                                                                     \
-    lcc_token_attach(tail, lcc_token_from_int(lcc_set_contains(&(self->type ## s), ident)));    \
-    lcc_string_unref(ident);                                                                    \
-    return 1;                                                                                   \
 }
 
-_LCC_MACRO_EXT(__has_builtin  ) _LCC_FEATURE_CHECK(builtin  )
-_LCC_MACRO_EXT(__has_feature  ) _LCC_FEATURE_CHECK(feature  )
-_LCC_MACRO_EXT(__has_extension) _LCC_FEATURE_CHECK(extension)
-
-#undef _LCC_FEATURE_CHECK
-
-static char _lcc_check_include(
-    lcc_lexer_t *self,
-    lcc_token_t **begin,
-    lcc_token_t *end,
-    char         is_next)
+lcc_token_t *lcc_lexer_advance(lcc_lexer_t *self)
 {
-    /* skip "__has_include" */
-    lcc_token_t *next;
-    lcc_token_t *head = (*begin)->next;
+    /* tokens created while advancing belongs to the lexer pool */
+    lcc_token_pool_t *pool = lcc_token_pool_swap(&(self->token_pool));
+    lcc_token_t *token = _lcc_lexer_advance(self);
 
-    /* token source and file path */
-    char is_sys = 1;
-    char is_macro = 0;
-    lcc_string_t *src;
-    lcc_string_t *path;
+    /* restore the previous pool */
+    lcc_token_pool_swap(pool);
+    return token;
+}
 
-    /* check for next token */
-    if ((head == end) ||
-        (head->type != LCC_TK_OPERATOR) ||
-        (head->operator != LCC_OP_LBRACKET))
-    {
-        _lcc_lexer_error(self, "Missing '(' after '__has_include'");
-        return 0;
-    }
+size_t lcc_lexer_next_batch(lcc_lexer_t *self, lcc_token_t **tokens, size_t count)
+{
+    /* the pool is swapped once for the whole batch */
+    size_t n = 0;
+    lcc_token_pool_t *pool = lcc_token_pool_swap(&(self->token_pool));
 
-    /* may need macro expansion */
-    if (((head->next->type != LCC_TK_LITERAL) ||
-         (head->next->literal.type != LCC_LT_STRING)) &&
-        ((head->next->type != LCC_TK_OPERATOR) ||
-         (head->next->operator != LCC_OP_LT)))
+    /* fill the batch */
+    while (n < count)
     {
-        /* could only be identifiers */
-        if (head->next->type != LCC_TK_IDENT)
+        /* advance lexer if no tokens remaining */
+        if (self->tokens.next == &(self->tokens))
         {
-            _lcc_lexer_error(self, "Expected \"FILENAME\" or <FILENAME>");
-            return 0;
+            /* lexer error */
+            if (!(_lcc_lexer_advance(self)))
+                break;
+
+            /* still no more tokens */
+            if (self->tokens.next == &(self->tokens))
+                break;
         }
 
-        /* search for next token */
-        if (!(next = _lcc_next_arg(head->next, end, 0)))
+        /* drain the lexer token list without re-entering the lexer */
+        while ((n < count) && (self->tokens.next != &(self->tokens)))
         {
-            _lcc_lexer_error(self, "Expected value in expression");
-            return 0;
+            /* stop right after EOF */
+            if ((tokens[n++] = _lcc_lexer_shift(self))->type == LCC_TK_EOF)
+            {
+                lcc_token_pool_swap(pool);
+                return n;
+            }
         }
-
-        /* perform substitution */
-        if (!(is_macro = _lcc_macro_subst(self, head->next, next)))
-            return 0;
     }
 
-    /* move to next token */
-    if ((next = head->next) == end)
-    {
-        _lcc_lexer_error(self, "Expected value in expression");
-        return 0;
-    }
+    /* restore the previous pool */
+    lcc_token_pool_swap(pool);
+    return n;
+}
 
-    /* __has_include[_next]("...") */
-    if ((next->type == LCC_TK_LITERAL) &&
-        (next->literal.type == LCC_LT_STRING))
-    {
-        /* copy the raw string */
-        path = lcc_string_copy(next->literal.raw);
-        next = next->next;
+static inline size_t _lcc_ident_len(const char *str, size_t len)
+{
+    /* identifiers must start with a letter or "_" */
+    size_t n = 0;
+    if (!len || (_LCC_CHAR_CLASS[(uint8_t)str[0]] != _LCC_CC_ALPHA))
+        return 0;
 
-        /* remove '"' on either side */
-        is_sys = 0;
-        path->buf[--path->len] = 0;
-        memmove(path->buf, path->buf + 1, path->len--);
-    }
+    /* followed by letters, digits or "_" */
+    while ((n < len) && ((_LCC_CHAR_CLASS[(uint8_t)str[n]] == _LCC_CC_ALPHA) ||
+                         (_LCC_CHAR_CLASS[(uint8_t)str[n]] == _LCC_CC_ZERO) ||
+                         (_LCC_CHAR_CLASS[(uint8_t)str[n]] == _LCC_CC_DIGIT)))
+        n++;
 
-    /* __has_include[_next](<...>) */
-    else if ((next->type == LCC_TK_OPERATOR) &&
-             (next->operator == LCC_OP_LT))
-    {
-        /* create a new string */
-        path = lcc_string_new(0);
-        next = next->next;
+    /* length of the identifier */
+    return n;
+}
 
-        /* concat every token before ">" */
-        while ((next != end) &&
-               ((next->type != LCC_TK_OPERATOR) ||
-                (next->operator != LCC_OP_GT)))
-        {
-            lcc_string_append(path, next->src);
-            next = next->next;
-        }
+static void _lcc_define_cancel(lcc_lexer_t *self, const char *name)
+{
+    /* nothing added by lcc_lexer_add_macro() */
+    if (!(self->defines.count))
+        return;
 
-        /* check for end of tokens */
-        if (next == end)
-        {
-            lcc_string_unref(path);
-            _lcc_lexer_error(self, "Expected \"FILENAME\" or <FILENAME>");
-            return 0;
-        }
+    /* only the identifier part counts, "M(x)" also replaces "M" */
+    size_t n = _lcc_ident_len(name, strlen(name));
+    lcc_string_t *key = lcc_string_from_buffer(name, n);
 
-        /* remove whitespaces when substituted from macro */
-        if (is_macro)
-        {
-            src = path;
-            path = lcc_string_trim(src);
-            lcc_string_unref(src);
-        }
+    /* the textual one is applied earlier, so drop the direct one */
+    lcc_map_pop(&(self->defines), key, NULL);
+    lcc_string_unref(key);
+}
 
-        /* skip the ">" */
-        next = next->next;
+void lcc_lexer_undef(lcc_lexer_t *self, const char *name)
+{
+    /* must be in initial state */
+    if (self->state != LCC_LX_STATE_INIT)
+    {
+        fprintf(stderr, "*** FATAL: cannot remove symbols in the middle of parsing");
+        abort();
     }
 
-    /* otherwise it's an error */
-    else
+    /* replaces the symbol added by lcc_lexer_add_macro() */
+    _lcc_define_cancel(self, name);
+
+    /* use "#undef" to remove the symbol */
+    lcc_string_array_append(
+        &(self->file->lines),
+        lcc_string_from_format("#undef %s", name)
+    );
+}
+
+void lcc_lexer_define(lcc_lexer_t *self, const char *name, const char *value)
+{
+    /* must be in initial state */
+    if (self->state != LCC_LX_STATE_INIT)
     {
-        _lcc_lexer_error(self, "Expected \"FILENAME\" or <FILENAME>");
-        return 0;
+        fprintf(stderr, "*** FATAL: cannot add symbols in the middle of parsing");
+        abort();
     }
 
-    /* must be a ")" */
-    if ((next->type != LCC_TK_OPERATOR) ||
-        (next->operator != LCC_OP_RBRACKET))
+    /* replaces the symbol added by lcc_lexer_add_macro() */
+    _lcc_define_cancel(self, name);
+
+    /* add to predefined sources */
+    if (!value)
     {
-        lcc_string_unref(path);
-        _lcc_lexer_error(self, "Missing ')' after '__has_include'");
-        return 0;
+        lcc_string_array_append(
+            &(self->file->lines),
+            lcc_string_from_format("#define %s", name)
+        );
+    }
+    else
+    {
+        lcc_string_array_append(
+            &(self->file->lines),
+            lcc_string_from_format("#define %s %s", name, value)
+        );
     }
+}
 
-    /* set flags */
-    if (is_sys) self->flags |= LCC_LXDF_INCLUDE_SYS;
-    if (is_next) self->flags |= LCC_LXDF_INCLUDE_NEXT;
-
-    /* try load the include file */
-    lcc_token_t *tail = next->next;
-    lcc_token_t *token = lcc_token_from_int(_lcc_load_include(self, path, 1));
+static void _lcc_psym_put(lcc_lexer_t *self, lcc_string_t *name, _lcc_sym_t *sym)
+{
+    /* textual definitions are still pending, wait for them */
+    if (self->state == LCC_LX_STATE_INIT)
+        lcc_map_set(&(self->defines), name, NULL, &sym);
 
-    /* reset flags */
-    if (is_sys) self->flags &= ~LCC_LXDF_INCLUDE_SYS;
-    if (is_next) self->flags &= ~LCC_LXDF_INCLUDE_NEXT;
+    /* otherwise take effect immediately */
+    else if (sym)
+        lcc_map_set(&(self->psyms), name, NULL, &sym);
+    else
+        _lcc_psym_remove(self, name);
 
-    /* replace the old token */
-    _lcc_range_subst(begin, tail, token);
-    lcc_string_unref(path);
-    return 1;
+    /* the map holds it's own reference */
+    lcc_string_unref(name);
 }
 
-_LCC_MACRO_EXT(__has_include)
+char lcc_lexer_add_macro(lcc_lexer_t *self, const char *name, const char **args, size_t nargs, lcc_token_t *body)
 {
-    /* check as "#include" */
-    return _lcc_check_include(self, begin, end, 0);
-}
+    /* check for macro name */
+    size_t len = strlen(name);
+    if (!len || (_lcc_ident_len(name, len) != len) || !(strcmp(name, "defined")))
+        return 0;
 
-_LCC_MACRO_EXT(__has_include_next)
-{
-    /* check as "#include_next" */
-    return _lcc_check_include(self, begin, end, 1);
-}
+    /* macros added here are treated as built-in */
+    long flags = LCC_LXDF_DEFINE_SYS | (args ? (LCC_LXDF_DEFINE_F | LCC_LXDF_DEFINE_FINE) : LCC_LXDF_DEFINE_O);
+    lcc_string_t *vaname = NULL;
+    lcc_string_array_t names = LCC_STRING_ARRAY_STATIC_INIT;
 
-/** Pseudo-macro "__func__" and "__FUNCTION__"
- *
- * neither of them is a macro
- * the preprocessor does not know the name of the current function
- * they will be replaced by the actual function name during syntax parsing
- */
-_LCC_MACRO_EXT_P(__func__)
-_LCC_MACRO_EXT_P(__FUNCTION__)
+    /* argument names */
+    for (size_t i = 0; i < nargs; i++)
+    {
+        /* the last one may be variadic */
+        size_t size = strlen(args[i]);
+        size_t n = _lcc_ident_len(args[i], size);
 
-static inline char _lcc_check_drop_char(lcc_lexer_t *self)
-{
-    /* most inner compiling section condition */
-    _lcc_val_t *value;
-    lcc_array_t *stack = &(self->eval_stack);
+        /* named argument */
+        if (n == size)
+        {
+            /* intern the name */
+            lcc_string_t *arg = _lcc_intern_buffer(self, args[i], n);
 
-    /* outside of condition compiling section,
-     * or parsing compiler directives */
-    if (!(value = lcc_array_top(stack)) ||
-        (self->flags & LCC_LXF_DIRECTIVE))
-        return 0;
-    else
-        return !(value->value);
-}
+            /* check for existing names */
+            if (_lcc_arg_index(&names, arg) >= 0)
+            {
+                lcc_string_unref(arg);
+                goto invalid;
+            }
 
-static inline char _lcc_check_line_cont(lcc_file_t *fp, lcc_string_t *line)
-{
-    /* check for every character after this */
-    for (size_t i = fp->col; i < line->len; i++)
-        if (!(isspace(line->buf[i])))
-            return 0;
+            /* add to argument list */
+            lcc_string_array_append(&names, arg);
+            continue;
+        }
 
-    /* it is a line continuation, but with whitespaces */
-    return 1;
-}
+        /* must be the last argument, ends with "..." */
+        if ((i != nargs - 1) || (size - n != 3) || strcmp(args[i] + n, "..."))
+            goto invalid;
 
-static void _lcc_psym_dtor(lcc_map_t *self, void *value, void *data)
-{
-    _lcc_sym_t **sym = value;
-    _lcc_sym_free(*sym);
-}
+        /* variadic argument, "__VA_ARGS__" if not named */
+        flags |= LCC_LXDF_DEFINE_VAR;
+        vaname = n ? _lcc_intern_buffer(self, args[i], n) : NULL;
 
-static void _lcc_file_dtor(lcc_array_t *self, void *item, void *data)
-{
-    lcc_file_t *fp = item;
-    _lcc_file_free(fp);
+        /* named variadic argument */
+        if (vaname)
+            flags |= LCC_LXDF_DEFINE_NVAR;
+    }
+
+    /* same as "#define", the variadic name defaults to "__VA_ARGS__" */
+    lcc_token_t *tokens = lcc_token_new();
+    _lcc_sym_t *sym = _lcc_sym_new(
+        flags,
+        tokens,
+        _lcc_intern_from(self, name),
+        vaname ? vaname : _lcc_intern_from(self, "__VA_ARGS__"),
+        &names,
+        NULL
+    );
+
+    /* move the body, identifiers are compared by pointers, so intern them */
+    while (body && (body->next != body))
+    {
+        lcc_token_t *token = lcc_token_detach(body->next);
+        lcc_token_attach(tokens, token);
+
+        /* intern the identifier */
+        if (token->type == LCC_TK_IDENT)
+            token->ident = _lcc_intern_string(self, token->ident);
+    }
+
+    /* add to pre-defined symbols */
+    _lcc_psym_put(self, lcc_string_ref(sym->name), sym);
+    return 1;
+
+invalid:
+    lcc_string_array_free(&names);
+    return 0;
 }
 
-static void _lcc_sstack_dtor(lcc_map_t *self, void *value, void *data)
+void lcc_lexer_remove_macro(lcc_lexer_t *self, const char *name)
 {
-    lcc_array_t *stack = value;
-    lcc_array_free(stack);
+    /* remove from pre-defined symbols */
+    size_t len = strlen(name);
+    _lcc_psym_put(self, _lcc_intern_buffer(self, name, len), NULL);
 }
 
-void lcc_lexer_free(lcc_lexer_t *self)
+static char _lcc_load_define(lcc_lexer_t *self, const char *buf, size_t len)
 {
-    /* clear old file name if any */
-    if (self->fname)
-        lcc_string_unref(self->fname);
+    /* macro name */
+    size_t n = _lcc_ident_len(buf, len);
+    const char *value = buf + n;
+    const char *end = buf + len;
 
-    /* release all cached tokens */
-    while (self->tokens.next != &(self->tokens))
-        lcc_token_free(self->tokens.next);
+    /* the name must be followed by nothing or "=" */
+    if (!n || ((value < end) && (*value != '=') && (*value != '(')))
+        return 0;
 
-    /* clear feature tables */
-    lcc_set_free(&(self->builtins));
-    lcc_set_free(&(self->features));
-    lcc_set_free(&(self->extensions));
+    /* "-DNAME" defines the name as "1" */
+    lcc_token_t *body = lcc_token_new();
+    lcc_string_t *name = _lcc_intern_buffer(self, buf, n);
 
-    /* clear directive related tables */
-    lcc_map_free(&(self->psyms));
-    lcc_map_free(&(self->sym_stacks));
-    lcc_string_array_free(&(self->sccs_msgs));
+    /* function-like macros need the lexer */
+    if ((value < end) && (*value == '('))
+        goto lexer;
 
-    /* clear complex state buffers */
-    lcc_array_free(&(self->files));
-    lcc_array_free(&(self->eval_stack));
+    /* "-DNAME" and "-DNAME=VALUE" */
+    if (value == end)
+    {
+        value = "1";
+        end = value + 1;
+    }
+    else
+    {
+        /* skip the "=" and whitespaces on either side */
+        for (value++; (value < end) && (_LCC_CHAR_CLASS[(uint8_t)*value] == _LCC_CC_SPACE); value++);
+        for (; (end > value) && (_LCC_CHAR_CLASS[(uint8_t)end[-1]] == _LCC_CC_SPACE); end--);
+    }
 
-    /* clear other tables */
-    lcc_string_unref(self->source);
-    lcc_token_buffer_free(&(self->token_buffer));
-    lcc_string_array_free(&(self->include_paths));
-    lcc_string_array_free(&(self->library_paths));
-}
+    /* empty value */
+    if (value == end)
+        goto define;
 
-char lcc_lexer_init(lcc_lexer_t *self, lcc_file_t file)
-{
-    /* check for file flags */
-    if (file.flags & LCC_FF_INVALID)
-        return 0;
+    /* single identifier */
+    if (_lcc_ident_len(value, end - value) == (size_t)(end - value))
+    {
+        lcc_token_attach(body, lcc_token_from_ident(
+            lcc_string_from_buffer(value, end - value),
+            _lcc_intern_buffer(self, value, end - value)
+        ));
 
-    /* macro sources */
-    lcc_file_t psrc = {
-        .col = 0,
-        .row = 0,
-        .name = lcc_string_from("<define>"),
-        .flags = LCC_FF_SYS,
-        .lines = LCC_STRING_ARRAY_STATIC_INIT,
-        .offset = 1,
-        .display = lcc_string_from("<define>"),
-    };
+        /* add the macro */
+        goto define;
+    }
 
-    /* pre-defined symbols */
-    lcc_map_init(
-        &(self->psyms),
-        sizeof(_lcc_sym_t *),
-        _lcc_psym_dtor,
+    /* single decimal integer without suffix */
+    for (const char *p = value; p < end; p++)
+        if ((_LCC_CHAR_CLASS[(uint8_t)*p] != _LCC_CC_DIGIT) &&
+            ((_LCC_CHAR_CLASS[(uint8_t)*p] != _LCC_CC_ZERO) || (p == value && end - value > 1)))
+            goto lexer;
+
+    /* deferred like any other number */
+    lcc_token_attach(body, _lcc_token_from_number_lazy(
+        lcc_string_from_buffer(value, end - value),
+        lcc_string_from_buffer(value, end - value),
+        LCC_LT_INT
+    ));
+
+define:
+    /* build the symbol directly */
+    _lcc_psym_put(self, name, _lcc_sym_new(
+        LCC_LXDF_DEFINE_SYS | LCC_LXDF_DEFINE_O,
+        body,
+        lcc_string_ref(name),
+        _lcc_intern_from(self, "__VA_ARGS__"),
+        &LCC_STRING_ARRAY_STATIC_INIT,
         NULL
-    );
+    ));
 
-    /* complex structures */
-    lcc_array_init(&(self->files), sizeof(lcc_file_t), _lcc_file_dtor, NULL);
-    lcc_array_init(&(self->eval_stack), sizeof(_lcc_val_t), NULL, NULL);
+    /* successful */
+    return 1;
 
-    /* saved tokens for "#pragma push_macro/pop_macro" */
-    lcc_map_init(
-        &(self->sym_stacks),
-        sizeof(lcc_array_t),
-        _lcc_sstack_dtor,
-        NULL
-    );
+lexer:
+    /* everything else goes to the "<define>" pseudo-file */
+    lcc_map_pop(&(self->defines), name, NULL);
+    lcc_token_clear(body);
+    lcc_string_unref(name);
 
-    /* feature sets */
-    lcc_set_init(&(self->builtins));
-    lcc_set_init(&(self->features));
-    lcc_set_init(&(self->extensions));
+    /* "NAME(ARGS)=VALUE" becomes "#define NAME(ARGS) VALUE" */
+    if (!(value = memchr(buf, '=', len)))
+        lcc_string_array_append(&(self->file->lines), lcc_string_from_format("#define %.*s 1", (int)len, buf));
+    else
+        lcc_string_array_append(&(self->file->lines), lcc_string_from_format("#define %.*s %.*s", (int)(value - buf), buf, (int)(buf + len - value - 1), value + 1));
 
-    /* token list and token buffer */
-    lcc_token_init(&(self->tokens));
-    lcc_token_buffer_init(&(self->token_buffer));
+    /* successful */
+    return 1;
+}
 
-    /* other tables */
-    lcc_string_array_init(&(self->sccs_msgs));
-    lcc_string_array_init(&(self->include_paths));
-    lcc_string_array_init(&(self->library_paths));
+static char _lcc_load_option(lcc_lexer_t *self, const char *buf, size_t len)
+{
+    /* "-UNAME" */
+    if ((len > 2) && !(strncmp(buf, "-U", 2)))
+    {
+        /* skip the flag and trailing whitespaces */
+        for (buf += 2, len -= 2; len && (_LCC_CHAR_CLASS[(uint8_t)buf[len - 1]] == _LCC_CC_SPACE); len--);
 
-    /* add initial source files */
-    lcc_array_append(&(self->files), &file);
-    lcc_array_append(&(self->files), &psrc);
+        /* must be a single identifier */
+        if (_lcc_ident_len(buf, len) != len)
+            return 0;
 
-    /* initial file info */
-    self->col = 0;
-    self->row = 0;
-    self->fname = lcc_string_ref(psrc.name);
-    self->source = lcc_string_new(0);
+        /* textual definitions of this name are still ordered before this */
+        _lcc_psym_put(self, _lcc_intern_buffer(self, buf, len), NULL);
+        return 1;
+    }
 
-    /* initial lexer state */
-    self->ch = 0;
-    self->file = lcc_array_top(&(self->files));
-    self->state = LCC_LX_STATE_INIT;
-    self->substate = LCC_LX_SUBSTATE_NULL;
+    /* "-D" is optional */
+    if ((len > 2) && !(strncmp(buf, "-D", 2)))
+    {
+        buf += 2;
+        len -= 2;
+    }
 
-    /* initial flags and GNU extensions */
-    self->flags = 0;
-    self->gnuext = 0;
-    self->counter = 0;
+    /* add the definition */
+    return _lcc_load_define(self, buf, len);
+}
 
-    /* default error handling */
-    self->error_fn = _lcc_error_default;
-    self->error_data = NULL;
+char lcc_lexer_load_option(lcc_lexer_t *self, const char *option)
+{
+    /* must be in initial state */
+    if (self->state != LCC_LX_STATE_INIT)
+    {
+        fprintf(stderr, "*** FATAL: cannot add symbols in the middle of parsing");
+        abort();
+    }
 
-    /* version symbols */
-    lcc_lexer_define(self, "__LCC__", "1");
-    lcc_lexer_define(self, "__VERSION__", "\"LightCC 1.0 (GCC 4.8.3 compatiable)\"");
+    /* a single option, same as a line of the definition file */
+    return _lcc_load_option(self, option, strlen(option));
+}
 
-    /* LightCC emulates GCC 4.8.3 */
-    lcc_lexer_define(self, "__GNUC__", "4");
-    lcc_lexer_define(self, "__GNUC_MINOR__", "8");
-    lcc_lexer_define(self, "__GNUC_PATCHLEVEL__", "3");
+char lcc_lexer_load_defines(lcc_lexer_t *self, const char *fname)
+{
+    /* must be in initial state */
+    if (self->state != LCC_LX_STATE_INIT)
+    {
+        fprintf(stderr, "*** FATAL: cannot add symbols in the middle of parsing");
+        abort();
+    }
 
-    /* standard defines */
-    lcc_lexer_define(self, "__STDC__", "1");
-    lcc_lexer_define(self, "__STDC_HOSTED__", "1");
-    lcc_lexer_define(self, "__STDC_VERSION__", "199901L");
+    /* map the whole file */
+    size_t len;
+    const char *buf;
+    lcc_file_t file = lcc_file_open(fname);
 
-    /* data model */
-    lcc_lexer_define(self, "_LP64", "1");
-    lcc_lexer_define(self, "__LP64__", "1");
+    /* check for errors */
+    if (file.flags & LCC_FF_INVALID)
+        return 0;
 
-    /* platform specific symbols */
-    lcc_lexer_define(self, "__unix__", "1");
-    lcc_lexer_define(self, "__amd64__", "1");
-    lcc_lexer_define(self, "__x86_64__", "1");
+    /* read every line */
+    for (size_t row = 0; lcc_file_line(&file, row, &buf, &len); row++)
+    {
+        /* skip leading whitespaces */
+        while (len && (_LCC_CHAR_CLASS[(uint8_t)*buf] == _LCC_CC_SPACE))
+        {
+            buf++;
+            len--;
+        }
 
-    /* assembler specified macros (LightCC uses GAS syntax) */
-    lcc_lexer_define(self, "__REGISTER_PREFIX__", "%");
-    lcc_lexer_define(self, "__USER_LABEL_PREFIX__", "_");
+        /* empty lines and comments */
+        if (!len || (*buf == '#'))
+            continue;
 
-#define _NAME_DEF(type)     #type
-#define _COPY_NAME(type)    lcc_lexer_define(self, #type, _NAME_DEF(type))
+        /* "-DNAME[=VALUE]" or "-UNAME" */
+        if (!(_lcc_load_option(self, buf, len)))
+        {
+            _lcc_file_free(&file);
+            return 0;
+        }
+    }
 
-#include "lcc_builtin_sizes.i"
-#include "lcc_builtin_types.i"
-#include "lcc_builtin_limits.i"
-#include "lcc_builtin_endians.i"
+    /* close the file */
+    _lcc_file_free(&file);
+    return 1;
+}
 
-#undef _NAME_DEF
-#undef _COPY_NAME
+#define LCC_PCH_MAGIC           "LCCPCH01"
 
-    /* built-in object-like extensions */
-    _LCC_ADD_MACRO_EXT_O(__FILE__)
-    _LCC_ADD_MACRO_EXT_O(__LINE__)
-    _LCC_ADD_MACRO_EXT_O(__DATE__)
-    _LCC_ADD_MACRO_EXT_O(__TIME__)
-    _LCC_ADD_MACRO_EXT_O(__COUNTER__)
-    _LCC_ADD_MACRO_EXT_O(__TIMESTAMP__)
-    _LCC_ADD_MACRO_EXT_O(__BASE_FILE__)
-    _LCC_ADD_MACRO_EXT_O(__INCLUDE_LEVEL__)
+typedef struct __lcc_pch_header_t
+{
+    char magic[8];
+    uint64_t size;          /* size of the file, including this header */
+    uint64_t check;         /* hash of everything after this header */
+    int64_t counter;
+    uint32_t loc;
+    uint32_t gnuext;
+    uint32_t deps;
+    uint32_t names;
+    uint32_t lines;
+    uint32_t once;
+    uint32_t guards;
+    uint32_t syms;
+} _lcc_pch_header_t;
+
+typedef struct __lcc_pch_dep_t
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtime_ns;
+} _lcc_pch_dep_t;
+
+typedef struct __lcc_pch_reader_t
+{
+    const char *buf;
+    const char *end;
+    uint32_t loc;           /* saved locations are moved after existing ones */
+    lcc_lexer_t *lexer;
+} _lcc_pch_reader_t;
+
+static inline size_t _lcc_pch_value_size(lcc_literal_type_t type)
+{
+    switch (type)
+    {
+        case LCC_LT_INT        : return sizeof(int);
+        case LCC_LT_LONG       : return sizeof(long);
+        case LCC_LT_LONGLONG   : return sizeof(long long);
+        case LCC_LT_UINT       : return sizeof(unsigned int);
+        case LCC_LT_ULONG      : return sizeof(unsigned long);
+        case LCC_LT_ULONGLONG  : return sizeof(unsigned long long);
+        case LCC_LT_FLOAT      : return sizeof(float);
+        case LCC_LT_DOUBLE     : return sizeof(double);
+        case LCC_LT_LONGDOUBLE : return sizeof(long double);
+        default                : return 0;
+    }
+}
 
-    /* built-in function-like extensions */
-    _LCC_ADD_MACRO_EXT_F(defined)
-    _LCC_ADD_MACRO_EXT_F(_Pragma)
-    _LCC_ADD_MACRO_EXT_F(__has_include)
-    _LCC_ADD_MACRO_EXT_F(__has_include_next)
+static inline void _lcc_pch_put_u32(lcc_token_buffer_t *self, uint32_t value)
+{
+    lcc_token_buffer_append_from_size(self, (const char *)&value, sizeof(uint32_t));
+}
 
-    /* built-in feature testing macros */
-    _LCC_ADD_MACRO_EXT_F(__has_builtin)
-    _LCC_ADD_MACRO_EXT_F(__has_feature)
-    _LCC_ADD_MACRO_EXT_F(__has_extension)
+static inline void _lcc_pch_put_str(lcc_token_buffer_t *self, lcc_string_t *str)
+{
+    _lcc_pch_put_u32(self, str->len);
+    lcc_token_buffer_append_from_size(self, str->buf, str->len);
+}
 
-    /* pseudo-macro "__func__" and "__FUNCTION__" */
-    _LCC_ADD_MACRO_EXT_O(__func__)
-    _LCC_ADD_MACRO_EXT_O(__FUNCTION__)
+static char _lcc_pch_put_dep(lcc_token_buffer_t *self, lcc_string_t *path, dev_t dev, ino_t ino)
+{
+    /* the file must still be the one that was read */
+    struct stat st;
+    if (stat(path->buf, &st) || (st.st_dev != dev) || (st.st_ino != ino))
+        return 0;
+
+    /* file identity and modification time */
+    _lcc_pch_dep_t dep = {
+        .dev      = st.st_dev,
+        .ino      = st.st_ino,
+        .size     = st.st_size,
+        .mtime    = st.st_mtim.tv_sec,
+        .mtime_ns = st.st_mtim.tv_nsec,
+    };
+
+    /* path followed by the identity */
+    _lcc_pch_put_str(self, path);
+    lcc_token_buffer_append_from_size(self, (const char *)&dep, sizeof(_lcc_pch_dep_t));
     return 1;
 }
 
-lcc_token_t *lcc_lexer_next(lcc_lexer_t *self)
+static char _lcc_pch_put_token(lcc_token_buffer_t *self, lcc_token_t *token)
 {
-    /* advance lexer if no tokens remaining */
-    if (self->tokens.next == &(self->tokens))
-        if (!(lcc_lexer_advance(self)))
-            return NULL;
+    /* common fields */
+    _lcc_pch_put_u32(self, token->type);
+    _lcc_pch_put_u32(self, token->loc);
+    _lcc_pch_put_str(self, token->src);
 
-    /* still no more tokens */
-    if (self->tokens.next == &(self->tokens))
-        return NULL;
+    /* token values */
+    switch (token->type)
+    {
+        case LCC_TK_IDENT:
+        {
+            _lcc_pch_put_str(self, token->ident);
+            return 1;
+        }
 
-    /* shift one token from lexer token list */
-    lcc_token_t *next = self->tokens.next;
-    lcc_token_t *token = lcc_token_detach(next);
+        case LCC_TK_KEYWORD:
+        {
+            _lcc_pch_put_u32(self, token->keyword);
+            return 1;
+        }
 
-    /* keyword conversion */
-    if (token->type == LCC_TK_IDENT)
-    {
-        /* search in keyword mapping table */
-        for (ssize_t i = 0; KEYWORDS[i].name; i++)
+        case LCC_TK_OPERATOR:
         {
-            /* found the keyword, upgrade to keyword token */
-            if (!(strcmp(KEYWORDS[i].name, token->ident->buf)))
-            {
-                lcc_string_unref(token->ident);
-                token->type = LCC_TK_KEYWORD;
-                token->keyword = KEYWORDS[i].keyword;
-                break;
-            }
+            _lcc_pch_put_u32(self, token->operator);
+            return 1;
         }
-    }
 
-    /* token maybe converted */
-    return token;
+        case LCC_TK_LITERAL:
+        {
+            /* literal type and the raw text */
+            _lcc_pch_put_u32(self, token->literal.type);
+            _lcc_pch_put_u32(self, token->literal.pending);
+            _lcc_pch_put_str(self, token->literal.raw);
+
+            /* string values */
+            if (token->literal.type == LCC_LT_CHAR)
+                _lcc_pch_put_str(self, token->literal.v_char);
+            else if (token->literal.type == LCC_LT_STRING)
+                _lcc_pch_put_str(self, token->literal.v_string);
+
+            /* numeric values, unless not converted yet */
+            else if (!(token->literal.pending))
+                lcc_token_buffer_append_from_size(self, (const char *)&(token->literal.v_int), _lcc_pch_value_size(token->literal.type));
+
+            return 1;
+        }
+
+        /* macro bodies never contain anything else */
+        default:
+            return 0;
+    }
 }
 
-lcc_token_t *lcc_lexer_advance(lcc_lexer_t *self)
+static char _lcc_pch_put_sym(lcc_token_buffer_t *self, lcc_string_t *name, _lcc_sym_t *sym)
 {
-    for (;;)
-    {
-        switch (self->state)
-        {
-            /* initial lexer state */
-            case LCC_LX_STATE_INIT:
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->file->flags &= ~LCC_FF_LNODIR;
-                lcc_token_buffer_reset(&(self->token_buffer));
-                break;
-            }
+    /* symbol name, and whether it's defined */
+    _lcc_pch_put_str(self, name);
+    _lcc_pch_put_u32(self, sym != NULL);
 
-            /* shift-in character */
-            case LCC_LX_STATE_SHIFT:
-            {
-                /* get the current line */
-                lcc_file_t *file = self->file;
-                lcc_string_t *line = lcc_string_array_get(&(file->lines), file->row);
+    /* undefined symbols have nothing else */
+    if (!sym)
+        return 1;
 
-                /* line out of range, it's EOF
-                 * pop the current file from file stack */
-                if (!line)
-                {
-                    self->state = LCC_LX_STATE_POP_FILE;
-                    break;
-                }
+    /* flags and variadic argument name */
+    _lcc_pch_put_u32(self, sym->flags);
+    _lcc_pch_put_str(self, sym->vaname);
+    _lcc_pch_put_u32(self, sym->args.array.count);
 
-                /* limit maximum line length */
-                if (line->len > LCC_LEXER_MAX_LINE_LEN)
-                {
-                    _lcc_lexer_error(self, "Line too long");
-                    break;
-                }
+    /* argument names */
+    for (size_t i = 0; i < sym->args.array.count; i++)
+        _lcc_pch_put_str(self, lcc_string_array_get(&(sym->args), i));
 
-                /* EOL, move to next line */
-                if (file->col >= line->len)
-                {
-                    self->state = LCC_LX_STATE_NEXT_LINE;
-                    break;
-                }
+    /* count the body tokens */
+    uint32_t count = 0;
+    for (lcc_token_t *p = sym->body->next; p != sym->body; p = p->next)
+        count++;
 
-                /* read the current character */
-                self->ch = line->buf[file->col];
-                file->col++;
+    /* then the tokens */
+    _lcc_pch_put_u32(self, count);
+    for (lcc_token_t *p = sym->body->next; p != sym->body; p = p->next)
+        if (!(_lcc_pch_put_token(self, p)))
+            return 0;
 
-                /* clear old file name if any */
-                if (self->fname)
-                    lcc_string_unref(self->fname);
+    /* successful */
+    return 1;
+}
 
-                /* save the current file info */
-                self->col = file->col;
-                self->row = file->row + file->offset;
-                self->fname = lcc_string_ref(file->display);
+static char _lcc_pch_save(lcc_lexer_t *self, lcc_token_buffer_t *buf, _lcc_pch_header_t *hdr)
+{
+    /* files the preamble depends on, starting with the main file */
+    lcc_file_t *file = lcc_array_get(&(self->files), 0);
+    lcc_map_t *incs = &(self->include_cache);
 
-                /* check current character */
-                if (self->ch != '\\')
-                {
-                    self->state = LCC_LX_STATE_GOT_CHAR;
-                    break;
-                }
+    /* the main file may be a string */
+    if (file->flags & LCC_FF_IDENT)
+    {
+        if (!(_lcc_pch_put_dep(buf, file->name, file->dev, file->ino)))
+            return 0;
+        else
+            hdr->deps++;
+    }
 
-                /* line continuation, move to next line */
-                if (file->col == line->len)
-                {
-                    self->state = LCC_LX_STATE_NEXT_LINE_CONT;
-                    break;
-                }
+    /* then every resolved include file */
+    for (size_t i = 0; i < incs->capacity; i++)
+    {
+        /* only in-use nodes */
+        if (incs->bucket[i].flags != LCC_MAP_FLAGS_USED)
+            continue;
 
-                /* check if it's a generic character */
-                if (!(_lcc_check_line_cont(file, line)))
-                {
-                    self->state = LCC_LX_STATE_GOT_CHAR;
-                    break;
-                }
+        /* files that were not found are not tracked */
+        _lcc_include_t *inc = (_lcc_include_t *)(incs->values + i * incs->value_size);
+        if (!(inc->path))
+            continue;
 
-                /* line continuation, but with whitespaces after "\\",
-                 * issue a warning and move to next line */
-                self->state = LCC_LX_STATE_NEXT_LINE_CONT;
-                _lcc_lexer_warning(self, "Whitespaces after line continuation");
-                break;
-            }
+        /* add to dependencies */
+        if (!(_lcc_pch_put_dep(buf, inc->path, inc->dev, inc->ino)))
+            return 0;
+        else
+            hdr->deps++;
+    }
 
-            /* pop file from file stack */
-            case LCC_LX_STATE_POP_FILE:
-            {
-                /* check for substitution status */
-                if (self->flags & LCC_LXF_SUBST)
-                {
-                    _lcc_lexer_error(self, "Unterminated function-like macro invocation");
-                    break;
-                }
+    /* location file names */
+    for (size_t i = 0; i < self->loc_names.array.count; i++)
+        _lcc_pch_put_str(buf, lcc_string_array_get(&(self->loc_names), i));
 
-                /* check for EOS (End-Of-Source) */
-                if (self->flags & LCC_LXF_EOS)
-                {
-                    /* check for unterminated conditional directives */
-                    if (self->eval_stack.count)
-                    {
-                        _lcc_lexer_error(self, "Unterminated conditional directive");
-                        break;
-                    }
+    /* location lines */
+    lcc_token_buffer_append_from_size(
+        buf,
+        self->loc_lines.items,
+        self->loc_lines.count * sizeof(lcc_lexer_line_t)
+    );
 
-                    /* move to end of source */
-                    self->state = LCC_LX_STATE_END;
-                    self->substate = LCC_LX_SUBSTATE_NULL;
-                    break;
-                }
+    /* "#pragma once" files */
+    for (size_t i = 0; i < self->once.map.capacity; i++)
+        if (self->once.map.bucket[i].flags == LCC_MAP_FLAGS_USED)
+            _lcc_pch_put_str(buf, self->once.map.bucket[i].key);
 
-                /* set EOF flags to flush the preprocessor */
-                if (!(_lcc_check_drop_char(self)))
-                {
-                    self->flags |= LCC_LXF_EOF;
-                    _lcc_handle_substate(self);
-                }
-                else
-                {
-                    self->flags |= LCC_LXF_EOF;
-                    _lcc_handle_condition(self);
-                }
+    /* include guards */
+    for (size_t i = 0; i < self->guards.capacity; i++)
+    {
+        if (self->guards.bucket[i].flags == LCC_MAP_FLAGS_USED)
+        {
+            _lcc_pch_put_str(buf, self->guards.bucket[i].key);
+            _lcc_pch_put_str(buf, *(lcc_string_t **)(self->guards.values + i * self->guards.value_size));
+        }
+    }
 
-                /* no files left, it's an EOS (End-Of-Source) */
-                if (self->files.count == 1)
-                {
-                    self->flags |= LCC_LXF_EOS;
-                    break;
-                }
+    /* symbols changed by this translation unit */
+    for (size_t i = 0; i < self->psyms.capacity; i++)
+    {
+        /* only in-use nodes */
+        if (self->psyms.bucket[i].flags != LCC_MAP_FLAGS_USED)
+            continue;
 
-                /* pop the file from stack */
-                if (!(lcc_array_pop(&(self->files), NULL)))
-                {
-                    fprintf(stderr, "*** FATAL: empty file stack\n");
-                    abort();
-                }
+        /* built-in macros are always there */
+        _lcc_sym_t *sym = *(_lcc_sym_t **)(self->psyms.values + i * self->psyms.value_size);
+        if (sym && sym->ext)
+            continue;
 
-                /* get the new stack top */
-                self->file = lcc_array_top(&(self->files));
-                self->file->flags &= ~LCC_FF_LNODIR;
-                break;
-            }
+        /* add the symbol */
+        if (!(_lcc_pch_put_sym(buf, self->psyms.bucket[i].key, sym)))
+            return 0;
+        else
+            hdr->syms++;
+    }
 
-            /* move to next line */
-            case LCC_LX_STATE_NEXT_LINE:
-            {
-                /* in condition compilation section,
-                 * whereas this section is not compiled */
-                if (!(_lcc_check_drop_char(self)))
-                {
-                    self->flags |= LCC_LXF_EOL;
-                    _lcc_handle_substate(self);
-                }
-                else
-                {
-                    self->flags |= LCC_LXF_EOL;
-                    _lcc_handle_condition(self);
-                }
+    /* fill the counts */
+    hdr->loc = self->loc;
+    hdr->names = self->loc_names.array.count;
+    hdr->lines = self->loc_lines.count;
+    hdr->once = self->once.map.count;
+    hdr->guards = self->guards.count;
+    return 1;
+}
 
-                /* move to next line */
-                self->file->row++;
-                self->file->col = 0;
-                self->file->flags &= ~LCC_FF_LNODIR;
-                break;
-            }
+char lcc_lexer_save_preamble(lcc_lexer_t *self, const char *fname)
+{
+    /* pre-defined symbols must be complete */
+    if (!(self->base_ready))
+        return 0;
 
-            /* move to next line (line continuation) */
-            case LCC_LX_STATE_NEXT_LINE_CONT:
-            {
-                self->file->row++;
-                self->file->col = 0;
-                self->state = LCC_LX_STATE_SHIFT;
-                break;
-            }
+    /* the header goes first */
+    lcc_token_buffer_t buf;
+    _lcc_pch_header_t hdr = {
+        .magic   = LCC_PCH_MAGIC,
+        .size    = 0,
+        .check   = 0,
+        .counter = self->counter,
+        .loc     = 0,
+        .gnuext  = self->gnuext,
+        .deps    = 0,
+        .names   = 0,
+        .lines   = 0,
+        .once    = 0,
+        .guards  = 0,
+        .syms    = 0,
+    };
 
-            /* we got a new character */
-            case LCC_LX_STATE_GOT_CHAR:
-            {
-                /* in condition compilation section,
-                 * whereas this section is not compiled */
-                if (_lcc_check_drop_char(self))
-                {
-                    self->flags &= ~LCC_LXF_EOF;
-                    self->flags &= ~LCC_LXF_EOL;
-                    _lcc_handle_condition(self);
-                }
-                else
-                {
-                    /* Special Case :: "#define" compiler directive
-                     * distingush object-like and function-like macros */
-                    if ((self->flags & LCC_LXDN_DEFINE) &&
-                        (self->flags & LCC_LXDF_DEFINE_MASK) == LCC_LXDF_DEFINE_NS)
-                    {
-                        if (self->ch == '(')
-                            self->flags |= LCC_LXDF_DEFINE_F;
-                        else
-                            self->flags |= LCC_LXDF_DEFINE_O;
-                    }
+    /* reserve space for the header */
+    lcc_token_buffer_init(&buf);
+    lcc_token_buffer_append_from_size(&buf, (const char *)&hdr, sizeof(_lcc_pch_header_t));
 
-                    /* append last character if not EOF or EOL */
-                    if (!(self->flags & (LCC_LXF_EOF | LCC_LXF_EOL)))
-                        lcc_string_append_from_size(self->source, &(self->ch), 1);
+    /* build the entire file in memory */
+    if (!(_lcc_pch_save(self, &buf, &hdr)))
+    {
+        lcc_token_buffer_free(&buf);
+        return 0;
+    }
+
+    /* hash of the contents */
+    lcc_string_t body = {
+        .ref  = -1,
+        .buf  = buf.buf + sizeof(_lcc_pch_header_t),
+        .len  = buf.len - sizeof(_lcc_pch_header_t),
+        .hash = 0,
+    };
+
+    /* complete the header */
+    hdr.size = buf.len;
+    hdr.check = lcc_string_hash(&body);
+    memcpy(buf.buf, &hdr, sizeof(_lcc_pch_header_t));
 
-                    /* handle all sub-states */
-                    self->flags &= ~LCC_LXF_EOF;
-                    self->flags &= ~LCC_LXF_EOL;
-                    _lcc_handle_substate(self);
+    /* write the preamble file */
+    char ret = _lcc_file_replace(fname, buf.buf, buf.len);
+    lcc_token_buffer_free(&buf);
+    return ret;
+}
 
-                    /* not a space, prohibit compiler directive on this line */
-                    if (!(isspace(self->ch)))
-                        self->file->flags |= LCC_FF_LNODIR;
-                }
+static inline char _lcc_pch_get(_lcc_pch_reader_t *self, void *data, size_t size)
+{
+    /* check for remaining bytes */
+    if ((size_t)(self->end - self->buf) < size)
+        return 0;
 
-                break;
-            }
+    /* copy the data out */
+    memcpy(data, self->buf, size);
+    self->buf += size;
+    return 1;
+}
 
-            /* we got a compiler directive */
-            case LCC_LX_STATE_GOT_DIRECTIVE:
-            {
-                self->state = LCC_LX_STATE_SHIFT;
-                self->flags |= LCC_LXF_DIRECTIVE;
-                self->file->flags |= LCC_FF_LNODIR;
-                break;
-            }
+static inline char _lcc_pch_get_u32(_lcc_pch_reader_t *self, uint32_t *value)
+{
+    return _lcc_pch_get(self, value, sizeof(uint32_t));
+}
 
-            /* commit parsed compiler directive */
-            case LCC_LX_STATE_COMMIT:
-            {
-                /* handle the token first */
-                _lcc_handle_directive(self);
-                self->file->flags &= ~LCC_FF_LNODIR;
+static inline char _lcc_pch_get_buf(_lcc_pch_reader_t *self, const char **buf, uint32_t *len)
+{
+    /* string length */
+    if (!(_lcc_pch_get_u32(self, len)) || ((size_t)(self->end - self->buf) < *len))
+        return 0;
 
-                /* rejected, don't commit */
-                if (self->state == LCC_LX_STATE_REJECT)
-                    break;
+    /* string content is used in place */
+    *buf = self->buf;
+    self->buf += *len;
+    return 1;
+}
 
-                /* commit the directive */
-                _lcc_commit_directive(self);
-                break;
-            }
+static inline lcc_string_t *_lcc_pch_get_str(_lcc_pch_reader_t *self)
+{
+    uint32_t len;
+    const char *buf;
+    return _lcc_pch_get_buf(self, &buf, &len) ? lcc_string_from_buffer(buf, len) : NULL;
+}
 
-            /* token accepted */
-            case LCC_LX_STATE_ACCEPT:
-            case LCC_LX_STATE_ACCEPT_KEEP:
-            {
-                /* shift next character if needed */
-                self->state = (self->state == LCC_LX_STATE_ACCEPT) ? LCC_LX_STATE_SHIFT : LCC_LX_STATE_GOT_CHAR;
-                self->substate = LCC_LX_SUBSTATE_NULL;
+static inline lcc_string_t *_lcc_pch_get_ident(_lcc_pch_reader_t *self)
+{
+    uint32_t len;
+    const char *buf;
+    return _lcc_pch_get_buf(self, &buf, &len) ? _lcc_intern_buffer(self->lexer, buf, len) : NULL;
+}
 
-                /* still parsing directives, don't accept now */
-                if (self->flags & LCC_LXF_DIRECTIVE)
-                {
-                    _lcc_handle_directive(self);
-                    break;
-                }
+static char _lcc_pch_check_dep(_lcc_pch_reader_t *self)
+{
+    struct stat st;
+    _lcc_pch_dep_t dep;
+    lcc_string_t *path = _lcc_pch_get_str(self);
 
-                /* nothing to accept, equivalent to SHIFT or GOT_CHAR */
-                if (self->tokens.next == &(self->tokens))
-                    break;
+    /* read the path and it's identity */
+    if (!path || !(_lcc_pch_get(self, &dep, sizeof(_lcc_pch_dep_t))))
+    {
+        if (path) lcc_string_unref(path);
+        return 0;
+    }
 
-                /* get the newly accepted token */
-                _lcc_sym_t **sym;
-                lcc_token_t *token = self->tokens.prev;
+    /* the file must not be changed */
+    char ret = !stat(path->buf, &st) &&
+               (dep.dev == (uint64_t)st.st_dev) &&
+               (dep.ino == (uint64_t)st.st_ino) &&
+               (dep.size == (uint64_t)st.st_size) &&
+               (dep.mtime == (int64_t)st.st_mtim.tv_sec) &&
+               (dep.mtime_ns == (int64_t)st.st_mtim.tv_nsec);
 
-                /* check for macro substitution */
-                if (!(self->flags & LCC_LXF_SUBST) &&                               /* not substituting */
-                     (token->type == LCC_TK_IDENT) &&                               /* is a valid identifier */
-                     (lcc_map_get(&(self->psyms), token->ident, (void **)&sym)))    /* which is also a macro name */
-                {
-                    /* function-like macro, expect a "(" operator */
-                    if ((*sym)->flags & LCC_LXDF_DEFINE_F)
-                    {
-                        self->flags |= LCC_LXF_SUBST;
-                        self->subst_level = 0;
-                        break;
-                    }
-                }
-                else
-                {
-                    /* still not substiting */
-                    if (!(self->flags & LCC_LXF_SUBST))
-                        return &(self->tokens);
+    /* release the path */
+    lcc_string_unref(path);
+    return ret;
+}
 
-                    /* looking for the first bracket */
-                    if (!(self->subst_level) &&
-                        !((token->type == LCC_TK_OPERATOR) &&
-                          (token->operator == LCC_OP_LBRACKET)))
-                    {
-                        self->flags &= ~LCC_LXF_SUBST;
-                        return &(self->tokens);
-                    }
+static lcc_token_t *_lcc_pch_get_token(_lcc_pch_reader_t *self)
+{
+    uint32_t type;
+    uint32_t loc;
+    uint32_t value;
+    lcc_string_t *src;
+    lcc_string_t *str;
+    lcc_token_t *token;
 
-                    /* not an operator, just append to token chain */
-                    if (token->type != LCC_TK_OPERATOR)
-                        break;
+    /* common fields */
+    if (!(_lcc_pch_get_u32(self, &type)) ||
+        !(_lcc_pch_get_u32(self, &loc)) ||
+        !(src = _lcc_pch_get_str(self)))
+        return NULL;
 
-                    /* "(" operator */
-                    if (token->operator == LCC_OP_LBRACKET)
-                        self->subst_level++;
+    /* token values */
+    switch (type)
+    {
+        case LCC_TK_IDENT:
+        {
+            /* identifiers are compared by pointers */
+            if (!(str = _lcc_pch_get_ident(self)))
+                goto invalid;
 
-                    /* ")" operator */
-                    if (token->operator == LCC_OP_RBRACKET)
-                        self->subst_level--;
+            /* create the token */
+            token = lcc_token_from_ident(src, str);
+            break;
+        }
 
-                    /* still in macro invocation */
-                    if (self->subst_level)
-                        break;
-                }
+        case LCC_TK_KEYWORD:
+        {
+            /* keyword tokens */
+            if (!(_lcc_pch_get_u32(self, &value)))
+                goto invalid;
 
-                /* reset substitution status */
-                self->flags &= ~LCC_LXF_SUBST;
-                self->subst_level = 0;
+            /* create the token */
+            token = lcc_token_from_keyword(src, value);
+            break;
+        }
 
-                /* perform substitution */
-                if (!(_lcc_macro_subst(self, self->tokens.next, &(self->tokens))) ||
-                    (self->tokens.next == &(self->tokens)))
-                    break;
-                else
-                    return &(self->tokens);
-            }
+        case LCC_TK_OPERATOR:
+        {
+            /* check for operator range */
+            if (!(_lcc_pch_get_u32(self, &value)) || (value > LCC_OP_CONCAT))
+                goto invalid;
 
-            /* token rejected */
-            case LCC_LX_STATE_REJECT:
-            {
-                self->state = LCC_LX_STATE_END;
-                self->substate = LCC_LX_SUBSTATE_NULL;
+            /* create the token */
+            token = lcc_token_from_operator(src, value);
+            break;
+        }
+
+        case LCC_TK_LITERAL:
+        {
+            /* literal type and the raw text */
+            uint32_t pending;
+            if (!(_lcc_pch_get_u32(self, &value)) ||
+                !(_lcc_pch_get_u32(self, &pending)) ||
+                (value > LCC_LT_STRING) ||
+                !(str = _lcc_pch_get_str(self)))
+                goto invalid;
+
+            /* the value is filled below */
+            token = _lcc_token_from_number_lazy(src, str, value);
+            token->literal.pending = 0;
+
+            /* string values */
+            if (value == LCC_LT_CHAR)
+                str = token->literal.v_char = _lcc_pch_get_str(self);
+            else if (value == LCC_LT_STRING)
+                str = token->literal.v_string = _lcc_pch_get_str(self);
+
+            /* numeric values, unless not converted yet */
+            else if (pending)
+                token->literal.pending = 1;
+            else if (!(_lcc_pch_get(self, &(token->literal.v_int), _lcc_pch_value_size(value))))
+                str = NULL;
+
+            /* check for errors */
+            if (!str)
+            {
+                token->literal.type = LCC_LT_INT;
+                lcc_token_free(token);
                 return NULL;
             }
 
-            /* end of lexing, emit an EOF token */
-            case LCC_LX_STATE_END:
-                return &(self->tokens);
+            break;
         }
+
+        /* macro bodies never contain anything else */
+        default:
+            goto invalid;
     }
+
+    /* moved after the current locations */
+    token->loc = loc ? loc + self->loc : 0;
+    return token;
+
+invalid:
+    lcc_string_unref(src);
+    return NULL;
 }
 
-void lcc_lexer_undef(lcc_lexer_t *self, const char *name)
+static char _lcc_pch_get_sym(_lcc_pch_reader_t *self)
 {
-    /* must be in initial state */
-    if (self->state != LCC_LX_STATE_INIT)
+    uint32_t defined;
+    uint32_t flags;
+    uint32_t nargs;
+    uint32_t count;
+    lcc_string_t *name = _lcc_pch_get_ident(self);
+    lcc_lexer_t *lexer = self->lexer;
+
+    /* symbol name, and whether it's defined */
+    if (!name || !(_lcc_pch_get_u32(self, &defined)))
     {
-        fprintf(stderr, "*** FATAL: cannot remove symbols in the middle of parsing");
-        abort();
+        if (name) lcc_string_unref(name);
+        return 0;
     }
 
-    /* use "#undef" to remove the symbol */
-    lcc_string_array_append(
-        &(self->file->lines),
-        lcc_string_from_format("#undef %s", name)
+    /* undefined symbols */
+    if (!defined)
+    {
+        lcc_map_set(&(lexer->preamble), name, NULL, &(_lcc_sym_t *){ NULL });
+        lcc_string_unref(name);
+        return 1;
+    }
+
+    /* flags and variadic argument name */
+    lcc_string_t *vaname;
+    if (!(_lcc_pch_get_u32(self, &flags)) || !(vaname = _lcc_pch_get_ident(self)))
+    {
+        lcc_string_unref(name);
+        return 0;
+    }
+
+    /* create an empty symbol */
+    _lcc_sym_t *sym = _lcc_sym_new(
+        flags,
+        lcc_token_new(),
+        name,
+        vaname,
+        &LCC_STRING_ARRAY_STATIC_INIT,
+        NULL
     );
+
+    /* argument names */
+    if (!(_lcc_pch_get_u32(self, &nargs)))
+        goto invalid;
+
+    /* read every argument */
+    for (uint32_t i = 0; i < nargs; i++)
+    {
+        lcc_string_t *arg = _lcc_pch_get_ident(self);
+        if (!arg) goto invalid;
+        lcc_string_array_append(&(sym->args), arg);
+    }
+
+    /* body tokens */
+    if (!(_lcc_pch_get_u32(self, &count)))
+        goto invalid;
+
+    /* read every token */
+    for (uint32_t i = 0; i < count; i++)
+    {
+        lcc_token_t *token = _lcc_pch_get_token(self);
+        if (!token) goto invalid;
+        lcc_token_attach(sym->body, token);
+    }
+
+    /* add to preamble symbols */
+    lcc_array_shrink_to_fit(&(sym->args.array));
+    lcc_map_set(&(lexer->preamble), name, NULL, &sym);
+    return 1;
+
+invalid:
+    _lcc_sym_free(sym);
+    return 0;
 }
 
-void lcc_lexer_define(lcc_lexer_t *self, const char *name, const char *value)
+static char _lcc_pch_load(lcc_lexer_t *self, const char *buf, size_t size)
+{
+    /* header of the preamble */
+    _lcc_pch_header_t hdr;
+    memcpy(&hdr, buf, sizeof(_lcc_pch_header_t));
+
+    /* hash of the contents */
+    lcc_string_t body = {
+        .ref  = -1,
+        .buf  = (char *)buf + sizeof(_lcc_pch_header_t),
+        .len  = size - sizeof(_lcc_pch_header_t),
+        .hash = 0,
+    };
+
+    /* check for the header, the contents, and the GNU extensions it was lexed with */
+    if (memcmp(hdr.magic, LCC_PCH_MAGIC, sizeof(hdr.magic)) ||
+        (hdr.size != size) ||
+        (hdr.gnuext != (uint32_t)self->gnuext) ||
+        (hdr.check != lcc_string_hash(&body)))
+        return 0;
+
+    /* locations must not overflow */
+    if ((uint64_t)hdr.loc + self->loc >= UINT32_MAX - LCC_LEXER_MAX_LINE_LEN)
+        return 0;
+
+    /* the reader */
+    _lcc_pch_reader_t rd = {
+        .buf   = body.buf,
+        .end   = body.buf + body.len,
+        .loc   = self->loc,
+        .lexer = self,
+    };
+
+    /* none of the dependencies may be changed */
+    for (uint32_t i = 0; i < hdr.deps; i++)
+        if (!(_lcc_pch_check_dep(&rd)))
+            return 0;
+
+    /* location file names are appended */
+    uint32_t nbase = self->loc_names.array.count;
+    for (uint32_t i = 0; i < hdr.names; i++)
+    {
+        lcc_string_t *name = _lcc_pch_get_str(&rd);
+        if (!name) return 0;
+        lcc_string_array_append(&(self->loc_names), name);
+    }
+
+    /* so does location lines */
+    for (uint32_t i = 0; i < hdr.lines; i++)
+    {
+        lcc_lexer_line_t line;
+        if (!(_lcc_pch_get(&rd, &line, sizeof(lcc_lexer_line_t))) || (line.name >= hdr.names))
+            return 0;
+
+        /* moved after the current locations */
+        line.loc += rd.loc;
+        line.name += nbase;
+        lcc_array_append(&(self->loc_lines), &line);
+    }
+
+    /* "#pragma once" files */
+    for (uint32_t i = 0; i < hdr.once; i++)
+    {
+        lcc_string_t *key = _lcc_pch_get_str(&rd);
+        if (!key) return 0;
+        lcc_set_add(&(self->once), key);
+        lcc_string_unref(key);
+    }
+
+    /* include guards */
+    for (uint32_t i = 0; i < hdr.guards; i++)
+    {
+        lcc_string_t *key = _lcc_pch_get_str(&rd);
+        lcc_string_t *guard = key ? _lcc_pch_get_ident(&rd) : NULL;
+
+        /* check for errors */
+        if (!guard)
+        {
+            if (key) lcc_string_unref(key);
+            return 0;
+        }
+
+        /* add to guard table */
+        lcc_map_set(&(self->guards), key, NULL, &guard);
+        lcc_string_unref(key);
+    }
+
+    /* symbols, applied after the pre-defined ones */
+    for (uint32_t i = 0; i < hdr.syms; i++)
+        if (!(_lcc_pch_get_sym(&rd)))
+            return 0;
+
+    /* continue right after the preamble */
+    self->loc = hdr.loc + rd.loc;
+    self->loc_file = NULL;
+    self->counter = hdr.counter;
+    return rd.buf == rd.end;
+}
+
+char lcc_lexer_load_preamble(lcc_lexer_t *self, const char *fname)
 {
     /* must be in initial state */
     if (self->state != LCC_LX_STATE_INIT)
     {
-        fprintf(stderr, "*** FATAL: cannot add symbols in the middle of parsing");
+        fprintf(stderr, "*** FATAL: cannot load preamble in the middle of parsing");
         abort();
     }
 
-    /* add to predefined sources */
-    if (!value)
-    {
-        lcc_string_array_append(
-            &(self->file->lines),
-            lcc_string_from_format("#define %s", name)
-        );
-    }
-    else
+    /* open the preamble file */
+    struct stat st;
+    int fd = open(fname, O_RDONLY);
+
+    /* check for errors */
+    if (fd < 0)
+        return 0;
+
+    /* must have a complete header */
+    if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(_lcc_pch_header_t)))
     {
-        lcc_string_array_append(
-            &(self->file->lines),
-            lcc_string_from_format("#define %s %s", name, value)
-        );
+        close(fd);
+        return 0;
     }
+
+    /* map the entire file */
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    /* check for errors */
+    if (map == MAP_FAILED)
+        return 0;
+
+    /* tokens belong to the lexer pool, like those created while lexing */
+    lcc_token_pool_t *pool = lcc_token_pool_swap(&(self->token_pool));
+    char ret = _lcc_pch_load(self, map, (size_t)st.st_size);
+
+    /* restore the pool, and unmap the file */
+    lcc_token_pool_swap(pool);
+    munmap(map, (size_t)st.st_size);
+    return ret;
 }
 
 void lcc_lexer_add_builtin(lcc_lexer_t *self, const char *name) { lcc_set_add_string(&(self->builtins), name); }
@@ -6381,12 +10420,19 @@ void lcc_lexer_add_include_path(lcc_lexer_t *self, const char *path)
 {
     lcc_string_t *s = lcc_string_from(path);
     lcc_string_array_append(&(self->include_paths), s);
+
+    /* previous lookups may resolve differently now, older entries
+     * are kept since the preamble still tracks them as dependencies */
+    self->include_gen++;
 }
 
 void lcc_lexer_add_library_path(lcc_lexer_t *self, const char *path)
 {
     lcc_string_t *s = lcc_string_from(path);
     lcc_string_array_append(&(self->library_paths), s);
+
+    /* search paths changed, don't hit previous lookups */
+    self->include_gen++;
 }
 
 void lcc_lexer_set_gnu_ext(lcc_lexer_t *self, lcc_lexer_gnu_ext_t name, char enabled)
@@ -6401,4 +10447,14 @@ void lcc_lexer_set_error_handler(lcc_lexer_t *self, lcc_lexer_on_error_fn error_
 {
     self->error_fn = error_fn;
     self->error_data = data;
+}
+
+void lcc_lexer_set_token_cache(lcc_lexer_t *self, lcc_token_cache_t *cache)
+{
+    self->tcache = cache;
+}
+
+void lcc_lexer_set_source_cache(lcc_lexer_t *self, lcc_source_cache_t *cache)
+{
+    self->scache = cache;
 }
\ No newline at end of file
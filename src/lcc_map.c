@@ -4,154 +4,116 @@
 
 #include "lcc_map.h"
 
-#define LCC_MAP_INIT_CAP    67
+#define LCC_MAP_INIT_CAP    64
 #define LCC_MAP_LOAD_FAC    3 / 4
 
-static inline long _lcc_djb_hash(lcc_string_t *key)
-{
-    /* 5381 is just a number that, in testing,
-     * resulted in fewer collisions and better avalanching */
-    long hash = 5381;
-    size_t size = key->len;
-    const char *data = key->buf;
-
-    /* hash every character */
-    while (size--)
-        hash = ((hash << 5) + hash) + (*data++);
-
-    /* invert the hash */
-    return ~hash;
-}
+#define VALUE_AT(self, index) \
+    ((void *)((self)->values + (index) * (self)->value_size))
 
-static inline char _lcc_is_prime(size_t value)
+static inline size_t _lcc_find_slot(lcc_map_t *self, lcc_string_t *key, size_t hash, char *found)
 {
-    for (size_t i = 2; i <= value / 2; i++)
-        if ((value % i) == 0)
-            return 0;
-
-    return 1;
-}
-
-static inline size_t _lcc_next_prime(size_t value)
-{
-    while (!(_lcc_is_prime(++value)));
-    return value;
-}
-
-static inline lcc_map_node_t *_lcc_find_node(lcc_map_t *self, lcc_string_t *key, long *hashp)
-{
-    /* calculate the hash and index */
-    long hash = _lcc_djb_hash(key);
-    size_t index = hash % self->capacity;
-
-    /* store the hash value as needed */
-    if (hashp)
-        *hashp = hash;
+    /* start from the home slot */
+    size_t mask = self->capacity - 1;
+    size_t slot = hash & mask;
+    size_t dead = self->capacity;
 
-    /* quadratic probing */
-    for (size_t p, i = 0; i < self->capacity; i++)
+    /* triangular probing, visits every slot when capacity is a power of 2 */
+    for (size_t i = 1; i <= self->capacity; i++)
     {
-        /* move to next index */
-        p = index + i * i;
-        p %= self->capacity;
+        lcc_map_node_t *node = &(self->bucket[slot]);
 
         /* empty nodes, cannot be after this */
-        if (!(self->bucket[p].flags))
+        if (!(node->flags))
             break;
 
-        /* skip deleted nodes */
-        if (self->bucket[p].flags & LCC_MAP_FLAGS_DEL)
-            continue;
-
-        /* absolute equals, definately found */
-        if (self->bucket[p].key == key)
-            return &(self->bucket[p]);
+        /* remember the first deleted node for insertion */
+        if (node->flags & LCC_MAP_FLAGS_DEL)
+        {
+            if (dead == self->capacity)
+                dead = slot;
+        }
 
         /* check for hash, key length and key string */
-        if ((self->bucket[p].hash == hash) &&
-            (self->bucket[p].key->len == key->len) &&
-            (memcmp(self->bucket[p].key->buf, key->buf, key->len) == 0))
-            return &(self->bucket[p]);
+        else if ((node->key == key) ||
+                 ((node->hash == hash) &&
+                  (node->key->len == key->len) &&
+                  (memcmp(node->key->buf, key->buf, key->len) == 0)))
+        {
+            *found = 1;
+            return slot;
+        }
+
+        /* move to next slot */
+        slot = (slot + i) & mask;
     }
 
-    /* not found */
-    return NULL;
+    /* not found, prefer reusing deleted nodes */
+    *found = 0;
+    return (dead != self->capacity) ? dead : slot;
 }
 
-static void _lcc_map_rehash(lcc_map_t *self)
+static void _lcc_map_rehash(lcc_map_t *self, size_t capacity)
 {
-    /* create a new bucket */
-    size_t capacity = _lcc_next_prime(self->capacity * 2);
+    /* create a new bucket and value slab */
+    size_t mask = capacity - 1;
+    char *values = malloc(capacity * self->value_size + 1);
     lcc_map_node_t *bucket = calloc(capacity, sizeof(lcc_map_node_t));
 
-    /* rehash all items */
+    /* rehash all items, deleted nodes are dropped */
     for (size_t i = 0; i < self->capacity; i++)
     {
         /* only rehash those are in-use */
-        if (self->bucket[i].flags == LCC_MAP_FLAGS_USED)
-        {
-            /* calculate new index */
-            size_t index = self->bucket[i].hash % capacity;
-            lcc_map_node_t *slot = NULL;
-
-            /* probe for an available slot */
-            for (size_t p, j = 0; j < capacity; j++)
-            {
-                /* move to next index */
-                p = index + j * j;
-                p %= capacity;
-
-                /* found an empty slot */
-                if (!(bucket[p].flags))
-                {
-                    slot = &(bucket[p]);
-                    break;
-                }
-            }
-
-            /* must exists */
-            if (!slot)
-            {
-                fprintf(stderr, "*** FATAL: rehash failed\n");
-                abort();
-            }
-
-            /* copy all the attributes */
-            slot->key = self->bucket[i].key;
-            slot->hash = self->bucket[i].hash;
-            slot->flags = self->bucket[i].flags;
-            slot->value = self->bucket[i].value;
-        }
+        if (self->bucket[i].flags != LCC_MAP_FLAGS_USED)
+            continue;
+
+        /* probe for an empty slot */
+        size_t j = 1;
+        size_t slot = self->bucket[i].hash & mask;
+
+        /* there is always an empty slot */
+        while (bucket[slot].flags)
+            slot = (slot + j++) & mask;
+
+        /* move the node and it's value */
+        bucket[slot] = self->bucket[i];
+        memcpy(values + slot * self->value_size, VALUE_AT(self, i), self->value_size);
     }
 
     /* replace with new one */
     free(self->bucket);
+    free(self->values);
+
+    /* no more deleted nodes */
+    self->used = self->count;
     self->bucket = bucket;
+    self->values = values;
     self->capacity = capacity;
 }
 
 void lcc_map_free(lcc_map_t *self)
 {
     /* clear items if any */
-    for (size_t i = 0; self->dtor_fn && (i < self->capacity); i++)
+    for (size_t i = 0; i < self->capacity; i++)
     {
         if (self->bucket[i].flags == LCC_MAP_FLAGS_USED)
         {
-            self->dtor_fn(self, self->bucket[i].value, self->dtor_data);
+            if (self->dtor_fn) self->dtor_fn(self, VALUE_AT(self, i), self->dtor_data);
             lcc_string_unref(self->bucket[i].key);
-            free(self->bucket[i].value);
         }
     }
 
-    /* release the bucket */
+    /* release the bucket and values */
     free(self->bucket);
+    free(self->values);
 }
 
 void lcc_map_init(lcc_map_t *self, size_t value_size, lcc_map_dtor_fn dtor, void *data)
 {
     /* initial map bucket */
+    self->used = 0;
     self->count = 0;
     self->bucket = calloc(LCC_MAP_INIT_CAP, sizeof(lcc_map_node_t));
+    self->values = malloc(LCC_MAP_INIT_CAP * value_size + 1);
     self->capacity = LCC_MAP_INIT_CAP;
     self->value_size = value_size;
 
@@ -160,45 +122,61 @@ void lcc_map_init(lcc_map_t *self, size_t value_size, lcc_map_dtor_fn dtor, void
     self->dtor_data = data;
 }
 
+char lcc_map_key(lcc_map_t *self, lcc_string_t *key, lcc_string_t **stored)
+{
+    /* lookup node in bucket */
+    char found;
+    size_t slot = _lcc_find_slot(self, key, lcc_string_hash(key), &found);
+
+    /* retain the stored key as needed */
+    if (found && stored)
+        *stored = self->bucket[slot].key;
+
+    /* found or not */
+    return found;
+}
+
 char lcc_map_pop(lcc_map_t *self, lcc_string_t *key, void *data)
 {
     /* lookup node in bucket */
-    lcc_map_node_t *node = _lcc_find_node(self, key, NULL);
+    char found;
+    size_t slot = _lcc_find_slot(self, key, lcc_string_hash(key), &found);
 
     /* node not found */
-    if (!node)
+    if (!found)
         return 0;
 
     /* copy the old value as needed */
     if (data)
-        memcpy(data, node->value, self->value_size);
+        memcpy(data, VALUE_AT(self, slot), self->value_size);
 
     /* otherwise, destroy it */
     else if (self->dtor_fn)
-        self->dtor_fn(self, node->value, self->dtor_data);
+        self->dtor_fn(self, VALUE_AT(self, slot), self->dtor_data);
 
-    /* release key and value memory */
-    free(node->value);
-    lcc_string_unref(node->key);
+    /* release key memory */
+    lcc_string_unref(self->bucket[slot].key);
+    self->bucket[slot].key = NULL;
 
     /* set the deleted flags */
     self->count--;
-    node->flags |= LCC_MAP_FLAGS_DEL;
+    self->bucket[slot].flags |= LCC_MAP_FLAGS_DEL;
     return 1;
 }
 
 char lcc_map_get(lcc_map_t *self, lcc_string_t *key, void **data)
 {
     /* lookup node in bucket */
-    lcc_map_node_t *node = _lcc_find_node(self, key, NULL);
+    char found;
+    size_t slot = _lcc_find_slot(self, key, lcc_string_hash(key), &found);
 
     /* node not found */
-    if (!node)
+    if (!found)
         return 0;
 
-    /* retain the value address as needed */
+    /* retain the value address as needed, it's valid until the next insertion */
     if (data)
-        *data = node->value;
+        *data = VALUE_AT(self, slot);
 
     /* but at least we found the node */
     return 1;
@@ -207,62 +185,53 @@ char lcc_map_get(lcc_map_t *self, lcc_string_t *key, void **data)
 char lcc_map_set(lcc_map_t *self, lcc_string_t *key, void *data, const void *new)
 {
     /* lookup node in bucket */
-    long hash;
-    lcc_map_node_t *node = _lcc_find_node(self, key, &hash);
+    char found;
+    size_t hash = lcc_string_hash(key);
+    size_t slot = _lcc_find_slot(self, key, hash, &found);
 
     /* found in bucket */
-    if (node)
+    if (found)
     {
         /* retain the value address as needed */
         if (data)
-            memcpy(data, node->value, self->value_size);
+            memcpy(data, VALUE_AT(self, slot), self->value_size);
 
         /* destroy the old value */
         else if (self->dtor_fn)
-            self->dtor_fn(self, node->value, self->dtor_data);
+            self->dtor_fn(self, VALUE_AT(self, slot), self->dtor_data);
 
         /* replace the value */
-        memcpy(node->value, new, self->value_size);
+        if (self->value_size)
+            memcpy(VALUE_AT(self, slot), new, self->value_size);
+
         return 1;
     }
 
-    /* rehash as needed */
-    if (self->count >= self->capacity * LCC_MAP_LOAD_FAC)
-        _lcc_map_rehash(self);
-
-    /* calculate node index */
-    node = NULL;
-    size_t index = hash % self->capacity;
-
-    /* quadratic probing algorithm */
-    for (size_t p, i = 0; i < self->capacity; i++)
+    /* rehash as needed, grow only if live nodes take up
+     * most of the space, otherwise just drop deleted nodes */
+    if (self->used >= self->capacity * LCC_MAP_LOAD_FAC)
     {
-        /* move to next index */
-        p = index + i * i;
-        p %= self->capacity;
+        if (self->count >= self->capacity / 2)
+            _lcc_map_rehash(self, self->capacity * 2);
+        else
+            _lcc_map_rehash(self, self->capacity);
 
-        /* use empty node or reuse deleted node */
-        if ((self->bucket[p].flags == 0) ||
-            (self->bucket[p].flags & LCC_MAP_FLAGS_DEL))
-        {
-            node = &(self->bucket[p]);
-            break;
-        }
+        /* find the slot again */
+        slot = _lcc_find_slot(self, key, hash, &found);
     }
 
-    /* must exists */
-    if (!node)
-    {
-        fprintf(stderr, "*** FATAL: no available space for new node\n");
-        abort();
-    }
+    /* reusing a deleted node doesn't occupy new space */
+    if (!(self->bucket[slot].flags))
+        self->used++;
 
     /* create a new node */
-    node->key = lcc_string_copy(key);
-    node->hash = hash;
-    node->flags = LCC_MAP_FLAGS_USED;
-    node->value = malloc(self->value_size);
-    memcpy(node->value, new, self->value_size);
+    self->bucket[slot].key = lcc_string_ref(key);
+    self->bucket[slot].hash = hash;
+    self->bucket[slot].flags = LCC_MAP_FLAGS_USED;
+
+    /* sets have no values */
+    if (self->value_size)
+        memcpy(VALUE_AT(self, slot), new, self->value_size);
 
     /* update node counter */
     self->count++;
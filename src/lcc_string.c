@@ -1,5 +1,6 @@
 #include <ctype.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -7,6 +8,11 @@
 
 void lcc_string_unref(lcc_string_t *self)
 {
+    /* frozen strings are released by their owner */
+    if (self->ref < 0)
+        return;
+
+    /* release the string when no longer referenced */
     if (!(--self->ref))
     {
         free(self->buf);
@@ -16,18 +22,90 @@ void lcc_string_unref(lcc_string_t *self)
 
 char lcc_string_equals(lcc_string_t *self, lcc_string_t *other)
 {
+    /* same string */
     if (self == other)
         return 1;
-    else
-        return (self->len == other->len) && !(strcmp(self->buf, other->buf));
+
+    /* different hashes must be different strings */
+    if (self->hash && other->hash && (self->hash != other->hash))
+        return 0;
+
+    /* compare the content */
+    return (self->len == other->len) && !(strcmp(self->buf, other->buf));
+}
+
+static inline uint64_t _lcc_hash_mix(uint64_t h)
+{
+    /* finalizer from MurmurHash3 */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+size_t lcc_string_hash(lcc_string_t *self)
+{
+    /* already calculated */
+    if (self->hash)
+        return self->hash;
+
+    /* hash the string 8 bytes at a time */
+    uint64_t w;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ self->len;
+    size_t size = self->len;
+    const char *data = self->buf;
+
+    /* every full word */
+    while (size >= sizeof(uint64_t))
+    {
+        memcpy(&w, data, sizeof(uint64_t));
+        h = (h ^ w) * 0x100000001b3ull;
+        h ^= h >> 29;
+        data += sizeof(uint64_t);
+        size -= sizeof(uint64_t);
+    }
+
+    /* remaining bytes */
+    if (size)
+    {
+        w = 0;
+        memcpy(&w, data, size);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+
+    /* 0 means "not calculated" */
+    if (!(h = _lcc_hash_mix(h)))
+        h = 1;
+
+    /* cache the hash value */
+    self->hash = (size_t)h;
+    return self->hash;
 }
 
 lcc_string_t *lcc_string_ref(lcc_string_t *self)
 {
-    self->ref++;
+    /* frozen strings are never written */
+    if (self->ref >= 0)
+        self->ref++;
+
     return self;
 }
 
+void lcc_string_thaw(lcc_string_t *self)
+{
+    /* owned by the caller again */
+    self->ref = 1;
+}
+
+void lcc_string_freeze(lcc_string_t *self)
+{
+    /* the hash is cached before freezing, so readers never write */
+    lcc_string_hash(self);
+    self->ref = -1;
+}
+
 lcc_string_t *lcc_string_copy(lcc_string_t *self)
 {
     /* allocate new string */
@@ -36,6 +114,7 @@ lcc_string_t *lcc_string_copy(lcc_string_t *self)
     /* make an identical copy except the buffer pointer */
     new->ref = 1;
     new->len = self->len;
+    new->hash = self->hash;
     new->buf = malloc(self->len + 1);
 
     /* copy string content */
@@ -134,6 +213,7 @@ lcc_string_t *lcc_string_new(size_t size)
     /* string length and buffer */
     self->len = size;
     self->buf = NULL;
+    self->hash = 0;
 
     /* initial string buffer as needed */
     if (size)
@@ -162,6 +242,7 @@ lcc_string_t *lcc_string_from_buffer(const char *s, size_t len)
     self->ref = 1;
     self->len = len;
     self->buf = malloc(len + 1);
+    self->hash = 0;
 
     /* copy the initial string */
     self->buf[len] = 0;
@@ -195,6 +276,7 @@ lcc_string_t *lcc_string_from_format_va(const char *fmt, va_list vargs)
     self->ref = 1;
     self->buf = s;
     self->len = (size_t)len;
+    self->hash = 0;
     return self;
 }
 
@@ -221,6 +303,7 @@ void lcc_string_append_from_size(lcc_string_t *self, const char *other, size_t s
     /* allocate new string buffer */
     self->len += size;
     self->buf = realloc(self->buf, self->len + 1);
+    self->hash = 0;
 
     /* copy new string */
     self->buf[self->len] = 0;
@@ -8,7 +8,7 @@ static void _lcc_string_dtor(lcc_array_t *self, void *item, void *data)
     *ps = NULL;
 }
 
-lcc_string_array_t LCC_STRING_ARRAY_STATIC_INIT = {
+const lcc_string_array_t LCC_STRING_ARRAY_STATIC_INIT = {
     .array = LCC_ARRAY_STATIC_INIT(
          sizeof(lcc_string_t *),
          _lcc_string_dtor,
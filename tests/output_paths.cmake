@@ -0,0 +1,59 @@
+# checks where the driver writes its outputs, invoked as
+#   cmake -DLCC=<path to lcc> -DWORK=<scratch directory> -P output_paths.cmake
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK}/out)
+file(WRITE ${WORK}/a.i "int a;\n")
+file(WRITE ${WORK}/b.i "int b;\n")
+file(WRITE ${WORK}/c.c "int c;\n")
+
+# runs the driver in the scratch directory, and checks its exit status
+function(lcc_run expect)
+    execute_process(
+        COMMAND ${LCC} ${ARGN}
+        WORKING_DIRECTORY ${WORK}
+        RESULT_VARIABLE ret
+        OUTPUT_QUIET
+        ERROR_QUIET)
+
+    if (ret EQUAL 0)
+        set(ok 1)
+    else ()
+        set(ok 0)
+    endif ()
+
+    if (NOT ok EQUAL expect)
+        message(FATAL_ERROR "lcc ${ARGN}: exit status ${ret}")
+    endif ()
+endfunction()
+
+# checks that a file exists with the given content
+function(lcc_expect path content)
+    if (NOT EXISTS ${WORK}/${path})
+        message(FATAL_ERROR "${path}: missing")
+    endif ()
+
+    file(READ ${WORK}/${path} data)
+    string(STRIP "${data}" data)
+
+    if (NOT data STREQUAL content)
+        message(FATAL_ERROR "${path}: unexpected content '${data}'")
+    endif ()
+endfunction()
+
+# "a.i" and "b.i" would be written to themselves
+lcc_run(0 -j1 a.i b.i)
+lcc_expect(a.i "int a;")
+lcc_expect(b.i "int b;")
+
+# the same file through a different path
+lcc_run(0 -o ./c.c c.c)
+lcc_expect(c.c "int c;")
+
+# an existing directory is a directory for a single input as well
+lcc_run(1 -o out c.c)
+lcc_expect(out/c.i "int c ;")
+
+# and for multiple inputs
+lcc_run(1 -o out a.i c.c)
+lcc_expect(out/a.i "int a ;")